@@ -18,6 +18,7 @@
 #include "IXml.hpp"
 #include "BlockMapStream.hpp"
 #include "Enumerators.hpp"
+#include "PackageIndex.hpp"
 
 // internal interface
 // {67fed21a-70ef-4175-8f12-415b213ab6d2}
@@ -31,7 +32,8 @@ class IAppxBlockMapInternal : public IUnknown
 {
 public:
     virtual std::vector<std::string> GetFileNames() = 0;
-    virtual std::vector<MSIX::Block> GetBlocks(const std::string& fileName) = 0;
+    // The returned range doesn't own the blocks, they are valid while the blockmap is.
+    virtual MSIX::BlockRange GetBlocks(const std::string& fileName) = 0;
     virtual MSIX::ComPtr<IAppxBlockMapFile> GetFile(const std::string& fileName) = 0;
 };
 MSIX_INTERFACE(IAppxBlockMapInternal, 0x67fed21a,0x70ef,0x4175,0x8f,0x12,0x41,0x5b,0x21,0x3a,0xb6,0xd2);
@@ -41,28 +43,32 @@ namespace MSIX {
     class AppxBlockMapBlock final : public MSIX::ComClass<AppxBlockMapBlock, IAppxBlockMapBlock>
     {
     public:
-        AppxBlockMapBlock(IMsixFactory* factory, Block* block) :
+        AppxBlockMapBlock(IMsixFactory* factory, const BlockRange& blocks, std::size_t index) :
             m_factory(factory),
-            m_block(block)
+            m_blocks(blocks),
+            m_index(index)
         {}
 
         // IAppxBlockMapBlock
         HRESULT STDMETHODCALLTYPE GetHash(UINT32* bufferSize, BYTE** buffer) noexcept override try
         {
-            ThrowHrIfFailed(m_factory->MarshalOutBytes(m_block->hash, bufferSize, buffer));
+            const std::uint8_t* hash = m_blocks.GetHash(m_index);
+            std::vector<std::uint8_t> data(hash, hash + BLOCKMAP_HASH_SIZE);
+            ThrowHrIfFailed(m_factory->MarshalOutBytes(data, bufferSize, buffer));
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
         HRESULT STDMETHODCALLTYPE GetCompressedSize(UINT32* size) noexcept override try
         {
             ThrowErrorIf(Error::InvalidParameter, (size == nullptr), "bad pointer");
-            *size = static_cast<UINT32>(m_block->compressedSize);
+            *size = static_cast<UINT32>(m_blocks.GetCompressedSize(m_index));
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
     private:
         IMsixFactory* m_factory;
-        Block*        m_block;
+        BlockRange    m_blocks;
+        std::size_t   m_index;
     };
 
     class AppxBlockMapFile final : public MSIX::ComClass<AppxBlockMapFile, IAppxBlockMapFile, IAppxBlockMapFileUtf8 >
@@ -70,7 +76,7 @@ namespace MSIX {
     public:
         AppxBlockMapFile(
             IMsixFactory* factory,
-            std::vector<Block>* blocks,
+            const BlockRange& blocks,
             std::uint32_t localFileHeaderSize,
             const std::string& name,
             std::uint64_t uncompressedSize
@@ -88,15 +94,11 @@ namespace MSIX {
         {
             ThrowErrorIf(Error::InvalidParameter, (blocks == nullptr || *blocks != nullptr), "bad pointer.");
             if (m_blockMapBlocks.empty())
-            {   m_blockMapBlocks.reserve(m_blocks->size());
-                std::transform(
-                    m_blocks->begin(),
-                    m_blocks->end(),
-                    std::back_inserter(m_blockMapBlocks),
-                    [&](auto& item){
-                        return ComPtr<IAppxBlockMapBlock>::Make<AppxBlockMapBlock>(m_factory, &item);
-                    }
-                );
+            {   m_blockMapBlocks.reserve(m_blocks.GetCount());
+                for (std::size_t i = 0; i < m_blocks.GetCount(); i++)
+                {
+                    m_blockMapBlocks.push_back(ComPtr<IAppxBlockMapBlock>::Make<AppxBlockMapBlock>(m_factory, m_blocks, i));
+                }
             }
             *blocks = ComPtr<IAppxBlockMapBlocksEnumerator>::
                 Make<EnumeratorCom<IAppxBlockMapBlocksEnumerator, IAppxBlockMapBlock>>(m_blockMapBlocks).Detach();
@@ -137,7 +139,7 @@ namespace MSIX {
 
     private:
         std::vector<ComPtr<IAppxBlockMapBlock>> m_blockMapBlocks;
-        std::vector<Block>* m_blocks;
+        BlockRange          m_blocks;
         IMsixFactory*       m_factory;
         std::uint32_t       m_localFileHeaderSize;
         std::string         m_name;
@@ -149,6 +151,9 @@ namespace MSIX {
     {
     public:
         AppxBlockMapObject(IMsixFactory* factory, const ComPtr<IStream>& stream);
+        // Creates the blockmap from the files of a package index instead of parsing the stream. If the stream checks
+        // a digest (IValidationStream) it is validated whole before anything else, and throws if it doesn't match.
+        AppxBlockMapObject(IMsixFactory* factory, const ComPtr<IStream>& stream, const std::map<std::string, PackageIndex::BlockMapFile>& files);
 
         // IVerifierObject
         const std::string& GetPublisher() override { NOTSUPPORTED; }
@@ -164,14 +169,16 @@ namespace MSIX {
 
         // IAppxBlockMapInternal methods
         std::vector<std::string>        GetFileNames() override;
-        std::vector<Block>              GetBlocks(const std::string& fileName) override;
+        BlockRange                      GetBlocks(const std::string& fileName) override;
         MSIX::ComPtr<IAppxBlockMapFile> GetFile(const std::string& fileName) override;
 
         // IAppxBlockMapReaderUtf8
         HRESULT STDMETHODCALLTYPE GetFile(LPCSTR filename, IAppxBlockMapFile **file) noexcept override;
 
     protected:
-        std::map<std::string, std::vector<Block>>        m_blockMap;
+        // The blocks of all the files, each file's blocks are a range of it.
+        BlockTable                                       m_blocks;
+        std::map<std::string, BlockRange>                m_blockMap;
         std::map<std::string, ComPtr<IAppxBlockMapFile>> m_blockMapFiles;
         IMsixFactory*   m_factory;
         ComPtr<IStream> m_stream;
@@ -30,7 +30,7 @@ namespace MSIX {
         ~AppxFactory() {}
 
         // IAppxFactory
-        HRESULT STDMETHODCALLTYPE CreatePackageWriter(IStream* outputStream, APPX_PACKAGE_SETTINGS* , IAppxPackageWriter** packageWriter) noexcept override;
+        HRESULT STDMETHODCALLTYPE CreatePackageWriter(IStream* outputStream, APPX_PACKAGE_SETTINGS* settings, IAppxPackageWriter** packageWriter) noexcept override;
         HRESULT STDMETHODCALLTYPE CreatePackageReader (IStream* inputStream, IAppxPackageReader** packageReader) noexcept override;
         HRESULT STDMETHODCALLTYPE CreateManifestReader(IStream* inputStream, IAppxManifestReader** manifestReader) noexcept override;
         HRESULT STDMETHODCALLTYPE CreateBlockMapReader(IStream* inputStream, IAppxBlockMapReader** blockMapReader) noexcept override;
@@ -55,6 +55,11 @@ namespace MSIX {
             return m_xmlFactory->CreateDomFromStream(footPrintType, stream);
         }
 
+        bool ParseFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, XmlStreamVisitor& visitor) override
+        {
+            return m_xmlFactory->ParseFromStream(footPrintType, stream, visitor);
+        }
+
         // IMsixFactoryOverrides
         HRESULT STDMETHODCALLTYPE SpecifyExtension(MSIX_FACTORY_EXTENSION name, IUnknown* extension) noexcept override;
         HRESULT STDMETHODCALLTYPE GetCurrentSpecifiedExtension(MSIX_FACTORY_EXTENSION name, IUnknown** extension) noexcept override;
@@ -71,6 +76,9 @@ namespace MSIX {
         MSIX_APPLICABILITY_OPTIONS m_applicabilityFlags;
         ComPtr<IMsixStreamFactory> m_streamFactory;
         ComPtr<IMsixApplicabilityLanguagesEnumerator> m_applicabilityLanguagesEnumerator;
+        ComPtr<IMsixIndexCache> m_indexCache;
+        ComPtr<IMsixBlockCache> m_blockCache;
+        ComPtr<IMsixWorkCounter> m_workCounter;
 
     private:
         template<typename T>
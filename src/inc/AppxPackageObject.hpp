@@ -7,7 +7,9 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <memory>
+#include <functional>
 
 #include "AppxPackaging.hpp"
 #include "MSIXWindows.hpp"
@@ -15,6 +17,7 @@
 #include "ComHelper.hpp"
 #include "StreamBase.hpp"
 #include "StorageObject.hpp"
+#include "DirectoryObject.hpp"
 #include "ZipObject.hpp"
 #include "VerifierObject.hpp"
 #include "IXml.hpp"
@@ -37,6 +40,16 @@ class IPackage : public IUnknown
 public:
     virtual void Unpack(MSIX_PACKUNPACK_OPTION options, const MSIX::ComPtr<IStorageObject>& to) = 0;
     virtual std::vector<std::string>& GetFootprintFiles() = 0;
+    // Checks every block of the payload files against the blockmap without extracting them. Calls back for each
+    // file in order with S_OK, or with the error and index of its bad block and then throws that error. Files
+    // after the first bad block are not checked. If the signature is validated, the digests of the zip file records
+    // and central directory are checked first, and throw without calling back if they don't match.
+    virtual void Verify(const std::function<void(const std::string& fileName, HRESULT result, std::uint64_t failedBlock)>& callback) = 0;
+    // Unpacks over a previous version of the package unpacked in previous, with previousBlockMap the blockmap its files
+    // came from. Payload files with the same blocks in both blockmaps aren't extracted but kept if to is previous,
+    // or else hard linked from it, or copied when they can't be. Returns the size of the files that weren't extracted.
+    virtual std::uint64_t UnpackDifferential(MSIX_PACKUNPACK_OPTION options, const MSIX::ComPtr<IStream>& previousBlockMap,
+        const MSIX::ComPtr<MSIX::DirectoryObject>& previous, const MSIX::ComPtr<MSIX::DirectoryObject>& to) = 0;
 };
 MSIX_INTERFACE(IPackage, 0x51b2c456,0xaaa9,0x46d6,0x8e,0xc9,0x29,0x82,0x20,0x55,0x91,0x89);
 
@@ -107,6 +120,9 @@ namespace MSIX {
         // internal IPackage methods
         void Unpack(MSIX_PACKUNPACK_OPTION options, const ComPtr<IStorageObject>& to) override;
         std::vector<std::string>& GetFootprintFiles() override { return m_footprintFiles; }
+        void Verify(const std::function<void(const std::string& fileName, HRESULT result, std::uint64_t failedBlock)>& callback) override;
+        std::uint64_t UnpackDifferential(MSIX_PACKUNPACK_OPTION options, const ComPtr<IStream>& previousBlockMap,
+            const ComPtr<DirectoryObject>& previous, const ComPtr<DirectoryObject>& to) override;
 
         // IAppxPackageReader
         HRESULT STDMETHODCALLTYPE GetBlockMap(IAppxBlockMapReader** blockMapReader) noexcept override;
@@ -136,12 +152,16 @@ namespace MSIX {
         // IAppxBundleReaderUtf8
         HRESULT STDMETHODCALLTYPE GetPayloadPackage(LPCSTR fileName, IAppxFile **payloadPackage) noexcept override;
 
+        // Checks the sizes of a file in the zip against its blocks in the blockmap
+        static void VerifyFile(bool isCompressed, std::uint64_t sizeOnZip, const std::string& fileName, const ComPtr<IAppxBlockMapInternal>& blockMapInternal);
+
     protected:
         // Helper methods
         void VerifyFile(const ComPtr<IStream>& stream, const std::string& fileName, const ComPtr<IAppxBlockMapInternal>& blockMapInternal);
         ComPtr<IAppxFile> GetAppxFile(const std::string& fileName);
+        std::string GetUnpackTargetName(MSIX_PACKUNPACK_OPTION options, const std::string& fileName);
 
-        std::map<std::string, ComPtr<IAppxFile>> m_files;
+        std::unordered_map<std::string, ComPtr<IAppxFile>> m_files;
 
         MSIX_VALIDATION_OPTION      m_validation = MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL;
         ComPtr<IMsixFactory>        m_factory;
@@ -150,6 +170,9 @@ namespace MSIX {
         ComPtr<IVerifierObject>     m_appxManifest;
         ComPtr<IVerifierObject>     m_appxBundleManifest;
         ComPtr<IStorageObject>      m_container;
+        // Set when the signature's digests of the archive are checked, the central directory's is checked on open.
+        ComPtr<ISignedZipArchive>   m_signedArchive;
+        std::uint64_t               m_endOfFileRecords = 0;
         
         std::vector<std::string>    m_payloadFiles;
         std::vector<std::string>    m_footprintFiles;
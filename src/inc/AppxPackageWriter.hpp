@@ -0,0 +1,95 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "AppxFactory.hpp"
+#include "ZipObject.hpp"
+#include "BlockMapStream.hpp"
+#include "ICompressionObject.hpp"
+#include "ThreadPool.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+
+namespace MSIX {
+
+    // Writes a package to a stream as the files are added. Files are read in 64KB blocks, each one is hashed for
+    // the AppxBlockMap.xml and deflated independently of the others with a full flush, so blocks are processed in
+    // parallel and at most a couple of blocks per thread are in memory at any time.
+    class AppxPackageWriter final : public ComClass<AppxPackageWriter, IAppxPackageWriter>
+    {
+    public:
+        AppxPackageWriter(IMsixFactory* factory, const ComPtr<IStream>& outputStream, bool forceZip32);
+
+        // IAppxPackageWriter
+        HRESULT STDMETHODCALLTYPE AddPayloadFile(LPCWSTR fileName, LPCWSTR contentType,
+            APPX_COMPRESSION_OPTION compressionOption, IStream* inputStream) noexcept override;
+        HRESULT STDMETHODCALLTYPE Close(IStream* manifest) noexcept override;
+
+    protected:
+        enum class WriterState
+        {
+            Open,
+            Closed,
+            Failed
+        };
+
+        typedef struct BlockMapFile
+        {
+            std::string        name;
+            std::uint64_t      size;
+            std::uint32_t      localFileHeaderSize;
+            bool               isCompressed;
+            std::vector<Block> blocks;
+        } BlockMapFile;
+
+        // Deflate streams get cleaned up when they are destroyed
+        struct DeflaterCleanup
+        {
+            void operator()(ICompressionObject* deflater) { deflater->Cleanup(); delete deflater; }
+        };
+        typedef std::unique_ptr<ICompressionObject, DeflaterCleanup> Deflater;
+
+        // Result of processing one block on the thread pool
+        typedef struct ProcessedBlock
+        {
+            std::vector<std::uint8_t> data;
+            std::vector<std::uint8_t> compressedData;
+            std::vector<std::uint8_t> hash;
+        } ProcessedBlock;
+
+        // Writes a file to the zip and returns its blockmap entry. name uses '\' as separator, zipName is the
+        // percent encoded name of payload files and the name itself for footprint files.
+        BlockMapFile AddFile(const std::string& name, const std::string& zipName, bool isCompressed, const ComPtr<IStream>& stream);
+        ProcessedBlock ProcessBlock(std::vector<std::uint8_t>&& data, bool isCompressed);
+        Deflater GetDeflater();
+        void ReturnDeflater(Deflater&& deflater);
+        void AddContentType(const std::string& name, const std::string& contentType);
+        std::string GetBlockMapXml();
+        std::string GetContentTypesXml();
+
+        ComPtr<IMsixFactory>      m_factory;
+        WriterState               m_state = WriterState::Open;
+        std::unique_ptr<ZipObjectWriter> m_zip;
+        std::vector<BlockMapFile> m_blockMapFiles;
+        // lower case zip names of the files added so far
+        std::set<std::string>     m_fileNames;
+        // extension -> content type
+        std::map<std::string, std::string> m_defaultContentTypes;
+        // part name -> content type, for files whose content type isn't the default one of their extension
+        std::map<std::string, std::string> m_overrideContentTypes;
+        // Deflate streams can be reused after a full flush, so they are kept around for the next blocks.
+        std::vector<Deflater>     m_deflaters;
+        std::mutex                m_deflatersLock;
+        // Must stay the last member, so its threads are done before anything they use is destroyed.
+        ThreadPool                m_threadPool;
+    };
+}
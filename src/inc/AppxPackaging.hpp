@@ -1056,6 +1056,11 @@ interface IMsixElementEnumerator;
 interface IMsixFactoryOverrides;
 interface IMsixStreamFactory;
 interface IMsixApplicabilityLanguagesEnumerator;
+interface IMsixIndexCache;
+interface IMsixBlockCache;
+interface IMsixWorkCounter;
+interface IMsixRangeReader;
+interface IMsixRangeReaderFactory;
 
 #ifndef __IMsixDocumentElement_INTERFACE_DEFINED__
 #define __IMsixDocumentElement_INTERFACE_DEFINED__
@@ -1129,6 +1134,9 @@ interface IMsixApplicabilityLanguagesEnumerator;
     {
         MSIX_FACTORY_EXTENSION_STREAM_FACTORY = 0x1,
         MSIX_FACTORY_EXTENSION_APPLICABILITY_LANGUAGES = 0x2,
+        MSIX_FACTORY_EXTENSION_INDEX_CACHE = 0x3,
+        MSIX_FACTORY_EXTENSION_BLOCK_CACHE = 0x4,
+        MSIX_FACTORY_EXTENSION_WORK_COUNTER = 0x5,
     } 	MSIX_FACTORY_EXTENSION;
 
     // {0acedbdb-57cd-4aca-8cee-33fa52394316}
@@ -1182,6 +1190,116 @@ interface IMsixApplicabilityLanguagesEnumerator;
     };
 #endif  /* __IMsixApplicabilityLanguagesEnumerator_INTERFACE_DEFINED__ */
 
+#ifndef __IMsixIndexCache_INTERFACE_DEFINED__
+#define __IMsixIndexCache_INTERFACE_DEFINED__
+
+    // Storage for the binary indexes the package reader writes when a package is opened for the first time.
+    // Keys are hex strings that identify the central directory of a package. OpenIndex returns a failure or
+    // a null stream when there is no index for the key.
+    // {5d3c4a6e-2f1b-4c8e-9a7d-0b6e1f2c3d48}
+    MSIX_INTERFACE(IMsixIndexCache,0x5d3c4a6e,0x2f1b,0x4c8e,0x9a,0x7d,0x0b,0x6e,0x1f,0x2c,0x3d,0x48);
+    interface IMsixIndexCache : public IUnknown
+    {
+    public:
+        virtual HRESULT STDMETHODCALLTYPE OpenIndex(
+            /* [in] */ LPCSTR key,
+            /* [retval][out] */ IStream** index) noexcept = 0;
+
+        virtual HRESULT STDMETHODCALLTYPE CreateIndex(
+            /* [in] */ LPCSTR key,
+            /* [retval][out] */ IStream** index) noexcept = 0;
+    };
+#endif  /* __IMsixIndexCache_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixBlockCache_INTERFACE_DEFINED__
+#define __IMsixBlockCache_INTERFACE_DEFINED__
+
+    // Uncompressed payload blocks that were already checked against the blockmap, shared by the readers of a
+    // factory. Blocks are found by the SHA-256 hash the blockmap has for them, so what AddBlock is given always
+    // hashes to its key. FindBlock sets found to FALSE when there is no block of blockSize bytes for the hash.
+    // {2e7d5a90-6c3b-4f1e-b4a8-93d0c1e5f7a2}
+    MSIX_INTERFACE(IMsixBlockCache,0x2e7d5a90,0x6c3b,0x4f1e,0xb4,0xa8,0x93,0xd0,0xc1,0xe5,0xf7,0xa2);
+    interface IMsixBlockCache : public IUnknown
+    {
+    public:
+        virtual HRESULT STDMETHODCALLTYPE FindBlock(
+            /* [in] */ const BYTE* hash,
+            /* [in] */ UINT32 hashSize,
+            /* [in] */ UINT32 blockSize,
+            /* [out] */ BYTE* block,
+            /* [retval][out] */ BOOL* found) noexcept = 0;
+
+        virtual HRESULT STDMETHODCALLTYPE AddBlock(
+            /* [in] */ const BYTE* hash,
+            /* [in] */ UINT32 hashSize,
+            /* [in] */ UINT32 blockSize,
+            /* [in] */ const BYTE* block) noexcept = 0;
+    };
+#endif  /* __IMsixBlockCache_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixWorkCounter_INTERFACE_DEFINED__
+#define __IMsixWorkCounter_INTERFACE_DEFINED__
+
+    typedef
+        enum MSIX_WORK_COUNTER
+    {
+        MSIX_WORK_COUNTER_CENTRAL_DIRECTORY_ENTRIES = 0x1,
+        MSIX_WORK_COUNTER_PACKAGE_FILES = 0x2,
+        MSIX_WORK_COUNTER_PAYLOAD_BLOCKS = 0x3,
+    }   MSIX_WORK_COUNTER;
+
+    // Told how many items of work the readers of a factory did, so tests can check how that work grows with the
+    // size of a package without timing it. MSIX_WORK_COUNTER_CENTRAL_DIRECTORY_ENTRIES counts the central directory
+    // entries parsed when a package is opened, MSIX_WORK_COUNTER_PACKAGE_FILES the file names the package reader
+    // looks up and the files it adds while it sorts them into footprint and payload files, and
+    // MSIX_WORK_COUNTER_PAYLOAD_BLOCKS the blockmap blocks that reads of payload file streams go through.
+    // {ad1341d5-ef6b-4b82-bd0d-a50e0e8e03b9}
+    MSIX_INTERFACE(IMsixWorkCounter,0xad1341d5,0xef6b,0x4b82,0xbd,0x0d,0xa5,0x0e,0x0e,0x8e,0x03,0xb9);
+    interface IMsixWorkCounter : public IUnknown
+    {
+    public:
+        virtual HRESULT STDMETHODCALLTYPE AddWork(
+            /* [in] */ MSIX_WORK_COUNTER counter,
+            /* [in] */ UINT64 count) noexcept = 0;
+    };
+#endif  /* __IMsixWorkCounter_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixRangeReader_INTERFACE_DEFINED__
+#define __IMsixRangeReader_INTERFACE_DEFINED__
+
+    // Random access to the bytes of a package that isn't local, for example a blob read with HTTP range requests.
+    // ReadRange only returns less than size bytes at the end of the package.
+    // {8f3e6c1d-4b2a-4e7f-9c5d-1a2b3c4d5e6f}
+    MSIX_INTERFACE(IMsixRangeReader,0x8f3e6c1d,0x4b2a,0x4e7f,0x9c,0x5d,0x1a,0x2b,0x3c,0x4d,0x5e,0x6f);
+    interface IMsixRangeReader : public IUnknown
+    {
+    public:
+        virtual HRESULT STDMETHODCALLTYPE GetSize(
+            /* [retval][out] */ UINT64* size) noexcept = 0;
+
+        virtual HRESULT STDMETHODCALLTYPE ReadRange(
+            /* [in] */ UINT64 offset,
+            /* [in] */ UINT32 size,
+            /* [out] */ BYTE* buffer,
+            /* [retval][out] */ UINT32* bytesRead) noexcept = 0;
+    };
+#endif  /* __IMsixRangeReader_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixRangeReaderFactory_INTERFACE_DEFINED__
+#define __IMsixRangeReaderFactory_INTERFACE_DEFINED__
+
+    // Creates range readers for the packages of a flat bundle, relative to the location of the bundle.
+    // {2c7d9e4b-6a1f-4d3e-8b2c-5f6e7a8b9c0d}
+    MSIX_INTERFACE(IMsixRangeReaderFactory,0x2c7d9e4b,0x6a1f,0x4d3e,0x8b,0x2c,0x5f,0x6e,0x7a,0x8b,0x9c,0x0d);
+    interface IMsixRangeReaderFactory : public IUnknown
+    {
+    public:
+        virtual HRESULT STDMETHODCALLTYPE CreateRangeReaderOnRelativePathUtf8(
+            /* [in] */ LPCSTR relativePath,
+            /* [retval][out] */ IMsixRangeReader** reader) noexcept = 0;
+    };
+#endif  /* __IMsixRangeReaderFactory_INTERFACE_DEFINED__ */
+
 // Specific to MSIX SDK. UTF8 variant of AppxPackaging interfaces
 interface IAppxBlockMapFileUtf8;
 interface IAppxBlockMapReaderUtf8;
@@ -1466,6 +1584,8 @@ enum MSIX_APPLICABILITY_OPTIONS
                           MSIX_PLATFORM_LINUX          | \
                           MSIX_PLATFORM_WEB              \
 
+// Unless the signature is skipped, the archive is checked against the signature's digest of the zip file records from
+// the reads that unpack the files, so a mismatch is only reported once they are written.
 MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackage(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
@@ -1480,6 +1600,57 @@ MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStream(
     char* utf8Destination
 ) noexcept;
 
+// Unpacks a package from a stream that is only read sequentially and never seeked, like a pipe. Payload files are
+// written as they are read and removed again if the package turns out to be invalid. Files that are already in
+// utf8Destination are not written over, the unpack fails instead. Bundles and
+// MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER are not supported.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromForwardOnlyStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination
+) noexcept;
+
+// Unpacks a new version of a package that is unpacked in utf8PreviousDirectory, extracting only the files whose blocks
+// differ from the ones in the previous version's blockmap, utf8PreviousBlockMap or AppxBlockMap.xml in
+// utf8PreviousDirectory if null. The files that didn't change are hard linked from utf8PreviousDirectory, or copied
+// if they can't be. If utf8Destination is utf8PreviousDirectory, they are kept and the files that are not in the new
+// version are removed. Extracted files replace the ones in utf8Destination instead of being written over them, so
+// older versions that share them through hard links don't change. bytesSaved, if not null, gets the size of the
+// files that weren't extracted. Bundles are not supported.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageDifferential(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8PreviousDirectory,
+    char* utf8PreviousBlockMap,
+    char* utf8Destination,
+    UINT64* bytesSaved
+) noexcept;
+
+// Called by VerifyPackage for each payload file it checked, with S_OK or the error of the file's bad block and its
+// index in the blockmap.
+typedef void STDMETHODCALLTYPE MSIX_VERIFY_FILE_CALLBACK(void* context, LPCSTR utf8FileName, HRESULT result, UINT64 failedBlock);
+
+// Checks every block of every payload file against the blockmap without extracting anything, with the blocks hashed
+// on all the cores. callback, if not null, is called for each file in the order of the blockmap. Stops at the first
+// block that doesn't match and returns its error, the files after it are not checked. Unless the signature is
+// skipped, the central directory was checked against the signature when the package was opened and the whole archive
+// is first read once to check it against the signature's digest of the zip file records.
+MSIX_API HRESULT STDMETHODCALLTYPE VerifyPackage(
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    MSIX_VERIFY_FILE_CALLBACK* callback,
+    void* context
+) noexcept;
+
+MSIX_API HRESULT STDMETHODCALLTYPE VerifyPackageFromStream(
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    MSIX_VERIFY_FILE_CALLBACK* callback,
+    void* context
+) noexcept;
+
 MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundle(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
@@ -1527,6 +1698,8 @@ MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxBundleFactoryWithHeap(
     IAppxBundleFactory** appxBundleFactory) noexcept;
 
 // provided as a helper for platforms that do not have an implementation of SHCreateStreamOnFileEx
+// On non Windows platforms files opened for read are memory mapped when possible. Truncating such a file while the
+// stream is in use raises SIGBUS in the process reading it.
 MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFile(
     char* utf8File,
     bool forRead,
@@ -1537,6 +1710,35 @@ MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileUTF16(
     bool forRead,
     IStream** stream) noexcept;
 
+// Index cache that keeps one file per package in utf8Directory. Specify it on a factory with
+// MSIX_FACTORY_EXTENSION_INDEX_CACHE so packages opened again skip parsing their central directory and blockmap.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateIndexCacheOnDirectory(
+    char* utf8Directory,
+    IMsixIndexCache** indexCache) noexcept;
+
+// Block cache that keeps up to maxBytes of blocks in memory and drops the least recently used ones first. Specify
+// it on a factory with MSIX_FACTORY_EXTENSION_BLOCK_CACHE so payload blocks that are read again are neither inflated
+// nor hashed again. Pass 0 to use the default of 64MB.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateBlockCache(
+    UINT64 maxBytes,
+    IMsixBlockCache** blockCache) noexcept;
+
+// Stream over a range reader. Reads are done in blocks of blockSize bytes that are kept in a cache of up to
+// maxCachedBlocks blocks, least recently used first out. Contiguous missing blocks are fetched with a single
+// range request, the end of the package with the central directory is fetched when the stream is created,
+// and sequential reads fetch ahead. Pass 0 to use the defaults of 64KB blocks and 256 cached blocks.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnRangeReader(
+    IMsixRangeReader* reader,
+    UINT32 blockSize,
+    UINT32 maxCachedBlocks,
+    IStream** stream) noexcept;
+
+// Stream factory for MSIX_FACTORY_EXTENSION_STREAM_FACTORY that opens the packages of a flat bundle with
+// CreateStreamOnRangeReader and default settings over the readers created by rangeReaderFactory.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamFactoryOnRangeReaderFactory(
+    IMsixRangeReaderFactory* rangeReaderFactory,
+    IMsixStreamFactory** streamFactory) noexcept;
+
 } // extern "C++"
 
 #endif //__appxpackaging_hpp__
\ No newline at end of file
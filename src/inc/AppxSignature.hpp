@@ -9,6 +9,26 @@
 #include "StreamBase.hpp"
 #include "AppxFactory.hpp"
 
+// internal interface
+// {f6c59108-32c2-4298-9b13-7e4dfa95ffc4}
+#ifndef WIN32
+interface IArchiveVerifierObject : public IUnknown
+#else
+#include "Unknwn.h"
+#include "Objidl.h"
+class IArchiveVerifierObject : public IUnknown
+#endif
+// Checks the digests of a signature that cover the archive itself instead of one of its files.
+{
+public:
+    // False if there is nothing to check, the package isn't signed or its signature isn't validated.
+    virtual bool HasArchiveDigests() = 0;
+    // Throw if the digest of the central directory or of the zip file records doesn't match the signature.
+    virtual void ValidateCentralDirectoryDigest(const std::vector<std::uint8_t>& centralDirectory) = 0;
+    virtual void ValidateFileRecordsDigest(const std::vector<std::uint8_t>& fileRecords) = 0;
+};
+MSIX_INTERFACE(IArchiveVerifierObject, 0xf6c59108,0x32c2,0x4298,0x9b,0x13,0x7e,0x4d,0xfa,0x95,0xff,0xc4);
+
 namespace MSIX {
 
     enum class SignatureOrigin
@@ -57,7 +77,7 @@ namespace MSIX {
     };    
 
     // Object backed by AppxSignature.p7x
-    class AppxSignatureObject final : public ComClass<AppxSignatureObject, IVerifierObject>
+    class AppxSignatureObject final : public ComClass<AppxSignatureObject, IVerifierObject, IArchiveVerifierObject>
     {
     public:
 
@@ -69,6 +89,11 @@ namespace MSIX {
         ComPtr<IStream> GetStream() override        { return m_stream; }
         ComPtr<IStream> GetValidationStream(const std::string& part, const ComPtr<IStream>& stream) override;
 
+        // IArchiveVerifierObject
+        bool HasArchiveDigests() override           { return m_hasDigests; }
+        void ValidateCentralDirectoryDigest(const std::vector<std::uint8_t>& centralDirectory) override;
+        void ValidateFileRecordsDigest(const std::vector<std::uint8_t>& fileRecords) override;
+
         void ValidateDigestHeader(DigestHeader* header, std::size_t numberOfHashes, std::size_t modHashes);
 
         SignatureOrigin GetSignatureOrigin() { return m_signatureOrigin; }
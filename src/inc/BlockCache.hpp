@@ -0,0 +1,47 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "Exceptions.hpp"
+#include "ComHelper.hpp"
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MSIX {
+
+    // In memory IMsixBlockCache with a budget in bytes. Readers of the same factory can use it from different
+    // threads at the same time.
+    class BlockCache final : public ComClass<BlockCache, IMsixBlockCache>
+    {
+    public:
+        static const std::uint64_t DefaultMaxBytes = 64 * 1024 * 1024;
+
+        BlockCache(std::uint64_t maxBytes) : m_maxBytes(maxBytes) {}
+
+        // IMsixBlockCache
+        HRESULT STDMETHODCALLTYPE FindBlock(const BYTE* hash, UINT32 hashSize, UINT32 blockSize, BYTE* block, BOOL* found) noexcept override;
+        HRESULT STDMETHODCALLTYPE AddBlock(const BYTE* hash, UINT32 hashSize, UINT32 blockSize, const BYTE* block) noexcept override;
+
+    protected:
+        typedef struct CachedBlock
+        {
+            std::string               hash;
+            std::vector<std::uint8_t> data;
+        } CachedBlock;
+
+        std::uint64_t          m_maxBytes;
+        std::uint64_t          m_bytes = 0;
+        // most recently used first
+        std::list<CachedBlock> m_blocks;
+        std::unordered_map<std::string, std::list<CachedBlock>::iterator> m_blockIndex;
+        std::mutex             m_lock;
+    };
+}
@@ -9,19 +9,45 @@
 #include "StreamBase.hpp"
 #include "RangeStream.hpp"
 #include "HashStream.hpp"
+#include "InflateStream.hpp"
 #include "ComHelper.hpp"
 #include "SHA256.hpp"
 #include "AppxFactory.hpp"
+#include "WorkCounter.hpp"
 
 #include <string>
 #include <map>
 #include <functional>
 #include <algorithm>
 #include <vector>
+#include <limits>
+#include <cstring>
+
+// internal interface
+// {6f3a1c52-9d84-4b07-a2e5-c8b9d0f41e76}
+#ifndef WIN32
+interface IBlockMapStreamInternal : public IUnknown
+#else
+class IBlockMapStreamInternal : public IUnknown
+#endif
+{
+public:
+    virtual std::size_t GetBlockCount() = 0;
+    // Reads what checking the blocks from index on against the blockmap needs and returns a task that does the check,
+    // which can run on any thread while the stream is alive. count is how many blocks the task can take and is set to
+    // how many it took: stored blocks are hashed together, compressed ones one at a time. The task returns how many
+    // of them match, from the first one on, and throws if a compressed block doesn't match. The rest have to be
+    // checked in order with CheckBlock, which throws if they don't match. That includes the blocks of a compressed
+    // file that don't inflate on their own, for which the task is empty when that is already known.
+    virtual std::function<std::size_t()> GetBlockCheck(std::size_t index, std::size_t& count) = 0;
+    virtual void CheckBlock(std::size_t index) = 0;
+};
+MSIX_INTERFACE(IBlockMapStreamInternal, 0x6f3a1c52,0x9d84,0x4b07,0xa2,0xe5,0xc8,0xb9,0xd0,0xf4,0x1e,0x76);
 
 namespace MSIX {
   
     const std::uint64_t BLOCKMAP_BLOCK_SIZE = 65536; // 64KB
+    const std::size_t BLOCKMAP_HASH_SIZE = 32; // SHA-256
 
     typedef struct Block
     {
@@ -30,19 +56,65 @@ namespace MSIX {
         std::vector<std::uint8_t> hash;
     } Block;
 
-    typedef struct BlockPlusStream : Block
+    // The blocks of all the files of a blockmap in one place, instead of a Block with its own hash vector each: the
+    // hashes in fixed size slots of one array and the sizes in arrays next to it. The blocks of a file are a
+    // BlockRange of it.
+    class BlockTable
+    {
+    public:
+        void Add(std::uint64_t compressedSize, std::uint64_t blockSize, const std::vector<std::uint8_t>& hash)
+        {
+            ThrowErrorIf(Error::BlockMapSemanticError, (hash.size() != BLOCKMAP_HASH_SIZE), "Block hash is not a SHA-256 digest");
+            m_hashes.insert(m_hashes.end(), hash.begin(), hash.end());
+            m_compressedSizes.push_back(compressedSize);
+            m_blockSizes.push_back(blockSize);
+        }
+
+        void Add(const Block& block) { Add(block.compressedSize, block.blockSize, block.hash); }
+
+        std::size_t GetCount() const { return m_blockSizes.size(); }
+        const std::uint8_t* GetHash(std::size_t index) const { return m_hashes.data() + index * BLOCKMAP_HASH_SIZE; }
+        std::uint64_t GetCompressedSize(std::size_t index) const { return m_compressedSizes[index]; }
+        std::uint64_t GetBlockSize(std::size_t index) const { return m_blockSizes[index]; }
+
+    protected:
+        std::vector<std::uint8_t>  m_hashes;
+        std::vector<std::uint64_t> m_compressedSizes;
+        std::vector<std::uint64_t> m_blockSizes;
+    };
+
+    // The blocks of one file in a BlockTable, which has to outlive it.
+    class BlockRange
     {
-        std::uint64_t   size;
-        std::uint64_t   offset;         
-        ComPtr<IStream> stream;
-    } BlockPlusStream;
+    public:
+        BlockRange() {}
+        BlockRange(const BlockTable* table, std::size_t first, std::size_t count) : m_table(table), m_first(first), m_count(count) {}
+
+        std::size_t GetCount() const { return m_count; }
+        const std::uint8_t* GetHash(std::size_t index) const { return m_table->GetHash(m_first + index); }
+        std::uint64_t GetCompressedSize(std::size_t index) const { return m_table->GetCompressedSize(m_first + index); }
+        std::uint64_t GetBlockSize(std::size_t index) const { return m_table->GetBlockSize(m_first + index); }
+
+        // A copy of the block, for what still keeps blocks on their own.
+        Block GetBlock(std::size_t index) const
+        {
+            const std::uint8_t* hash = GetHash(index);
+            return Block{ GetCompressedSize(index), GetBlockSize(index), std::vector<std::uint8_t>(hash, hash + BLOCKMAP_HASH_SIZE) };
+        }
+
+    protected:
+        const BlockTable* m_table = nullptr;
+        std::size_t       m_first = 0;
+        std::size_t       m_count = 0;
+    };
 
     // This represents a subset of a Stream
-    class BlockMapStream final : public StreamBase
+    class BlockMapStream final : public StreamBase, public IBlockMapStreamInternal
     {
     public:
-        BlockMapStream(IMsixFactory* factory, std::string decodedName, const ComPtr<IStream>& stream, std::vector<Block>& blocks)
-            : m_factory(factory), m_decodedName(decodedName), m_stream(stream)
+        // blockMap owns the table of blocks and is kept alive with the stream.
+        BlockMapStream(IMsixFactory* factory, std::string decodedName, const ComPtr<IStream>& stream, const BlockRange& blocks, const ComPtr<IAppxBlockMapReader>& blockMap)
+            : m_factory(factory), m_workCounter(factory), m_decodedName(decodedName), m_stream(stream), m_blocks(blocks), m_blockMap(blockMap)
         {
             // Determine overall stream size
             ULARGE_INTEGER uli;
@@ -56,31 +128,37 @@ namespace MSIX {
             li.QuadPart = 0;
             ThrowHrIfFailed(stream->Seek(li, STREAM_SEEK_SET, nullptr));
 
-            // Build a vector of all HashStream->RangeStream's for the blocks in the blockmap
-            std::uint64_t offset = 0;
-            std::uint64_t sizeRemaining = m_streamSize;
-            for (auto block = blocks.begin(); ((sizeRemaining != 0) && (block != blocks.end())); block++)
+            // Only the blocks that cover the stream are used. Nothing is allocated per block until the stream is read,
+            // so opening a package costs memory in proportion to its files, not its size.
+            m_blockCount = static_cast<std::size_t>(std::min(static_cast<std::uint64_t>(blocks.GetCount()),
+                (m_streamSize + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE));
+
+            // Blocks read before by this or another reader of the factory can come from its block cache.
+            ComPtr<IMsixFactoryOverrides> factoryOverrides;
+            ComPtr<IUnknown> blockCache;
+            if (m_factory && SUCCEEDED(m_factory->QueryInterface(UuidOfImpl<IMsixFactoryOverrides>::iid, reinterpret_cast<void**>(&factoryOverrides))) &&
+                SUCCEEDED(factoryOverrides->GetCurrentSpecifiedExtension(MSIX_FACTORY_EXTENSION_BLOCK_CACHE, &blockCache)) && blockCache)
             {
-                auto rangeStream = ComPtr<IStream>::Make<RangeStream>(offset, std::min(sizeRemaining, BLOCKMAP_BLOCK_SIZE), stream);                
-                auto hashStream = ComPtr<IStream>::Make<HashStream>(rangeStream, block->hash);
-                std::uint64_t blockSize = std::min(sizeRemaining, BLOCKMAP_BLOCK_SIZE);
-
-                BlockPlusStream bs;
-                bs.offset = offset;
-                bs.size   = blockSize;
-                bs.stream = hashStream;
-                bs.hash   = block->hash;
-                m_blockStreams.emplace_back(std::move(bs));
-                
-                offset          += blockSize;
-                sizeRemaining   -= blockSize;
+                m_blockCache = blockCache.As<IMsixBlockCache>();
             }
 
-            // Reset seek position to beginning
-            ThrowHrIfFailed(stream->Seek(li, STREAM_SEEK_SET, nullptr));
             ThrowHrIfFailed(Seek(li, STREAM_SEEK_SET, nullptr));
         }
 
+        // IUnknown
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return StreamBase::AddRef(); }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return StreamBase::Release(); }
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (ppvObject != nullptr && *ppvObject == nullptr && riid == UuidOfImpl<IBlockMapStreamInternal>::iid)
+            {
+                *ppvObject = static_cast<void*>(static_cast<IBlockMapStreamInternal*>(this));
+                AddRef();
+                return S_OK;
+            }
+            return StreamBase::QueryInterface(riid, ppvObject);
+        }
+
         // IStream
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) noexcept override try
         {
@@ -99,8 +177,6 @@ namespace MSIX {
             }
             m_relativePosition = std::max((std::uint64_t)0, std::min(m_relativePosition, m_streamSize));
             if (newPosition) { newPosition->QuadPart = m_relativePosition; }
-
-            m_currentBlock = m_blockStreams.begin();
             return S_OK;
         } CATCH_RETURN();
 
@@ -109,39 +185,49 @@ namespace MSIX {
             std::uint32_t bytesRead = 0;
             if (m_relativePosition < m_streamSize)
             {
-                std::uint32_t bytesToRead = std::min(static_cast<std::uint32_t>(countBytes), static_cast<std::uint32_t>(m_streamSize - m_relativePosition));
-                while (m_currentBlock != m_blockStreams.end() && bytesToRead > 0)
+                std::uint32_t bytesToRead = static_cast<std::uint32_t>(std::min(static_cast<std::uint64_t>(countBytes), m_streamSize - m_relativePosition));
+                // Every block but the last one is BLOCKMAP_BLOCK_SIZE, so the position says which block to read.
+                std::size_t index = static_cast<std::size_t>(m_relativePosition / BLOCKMAP_BLOCK_SIZE);
+                std::size_t blocksVisited = 0;
+                while (index < m_blockCount && bytesToRead > 0)
                 {
-                    if ((m_currentBlock->offset + m_currentBlock->size) <= m_relativePosition)
+                    blocksVisited++;
+                    std::uint64_t positionInBlock = m_relativePosition - GetBlockOffset(index);
+                    std::uint32_t count = std::min(bytesToRead, static_cast<std::uint32_t>(GetBlockSize(index) - positionInBlock));
+                    ULONG actual = 0;
+                    if (LoadBlock(index))
                     {
-                        m_currentBlock++;
+                        memcpy(buffer, m_blockBuffer.data() + positionInBlock, count);
+                        actual = count;
                     }
-                    else if (m_currentBlock->offset <= m_relativePosition)
+                    else
                     {
-                        std::uint64_t positionInBlock = m_relativePosition - m_currentBlock->offset;
+                        auto blockStream = GetBlockStream(index);
                         LARGE_INTEGER li{0};
                         li.QuadPart = positionInBlock;
-                        ThrowHrIfFailed(m_currentBlock->stream->Seek(li, STREAM_SEEK_SET, nullptr));
-
-                        std::uint32_t count = std::min(bytesToRead, static_cast<std::uint32_t>(m_currentBlock->size - positionInBlock));
-                        ULONG actual = 0;
-                        ThrowHrIfFailed(m_currentBlock->stream->Read(buffer, count, &actual));
-
-                        buffer = static_cast<std::uint8_t*>(buffer) + actual;
-                        m_relativePosition += actual;
-                        bytesToRead -= actual;
-                        bytesRead += actual;
-                    }
-                    else
-                    {
-                        m_currentBlock = m_blockStreams.begin();
+                        ThrowHrIfFailed(blockStream->Seek(li, STREAM_SEEK_SET, nullptr));
+                        ThrowHrIfFailed(blockStream->Read(buffer, count, &actual));
+                        if (actual == 0) { break; }
                     }
+
+                    buffer = static_cast<std::uint8_t*>(buffer) + actual;
+                    m_relativePosition += actual;
+                    bytesToRead -= actual;
+                    bytesRead += actual;
+                    index = static_cast<std::size_t>(m_relativePosition / BLOCKMAP_BLOCK_SIZE);
                 }
+                m_workCounter.Add(MSIX_WORK_COUNTER_PAYLOAD_BLOCKS, blocksVisited);
             }
             if (actualRead) { *actualRead = bytesRead; }
             return (countBytes == bytesRead) ? S_OK : S_FALSE;
         } CATCH_RETURN();
 
+        // Copying the rest of a compressed file inflates and hashes its blocks straight into the target, on a thread
+        // pool for large files. Every block is deflated with a full flush, so it can be inflated without the blocks
+        // before it. Copying the rest of a stored file from a mapped package into a file is left to the kernel once
+        // its blocks are hashed in place.
+        HRESULT STDMETHODCALLTYPE CopyTo(IStream* stream, ULARGE_INTEGER bytesCount, ULARGE_INTEGER* bytesRead, ULARGE_INTEGER* bytesWritten) noexcept override;
+
         // IStreamInternal
         std::uint64_t GetSizeOnZip() override
         {   // The underlying ZipFileStream/InflateStream object knows, so go ask it.
@@ -157,14 +243,67 @@ namespace MSIX {
         {   // The underlying ZipFileStream/InflateStream object knows, so go ask it.
             return m_stream.As<IStreamInternal>()->GetName();
         }
+
+        // IBlockMapStreamInternal
+        std::size_t GetBlockCount() override { return m_blockCount; }
+        std::function<std::size_t()> GetBlockCheck(std::size_t index, std::size_t& count) override;
+        void CheckBlock(std::size_t index) override;
       
     protected:
-        std::vector<BlockPlusStream>::iterator m_currentBlock;
-        std::vector<BlockPlusStream> m_blockStreams;
+        // Every block but the last one is BLOCKMAP_BLOCK_SIZE.
+        std::uint64_t GetBlockOffset(std::size_t index) { return index * BLOCKMAP_BLOCK_SIZE; }
+        std::uint64_t GetBlockSize(std::size_t index) { return std::min(BLOCKMAP_BLOCK_SIZE, m_streamSize - GetBlockOffset(index)); }
+
+        // Returns the HashStream that checks a block as it is read, created on first use. Only the last one is kept,
+        // reads go through it block after block.
+        ComPtr<IStream> GetBlockStream(std::size_t index);
+
+        // If the stream inflates a compressed file and the blockmap's compressed sizes add up to it, remembers
+        // where each block's compressed data starts and lets the inflate stream seek by block. Done on first use.
+        void FindCompressedBlocks();
+        // Once a block turns out not to stand on its own, neither the blocks nor the inflate stream's seek points
+        // are used again.
+        void ForgetCompressedBlocks();
+
+        // Puts a block checked against its hash in m_blockBuffer, from the block cache or by inflating it and checking
+        // its hash while it is still in the CPU cache, instead of hashing it again on its way out of the inflate
+        // stream. Without a block cache, returns false if the blocks can't be inflated on their own; reads then go
+        // through the block's HashStream.
+        bool LoadBlock(std::size_t index);
+        bool InflateCompressedBlock(std::size_t index);
+
+        // Writes the blocks from the current position to the end of the stream, inflating them in parallel if there
+        // are enough of them. Returns the number of bytes written, which is less than what is left when a block
+        // doesn't end where the blockmap says it does. The rest is then copied through the block's HashStream.
+        std::uint64_t CopyCompressedBlocksTo(IStream* stream);
+        std::uint64_t ParallelCopyTo(IStream* stream, std::size_t first);
+
+        // Has the kernel copy the blocks from the current position to the end of a stored file when both the package
+        // and the target are files, then checks them against the blockmap as they were written. Returns the number of
+        // bytes copied and checked, 0 if that isn't possible; what is left is then copied through the blocks'
+        // HashStreams. Throws, after removing what was copied, if a block doesn't match.
+        std::uint64_t CopyStoredBlocksTo(IStream* stream);
+
+        // Set by FindCompressedBlocks, empty when the blocks can't be inflated on their own.
+        bool m_compressedBlocksFound = false;
+        ComPtr<IInflateStreamInternal> m_inflateStream;
+        std::vector<std::uint64_t> m_compressedOffsets;
+        // The last block LoadBlock inflated. The buffers are reused from block to block.
+        std::vector<std::uint8_t> m_compressedBuffer;
+        std::vector<std::uint8_t> m_blockBuffer;
+        std::size_t m_loadedBlock = std::numeric_limits<std::size_t>::max();
+        ComPtr<IMsixBlockCache> m_blockCache;
+
+        BlockRange m_blocks;
+        ComPtr<IAppxBlockMapReader> m_blockMap;
+        std::size_t m_blockCount;
+        ComPtr<IStream> m_blockStream;
+        std::size_t m_blockStreamIndex = std::numeric_limits<std::size_t>::max();
         std::uint64_t m_relativePosition;
         std::uint64_t m_streamSize;
         std::string m_decodedName;
         ComPtr<IStream> m_stream;
         IMsixFactory* m_factory;
+        WorkCounter m_workCounter;
     };
 }
\ No newline at end of file
@@ -28,6 +28,16 @@ namespace MSIX {
         ComPtr<IStream> OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode) override;
         std::string GetFileName() override { NOTIMPLEMENTED; }
 
+        // Removes a file created with OpenFile, returns false if it couldn't. Directories created for it are left behind.
+        bool RemoveFile(const std::string& fileName);
+
+        // Gets the size of a file, returns false if there's no such file.
+        bool GetFileSize(const std::string& fileName, std::uint64_t& size);
+
+        // Makes fileName a hard link to sourceName in source, replacing the file that was there. Returns false if it
+        // couldn't, like when the directories are on different volumes. If they are already the same file it's left as is.
+        bool LinkFile(const std::string& fileName, const DirectoryObject& source, const std::string& sourceName);
+
     protected:
         std::string m_root;
 
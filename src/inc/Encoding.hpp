@@ -13,5 +13,6 @@ namespace MSIX { namespace Encoding {
 
     std::string Base32Encoding(const std::vector<uint8_t>& bytes);
     std::vector<std::uint8_t> GetBase64DecodedValue(const std::string& value);
+    std::string Base64Encoding(const std::vector<std::uint8_t>& bytes);
 
 } /*Encoding */ } /* MSIX */
@@ -12,15 +12,21 @@
 #include "StreamBase.hpp"
 #include "UnicodeConversion.hpp"
 
+#ifndef WIN32
+#include <unistd.h>
+#include <cerrno>
+#endif
+
 namespace MSIX {
-    class FileStream final : public StreamBase
+    class FileStream final : public StreamBase, public IFileBackedStream
     {
     public:
-        enum Mode { READ = 0, WRITE, APPEND, READ_UPDATE, WRITE_UPDATE, APPEND_UPDATE };
+        // CREATE_UPDATE is WRITE_UPDATE for a file that doesn't exist yet, opening a file that exists fails.
+        enum Mode { READ = 0, WRITE, APPEND, READ_UPDATE, WRITE_UPDATE, APPEND_UPDATE, CREATE_UPDATE };
 
-        FileStream(const std::string& name, Mode mode) : m_name(name)
+        FileStream(const std::string& name, Mode mode) : m_name(name), m_mode(mode)
         {
-            static const char* modes[] = { "rb", "wb", "ab", "r+b", "w+b", "a+b" };
+            static const char* modes[] = { "rb", "wb", "ab", "r+b", "w+b", "a+b", "w+bx" };
             #ifdef WIN32
             errno_t err = fopen_s(&m_file, name.c_str(), modes[mode]);
             std::ostringstream builder;
@@ -39,17 +45,17 @@ namespace MSIX {
             m_size = end.u.LowPart;
         }
 
-        FileStream(const std::wstring& name, Mode mode)
+        FileStream(const std::wstring& name, Mode mode) : m_mode(mode)
         {
             m_name = wstring_to_utf8(name);
             #ifdef WIN32
-            static const wchar_t* modes[] = { L"rb", L"wb", L"ab", L"r+b", L"w+b", L"a+b" };
+            static const wchar_t* modes[] = { L"rb", L"wb", L"ab", L"r+b", L"w+b", L"a+b", L"w+bx" };
             errno_t err = _wfopen_s(&m_file, name.c_str(), modes[mode]);
             std::wostringstream builder;
             builder << L"file: '" << name << L"' does not exist.";
             ThrowErrorIfNot(Error::FileOpen, (err==0), "change this");
             #else
-            static const char* modes[] = { "rb", "wb", "ab", "r+b", "w+b", "a+b" };
+            static const char* modes[] = { "rb", "wb", "ab", "r+b", "w+b", "a+b", "w+bx" };
             m_file = std::fopen(m_name.c_str(), modes[mode]);
             ThrowErrorIfNot(Error::FileOpen, (m_file), m_name.c_str());
             #endif
@@ -75,6 +81,20 @@ namespace MSIX {
             }
         }
 
+        // IUnknown. IFileBackedStream isn't part of StreamBase's interface list, so answer for it here.
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return StreamBase::AddRef(); }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return StreamBase::Release(); }
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (ppvObject != nullptr && *ppvObject == nullptr && riid == UuidOfImpl<IFileBackedStream>::iid)
+            {
+                *ppvObject = static_cast<void*>(static_cast<IFileBackedStream*>(this));
+                AddRef();
+                return S_OK;
+            }
+            return StreamBase::QueryInterface(riid, ppvObject);
+        }
+
         // IStream
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
         {
@@ -108,6 +128,41 @@ namespace MSIX {
         // IStreamInternal
         std::string GetName() override { return m_name; }
 
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            #ifndef WIN32
+            // pread doesn't touch the FILE's position, so any number of readers can share this stream. Only used for
+            // read only streams, otherwise there might be pending writes in the stdio buffer.
+            if (m_mode == Mode::READ)
+            {
+                int fd = fileno(m_file);
+                ULONG result = 0;
+                while (result < countBytes)
+                {
+                    auto bytes = pread(fd, reinterpret_cast<std::uint8_t*>(buffer) + result, countBytes - result, static_cast<off_t>(offset + result));
+                    if (bytes == -1 && errno == EINTR) { continue; }
+                    ThrowErrorIf(Error::FileRead, (bytes == -1), "read failed");
+                    if (bytes == 0) { break; }
+                    result += static_cast<ULONG>(bytes);
+                }
+                return result;
+            }
+            #endif
+            return StreamBase::ReadAt(offset, buffer, countBytes);
+        }
+
+        // IFileBackedStream
+        int GetFileDescriptor() override
+        {
+            #ifndef WIN32
+            Flush();
+            return fileno(m_file);
+            #else
+            return -1;
+            #endif
+        }
+        std::uint64_t GetFileOffset() override { return 0; }
+
     protected:
         inline int Ferror() { return std::ferror(m_file); }
         inline bool Feof()  { return 0 != std::feof(m_file); }
@@ -122,6 +177,7 @@ namespace MSIX {
         std::uint64_t m_offset = 0;
         std::uint64_t m_size = 0;
         std::string m_name;
+        Mode m_mode;
         FILE* m_file;
     };
 }
@@ -0,0 +1,65 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "AppxFactory.hpp"
+#include "DirectoryObject.hpp"
+#include "ZipObject.hpp"
+#include "AppxBlockMapObject.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+namespace MSIX {
+
+    // Unpacks a package from a stream that is only read front to back, like a pipe or a socket. Payload files are
+    // extracted as they arrive and the hashes of their blocks are kept. The blockmap and signature usually come
+    // after the payload, so they are validated at the end and the payload hashes are checked against the blockmap.
+    // Files are only ever created, a name that goes outside of the destination or a file that is already there fails
+    // the unpack. If the package isn't valid, the files this unpacker created are removed again.
+    class ForwardOnlyUnpacker final
+    {
+    public:
+        ForwardOnlyUnpacker(IMsixFactory* factory, MSIX_VALIDATION_OPTION validation, const ComPtr<IStream>& stream,
+            const ComPtr<DirectoryObject>& to);
+        ~ForwardOnlyUnpacker();
+
+        void Unpack();
+
+    protected:
+        typedef struct ZipFile
+        {
+            bool                                   isCompressed;
+            std::uint64_t                          size;
+            std::uint64_t                          sizeOnZip;
+            // hashes of the 64KB blocks of the uncompressed data
+            std::vector<std::vector<std::uint8_t>> hashes;
+        } ZipFile;
+
+        // Reads the current file of the zip, passing its uncompressed data to write as it arrives.
+        ZipFile ReadFile(ZipObjectForwardOnlyReader& zip, bool isCompressed,
+            const std::function<void(const std::uint8_t*, std::size_t)>& write);
+        void VerifyFiles(const ComPtr<IAppxBlockMapInternal>& blockMapInternal);
+        // Creates a file in the destination and remembers it, so it can be removed if unpacking doesn't complete.
+        ComPtr<IStream> CreateTargetFile(const std::string& name);
+        void ExtractFootprintFile(const std::string& name, const ComPtr<IStream>& stream);
+
+        ComPtr<IMsixFactory>                             m_factory;
+        MSIX_VALIDATION_OPTION                           m_validation;
+        ComPtr<IStream>                                  m_stream;
+        ComPtr<DirectoryObject>                          m_to;
+        // zip name -> contents, footprint files are small and needed for validation
+        std::map<std::string, std::vector<std::uint8_t>> m_footprintFiles;
+        // zip name -> file, for the payload and footprint files
+        std::map<std::string, ZipFile>                   m_files;
+        // Names in the destination of the files created so far, removed if unpacking doesn't complete.
+        std::vector<std::string>                         m_createdFiles;
+        bool                                             m_isComplete = false;
+    };
+}
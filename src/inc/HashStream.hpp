@@ -15,24 +15,67 @@
 #include <functional>
 #include <algorithm>
 
+// internal interface
+// Implemented by streams that check their content against a digest, so the check can be made without reading them.
+// {2c8e5f61-7a0d-4b93-b1e4-93f5d6a2c7b8}
+#ifndef WIN32
+interface IValidationStream : public IUnknown
+#else
+#include "Unknwn.h"
+#include "Objidl.h"
+class IValidationStream : public IUnknown
+#endif
+{
+public:
+    // Checks the whole stream against the digest now, if it wasn't already, and throws if it doesn't match.
+    virtual void Validate() = 0;
+};
+MSIX_INTERFACE(IValidationStream, 0x2c8e5f61,0x7a0d,0x4b93,0xb1,0xe4,0x93,0xf5,0xd6,0xa2,0xc7,0xb8);
+
 namespace MSIX {
+
+    // Checks a stream that has a digest now, other streams are left alone. Done before a file is written from the
+    // stream, so a file that doesn't match isn't left behind half written.
+    inline void ValidateStream(const ComPtr<IStream>& stream)
+    {
+        ComPtr<IValidationStream> validationStream;
+        if (SUCCEEDED(stream->QueryInterface(UuidOfImpl<IValidationStream>::iid, reinterpret_cast<void**>(&validationStream))) && validationStream)
+        {
+            validationStream->Validate();
+        }
+    }
   
-    // This represents a subset of a Stream
-    class HashStream final : public StreamBase
+    // Checks the stream against a digest. Streams that fit in a blockmap block are read and checked as a whole
+    // before the first read returns anything. Bigger ones are hashed as they are read from start to end and
+    // the read that reaches the end fails if the digest doesn't match, any other read hashes the rest of the stream
+    // first. Either way the memory used doesn't depend on the size of the stream.
+    class HashStream final : public StreamBase, public IValidationStream
     {
     protected:
+        static const std::size_t BufferSize = 65536;
+
         bool m_validated;
         ComPtr<IStream> m_stream;
-        std::vector<std::uint8_t>& m_expectedHash;
+        const std::uint8_t* m_expectedHash;
+        std::size_t m_expectedHashSize;
         std::unique_ptr<std::vector<std::uint8_t>> m_cacheBuffer;
         std::uint64_t m_relativePosition;
-        size_t m_streamSize;
+        std::uint64_t m_streamSize;
+        // How much of the stream went into m_hash so far.
+        std::uint64_t m_hashedSize = 0;
+        std::unique_ptr<MSIX::SHA256> m_hash;
 
     public:
-        HashStream(const ComPtr<IStream>& stream, std::vector<std::uint8_t>& expectedHash) :
+        HashStream(const ComPtr<IStream>& stream, const std::vector<std::uint8_t>& expectedHash) :
+            HashStream(stream, expectedHash.data(), expectedHash.size())
+        {}
+
+        // The expected hash isn't copied, it has to outlive the stream.
+        HashStream(const ComPtr<IStream>& stream, const std::uint8_t* expectedHash, std::size_t expectedHashSize) :
             m_validated(false),
             m_stream(stream),
             m_expectedHash(expectedHash),
+            m_expectedHashSize(expectedHashSize),
             m_relativePosition(0),
             m_streamSize(0)
         {
@@ -42,28 +85,88 @@ namespace MSIX {
             
             ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::END, &uli));
             ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::START, nullptr));
-            m_streamSize = static_cast<size_t>(uli.u.LowPart);
+            m_streamSize = uli.QuadPart;
         }
 
-        void Validate()
+        // IUnknown
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return StreamBase::AddRef(); }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return StreamBase::Release(); }
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
         {
-            if (m_validated) { return; }
+            if (ppvObject != nullptr && *ppvObject == nullptr && riid == UuidOfImpl<IValidationStream>::iid)
+            {
+                *ppvObject = static_cast<void*>(static_cast<IValidationStream*>(this));
+                AddRef();
+                return S_OK;
+            }
+            return StreamBase::QueryInterface(riid, ppvObject);
+        }
 
-            // read stream into cache buffer
-            m_cacheBuffer = std::make_unique<std::vector<std::uint8_t>>(m_streamSize);
-            ULONG bytesRead = 0;
-            ThrowHrIfFailed(m_stream->Read(m_cacheBuffer->data(), static_cast<ULONG>(m_cacheBuffer->size()), &bytesRead));
-            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, bytesRead == m_streamSize, "read failed");
+        // IValidationStream
+        void Validate() override
+        {
+            if (m_validated) { return; }
 
-            // compute digest and compare against expected digest
             std::vector<std::uint8_t> hash;
-            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, 
-                MSIX::SHA256::ComputeHash(m_cacheBuffer->data(), static_cast<uint32_t>(m_cacheBuffer->size()), hash), 
-                "Invalid signature");
-            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, m_expectedHash.size() == hash.size(), "Signature is corrupt");
+            ComPtr<IMappedStream> mapped;
+            if (SUCCEEDED(m_stream->QueryInterface(UuidOfImpl<IMappedStream>::iid, reinterpret_cast<void**>(&mapped))) && mapped)
+            {   // The bytes are already in memory, hash them in place and let reads go to the underlying stream.
+                ThrowErrorIfNot(MSIX::Error::SignatureInvalid, mapped->GetMappedSize() == m_streamSize, "read failed");
+                MSIX::SHA256 sha256;
+                sha256.Update(mapped->GetMappedBuffer(), static_cast<std::size_t>(m_streamSize));
+                sha256.Final(hash);
+                ValidateHash(hash);
+                return;
+            }
+
+            if (m_streamSize <= BufferSize)
+            {   // read stream into cache buffer
+                m_cacheBuffer = std::make_unique<std::vector<std::uint8_t>>(static_cast<std::size_t>(m_streamSize));
+                ULONG bytesRead = StreamBase::ReadAt(m_stream, 0, m_cacheBuffer->data(), static_cast<ULONG>(m_cacheBuffer->size()));
+                ThrowErrorIfNot(MSIX::Error::SignatureInvalid, bytesRead == m_streamSize, "read failed");
+
+                // compute digest and compare against expected digest
+                ThrowErrorIfNot(MSIX::Error::SignatureInvalid, 
+                    MSIX::SHA256::ComputeHash(m_cacheBuffer->data(), static_cast<uint32_t>(m_cacheBuffer->size()), hash), 
+                    "Invalid signature");
+                ValidateHash(hash);
+                return;
+            }
+
+            // hash whatever sequential reads haven't yet
+            std::vector<std::uint8_t> buffer(BufferSize);
+            while (m_hashedSize < m_streamSize)
+            {
+                ULONG bytesToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(BufferSize), m_streamSize - m_hashedSize));
+                ULONG bytesRead = StreamBase::ReadAt(m_stream, m_hashedSize, buffer.data(), bytesToRead);
+                ThrowErrorIfNot(MSIX::Error::SignatureInvalid, bytesRead == bytesToRead, "read failed");
+                Hash(buffer.data(), bytesRead);
+            }
+            // All of it was hashed already and didn't match.
+            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, m_validated, "Signature hash doesn't match digest hash");
+        }
+
+        // Adds the next bytes of the stream to the hash and checks it once the whole stream is in.
+        void Hash(const std::uint8_t* buffer, ULONG countBytes)
+        {
+            if (!m_hash) { m_hash = std::make_unique<MSIX::SHA256>(); }
+            m_hash->Update(buffer, countBytes);
+            m_hashedSize += countBytes;
+            if (m_hashedSize == m_streamSize)
+            {
+                std::vector<std::uint8_t> hash;
+                m_hash->Final(hash);
+                m_hash.reset();
+                ValidateHash(hash);
+            }
+        }
+
+        void ValidateHash(const std::vector<std::uint8_t>& hash)
+        {
+            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, m_expectedHashSize == hash.size(), "Signature is corrupt");
             ThrowErrorIfNot(
                 MSIX::Error::SignatureInvalid,
-                memcmp(m_expectedHash.data(), hash.data(), hash.size()) == 0,
+                memcmp(m_expectedHash, hash.data(), hash.size()) == 0,
                 "Signature hash doesn't match digest hash"); //TODO: better exception
 
             m_validated = true;
@@ -75,53 +178,58 @@ namespace MSIX {
             switch (origin)
             {
                 case Reference::CURRENT:
-                    m_relativePosition += move.u.LowPart;
+                    m_relativePosition += move.QuadPart;
                     break;
                 case Reference::START:
-                    m_relativePosition = move.u.LowPart;
+                    m_relativePosition = move.QuadPart;
                     break;
                 case Reference::END:
                     m_relativePosition = m_streamSize;
                     break;
             }
-            m_relativePosition = std::max((std::uint64_t)0, std::min(m_relativePosition, static_cast<std::uint64_t>(m_streamSize)));
+            m_relativePosition = std::max((std::uint64_t)0, std::min(m_relativePosition, m_streamSize));
             if (newPosition) { newPosition->QuadPart = (std::uint64_t)m_relativePosition; }
         }        
 
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) noexcept override try
         {
-            if (m_cacheBuffer.get() == nullptr)
-            {   ThrowHrIfFailed(m_stream->Seek(move, origin, newPosition));
-            }
-            // always call into cache seek to keep cache state aligned with the underlying stream state.
+            // Reads are positional on the underlying stream, so only our own position needs to move.
             CacheSeek(move, origin, newPosition);
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
-        void CacheRead(void* buffer, ULONG countBytes, ULONG* actualRead)
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* actualRead) noexcept override try
         {
             ThrowErrorIf(Error::Stg_E_Invalidpointer, (buffer == nullptr), "bad input");
-            ULONG bytesToRead = std::min((std::uint32_t)countBytes, static_cast<std::uint32_t>((std::uint64_t)m_cacheBuffer->size() - m_relativePosition));
-            if (bytesToRead)
-            {
-                memcpy(buffer, reinterpret_cast<BYTE*>(m_cacheBuffer->data()) + m_relativePosition, bytesToRead);
-            }
-
-            m_relativePosition += bytesToRead;
+            ULONG bytesRead = ReadAt(m_relativePosition, buffer, countBytes);
+            m_relativePosition += bytesRead;
             if (m_streamSize == m_relativePosition) { m_cacheBuffer = nullptr; }
-            if (actualRead) { *actualRead = bytesToRead; }
-        }
+            if (actualRead) { *actualRead = bytesRead; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
 
-        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* actualRead) noexcept override try
+        // IStreamInternal
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
         {
+            if (!m_validated && (m_streamSize > BufferSize) && (offset == m_hashedSize))
+            {   // Reading on from where the hash is, hash what is read on the way out.
+                ULONG bytesRead = StreamBase::ReadAt(m_stream, offset, buffer, countBytes);
+                ThrowErrorIf(MSIX::Error::SignatureInvalid, ((bytesRead < countBytes) && (offset + bytesRead < m_streamSize)), "read failed");
+                Hash(static_cast<std::uint8_t*>(buffer), bytesRead);
+                return bytesRead;
+            }
             Validate();
             if (m_cacheBuffer.get() == nullptr)
-            {   ThrowHrIfFailed(m_stream->Read(buffer, countBytes, actualRead));
+            {
+                return StreamBase::ReadAt(m_stream, offset, buffer, countBytes);
             }
-            else
-            {   CacheRead(buffer, countBytes, actualRead);
+            ULONG bytesToRead = (offset < m_cacheBuffer->size()) ?
+                static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), static_cast<std::uint64_t>(m_cacheBuffer->size()) - offset)) : 0;
+            if (bytesToRead)
+            {
+                memcpy(buffer, m_cacheBuffer->data() + offset, bytesToRead);
             }
-            return static_cast<HRESULT>(Error::OK);
-        } CATCH_RETURN();
+            return bytesToRead;
+        }
     };
 }
@@ -28,6 +28,9 @@ namespace MSIX {
         public:
             virtual CompressionStatus Initialize(CompressionOperation operation) = 0;
             virtual CompressionStatus Inflate() = 0;
+            // Compresses the available input ending with a full flush, so the output is byte aligned and can be
+            // inflated without any of the data that came before. With finish the deflate stream is terminated.
+            virtual CompressionStatus Deflate(bool finish) = 0;
             virtual CompressionStatus Cleanup() = 0;
             virtual std::size_t GetAvailableSourceSize() = 0;
             virtual std::size_t GetAvailableDestinationSize() = 0;
@@ -37,4 +40,12 @@ namespace MSIX {
     };
 
     std::unique_ptr<ICompressionObject> CreateCompressionObject();
+
+    // Inflates raw deflate data that ends on a byte boundary, after a full flush or at the end of the deflate stream,
+    // in one call. The data must inflate to exactly destinationSize bytes. Returns Ok if it does, End if it also ends
+    // the deflate stream and Error otherwise. Meant for blockmap blocks, whose inflated size is known up front.
+    CompressionStatus InflateBlock(const std::uint8_t* source, std::size_t sourceSize, std::uint8_t* destination, std::size_t destinationSize);
+
+    // Updates a zip CRC-32 with buffer. The initial value is 0.
+    std::uint32_t Crc32(std::uint32_t crc, const std::uint8_t* buffer, std::size_t size);
 }
\ No newline at end of file
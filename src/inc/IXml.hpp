@@ -163,6 +163,20 @@ struct XmlVisitor
     XmlVisitor(void* c, lambda f) : context(c), Callback(f) {}
 };
 
+// Elements of a document as IXmlFactory::ParseFromStream reads them, in document order. name is the local name
+// of the element. The element is only valid during the call and can't return its text.
+struct XmlStreamVisitor
+{
+    typedef void(*startLambda)(void*, const std::string&, const MSIX::ComPtr<IXmlElement>&);
+    typedef void(*endLambda)(void*, const std::string&);
+
+    void*       context;
+    startLambda StartElement;
+    endLambda   EndElement;
+
+    XmlStreamVisitor(void* c, startLambda start, endLambda end) : context(c), StartElement(start), EndElement(end) {}
+};
+
 // {0e7a446e-baf7-44c1-b38a-216bfa18a1a8}
 #ifndef WIN32
 interface IXmlDom : public IUnknown
@@ -191,6 +205,9 @@ class IXmlFactory : public IUnknown
 {
 public:
     virtual MSIX::ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const MSIX::ComPtr<IStream>& stream) = 0;
+    // Validates the document like CreateDomFromStream but hands its elements to the visitor as they are read, without
+    // building a DOM. Returns false if the XML implementation can't do that for this type of document.
+    virtual bool ParseFromStream(XmlContentType footPrintType, const MSIX::ComPtr<IStream>& stream, XmlStreamVisitor& visitor) = 0;
 };
 MSIX_INTERFACE(IXmlFactory, 0xf82a60ec,0xfbfc,0x4cb9,0xbc,0x04,0x1a,0x0f,0xe2,0xb4,0xd5,0xbe);
 
@@ -13,17 +13,49 @@
 #include <string>
 #include <map>
 #include <functional>
+#include <utility>
 #include <vector>
 
+// Implemented by streams that inflate a deflate compressed stream. Consumers that know where independently
+// compressed blocks start (like the blockmap's full flush blocks) can go to the compressed data directly.
+// {4ae24357-86b4-4eee-89f6-fed7ffbfc969}
+#ifndef WIN32
+interface IInflateStreamInternal : public IUnknown
+#else
+class IInflateStreamInternal : public IUnknown
+#endif
+{
+public:
+    virtual MSIX::ComPtr<IStream> GetCompressedStream() = 0;
+    // Points where inflating can start over without the data before them, as (uncompressed offset, compressed
+    // offset) pairs in increasing order. Seeks restart at the nearest one instead of the start of the stream.
+    virtual void SetSeekPoints(std::vector<std::pair<std::uint64_t, std::uint64_t>>&& seekPoints) = 0;
+};
+MSIX_INTERFACE(IInflateStreamInternal, 0x4ae24357,0x86b4,0x4eee,0x89,0xf6,0xfe,0xd7,0xff,0xbf,0xc9,0x69);
+
 namespace MSIX {
 
     // This represents a LZW-compressed stream
-    class InflateStream final : public StreamBase
+    class InflateStream final : public StreamBase, public IInflateStreamInternal
     {
     public:
         InflateStream(const ComPtr<IStream>& stream, std::uint64_t uncompressedSize);
         ~InflateStream();
 
+        // IUnknown
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return StreamBase::AddRef(); }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return StreamBase::Release(); }
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (ppvObject != nullptr && *ppvObject == nullptr && riid == UuidOfImpl<IInflateStreamInternal>::iid)
+            {
+                *ppvObject = static_cast<void*>(static_cast<IInflateStreamInternal*>(this));
+                AddRef();
+                return S_OK;
+            }
+            return StreamBase::QueryInterface(riid, ppvObject);
+        }
+
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) noexcept override;
         HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override;
         HRESULT STDMETHODCALLTYPE Write(void const *buffer, ULONG countBytes, ULONG *bytesWritten) noexcept override
@@ -46,6 +78,11 @@ namespace MSIX {
         {   // The underlying ZipFileStream object knows, so go ask it.
             return m_stream.As<IStreamInternal>()->GetName();
         }
+
+        // IInflateStreamInternal
+        ComPtr<IStream> GetCompressedStream() override { return m_stream; }
+        void SetSeekPoints(std::vector<std::pair<std::uint64_t, std::uint64_t>>&& seekPoints) override;
+
         void Cleanup();
 
         enum class State : size_t
@@ -73,6 +110,15 @@ namespace MSIX {
         std::unique_ptr<ICompressionObject> m_compressionObject;
         CompressionStatus m_compressionStatus = CompressionStatus::Ok;
 
+        // Set when the compressed stream is memory mapped, in which case it is inflated in place.
+        const std::uint8_t* m_mappedInput = nullptr;
+        std::uint64_t       m_mappedInputSize = 0;
+        std::uint64_t       m_mappedInputPosition = 0;
+
+        // Where inflating (re)starts, (0, 0) or one of the seek points.
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> m_seekPoints;
+        std::pair<std::uint64_t, std::uint64_t>              m_startPoint = { 0, 0 };
+
         std::unique_ptr<std::vector<std::uint8_t>> m_compressedBuffer;
         std::unique_ptr<std::vector<std::uint8_t>> m_inflateWindow;
     };
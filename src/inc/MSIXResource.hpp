@@ -0,0 +1,79 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+//  MSIXResource.hpp is generated by CMake. Do not edit.
+//
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "AppxFactory.hpp"
+#include <vector>
+
+namespace MSIX {
+
+    namespace Resource {
+
+        enum Type
+        {
+            Certificates,
+            ContentType,
+            BlockMap,
+            AppxManifest,
+            AppxBundleManifest
+        };
+
+        const size_t resourceLength = 10597;
+        extern const std::uint8_t resourceByte[resourceLength];
+    }
+
+    inline std::vector<std::pair<std::string, ComPtr<IStream>>> GetResources(IMsixFactory* factory, Resource::Type type)
+    {
+        std::vector<std::pair<std::string, ComPtr<IStream>>> result;
+        switch(type)
+        {
+            case Resource::Type::Certificates:
+                result.push_back(std::make_pair("certs/base64_MSFT_RCA_2010.cer",std::move(factory->GetResource("certs/base64_MSFT_RCA_2010.cer"))));
+				result.push_back(std::make_pair("certs/base64_MSFT_RCA_2011.cer",std::move(factory->GetResource("certs/base64_MSFT_RCA_2011.cer"))));
+				result.push_back(std::make_pair("certs/base64_STORE_PCA_2011.cer",std::move(factory->GetResource("certs/base64_STORE_PCA_2011.cer"))));
+				result.push_back(std::make_pair("certs/base64_Windows_Production.cer",std::move(factory->GetResource("certs/base64_Windows_Production.cer"))));
+				result.push_back(std::make_pair("certs/base64_Windows_Production_PCA_2011.cer",std::move(factory->GetResource("certs/base64_Windows_Production_PCA_2011.cer"))));
+				result.push_back(std::make_pair("certs/Microsoft_MarketPlace_PCA_2011.cer",std::move(factory->GetResource("certs/Microsoft_MarketPlace_PCA_2011.cer"))));
+				
+                break;
+            case Resource::Type::ContentType:
+                
+                break;
+            case Resource::Type::BlockMap:
+                
+                break;
+            case Resource::Type::AppxManifest:
+                
+                
+                break;
+            case Resource::Type::AppxBundleManifest:
+                
+                
+                break;
+        }
+        return result;
+    }
+
+    
+    struct SchemaEntry
+    {
+        const char*  uri;
+        const char*  alias;
+        const char*          schema;
+    
+        SchemaEntry(const char* u, const char* a, const char* s) : uri(u), alias(a), schema(s) {}
+    
+        inline bool operator==(const char* otherUri) const {
+            return 0 == strcmp(uri, otherUri);
+        }
+    };
+    
+    typedef std::vector<SchemaEntry> NamespaceManager;
+    
+    //         ALL THE URIs MUST BE LOWER-CASE, ordering of schema entries defines order of placement of schema into schema cache.
+    extern const NamespaceManager s_xmlNamespaces[];
+}
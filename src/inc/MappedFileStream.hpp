@@ -0,0 +1,178 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <limits>
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "FileStream.hpp"
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace MSIX {
+    // Read only stream over a memory mapped file. Reads are plain memcpy out of the mapping and
+    // consumers that understand IMappedStream can use the mapped bytes without copying them at all.
+    // The file must not be truncated while the stream is alive: touching a mapped page past the new end of the
+    // file raises SIGBUS instead of returning an error.
+    class MappedFileStream final : public StreamBase, public IMappedStream, public IFileBackedStream
+    {
+    public:
+        // Only regular, non-empty files that fit in the address space can be mapped.
+        static bool IsMappable(const std::string& name)
+        {
+            struct stat fileStat;
+            if (stat(name.c_str(), &fileStat) != 0) { return false; }
+            return S_ISREG(fileStat.st_mode) && (fileStat.st_size > 0) &&
+                (static_cast<std::uint64_t>(fileStat.st_size) <= std::numeric_limits<std::size_t>::max());
+        }
+
+        // Maps the file if it can be mapped. Files that can't, or for which mmap fails (file systems without mmap
+        // support, not enough address space, etc), are opened as a FileStream instead.
+        static ComPtr<IStream> OpenForRead(const std::string& name)
+        {
+            if (IsMappable(name))
+            {
+                int fd = open(name.c_str(), O_RDONLY);
+                ThrowErrorIf(Error::FileOpen, (fd == -1), name.c_str());
+                struct stat fileStat;
+                if (fstat(fd, &fileStat) != 0)
+                {
+                    close(fd);
+                    ThrowErrorAndLog(Error::FileOpen, name.c_str());
+                }
+                auto size = static_cast<std::uint64_t>(fileStat.st_size);
+                void* mapping = mmap(nullptr, static_cast<std::size_t>(size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping != MAP_FAILED)
+                {
+                    try
+                    {
+                        return ComPtr<IStream>::Make<MappedFileStream>(name, fd, size, mapping);
+                    }
+                    catch (...)
+                    {
+                        munmap(mapping, static_cast<std::size_t>(size));
+                        close(fd);
+                        throw;
+                    }
+                }
+                close(fd);
+            }
+            return ComPtr<IStream>::Make<FileStream>(name, FileStream::Mode::READ);
+        }
+
+        // Takes ownership of the descriptor and the mapping. The mapping keeps its own reference to the file, the
+        // descriptor is kept for IFileBackedStream.
+        MappedFileStream(const std::string& name, int fd, std::uint64_t size, void* mapping) :
+            m_size(size), m_name(name), m_data(reinterpret_cast<const std::uint8_t*>(mapping)), m_fd(fd)
+        {}
+
+        virtual ~MappedFileStream() override
+        {
+            if (m_fd != -1)
+            {
+                close(m_fd);
+                m_fd = -1;
+            }
+            if (m_data)
+            {
+                munmap(const_cast<std::uint8_t*>(m_data), static_cast<std::size_t>(m_size));
+                m_data = nullptr;
+            }
+        }
+
+        // IUnknown. IMappedStream and IFileBackedStream aren't part of StreamBase's interface list, so answer for
+        // them here.
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return StreamBase::AddRef(); }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return StreamBase::Release(); }
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (ppvObject != nullptr && *ppvObject == nullptr && riid == UuidOfImpl<IMappedStream>::iid)
+            {
+                *ppvObject = static_cast<void*>(static_cast<IMappedStream*>(this));
+                AddRef();
+                return S_OK;
+            }
+            if (ppvObject != nullptr && *ppvObject == nullptr && riid == UuidOfImpl<IFileBackedStream>::iid)
+            {
+                *ppvObject = static_cast<void*>(static_cast<IFileBackedStream*>(this));
+                AddRef();
+                return S_OK;
+            }
+            return StreamBase::QueryInterface(riid, ppvObject);
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            LARGE_INTEGER newPos = { 0 };
+            switch (origin)
+            {
+            case Reference::CURRENT:
+                newPos.QuadPart = m_offset + move.QuadPart;
+                break;
+            case Reference::START:
+                newPos.QuadPart = move.QuadPart;
+                break;
+            case Reference::END:
+                newPos.QuadPart = m_size + move.QuadPart;
+                break;
+            }
+            // same semantics as fseek: seeking before the start fails, seeking past the end is allowed.
+            ThrowErrorIf(Error::FileSeek, (newPos.QuadPart < 0), "seek failed");
+            m_offset = static_cast<std::uint64_t>(newPos.QuadPart);
+            if (newPosition) { newPosition->QuadPart = m_offset; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            if (bytesRead) { *bytesRead = 0; }
+            ULONG amountToRead = ReadAt(m_offset, buffer, countBytes);
+            m_offset += amountToRead;
+            if (bytesRead) { *bytesRead = amountToRead; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        // IStreamInternal
+        std::string GetName() override { return m_name; }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            ULONG amountToRead = (offset < m_size) ?
+                static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - offset)) : 0;
+            if (amountToRead > 0) { std::memcpy(buffer, m_data + offset, amountToRead); }
+            return amountToRead;
+        }
+
+        // IMappedStream
+        const std::uint8_t* GetMappedBuffer() override { return m_data; }
+        std::uint64_t GetMappedSize() override { return m_size; }
+
+        // IFileBackedStream
+        int GetFileDescriptor() override { return m_fd; }
+        std::uint64_t GetFileOffset() override { return 0; }
+
+    protected:
+        std::uint64_t m_offset = 0;
+        std::uint64_t m_size = 0;
+        std::string m_name;
+        const std::uint8_t* m_data = nullptr;
+        int m_fd = -1;
+    };
+}
+#endif
@@ -24,6 +24,7 @@ namespace MSIX {
         NotSupported                = 0x80070032,
         InvalidParameter            = 0x80070057,
         Stg_E_Invalidpointer        = 0x80030009,
+        InvalidState                = 0x8007139F,
 
         //
         // msix specific error codes
@@ -51,6 +52,10 @@ namespace MSIX {
         InflateRead                 = ERROR_FACILITY + 0x0022,
         InflateCorruptData          = ERROR_FACILITY + 0x0023,
 
+        // Deflate errors
+        DeflateInitialize           = ERROR_FACILITY + 0x0024,
+        DeflateWrite                = ERROR_FACILITY + 0x0025,
+
         // Package format errors
         MissingAppxSignatureP7X     = ERROR_FACILITY + 0x0031,
         MissingContentTypesXML      = ERROR_FACILITY + 0x0032,
@@ -7,6 +7,7 @@
 #include <vector>
 #include <tuple>
 #include <type_traits>
+#include <cstring>
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
 
@@ -36,6 +37,39 @@ static void OnlyEitherValueValidation(T value, T spec1, T spec2)
         "Incorrect value specified at field.");
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////
+//              Bounds checked view over bytes that were read in one go                     //
+//////////////////////////////////////////////////////////////////////////////////////////////
+class SpanReader
+{
+public:
+    // offset is where data starts in the stream it was read from, positions are reported relative to it.
+    SpanReader(const std::uint8_t* data, std::size_t size, std::uint64_t offset = 0) :
+        m_data(data), m_size(size), m_offset(offset)
+    {}
+
+    template <class T>
+    void Read(T* value)
+    {
+        ReadBytes(value, sizeof(T));
+    }
+
+    void ReadBytes(void* buffer, std::size_t size)
+    {
+        ThrowErrorIf(Error::FileRead, (m_size - m_position < size), "Entire object wasn't read!");
+        if (size != 0) { std::memcpy(buffer, m_data + m_position, size); }
+        m_position += size;
+    }
+
+    std::uint64_t GetPosition() noexcept { return m_offset + m_position; }
+
+protected:
+    const std::uint8_t* m_data;
+    std::size_t         m_size;
+    std::uint64_t       m_offset;
+    std::size_t         m_position = 0;
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 //              Base type for individual serializable/deserializable fields                 //
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -46,6 +80,7 @@ public:
     FieldBase() = default;
 
     size_t Size() { return sizeof(T); }
+    void Read(SpanReader& reader) { reader.Read(&value); }
     
     T value;
 };
@@ -60,6 +95,8 @@ class FieldNBytes : public FieldBase<std::vector<std::uint8_t>>
 {
 public:
     size_t Size() { return this->value.size(); }
+    // The size of the field has to be set before reading it.
+    void Read(SpanReader& reader) { reader.ReadBytes(this->value.data(), this->value.size()); }
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -81,6 +118,17 @@ public:
         for_each<index + 1, FuncT>(f, std::forward<Args>(args)...);
     }
 
+    // Same as for_each, over the fields in [begin, end)
+    template<std::size_t begin, std::size_t end, typename FuncT>
+    inline typename std::enable_if<begin == end, void>::type for_each_in(FuncT) { }
+
+    template<std::size_t begin, std::size_t end, typename FuncT>
+    inline typename std::enable_if<(begin < end), void>::type for_each_in(FuncT f)
+    {
+        f(Field<begin>());
+        for_each_in<begin + 1, end, FuncT>(f);
+    }
+
     template <size_t index>
     auto& Field() noexcept { return std::get<index>(fields); }
 };
@@ -100,6 +148,13 @@ public:
         }, result);
         return result;
     }
+
+    // Decodes the fields in [begin, end) in the order they are laid out, without any stream calls.
+    template <std::size_t begin, std::size_t end>
+    void ReadFields(SpanReader& reader)
+    {
+        this->template for_each_in<begin, end>([&reader](auto& field) { field.Read(reader); });
+    }
 };
 
 } /* namespace Meta */ } /* namespace MSIX */
\ No newline at end of file
@@ -0,0 +1,96 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "StreamBase.hpp"
+#include "BlockMapStream.hpp"
+#include "StorageObject.hpp"
+#include "DirectoryObject.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+namespace MSIX {
+
+    // Everything needed to reopen a package without walking its central directory, its local file headers or
+    // parsing its AppxBlockMap.xml. Indexes are keyed by the SHA-256 of the central directory, so a package
+    // that changes gets a new key. The format uses the byte order of the machine that wrote it.
+    class PackageIndex
+    {
+    public:
+        typedef struct ZipEntry
+        {
+            std::uint64_t dataOffset;   // offset of the file data, after its local file header
+            std::uint64_t compressedSize;
+            std::uint64_t uncompressedSize;
+            bool          isCompressed;
+        } ZipEntry;
+
+        typedef struct BlockMapFile
+        {
+            std::uint64_t      size;
+            std::uint32_t      localFileHeaderSize;
+            std::vector<Block> blocks;
+        } BlockMapFile;
+
+        PackageIndex(const std::string& key) : m_key(key) {}
+
+        // Returns nullptr if the stream doesn't contain a well formed index for key.
+        static std::unique_ptr<PackageIndex> Load(const ComPtr<IStream>& stream, const std::string& key);
+        HRESULT Save(const ComPtr<IStream>& stream);
+
+        const std::string& GetKey() { return m_key; }
+        std::map<std::string, ZipEntry>& GetZipEntries() { return m_zipEntries; }
+        std::map<std::string, BlockMapFile>& GetBlockMapFiles() { return m_blockMapFiles; }
+
+    protected:
+        std::string                         m_key;
+        std::map<std::string, ZipEntry>     m_zipEntries;
+        std::map<std::string, BlockMapFile> m_blockMapFiles;
+    };
+
+    // Returns the index cache key of a central directory.
+    std::string GetPackageIndexKey(const std::uint8_t* centralDirectory, std::uint32_t size);
+
+    // Index cache that stores each index as <key>.msixindex in a directory.
+    class DirectoryIndexCache final : public ComClass<DirectoryIndexCache, IMsixIndexCache>
+    {
+    public:
+        DirectoryIndexCache(const std::string& root) : m_root(root),
+            m_directory(ComPtr<IStorageObject>::Make<DirectoryObject>(root))
+        {}
+
+        // IMsixIndexCache
+        HRESULT STDMETHODCALLTYPE OpenIndex(LPCSTR key, IStream** index) noexcept override;
+        HRESULT STDMETHODCALLTYPE CreateIndex(LPCSTR key, IStream** index) noexcept override;
+
+    protected:
+        std::string            m_root;
+        ComPtr<IStorageObject> m_directory;
+    };
+}
+
+// internal interface
+// {0b4b0b0e-9d6b-4d2c-8a57-4c1b5e0f3a6d}
+#ifndef WIN32
+interface IPackageIndexProvider : public IUnknown
+#else
+#include "Unknwn.h"
+#include "Objidl.h"
+class IPackageIndexProvider : public IUnknown
+#endif
+{
+public:
+    // Index loaded from the index cache of the factory, nullptr if there wasn't any.
+    virtual MSIX::PackageIndex* GetIndex() = 0;
+    // Writes a new index to the index cache of the factory. Does nothing if there is no index cache or the
+    // package was opened from an index.
+    virtual void SaveIndex(std::map<std::string, MSIX::PackageIndex::BlockMapFile>&& blockMapFiles) = 0;
+};
+MSIX_INTERFACE(IPackageIndexProvider, 0x0b4b0b0e,0x9d6b,0x4d2c,0x8a,0x57,0x4c,0x1b,0x5e,0x0f,0x3a,0x6d);
@@ -0,0 +1,86 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace MSIX {
+
+    // Read only stream over an IMsixRangeReader, for packages where every read is a request to somewhere else.
+    // The package is read in blocks that are kept in an LRU cache. Missing blocks next to each other are fetched
+    // with one request, so small reads close to each other (headers, names, file data) cost one request at most.
+    // The end of the package, where the central directory is, is fetched up front and reads that continue where
+    // the previous fetch ended read ahead more and more blocks.
+    class RangeReaderStream final : public StreamBase
+    {
+    public:
+        static const std::uint32_t DefaultBlockSize = 64 * 1024;
+        static const std::uint32_t DefaultMaxCachedBlocks = 256;
+
+        RangeReaderStream(const ComPtr<IMsixRangeReader>& reader, std::uint32_t blockSize, std::uint32_t maxCachedBlocks);
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override;
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override;
+        HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        // IStreamInternal
+        std::string GetName() override { return std::string(); }
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override;
+
+    protected:
+        typedef struct CachedBlock
+        {
+            std::uint64_t             index;
+            std::vector<std::uint8_t> data;
+        } CachedBlock;
+
+        // Returns the block, fetching it and the missing blocks after it that are wanted too. Must be called
+        // with m_lock held.
+        const std::vector<std::uint8_t>& GetBlock(std::uint64_t index, std::uint64_t lastWanted);
+        void Fetch(std::uint64_t first, std::uint64_t count);
+        bool IsCached(std::uint64_t index) { return m_blockIndex.find(index) != m_blockIndex.end(); }
+        std::uint64_t GetBlockCount() { return (m_size + m_blockSize - 1) / m_blockSize; }
+
+        ComPtr<IMsixRangeReader> m_reader;
+        std::uint64_t            m_size = 0;
+        std::uint64_t            m_blockSize;
+        std::uint64_t            m_maxCachedBlocks;
+        std::uint64_t            m_position = 0;
+        // most recently used first
+        std::list<CachedBlock>   m_blocks;
+        std::unordered_map<std::uint64_t, std::list<CachedBlock>::iterator> m_blockIndex;
+        // Block after the last one fetched and how many blocks are read ahead when the next miss is there.
+        std::uint64_t            m_nextFetch = 0;
+        std::uint64_t            m_readAhead = 0;
+        std::mutex               m_lock;
+    };
+
+    // Stream factory that opens the packages of a flat bundle as RangeReaderStreams.
+    class RangeReaderStreamFactory final : public ComClass<RangeReaderStreamFactory, IMsixStreamFactory>
+    {
+    public:
+        RangeReaderStreamFactory(const ComPtr<IMsixRangeReaderFactory>& rangeReaderFactory) : m_rangeReaderFactory(rangeReaderFactory) {}
+
+        // IMsixStreamFactory
+        HRESULT STDMETHODCALLTYPE CreateStreamOnRelativePath(LPCWSTR relativePath, IStream** stream) noexcept override;
+        HRESULT STDMETHODCALLTYPE CreateStreamOnRelativePathUtf8(LPCSTR relativePath, IStream** stream) noexcept override;
+
+    protected:
+        ComPtr<IMsixRangeReaderFactory> m_rangeReaderFactory;
+    };
+}
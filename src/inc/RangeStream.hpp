@@ -10,12 +10,13 @@
 #include <string>
 #include <map>
 #include <functional>
+#include <cstring>
 
 
 namespace MSIX {
 
     // This represents a subset of a Stream
-    class RangeStream : public StreamBase
+    class RangeStream : public StreamBase, public IMappedStream, public IFileBackedStream
     {
     public:
         RangeStream(std::uint64_t offset, std::uint64_t size, const ComPtr<IStream>& stream) :
@@ -23,6 +24,41 @@ namespace MSIX {
             m_size(size),
             m_stream(stream)
         {
+            // If the parent stream is memory mapped, this range is just a slice of the mapping
+            ComPtr<IMappedStream> mapped;
+            if (SUCCEEDED(m_stream->QueryInterface(UuidOfImpl<IMappedStream>::iid, reinterpret_cast<void**>(&mapped))) && mapped)
+            {
+                ThrowErrorIf(Error::FileSeekOutOfRange, (m_offset > mapped->GetMappedSize() || m_size > mapped->GetMappedSize() - m_offset),
+                    "range is outside of the stream");
+                m_data = mapped->GetMappedBuffer() + m_offset;
+            }
+            else
+            {   // Otherwise read via the parent's ReadAt when it has one, so ranges over the same stream don't
+                // share (and fight over) the parent's seek pointer. m_streamInternal stays empty if it doesn't.
+                m_stream->QueryInterface(UuidOfImpl<IStreamInternal>::iid, reinterpret_cast<void**>(&m_streamInternal));
+            }
+            m_stream->QueryInterface(UuidOfImpl<IFileBackedStream>::iid, reinterpret_cast<void**>(&m_file));
+        }
+
+        // IUnknown. IMappedStream is only exposed when the range is backed by a mapping and IFileBackedStream
+        // when the parent is backed by a file.
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return StreamBase::AddRef(); }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return StreamBase::Release(); }
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (m_data != nullptr && ppvObject != nullptr && *ppvObject == nullptr && riid == UuidOfImpl<IMappedStream>::iid)
+            {
+                *ppvObject = static_cast<void*>(static_cast<IMappedStream*>(this));
+                AddRef();
+                return S_OK;
+            }
+            if (m_file && ppvObject != nullptr && *ppvObject == nullptr && riid == UuidOfImpl<IFileBackedStream>::iid)
+            {
+                *ppvObject = static_cast<void*>(static_cast<IFileBackedStream*>(this));
+                AddRef();
+                return S_OK;
+            }
+            return StreamBase::QueryInterface(riid, ppvObject);
         }
 
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) noexcept override try
@@ -42,7 +78,15 @@ namespace MSIX {
             }
             //TODO: We need to constrain newPos so that it can't exceed the end of the stream
             ULARGE_INTEGER pos = { 0 };
-            m_stream->Seek(newPos, Reference::START, &pos);
+            if (m_data || m_streamInternal)
+            {   // Reads never depend on the parent's seek pointer, so there's no need to move it
+                ThrowErrorIf(Error::FileSeek, (newPos.QuadPart < 0), "seek failed");
+                pos.QuadPart = newPos.QuadPart;
+            }
+            else
+            {
+                m_stream->Seek(newPos, Reference::START, &pos);
+            }
             m_relativePosition = std::min(static_cast<std::uint64_t>(pos.QuadPart - m_offset), m_size);
             if (newPosition) { newPosition->QuadPart = m_relativePosition; }
             return static_cast<HRESULT>(Error::OK);
@@ -50,12 +94,8 @@ namespace MSIX {
 
         HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
         {
-            LARGE_INTEGER offset = {0};
-            offset.QuadPart = m_relativePosition + m_offset;
-            ThrowHrIfFailed(m_stream->Seek(offset, StreamBase::START, nullptr));
             ULONG amountToRead = std::min(countBytes, static_cast<ULONG>(m_size - m_relativePosition));
-            ULONG amountRead = 0;
-            ThrowHrIfFailed(m_stream->Read(buffer, amountToRead, &amountRead));
+            ULONG amountRead = ReadAt(m_relativePosition, buffer, amountToRead);
             ThrowErrorIf(Error::FileRead, (amountToRead != amountRead), "Did not read as much as requesteed.");
             m_relativePosition += amountRead;
             if (bytesRead) { *bytesRead = amountRead; }
@@ -63,12 +103,41 @@ namespace MSIX {
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
+        // IStreamInternal
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            if (offset >= m_size) { return 0; }
+            ULONG amountToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - offset));
+            if (amountToRead == 0) { return 0; }
+            if (m_data)
+            {
+                std::memcpy(buffer, m_data + offset, amountToRead);
+                return amountToRead;
+            }
+            if (m_streamInternal)
+            {
+                return m_streamInternal->ReadAt(m_offset + offset, buffer, amountToRead);
+            }
+            return StreamBase::ReadAt(m_stream, m_offset + offset, buffer, amountToRead);
+        }
+
         std::uint64_t Size() { return m_size; }
 
+        // IMappedStream
+        const std::uint8_t* GetMappedBuffer() override { return m_data; }
+        std::uint64_t GetMappedSize() override { return m_size; }
+
+        // IFileBackedStream
+        int GetFileDescriptor() override { return m_file->GetFileDescriptor(); }
+        std::uint64_t GetFileOffset() override { return m_file->GetFileOffset() + m_offset; }
+
     protected:
         std::uint64_t m_offset;
         std::uint64_t m_size;
         std::uint64_t m_relativePosition = 0;
         ComPtr<IStream> m_stream;
+        ComPtr<IStreamInternal> m_streamInternal;
+        ComPtr<IFileBackedStream> m_file;
+        const std::uint8_t* m_data = nullptr;
     };
-}
\ No newline at end of file
+}
@@ -4,6 +4,8 @@
 // 
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 namespace MSIX {
@@ -12,5 +14,27 @@ namespace MSIX {
     {
     public:
         static bool ComputeHash(std::uint8_t *buffer, std::uint32_t cbBuffer, std::vector<uint8_t>& hash);
+
+        // How hashes are computed: with the crypto library, the CPU's SHA-256 instructions or several buffers side by
+        // side in vector registers. Default picks from what the CPU has, the others are for tests.
+        enum class Engine { Default, Library, Instructions, Avx2, Avx512 };
+        static bool IsSupported(Engine engine);
+
+        // Hashes count buffers that don't depend on each other, with sizes[i] bytes at buffers[i], into 32 bytes
+        // each at hashes.
+        static void ComputeHashes(std::size_t count, const std::uint8_t* const* buffers, const std::size_t* sizes, std::uint8_t* hashes);
+        static void ComputeHashes(Engine engine, std::size_t count, const std::uint8_t* const* buffers, const std::size_t* sizes, std::uint8_t* hashes);
+
+        // Incremental hash, for data that doesn't come in a single buffer. Init starts a new hash, Update can be
+        // called any number of times and Final gets the hash. Init has to be called again before the next Update.
+        SHA256();
+        ~SHA256();
+        void Init();
+        void Update(const std::uint8_t* buffer, std::size_t cbBuffer);
+        void Final(std::vector<std::uint8_t>& hash);
+
+    protected:
+        struct Context;
+        std::unique_ptr<Context> m_context;
     };
 }
\ No newline at end of file
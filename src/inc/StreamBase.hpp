@@ -28,9 +28,44 @@ public:
     virtual std::uint64_t GetSizeOnZip() = 0;
     virtual bool IsCompressed() = 0;
     virtual std::string GetName() = 0;
+    // Reads up to countBytes starting at offset without using or moving the stream's seek pointer.
+    // Returns the number of bytes read, which is only less than countBytes at the end of the stream.
+    virtual ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) = 0;
 };
 MSIX_INTERFACE(IStreamInternal, 0x44d2a7a8,0xa165,0x4a6e,0xa5,0x6f,0xc7,0xc2,0x4d,0xe7,0x50,0x5c);
 
+// Implemented by streams whose whole content is addressable in memory (e.g. a memory mapped file) so
+// consumers can work directly over the bytes instead of copying them out via Read.
+// {748832eb-a3eb-4932-9f0f-8f9c8c0c185f}
+#ifndef WIN32
+interface IMappedStream : public IUnknown
+#else
+class IMappedStream : public IUnknown
+#endif
+{
+public:
+    virtual const std::uint8_t* GetMappedBuffer() = 0;
+    virtual std::uint64_t GetMappedSize() = 0;
+};
+MSIX_INTERFACE(IMappedStream, 0x748832eb,0xa3eb,0x4932,0x9f,0x0f,0x8f,0x9c,0x8c,0x0c,0x18,0x5f);
+
+// Implemented by streams whose content is a range of a file that is open on disk, so copies from one file to
+// another can be left to the kernel.
+// {b2f0c7d4-58e1-4a3f-9b6c-d1e27a4f8c03}
+#ifndef WIN32
+interface IFileBackedStream : public IUnknown
+#else
+class IFileBackedStream : public IUnknown
+#endif
+{
+public:
+    // Descriptor of the file, with any buffered writes flushed to it, or -1 if there is none.
+    virtual int GetFileDescriptor() = 0;
+    // Where the stream starts in the file.
+    virtual std::uint64_t GetFileOffset() = 0;
+};
+MSIX_INTERFACE(IFileBackedStream, 0xb2f0c7d4,0x58e1,0x4a3f,0x9b,0x6c,0xd1,0xe2,0x7a,0x4f,0x8c,0x03);
+
 namespace MSIX {
     class StreamBase : public MSIX::ComClass<StreamBase, IStream, IStreamInternal>
     {
@@ -134,6 +169,18 @@ namespace MSIX {
         virtual bool IsCompressed() override { NOTIMPLEMENTED; }
         virtual std::string GetName() override { NOTIMPLEMENTED; }
 
+        // Default implementation goes through the seek pointer, so it is not safe to use concurrently with
+        // other reads. Streams that can read at an offset directly (pread, memcpy) override it.
+        virtual ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            LARGE_INTEGER pos = {0};
+            pos.QuadPart = static_cast<LONGLONG>(offset);
+            ThrowHrIfFailed(Seek(pos, Reference::START, nullptr));
+            ULONG result = 0;
+            ThrowHrIfFailed(Read(buffer, countBytes, &result));
+            return result;
+        }
+
         template <class T>
         static ULONG Read(const ComPtr<IStream>& stream, T* value)
         {
@@ -143,6 +190,22 @@ namespace MSIX {
             return result;
         }
 
+        // Positional read on any stream, using IStreamInternal::ReadAt when the stream implements it.
+        static ULONG ReadAt(const ComPtr<IStream>& stream, std::uint64_t offset, void* buffer, ULONG countBytes)
+        {
+            ComPtr<IStreamInternal> streamInternal;
+            if (SUCCEEDED(stream->QueryInterface(UuidOfImpl<IStreamInternal>::iid, reinterpret_cast<void**>(&streamInternal))) && streamInternal)
+            {
+                return streamInternal->ReadAt(offset, buffer, countBytes);
+            }
+            LARGE_INTEGER pos = {0};
+            pos.QuadPart = static_cast<LONGLONG>(offset);
+            ThrowHrIfFailed(stream->Seek(pos, Reference::START, nullptr));
+            ULONG result = 0;
+            ThrowHrIfFailed(stream->Read(buffer, countBytes, &result));
+            return result;
+        }
+
         template <class T>
         static void Write(const ComPtr<IStream>& stream, T* value)
         {
@@ -0,0 +1,93 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace MSIX {
+
+    // Fixed set of worker threads that run tasks in the order they are submitted. An exception thrown by a task
+    // is rethrown by get() on the future returned by Submit.
+    class ThreadPool final
+    {
+    public:
+        ThreadPool(std::size_t threadCount = GetDefaultThreadCount())
+        {
+            for (std::size_t i = 0; i < std::max(threadCount, static_cast<std::size_t>(1)); i++)
+            {
+                m_threads.emplace_back([this]() { Run(); });
+            }
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_stopping = true;
+            }
+            m_condition.notify_all();
+            for (auto& thread : m_threads)
+            {
+                thread.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        template <class Function>
+        std::future<typename std::result_of<Function()>::type> Submit(Function&& function)
+        {
+            typedef typename std::result_of<Function()>::type Result;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+            auto result = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_tasks.emplace([task]() { (*task)(); });
+            }
+            m_condition.notify_one();
+            return result;
+        }
+
+        std::size_t GetThreadCount() { return m_threads.size(); }
+
+        static std::size_t GetDefaultThreadCount()
+        {   // hardware_concurrency may return 0 if it can't tell
+            return std::max(static_cast<std::size_t>(std::thread::hardware_concurrency()), static_cast<std::size_t>(1));
+        }
+
+    protected:
+        void Run()
+        {
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+                    if (m_tasks.empty()) { return; }
+                    task = std::move(m_tasks.front());
+                    m_tasks.pop();
+                }
+                task();
+            }
+        }
+
+        std::vector<std::thread>          m_threads;
+        std::queue<std::function<void()>> m_tasks;
+        std::mutex                        m_lock;
+        std::condition_variable           m_condition;
+        bool                              m_stopping = false;
+    };
+}
@@ -45,6 +45,15 @@ namespace MSIX {
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
+        // IStreamInternal
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            ULONG amountToRead = (offset < m_data->size()) ?
+                static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), static_cast<std::uint64_t>(m_data->size() - offset))) : 0;
+            if (amountToRead > 0) { memcpy(buffer, m_data->data() + offset, amountToRead); }
+            return amountToRead;
+        }
+
     protected:
         ULONG m_offset = 0;
         std::vector<std::uint8_t>* m_data;
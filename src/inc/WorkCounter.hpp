@@ -0,0 +1,38 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+
+#include <cstdint>
+
+namespace MSIX {
+
+    // The IMsixWorkCounter specified on a factory, if there is one. Work is added up by the caller and reported
+    // once per step, so a factory without a counter costs nothing more than the lookup.
+    class WorkCounter final
+    {
+    public:
+        WorkCounter(IUnknown* factory)
+        {
+            ComPtr<IMsixFactoryOverrides> factoryOverrides;
+            ComPtr<IUnknown> counter;
+            if (factory && SUCCEEDED(factory->QueryInterface(UuidOfImpl<IMsixFactoryOverrides>::iid, reinterpret_cast<void**>(&factoryOverrides))) &&
+                SUCCEEDED(factoryOverrides->GetCurrentSpecifiedExtension(MSIX_FACTORY_EXTENSION_WORK_COUNTER, &counter)) && counter)
+            {
+                m_counter = counter.As<IMsixWorkCounter>();
+            }
+        }
+
+        void Add(MSIX_WORK_COUNTER counter, std::uint64_t count)
+        {
+            if (m_counter) { m_counter->AddWork(counter, count); }
+        }
+
+    protected:
+        ComPtr<IMsixWorkCounter> m_counter;
+    };
+}
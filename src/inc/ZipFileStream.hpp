@@ -8,11 +8,42 @@
 #include "StreamBase.hpp"
 #include "RangeStream.hpp"
 #include "AppxFactory.hpp"
+#include "SHA256.hpp"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace MSIX {
 
+    // Hashes the file records at the start of an archive from the reads of its files, see
+    // ISignedZipArchive::GetFileRecordsDigest. The bytes are hashed in order: a read that continues the hashed
+    // bytes moves the digest forward, a small gap before it is read here and anything else is ignored.
+    class FileRecordsDigest final
+    {
+    public:
+        FileRecordsDigest(const ComPtr<IStream>& stream) : m_stream(stream) {}
+
+        // Starts a new digest of [0, end). Reads are only hashed while isActive.
+        void Begin(std::uint64_t end, bool isActive);
+        bool IsActive() { return m_isActive; }
+        void Add(std::uint64_t offset, const void* buffer, std::size_t count);
+        // Stops hashing reads and returns how far they got. The digest is continued from there with Update.
+        std::uint64_t End();
+        void Update(const std::uint8_t* buffer, std::size_t count) { m_hash.Update(buffer, count); }
+        void Final(std::vector<std::uint8_t>& digest) { m_hash.Final(digest); }
+
+    protected:
+        ComPtr<IStream>         m_stream;
+        std::mutex              m_lock;
+        std::atomic<bool>       m_isActive{false};
+        SHA256                  m_hash;
+        std::uint64_t           m_hashed = 0;
+        std::uint64_t           m_end = 0;
+    };
+
     // This represents a raw stream over a file contained in a .zip file.
     class ZipFileStream final : public RangeStream
     {
@@ -25,21 +56,43 @@ namespace MSIX {
             bool isCompressed,
             std::uint64_t offset,
             std::uint64_t size,
-            const ComPtr<IStream>& stream
-        ) : m_isCompressed(isCompressed), RangeStream(offset, size, stream), m_name(name), m_contentType(contentType), m_factory(factory), m_compressedSize(size)
+            const ComPtr<IStream>& stream,
+            const std::shared_ptr<FileRecordsDigest>& digest = nullptr
+        ) : m_isCompressed(isCompressed), RangeStream(offset, size, stream), m_name(name), m_contentType(contentType), m_factory(factory), m_compressedSize(size),
+            m_digest(digest)
         {
         }
 
+        // IUnknown. While the file records are hashed their bytes have to go through here, so they aren't left to
+        // the kernel to copy.
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (m_digest && m_digest->IsActive() && ppvObject != nullptr && riid == UuidOfImpl<IFileBackedStream>::iid)
+            {
+                *ppvObject = nullptr;
+                return E_NOINTERFACE;
+            }
+            return RangeStream::QueryInterface(riid, ppvObject);
+        }
+
         // IStreamInternal
         std::uint64_t GetSizeOnZip() override { return m_compressedSize; }
         bool IsCompressed() override { return m_isCompressed; }
         std::string GetName() override { return m_name; }
 
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            ULONG read = RangeStream::ReadAt(offset, buffer, countBytes);
+            if (m_digest && m_digest->IsActive()) { m_digest->Add(m_offset + offset, buffer, read); }
+            return read;
+        }
+
     protected:
         IMsixFactory*   m_factory;
         std::string     m_name;
         std::string     m_contentType;
         bool            m_isCompressed = false;
         std::uint64_t   m_compressedSize;
+        std::shared_ptr<FileRecordsDigest> m_digest;
     };
 }
\ No newline at end of file
@@ -9,14 +9,48 @@
 #include "StreamBase.hpp"
 #include "StorageObject.hpp"
 #include "AppxFactory.hpp"
+#include "PackageIndex.hpp"
+#include "ICompressionObject.hpp"
 
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <cstring>
+#include <functional>
+
+// internal interface
+// {654ce148-b263-48ca-90b5-d00918016402}
+#ifndef WIN32
+interface ISignedZipArchive : public IUnknown
+#else
+#include "Unknwn.h"
+#include "Objidl.h"
+class ISignedZipArchive : public IUnknown
+#endif
+{
+public:
+    // A package signature is the last file added to the archive and its digests are of the archive as it was before:
+    // the file records in front of the signature's, and the central directory without the signature's entry followed
+    // by the records that end it.
+    // The central directory's digest is computed from what was read to open the archive. Throws if signatureFile
+    // isn't the last file record, otherwise returns where its record starts, which is where the file records end.
+    virtual std::uint64_t GetCentralDirectoryDigest(const std::string& signatureFile, std::vector<std::uint8_t>& digest) = 0;
+    // Digest of the file records in [0, end). The reads of the archive's files that reader makes are hashed as they
+    // happen, the bytes it didn't read in order are read after it returns. Without a reader all of them are read.
+    virtual void GetFileRecordsDigest(std::uint64_t end, std::vector<std::uint8_t>& digest, const std::function<void()>& reader) = 0;
+    // Sorts file names in the order of their records in the archive, for readers of GetFileRecordsDigest.
+    virtual void SortByFileRecords(std::vector<std::string>& fileNames) = 0;
+};
+MSIX_INTERFACE(ISignedZipArchive, 0x654ce148,0xb263,0x48ca,0x90,0xb5,0xd0,0x09,0x18,0x01,0x64,0x02);
 
 namespace MSIX {
+    class CentralDirectoryFileHeader;
+    class FileRecordsDigest;
+    class LocalFileHeader;
+
     // This represents a raw stream over a.zip file.
-    class ZipObject final : public ComClass<ZipObject, IStorageObject>
+    class ZipObject final : public ComClass<ZipObject, IStorageObject, IPackageIndexProvider, ISignedZipArchive>
     {
     public:
         ZipObject(IMsixFactory* factory, const ComPtr<IStream>& stream);
@@ -28,9 +62,149 @@ namespace MSIX {
         ComPtr<IStream> OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode) override { NOTIMPLEMENTED; }
         std::string GetFileName() override;
 
+        // IPackageIndexProvider
+        PackageIndex* GetIndex() override { return m_index.get(); }
+        void SaveIndex(std::map<std::string, PackageIndex::BlockMapFile>&& blockMapFiles) override;
+
+        // ISignedZipArchive
+        std::uint64_t GetCentralDirectoryDigest(const std::string& signatureFile, std::vector<std::uint8_t>& digest) override;
+        void GetFileRecordsDigest(std::uint64_t end, std::vector<std::uint8_t>& digest, const std::function<void()>& reader) override;
+        void SortByFileRecords(std::vector<std::string>& fileNames) override;
+
     protected:
+        ComPtr<IStream> CreateFileStream(const std::string& fileName, const PackageIndex::ZipEntry& entry);
+
         IMsixFactory*                          m_factory;
         ComPtr<IStream>                        m_stream;
+        // Only the central directory is read at construction time. Streams for the entries are created
+        // the first time they are requested via GetFile and then cached in m_streams.
+        std::map<std::string, std::shared_ptr<CentralDirectoryFileHeader>> m_centralDirectory;
         std::map<std::string, ComPtr<IStream>> m_streams;
+        // Where the central directory and the records after it are, from the end of central directory records.
+        std::uint64_t                          m_startOfCD = 0;
+        std::uint64_t                          m_endOfCD = 0;
+        std::uint64_t                          m_startOfEoCD = 0;
+        std::uint64_t                          m_endOfStream = 0;
+        std::uint64_t                          m_entryCount = 0;
+        bool                                   m_isZip64 = false;
+        bool                                   m_hasZip64Locator = false;
+        // The central directory and the records after it, as read at construction time.
+        std::vector<std::uint8_t>              m_centralDirectoryBytes;
+        // Shared with the streams of the entries, which add their reads to it.
+        std::shared_ptr<FileRecordsDigest>     m_fileRecordsDigest;
+        // Set when the factory has an index cache. If an index was found for the package m_index is used
+        // instead of m_centralDirectory.
+        ComPtr<IMsixIndexCache>                m_indexCache;
+        std::string                            m_indexKey;
+        std::unique_ptr<PackageIndex>          m_index;
+        // GetFile may be called from multiple threads; it guards m_streams and the seek pointer of m_stream.
+        std::mutex                             m_streamsLock;
     };//class ZipObject
+
+    // Writes a .zip file front to back, so the output stream is never seeked or read. The crc and sizes of each
+    // file go in a data descriptor after its data. Zip64 structures are only written when they are needed.
+    class ZipObjectWriter final
+    {
+    public:
+        ZipObjectWriter(const ComPtr<IStream>& stream, bool forceZip32) : m_stream(stream), m_forceZip32(forceZip32) {}
+
+        // Writes the local file header of a new file and returns its size. expectedSize is the uncompressed size
+        // of the file, which decides whether the data descriptor needs 8 bytes sizes.
+        std::uint32_t BeginFile(const std::string& name, bool isCompressed, std::uint64_t expectedSize);
+        void WriteFileData(const std::uint8_t* data, std::size_t size);
+        void EndFile(std::uint32_t crc, std::uint64_t compressedSize, std::uint64_t uncompressedSize);
+        // Writes the central directory and the end of central directory records.
+        void Close();
+
+    protected:
+        typedef struct Entry
+        {
+            std::string   name;
+            bool          isCompressed;
+            bool          hasZip64LocalHeader;
+            std::uint32_t crc;
+            std::uint64_t compressedSize;
+            std::uint64_t uncompressedSize;
+            std::uint64_t offset;
+        } Entry;
+
+        void Write(const std::vector<std::uint8_t>& bytes) { Write(bytes.data(), bytes.size()); }
+        void Write(const std::uint8_t* data, std::size_t size);
+
+        ComPtr<IStream>    m_stream;
+        bool               m_forceZip32;
+        bool               m_isFileOpen = false;
+        std::uint64_t      m_position = 0;
+        std::vector<Entry> m_entries;
+    };//class ZipObjectWriter
+
+    // Reads a .zip file front to back using only IStream::Read, so it works over pipes and sockets. Files are
+    // returned in the order of their local file headers. The end of a file that has a data descriptor is found
+    // by inflating it or, if it is stored, by looking for a data descriptor that matches the data read so far.
+    class ZipObjectForwardOnlyReader final
+    {
+    public:
+        ZipObjectForwardOnlyReader(const ComPtr<IStream>& stream);
+        ~ZipObjectForwardOnlyReader();
+
+        // Moves to the next file. Once the local file headers end, the central directory is read and checked
+        // against the files that were read, and false is returned. The data of the current file must be read
+        // completely before moving to the next one.
+        bool NextFile(std::string& name, bool& isCompressed);
+        // Reads the uncompressed data of the current file, returns 0 at its end. The sizes are checked against
+        // the local file header or the data descriptor when the end is reached.
+        std::size_t ReadFileData(std::uint8_t* buffer, std::size_t size);
+        // Size of the current file in the zip, known once all its data was read.
+        std::uint64_t GetSizeOnZip() { return m_compressedRead; }
+
+    protected:
+        typedef struct Entry
+        {
+            std::string   name;
+            std::uint64_t compressedSize;
+            std::uint64_t uncompressedSize;
+        } Entry;
+
+        bool Fill(std::size_t size);
+        void Consume(std::size_t size) { m_bufferPosition += size; m_position += size; }
+        std::size_t GetAvailable() { return m_bufferEnd - m_bufferPosition; }
+        const std::uint8_t* Peek() { return m_buffer.data() + m_bufferPosition; }
+        template <class T>
+        T PeekValue(std::size_t offset)
+        {
+            T value;
+            std::memcpy(&value, Peek() + offset, sizeof(T));
+            return value;
+        }
+
+        std::size_t ReadCompressedData(std::uint8_t* buffer, std::size_t size);
+        std::size_t ReadStoredData(std::uint8_t* buffer, std::size_t size);
+        bool IsDataDescriptorNext();
+        void EndFile();
+        void ReadCentralDirectory();
+
+        ComPtr<IStream>                     m_stream;
+        std::vector<std::uint8_t>           m_buffer;
+        std::size_t                         m_bufferPosition = 0;
+        std::size_t                         m_bufferEnd = 0;
+        std::uint64_t                       m_position = 0;
+        std::unique_ptr<ICompressionObject> m_inflater;
+        // local file header offset -> file
+        std::map<std::uint64_t, Entry>      m_entries;
+
+        // State of the current file
+        std::unique_ptr<LocalFileHeader>    m_header;
+        std::uint64_t                       m_headerOffset = 0;
+        bool                                m_isFileOpen = false;
+        bool                                m_hasDataDescriptor = false;
+        bool                                m_hasZip64Sizes = false;
+        bool                                m_isInflating = false;
+        bool                                m_inflateEnded = false;
+        // Only known up front without a data descriptor
+        std::uint64_t                       m_expectedCompressedSize = 0;
+        std::uint64_t                       m_expectedUncompressedSize = 0;
+        std::uint64_t                       m_compressedRead = 0;
+        std::uint64_t                       m_uncompressedRead = 0;
+        std::uint32_t                       m_crc = 0;
+    };//class ZipObjectForwardOnlyReader
 }
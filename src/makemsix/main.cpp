@@ -85,6 +85,13 @@ struct State
         return true;
     }
 
+    bool SetPreviousDirectoryName(const std::string& name)
+    {
+        if (!previousDirectoryName.empty() || name.empty()) { return false; }
+        previousDirectoryName = name;
+        return true;
+    }
+
     bool Validate()
     {
         if (packageName.empty() || directoryName.empty()) {
@@ -96,6 +103,7 @@ struct State
     std::string packageName;
     std::string certName;
     std::string directoryName;
+    std::string previousDirectoryName;
     UserSpecified specified                  = UserSpecified::Nothing;
     MSIX_VALIDATION_OPTION validationOptions = MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL;
     MSIX_PACKUNPACK_OPTION unpackOptions     = MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE;
@@ -259,6 +267,22 @@ int ParseAndRun(std::vector<Command>& commands, int argc, char* argv[])
     case UserSpecified::Nothing:
         return Help(argv[0], commands, state);
     case UserSpecified::Unpack:
+        if (!state.previousDirectoryName.empty())
+        {
+            UINT64 bytesSaved = 0;
+            auto result = UnpackPackageDifferential(state.unpackOptions, state.validationOptions,
+                const_cast<char*>(state.packageName.c_str()),
+                const_cast<char*>(state.previousDirectoryName.c_str()),
+                nullptr,
+                const_cast<char*>(state.directoryName.c_str()),
+                &bytesSaved
+            );
+            if (result == 0)
+            {
+                std::cout << "Bytes not extracted, unchanged since the previous version: " << bytesSaved << std::endl;
+            }
+            return result;
+        }
         return UnpackPackage(state.unpackOptions, state.validationOptions,
             const_cast<char*>(state.packageName.c_str()),
             const_cast<char*>(state.directoryName.c_str())
@@ -302,6 +326,8 @@ int main(int argc, char* argv[])
                     [](State& state, const std::string& name) { return state.SetDirectoryName(name); }),
                 Option("-pfn", false, "Unpacks all files to a subdirectory under the specified output path, named after the package full name.",
                     [](State& state, const std::string&) {return state.CreatePackageSubfolder(); }),
+                Option("-prev", true, "Specify the directory where the previous version of the package is unpacked. Only the files that changed are extracted, the others are hard linked from it.",
+                    [](State& state, const std::string& name) { return state.SetPreviousDirectoryName(name); }),
                 Option("-mv", false, "Skips manifest validation.  By default manifest validation is enabled.",
                     [](State& state, const std::string&) { return state.SkipManifestValidation(); }),
                 Option("-sv", false, "Skips signature validation.  By default signature validation is enabled.",
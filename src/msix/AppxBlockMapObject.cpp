@@ -3,6 +3,7 @@
 //  See LICENSE file in the project root for full license information.
 // 
 #include "AppxBlockMapObject.hpp"
+#include "HashStream.hpp"
 #include <algorithm>
 #include <iterator>
 #include "IXml.hpp"
@@ -49,64 +50,189 @@ namespace MSIX {
         return result;
     }
 
+    // Adds the File elements of AppxBlockMap.xml and their Block elements to the blockmap, whether they come from a
+    // DOM or are read straight from the stream.
+    class BlockMapBuilder
+    {
+    public:
+        BlockMapBuilder(IMsixFactory* factory, BlockTable& blocks, std::map<std::string, BlockRange>& blockMap,
+            std::map<std::string, ComPtr<IAppxBlockMapFile>>& blockMapFiles) :
+            m_factory(factory), m_blocks(blocks), m_blockMap(blockMap), m_blockMapFiles(blockMapFiles)
+        {}
+
+        void StartFile(const ComPtr<IXmlElement>& fileNode)
+        {
+            m_name = fileNode->GetAttributeValue(XmlAttributeName::Name);
+            ThrowErrorIf(Error::BlockMapSemanticError, (m_name == "[Content_Types].xml"), "[Content_Types].xml cannot be in the AppxBlockMap.xml file");
+
+            std::ostringstream builder;
+            builder << "Duplicate file: '" << m_name << "' specified in AppxBlockMap.xml.";
+            ThrowErrorIf(Error::BlockMapSemanticError, (m_blockMap.find(m_name) != m_blockMap.end()), builder.str().c_str());
+
+            m_size = GetNumber<std::uint64_t>(fileNode, XmlAttributeName::Size, BLOCKMAP_BLOCK_SIZE);
+            m_localFileHeaderSize = GetNumber<std::uint32_t>(fileNode, XmlAttributeName::BlockMap_File_LocalFileHeaderSize, 0);
+            m_firstBlock = m_blocks.GetCount();
+        }
+
+        void AddBlock(const ComPtr<IXmlElement>& blockNode)
+        {
+            m_blocks.Add(GetBlock(blockNode, m_size));
+        }
+
+        void EndFile()
+        {
+            BlockRange blocks(&m_blocks, m_firstBlock, m_blocks.GetCount() - m_firstBlock);
+            ThrowErrorIf(Error::BlockMapSemanticError, (0 == blocks.GetCount() && 0 != m_size), "If size is non-zero, then there must be 1+ blocks.");
+
+            m_blockMap.insert(std::make_pair(m_name, blocks));
+            m_blockMapFiles.insert(std::make_pair(m_name,
+                ComPtr<IAppxBlockMapFile>::Make<AppxBlockMapFile>(
+                    m_factory,
+                    blocks,
+                    m_localFileHeaderSize,
+                    m_name,
+                    m_size
+                )));
+            m_countFilesFound++;
+        }
+
+        std::size_t GetFileCount() { return m_countFilesFound; }
+
+    protected:
+        IMsixFactory* m_factory;
+        BlockTable& m_blocks;
+        std::map<std::string, BlockRange>& m_blockMap;
+        std::map<std::string, ComPtr<IAppxBlockMapFile>>& m_blockMapFiles;
+        std::size_t m_countFilesFound = 0;
+
+        // The File element being read
+        std::string m_name;
+        std::uint64_t m_size = 0;
+        std::uint32_t m_localFileHeaderSize = 0;
+        std::size_t m_firstBlock = 0;
+    };
+
     AppxBlockMapObject::AppxBlockMapObject(IMsixFactory* factory, const ComPtr<IStream>& stream) : m_factory(factory), m_stream(stream)
     {
         ComPtr<IXmlFactory> xmlFactory;
         ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IXmlFactory>::iid, reinterpret_cast<void**>(&xmlFactory)));
-        auto dom = xmlFactory->CreateDomFromStream(XmlContentType::AppxBlockMapXml, stream);
+        BlockMapBuilder blockMapBuilder(factory, m_blocks, m_blockMap, m_blockMapFiles);
 
-        struct _context
+        // Read the blocks as the parser gets to them, instead of building a DOM of what can be a very large document.
+        struct _streamContext
         {
-            AppxBlockMapObject* self;
-            IMsixFactory*       factory;
-            size_t              countFilesFound;
-            IXmlDom*            dom;
+            BlockMapBuilder* builder;
+            std::size_t      depth;
+            bool             inBlockMap;
+            bool             inFile;
         };
-        _context context = { this, factory, 0, dom.Get() };
+        _streamContext streamContext = { &blockMapBuilder, 0, false, false };
+        XmlStreamVisitor streamVisitor(static_cast<void*>(&streamContext),
+            [](void* c, const std::string& name, const ComPtr<IXmlElement>& element)
+            {
+                _streamContext* context = reinterpret_cast<_streamContext*>(c);
+                // Same elements as the BlockMap_File and BlockMap_File_Block queries.
+                if (context->depth == 0)
+                {
+                    context->inBlockMap = (name == "BlockMap");
+                }
+                else if ((context->depth == 1) && context->inBlockMap && (name == "File"))
+                {
+                    context->inFile = true;
+                    context->builder->StartFile(element);
+                }
+                else if ((context->depth == 2) && context->inFile && (name == "Block"))
+                {
+                    context->builder->AddBlock(element);
+                }
+                context->depth++;
+            },
+            [](void* c, const std::string& name)
+            {
+                _streamContext* context = reinterpret_cast<_streamContext*>(c);
+                context->depth--;
+                if ((context->depth == 1) && context->inFile)
+                {
+                    context->inFile = false;
+                    context->builder->EndFile();
+                }
+            });
 
-        XmlVisitor visitor(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& fileNode)->bool
+        bool parsed = false;
+        try
         {
-            const auto& name = fileNode->GetAttributeValue(XmlAttributeName::Name);
-            ThrowErrorIf(Error::BlockMapSemanticError, (name == "[Content_Types].xml"), "[Content_Types].xml cannot be in the AppxBlockMap.xml file");
-
-            _context* context = reinterpret_cast<_context*>(c);
-            std::ostringstream builder;
-            builder << "Duplicate file: '" << name << "' specified in AppxBlockMap.xml.";
-            ThrowErrorIf(Error::BlockMapSemanticError, (context->self->m_blockMap.find(name) != context->self->m_blockMap.end()), builder.str().c_str());
+            parsed = xmlFactory->ParseFromStream(XmlContentType::AppxBlockMapXml, stream, streamVisitor);
+        }
+        catch (...)
+        {   // The parser only read part of the stream. If it comes from the signature, read the rest so a blockmap
+            // that doesn't match its digest fails for that rather than for what is wrong with it.
+            std::vector<std::uint8_t> buffer(BLOCKMAP_BLOCK_SIZE);
+            ULONG actualRead = 0;
+            do
+            {
+                ThrowHrIfFailed(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &actualRead));
+            } while (actualRead != 0);
+            throw;
+        }
 
-            std::uint64_t sizeAttribute = GetNumber<std::uint64_t>(fileNode, XmlAttributeName::Size, BLOCKMAP_BLOCK_SIZE);
+        if (!parsed)
+        {
+            auto dom = xmlFactory->CreateDomFromStream(XmlContentType::AppxBlockMapXml, stream);
 
-            std::vector<Block> blocks;
-            struct _contextBlock
+            struct _context
             {
-                std::vector<Block>* blocks;
-                std::uint64_t fallbackSize;
+                BlockMapBuilder* builder;
+                IXmlDom*         dom;
             };
-            _contextBlock contextBlock = { &blocks, sizeAttribute};
-            XmlVisitor visitor(static_cast<void*>(&contextBlock), [](void* c, const ComPtr<IXmlElement>& blockNode)->bool
+            _context context = { &blockMapBuilder, dom.Get() };
+
+            XmlVisitor visitor(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& fileNode)->bool
             {
-                _contextBlock* contextBlock = reinterpret_cast<_contextBlock*>(c);
-                contextBlock->blocks->push_back(GetBlock(blockNode, contextBlock->fallbackSize));
+                _context* context = reinterpret_cast<_context*>(c);
+                context->builder->StartFile(fileNode);
+                XmlVisitor visitor(static_cast<void*>(context->builder), [](void* c, const ComPtr<IXmlElement>& blockNode)->bool
+                {
+                    reinterpret_cast<BlockMapBuilder*>(c)->AddBlock(blockNode);
+                    return true;
+                });
+                context->dom->ForEachElementIn(fileNode, XmlQueryName::BlockMap_File_Block, visitor);
+                context->builder->EndFile();
                 return true;
             });
-            context->dom->ForEachElementIn(fileNode, XmlQueryName::BlockMap_File_Block, visitor);
+            dom->ForEachElementIn(dom->GetDocument(), XmlQueryName::BlockMap_File, visitor);
+        }
+        ThrowErrorIf(Error::XmlError, (0 == blockMapBuilder.GetFileCount()), "Empty AppxBlockMap.xml");
+    }
 
-            ThrowErrorIf(Error::BlockMapSemanticError, (0 == blocks.size() && 0 != sizeAttribute), "If size is non-zero, then there must be 1+ blocks.");
+    AppxBlockMapObject::AppxBlockMapObject(IMsixFactory* factory, const ComPtr<IStream>& stream,
+        const std::map<std::string, PackageIndex::BlockMapFile>& files) : m_factory(factory), m_stream(stream)
+    {
+        // The files were validated when the index was created, but the blockmap isn't parsed, so nothing reads the
+        // stream. If it is a validation stream from the signature, check the digest of AppxBlockMap.xml here.
+        ComPtr<IValidationStream> validationStream;
+        if (SUCCEEDED(m_stream->QueryInterface(UuidOfImpl<IValidationStream>::iid, reinterpret_cast<void**>(&validationStream))) && validationStream)
+        {
+            validationStream->Validate();
+        }
 
-            context->self->m_blockMap.insert(std::make_pair(name, std::move(blocks)));
-            context->self->m_blockMapFiles.insert(std::make_pair(name,
+        ThrowErrorIf(Error::XmlError, files.empty(), "Empty AppxBlockMap.xml");
+        for (const auto& file : files)
+        {
+            BlockRange blocks(&m_blocks, m_blocks.GetCount(), file.second.blocks.size());
+            for (const auto& block : file.second.blocks)
+            {
+                m_blocks.Add(block);
+            }
+            m_blockMap.insert(std::make_pair(file.first, blocks));
+            m_blockMapFiles.insert(std::make_pair(file.first,
                 ComPtr<IAppxBlockMapFile>::Make<AppxBlockMapFile>(
-                    context->factory,
-                    &(context->self->m_blockMap[name]),
-                    GetNumber<std::uint32_t>(fileNode, XmlAttributeName::BlockMap_File_LocalFileHeaderSize, 0),
-                    name,
-                    sizeAttribute
+                    factory,
+                    blocks,
+                    file.second.localFileHeaderSize,
+                    file.first,
+                    file.second.size
                 )));
-            context->countFilesFound++;
-            return true;
-        });
-        dom->ForEachElementIn(dom->GetDocument(), XmlQueryName::BlockMap_File, visitor);
-        ThrowErrorIf(Error::XmlError, (0 == context.countFilesFound), "Empty AppxBlockMap.xml");
+        }
     }
 
     // IVerifierObject
@@ -117,7 +243,9 @@ namespace MSIX {
         std::ostringstream builder;
         builder << "file: '" << part << "' not tracked by blockmap.";
         ThrowErrorIf(Error::BlockMapSemanticError, item == m_blockMap.end(), builder.str().c_str());
-        return ComPtr<IStream>::Make<BlockMapStream>(m_factory, part, stream, item->second);
+        // The stream refers to the blocks in m_blockMap, so it holds a reference to the blockmap.
+        return ComPtr<IStream>::Make<BlockMapStream>(m_factory, part, stream, item->second,
+            ComPtr<IAppxBlockMapReader>(static_cast<IAppxBlockMapReader*>(this)));
     }
 
     // IAppxBlockMapReader
@@ -168,7 +296,7 @@ namespace MSIX {
         return fileNames;
     }
 
-    std::vector<Block> AppxBlockMapObject::GetBlocks(const std::string& fileName)
+    BlockRange AppxBlockMapObject::GetBlocks(const std::string& fileName)
     {
         auto index = m_blockMap.find(fileName);
         ThrowErrorIf(Error::FileNotFound, (index == m_blockMap.end()), "File not in blockmap");
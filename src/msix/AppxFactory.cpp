@@ -7,6 +7,7 @@
 #include "Exceptions.hpp"
 #include "ZipObject.hpp"
 #include "AppxPackageObject.hpp"
+#include "AppxPackageWriter.hpp"
 #include "MSIXResource.hpp"
 #include "VectorStream.hpp"
 
@@ -14,11 +15,19 @@ namespace MSIX {
     // IAppxFactory
     HRESULT STDMETHODCALLTYPE AppxFactory::CreatePackageWriter (
         IStream* outputStream,
-        APPX_PACKAGE_SETTINGS* ,//settings, TODO: plumb this through
-        IAppxPackageWriter** packageWriter) noexcept
+        APPX_PACKAGE_SETTINGS* settings,
+        IAppxPackageWriter** packageWriter) noexcept try
     {
-        return static_cast<HRESULT>(Error::NotImplemented);
-    }
+        ThrowErrorIf(Error::InvalidParameter, (outputStream == nullptr || settings == nullptr ||
+            packageWriter == nullptr || *packageWriter != nullptr), "Invalid parameter");
+        // Blocks are always hashed with SHA256, which is the only hash method we read. settings->hashMethod is ignored.
+        ComPtr<IMsixFactory> self;
+        ThrowHrIfFailed(QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&self)));
+        ComPtr<IStream> output(outputStream);
+        auto result = ComPtr<IAppxPackageWriter>::Make<AppxPackageWriter>(self.Get(), output, settings->forceZip32 != FALSE);
+        *packageWriter = result.Detach();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
 
     HRESULT STDMETHODCALLTYPE AppxFactory::CreatePackageReader (
         IStream* inputStream,
@@ -182,6 +191,18 @@ namespace MSIX {
         {
             ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixApplicabilityLanguagesEnumerator>::iid, reinterpret_cast<void**>(&m_applicabilityLanguagesEnumerator)));
         }
+        else if (name == MSIX_FACTORY_EXTENSION_INDEX_CACHE)
+        {
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixIndexCache>::iid, reinterpret_cast<void**>(&m_indexCache)));
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_BLOCK_CACHE)
+        {
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixBlockCache>::iid, reinterpret_cast<void**>(&m_blockCache)));
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_WORK_COUNTER)
+        {
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixWorkCounter>::iid, reinterpret_cast<void**>(&m_workCounter)));
+        }
         else
         {
             return static_cast<HRESULT>(Error::InvalidParameter);
@@ -208,6 +229,27 @@ namespace MSIX {
                 *extension = m_applicabilityLanguagesEnumerator.As<IUnknown>().Detach();
             }
         }
+        else if (name == MSIX_FACTORY_EXTENSION_INDEX_CACHE)
+        {
+            if (m_indexCache.Get() != nullptr)
+            {
+                *extension = m_indexCache.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_BLOCK_CACHE)
+        {
+            if (m_blockCache.Get() != nullptr)
+            {
+                *extension = m_blockCache.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_WORK_COUNTER)
+        {
+            if (m_workCounter.Get() != nullptr)
+            {
+                *extension = m_workCounter.As<IUnknown>().Detach();
+            }
+        }
         else
         {
             return static_cast<HRESULT>(Error::InvalidParameter);
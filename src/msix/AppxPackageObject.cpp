@@ -15,6 +15,11 @@
 #include "Encoding.hpp"
 #include "Enumerators.hpp"
 #include "AppxFile.hpp"
+#include "PackageIndex.hpp"
+#include "BlockMapStream.hpp"
+#include "HashStream.hpp"
+#include "ThreadPool.hpp"
+#include "WorkCounter.hpp"
 
 #ifdef BUNDLE_SUPPORT
 #include "Applicability.hpp"
@@ -24,10 +29,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <unordered_set>
 #include <memory>
 #include <limits>
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <cstring>
 
 namespace MSIX {
 
@@ -70,6 +81,19 @@ namespace MSIX {
         }
         m_appxSignature = ComPtr<IVerifierObject>::Make<AppxSignatureObject>(factory, validation, file);
 
+        // The central directory was read to open the container, so its digest is checked right away. The digest of
+        // the file records is checked by Unpack and Verify, which read them anyway.
+        auto archiveVerifier = m_appxSignature.As<IArchiveVerifierObject>();
+        ComPtr<ISignedZipArchive> signedArchive;
+        if (archiveVerifier->HasArchiveDigests() &&
+            SUCCEEDED(m_container->QueryInterface(UuidOfImpl<ISignedZipArchive>::iid, reinterpret_cast<void**>(&signedArchive))) && signedArchive)
+        {
+            std::vector<std::uint8_t> centralDirectory;
+            m_endOfFileRecords = signedArchive->GetCentralDirectoryDigest(APPXSIGNATURE_P7X, centralDirectory);
+            archiveVerifier->ValidateCentralDirectoryDigest(centralDirectory);
+            m_signedArchive = signedArchive;
+        }
+
         // 2. Get content type using signature object for validation
         file = m_container->GetFile(CONTENT_TYPES_XML);
         ThrowErrorIfNot(Error::MissingContentTypesXML, file, "[Content_Types].xml not in archive!");
@@ -80,7 +104,17 @@ namespace MSIX {
         file = m_container->GetFile(APPXBLOCKMAP_XML);
         ThrowErrorIfNot(Error::MissingAppxBlockMapXML, file, "AppxBlockMap.xml not in archive!");
         stream = m_appxSignature->GetValidationStream(APPXBLOCKMAP_XML, file);
-        m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, stream);
+        ComPtr<IPackageIndexProvider> indexProvider;
+        if (SUCCEEDED(m_container->QueryInterface(UuidOfImpl<IPackageIndexProvider>::iid, reinterpret_cast<void**>(&indexProvider))) &&
+            indexProvider->GetIndex() != nullptr)
+        {   // The package was opened before, don't parse the blockmap again. This constructor doesn't read the
+            // stream, the signature's digest of AppxBlockMap.xml is still checked because it validates it explicitly.
+            m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, stream, indexProvider->GetIndex()->GetBlockMapFiles());
+        }
+        else
+        {
+            m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, stream);
+        }
 
         // 4. Get manifest object using blockmap object for validation
         // TODO: pass validation flags and other necessary goodness through.
@@ -187,14 +221,19 @@ namespace MSIX {
 
         // 5. Ensure that the stream collection contains streams wired up for their appropriate validation
         // and partition the container's file names into footprint and payload files.  First by going through
-        // the footprint files, and then by going through the payload files.
-        auto filesToProcess = m_container->GetFileNames(FileNameOptions::All);
+        // the footprint files, and then by going through the payload files. Each file is removed from the set
+        // as it is claimed, so this stays linear in the number of files in the container.
+        auto containerFiles = m_container->GetFileNames(FileNameOptions::All);
+        std::unordered_set<std::string> filesToProcess(containerFiles.begin(), containerFiles.end());
+        std::uint64_t packageFiles = 0; // names looked up and files added, for the factory's work counter
         for (const auto& fileName : m_container->GetFileNames(FileNameOptions::FootPrintOnly))
-        {   auto footPrintFile = std::find(std::begin(footPrintFileNames), std::end(footPrintFileNames), fileName);
+        {   packageFiles++;
+            auto footPrintFile = std::find(std::begin(footPrintFileNames), std::end(footPrintFileNames), fileName);
             if (footPrintFile != std::end(footPrintFileNames))
             {
                 if (fileName != CONTENT_TYPES_XML)
                 {
+                    packageFiles++;
                     auto stream = footPrintFile->GetValidationStream(this);
                     if (fileName == CODEINTEGRITY_CAT)
                     {
@@ -209,7 +248,7 @@ namespace MSIX {
                         m_files[fileName] = MSIX::ComPtr<IAppxFile>::Make<MSIX::AppxFile>(m_factory.Get(), fileName, std::move(stream));;
                     }
                 }
-                filesToProcess.erase(std::remove(filesToProcess.begin(), filesToProcess.end(), fileName), filesToProcess.end());
+                filesToProcess.erase(fileName);
             }
         }
 
@@ -335,6 +374,7 @@ namespace MSIX {
                     packageType, bundleInfoInternal->HasQualifiedResources());
 
                 m_files[packageName] = ComPtr<IAppxFile>::Make<MSIX::AppxFile>(m_factory.Get(), packageName, std::move(packageStream));
+                packageFiles++;
                 // Intentionally don't remove from fileToProcess. For bundles, it is possible to don't unpack packages, like
                 // resource packages that are not languages packages.
             }
@@ -345,7 +385,8 @@ namespace MSIX {
         {
 #endif // BUNDLE_SUPPORT
             for (const auto& fileName : blockMapFiles)
-            {   auto footPrintFile = std::find(std::begin(footPrintFileNames), std::end(footPrintFileNames), fileName);
+            {   packageFiles++;
+                auto footPrintFile = std::find(std::begin(footPrintFileNames), std::end(footPrintFileNames), fileName);
                 if (footPrintFile == std::end(footPrintFileNames))
                 {
                     auto opcFileName = Encoding::EncodeFileName(fileName);
@@ -355,7 +396,8 @@ namespace MSIX {
                     VerifyFile(fileStream, fileName, blockMapInternal);
                     auto blockMapStream = m_appxBlockMap->GetValidationStream(fileName, fileStream);
                     m_files[opcFileName] = MSIX::ComPtr<IAppxFile>::Make<MSIX::AppxFile>(m_factory.Get(), fileName, std::move(blockMapStream));
-                    filesToProcess.erase(std::remove(filesToProcess.begin(), filesToProcess.end(), opcFileName), filesToProcess.end());
+                    filesToProcess.erase(opcFileName);
+                    packageFiles++;
                 }
             }
 
@@ -365,23 +407,52 @@ namespace MSIX {
 #ifdef BUNDLE_SUPPORT
         }
 #endif
+        WorkCounter(m_factory.Get()).Add(MSIX_WORK_COUNTER_PACKAGE_FILES, packageFiles);
+
+        // 6. The package is valid. If the factory has an index cache and this is the first time the package is
+        // opened store an index for it, so it opens faster next time.
+        if (indexProvider && indexProvider->GetIndex() == nullptr)
+        {
+            std::map<std::string, PackageIndex::BlockMapFile> indexFiles;
+            for (const auto& fileName : blockMapFiles)
+            {
+                auto blockMapFile = blockMapInternal->GetFile(fileName);
+                PackageIndex::BlockMapFile indexFile;
+                UINT32 lfhSize = 0;
+                UINT64 size = 0;
+                ThrowHrIfFailed(blockMapFile->GetLocalFileHeaderSize(&lfhSize));
+                ThrowHrIfFailed(blockMapFile->GetUncompressedSize(&size));
+                indexFile.localFileHeaderSize = lfhSize;
+                indexFile.size = size;
+                auto blocks = blockMapInternal->GetBlocks(fileName);
+                indexFile.blocks.reserve(blocks.GetCount());
+                for (std::size_t i = 0; i < blocks.GetCount(); i++)
+                {
+                    indexFile.blocks.push_back(blocks.GetBlock(i));
+                }
+                indexFiles.insert(std::make_pair(fileName, std::move(indexFile)));
+            }
+            indexProvider->SaveIndex(std::move(indexFiles));
+        }
     }
 
     // Verify file in OPC and BlockMap
     void AppxPackageObject::VerifyFile(const ComPtr<IStream>& stream, const std::string& fileName, const ComPtr<IAppxBlockMapInternal>& blockMapInternal)
     {
         auto zipStream = stream.As<IStreamInternal>();
-        auto sizeOnZip = zipStream->GetSizeOnZip();
-        bool isCompressed = zipStream->IsCompressed();
+        VerifyFile(zipStream->IsCompressed(), zipStream->GetSizeOnZip(), fileName, blockMapInternal);
+    }
 
+    void AppxPackageObject::VerifyFile(bool isCompressed, std::uint64_t sizeOnZip, const std::string& fileName, const ComPtr<IAppxBlockMapInternal>& blockMapInternal)
+    {
         auto blocks = blockMapInternal->GetBlocks(fileName);
         std::uint64_t blocksSize = 0;
-        for(auto& block : blocks)
+        for (std::size_t i = 0; i < blocks.GetCount(); i++)
         {   // For Block elements that don't have a Size attribute, we always set its size as BLOCKMAP_BLOCK_SIZE
             // (even for the last one). The Size attribute isn't specified if the file is not compressed.
-            ThrowErrorIf(Error::BlockMapSemanticError, (!isCompressed) && (block.blockSize != BLOCKMAP_BLOCK_SIZE),
+            ThrowErrorIf(Error::BlockMapSemanticError, (!isCompressed) && (blocks.GetBlockSize(i) != BLOCKMAP_BLOCK_SIZE),
                 "An uncompressed file has a size attribute in its Block elements");
-            blocksSize += block.blockSize;
+            blocksSize += blocks.GetBlockSize(i);
         }
 
         if(isCompressed)
@@ -415,48 +486,295 @@ namespace MSIX {
         }
     }
 
+    static void CopyStream(const ComPtr<IStream>& source, const ComPtr<IStream>& target)
+    {
+        ULARGE_INTEGER bytesCount = {0};
+        bytesCount.QuadPart = std::numeric_limits<std::uint64_t>::max();
+        ThrowHrIfFailed(source->CopyTo(target.Get(), bytesCount, nullptr, nullptr));
+    }
+
+    std::string AppxPackageObject::GetUnpackTargetName(MSIX_PACKUNPACK_OPTION options, const std::string& fileName)
+    {
+        if (options & MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER)
+        {   // Don't use to->GetPathSeparator(). DirectoryObject::OpenFile created directories
+            // by looking at "/" in the string. If to->GetPathSeparator() is used the subfolder with
+            // the package full name won't be created on Windows, but it will on other platforms.
+            // This means that we have different behaviors in non-Win platforms.
+            auto manifest = m_appxManifest.As<IAppxManifestReader>();
+            ComPtr<IAppxManifestPackageId> packageId;
+            ThrowHrIfFailed(manifest->GetPackageId(&packageId));
+            return packageId.As<IAppxManifestPackageIdInternal>()->GetPackageFullName() + "/" + fileName;
+        }
+        return Encoding::DecodeFileName(fileName);
+    }
+
     void AppxPackageObject::Unpack(MSIX_PACKUNPACK_OPTION options, const ComPtr<IStorageObject>& to)
     {
         auto fileNames = GetFileNames(FileNameOptions::All);
-        for (const auto& fileName : fileNames)
-        {   // Don't extract packages files
-            auto file = std::find(std::begin(m_applicablePackagesNames), std::end(m_applicablePackagesNames), fileName);
-            if (file == std::end(m_applicablePackagesNames))
-            {
-                std::string targetName;
-                if (options & MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER)
-                {   // Don't use to->GetPathSeparator(). DirectoryObject::OpenFile created directories
-                    // by looking at "/" in the string. If to->GetPathSeparator() is used the subfolder with
-                    // the package full name won't be created on Windows, but it will on other platforms.
-                    // This means that we have different behaviors in non-Win platforms.
-                    auto manifest = m_appxManifest.As<IAppxManifestReader>();
-                    ComPtr<IAppxManifestPackageId> packageId;
-                    ThrowHrIfFailed(manifest->GetPackageId(&packageId));
-                    targetName = packageId.As<IAppxManifestPackageIdInternal>()->GetPackageFullName() + "/" + fileName;
+        auto UnpackFiles = [&]()
+        {
+            for (const auto& fileName : fileNames)
+            {   // Don't extract packages files
+                auto file = std::find(std::begin(m_applicablePackagesNames), std::end(m_applicablePackagesNames), fileName);
+                if (file == std::end(m_applicablePackagesNames))
+                {
+                    auto stream = GetFile(fileName).As<IStream>();
+                    ValidateStream(stream);
+                    auto targetFile = to->OpenFile(GetUnpackTargetName(options, fileName), MSIX::FileStream::Mode::WRITE_UPDATE);
+                    CopyStream(stream, targetFile);
                 }
-                else
-                {   targetName = Encoding::DecodeFileName(fileName);
+            }
+
+#ifdef BUNDLE_SUPPORT
+            if(m_isBundle)
+            {
+                for(const auto& appx : m_applicablePackages)
+                {
+                    appx.As<IPackage>()->Unpack(
+                        static_cast<MSIX_PACKUNPACK_OPTION>(options | MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER), to.Get());
                 }
+            }
+#endif
+        };
+
+        if (!m_signedArchive)
+        {
+            UnpackFiles();
+            return;
+        }
+        // The files are unpacked in the order of their records, so the signature's digest of the file records is
+        // computed from the same reads. It is checked once all of them are written.
+        m_signedArchive->SortByFileRecords(fileNames);
+        std::vector<std::uint8_t> fileRecords;
+        m_signedArchive->GetFileRecordsDigest(m_endOfFileRecords, fileRecords, UnpackFiles);
+        m_appxSignature.As<IArchiveVerifierObject>()->ValidateFileRecordsDigest(fileRecords);
+    }
+
+    // A file with the same size and block hashes in both blockmaps has the same content.
+    static bool HasSameBlocks(const ComPtr<IAppxBlockMapInternal>& blockMap, const ComPtr<IAppxBlockMapInternal>& previousBlockMap,
+        const std::string& name)
+    {
+        UINT64 size = 0;
+        UINT64 previousSize = 0;
+        ThrowHrIfFailed(blockMap->GetFile(name)->GetUncompressedSize(&size));
+        ThrowHrIfFailed(previousBlockMap->GetFile(name)->GetUncompressedSize(&previousSize));
+        auto blocks = blockMap->GetBlocks(name);
+        auto previousBlocks = previousBlockMap->GetBlocks(name);
+        if ((size != previousSize) || (blocks.GetCount() != previousBlocks.GetCount())) { return false; }
+        for (std::size_t i = 0; i < blocks.GetCount(); i++)
+        {
+            if (std::memcmp(blocks.GetHash(i), previousBlocks.GetHash(i), BLOCKMAP_HASH_SIZE) != 0) { return false; }
+        }
+        return true;
+    }
 
-                auto targetFile = to->OpenFile(targetName, MSIX::FileStream::Mode::WRITE_UPDATE);
-                auto sourceFile = GetFile(fileName).As<IStream>();
+    std::uint64_t AppxPackageObject::UnpackDifferential(MSIX_PACKUNPACK_OPTION options, const ComPtr<IStream>& previousBlockMap,
+        const ComPtr<DirectoryObject>& previous, const ComPtr<DirectoryObject>& to)
+    {
+        ThrowErrorIf(Error::NotSupported, m_isBundle, "Differential unpack of bundles is not supported");
+
+        // The previous blockmap is parsed as it's created, before unpacking in place replaces it. Its files are
+        // trusted to be the ones on disk, only their sizes are checked.
+        auto previousBlockMapInternal = ComPtr<IAppxBlockMapReader>::Make<AppxBlockMapObject>(m_factory.Get(), previousBlockMap).As<IAppxBlockMapInternal>();
+        auto blockMapInternal = m_appxBlockMap.As<IAppxBlockMapInternal>();
+        auto previousFiles = previousBlockMapInternal->GetFileNames();
+        std::set<std::string> previousNames(previousFiles.begin(), previousFiles.end());
+        std::map<std::string, std::string> blockMapNames;
+        for (const auto& name : blockMapInternal->GetFileNames())
+        {
+            blockMapNames[Encoding::EncodeFileName(name)] = name;
+        }
 
-                ULARGE_INTEGER bytesCount = {0};
-                bytesCount.QuadPart = std::numeric_limits<std::uint64_t>::max();
-                ThrowHrIfFailed(sourceFile->CopyTo(targetFile.Get(), bytesCount, nullptr, nullptr));
+        bool inPlace = (previous.Get() == to.Get()) && !(options & MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER);
+        // A file that an earlier differential unpack linked shares its content with the version it was linked from.
+        // It is removed and written as a new file, rewriting it would change that version too.
+        auto OpenNewFile = [&to](const std::string& name)
+        {
+            to->RemoveFile(name);
+            return to->OpenFile(name, MSIX::FileStream::Mode::WRITE_UPDATE);
+        };
+        std::uint64_t bytesSaved = 0;
+        for (const auto& fileName : GetFileNames(FileNameOptions::All))
+        {
+            auto targetName = GetUnpackTargetName(options, fileName);
+            auto previousName = Encoding::DecodeFileName(fileName);
+            auto blockMapName = blockMapNames.find(fileName);
+            std::uint64_t previousSize = 0;
+            if ((blockMapName != blockMapNames.end()) && (previousNames.count(blockMapName->second) != 0) &&
+                HasSameBlocks(blockMapInternal, previousBlockMapInternal, blockMapName->second) &&
+                previous->GetFileSize(previousName, previousSize))
+            {
+                UINT64 size = 0;
+                ThrowHrIfFailed(blockMapInternal->GetFile(blockMapName->second)->GetUncompressedSize(&size));
+                if (previousSize == size)
+                {
+                    if (!inPlace && !to->LinkFile(targetName, *previous.Get(), previousName))
+                    {
+                        auto targetFile = OpenNewFile(targetName);
+                        CopyStream(previous->OpenFile(previousName, MSIX::FileStream::Mode::READ), targetFile);
+                    }
+                    bytesSaved += size;
+                    continue;
+                }
+            }
+            auto stream = GetFile(fileName).As<IStream>();
+            ValidateStream(stream);
+            auto targetFile = OpenNewFile(targetName);
+            CopyStream(stream, targetFile);
+        }
+
+        // Files that are not in the new version anymore are removed from it.
+        if (inPlace)
+        {
+            for (const auto& name : previousFiles)
+            {
+                auto fileName = Encoding::EncodeFileName(name);
+                if (blockMapNames.find(fileName) == blockMapNames.end())
+                {
+                    previous->RemoveFile(Encoding::DecodeFileName(fileName));
+                }
             }
         }
+        return bytesSaved;
+    }
+
+    // Blocks that are read and being checked ahead of the one waited for, per thread. Stored blocks are checked
+    // several at a time, so this is enough for a couple of those checks.
+    static const std::size_t BlocksInFlightPerThread = 32;
+
+    struct PendingBlockCheck
+    {
+        std::size_t file;
+        std::size_t block;
+        std::size_t count;
+        std::future<std::size_t> checked;
+    };
+
+    static HRESULT WaitForBlockCheck(PendingBlockCheck& pending, IBlockMapStreamInternal* stream, std::uint64_t& failedBlock) noexcept try
+    {   // Blocks that didn't match or can't be checked on their own are checked here, in order.
+        failedBlock = pending.block;
+        for (failedBlock += pending.checked.get(); failedBlock < pending.block + pending.count; failedBlock++)
+        {
+            stream->CheckBlock(static_cast<std::size_t>(failedBlock));
+        }
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    void AppxPackageObject::Verify(const std::function<void(const std::string& fileName, HRESULT result, std::uint64_t failedBlock)>& callback)
+    {
+        // The digest of the zip file records covers all of the archive but the signature and the central directory,
+        // whose digest was checked on open. It is checked before the blocks.
+        if (m_signedArchive)
+        {
+            std::vector<std::uint8_t> fileRecords;
+            m_signedArchive->GetFileRecordsDigest(m_endOfFileRecords, fileRecords, nullptr);
+            m_appxSignature.As<IArchiveVerifierObject>()->ValidateFileRecordsDigest(fileRecords);
+        }
 
 #ifdef BUNDLE_SUPPORT
-        if(m_isBundle)
+        if (m_isBundle)
         {
-            for(const auto& appx : m_applicablePackages)
+            for (std::size_t i = 0; i < m_applicablePackages.size(); i++)
             {
-                appx.As<IPackage>()->Unpack(
-                    static_cast<MSIX_PACKUNPACK_OPTION>(options | MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER), to.Get());
+                const auto& packageName = m_applicablePackagesNames[i];
+                m_applicablePackages[i].As<IPackage>()->Verify(
+                    [&](const std::string& fileName, HRESULT result, std::uint64_t failedBlock)
+                    {
+                        callback(packageName + "/" + fileName, result, failedBlock);
+                    });
             }
+            return;
         }
 #endif
+        // The blocks of all the files go through the same thread pool, so small files don't leave it idle. Files are
+        // reported as soon as all their blocks and the files before them are checked.
+        std::vector<ComPtr<IBlockMapStreamInternal>> streams;
+        std::vector<std::size_t> blocksLeft;
+        std::size_t reported = 0;
+        auto ReportCheckedFiles = [&]()
+        {
+            while ((reported < streams.size()) && (blocksLeft[reported] == 0))
+            {
+                callback(Encoding::DecodeFileName(m_payloadFiles[reported]), static_cast<HRESULT>(Error::OK), 0);
+                reported++;
+            }
+        };
+
+        // Blocks still queued when a check fails are skipped. The thread pool is declared after what its tasks use,
+        // so it is done with them before they go away.
+        std::atomic<bool> stop(false);
+        ThreadPool threadPool;
+        std::deque<PendingBlockCheck> pending;
+        std::size_t blocksInFlight = 0;
+        HRESULT result = static_cast<HRESULT>(Error::OK);
+        std::size_t failedFile = 0;
+        std::uint64_t failedBlock = 0;
+        auto WaitForOldest = [&]()
+        {
+            auto oldest = std::move(pending.front());
+            pending.pop_front();
+            blocksInFlight -= oldest.count;
+            result = WaitForBlockCheck(oldest, streams[oldest.file].Get(), failedBlock);
+            if (FAILED(result))
+            {
+                stop = true;
+                failedFile = oldest.file;
+                return;
+            }
+            blocksLeft[oldest.file] -= oldest.count;
+            ReportCheckedFiles();
+        };
+
+        for (std::size_t file = 0; (file < m_payloadFiles.size()) && SUCCEEDED(result); file++)
+        {
+            auto stream = GetFile(m_payloadFiles[file]).As<IBlockMapStreamInternal>();
+            std::size_t blockCount = stream->GetBlockCount();
+            streams.push_back(stream);
+            blocksLeft.push_back(blockCount);
+            ReportCheckedFiles();
+            for (std::size_t block = 0; (block < blockCount) && SUCCEEDED(result); block += pending.back().count)
+            {
+                while ((blocksInFlight >= threadPool.GetThreadCount() * BlocksInFlightPerThread) && SUCCEEDED(result))
+                {
+                    WaitForOldest();
+                }
+                if (FAILED(result)) { break; }
+
+                PendingBlockCheck check { file, block, blockCount - block, std::future<std::size_t>() };
+                try
+                {   // The blocks are read here, the package stream might not be safe to read from other threads.
+                    auto task = stream->GetBlockCheck(block, check.count);
+                    if (task)
+                    {
+                        check.checked = threadPool.Submit([task, &stop]() { return stop ? 0 : task(); });
+                    }
+                    else
+                    {
+                        std::promise<std::size_t> inOrder;
+                        inOrder.set_value(0);
+                        check.checked = inOrder.get_future();
+                    }
+                }
+                catch (...)
+                {   // Blocks that can't be read fail when their turn comes, like ones that don't match.
+                    std::promise<std::size_t> unreadable;
+                    unreadable.set_exception(std::current_exception());
+                    check.checked = unreadable.get_future();
+                }
+                blocksInFlight += check.count;
+                pending.push_back(std::move(check));
+            }
+        }
+        while (!pending.empty() && SUCCEEDED(result))
+        {
+            WaitForOldest();
+        }
+
+        if (FAILED(result))
+        {
+            callback(Encoding::DecodeFileName(m_payloadFiles[failedFile]), result, failedBlock);
+            ThrowHrIfFailed(result);
+        }
     }
 
     // IStorageObject
@@ -0,0 +1,314 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "AppxPackageWriter.hpp"
+#include "AppxManifestObject.hpp"
+#include "VectorStream.hpp"
+#include "UnicodeConversion.hpp"
+#include "Encoding.hpp"
+#include "Exceptions.hpp"
+#include "SHA256.hpp"
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <future>
+#include <sstream>
+
+namespace MSIX {
+
+    #define APPXBLOCKMAP_XML       "AppxBlockMap.xml"
+    #define APPXMANIFEST_XML       "AppxManifest.xml"
+    #define CONTENT_TYPES_XML      "[Content_Types].xml"
+
+    // Files that are written by the package writer or by signing, they can't be payload files.
+    static const std::array<const char*, 5> reservedFileNames =
+    {   "appxmanifest.xml",
+        "appxblockmap.xml",
+        "appxsignature.p7x",
+        "[content_types].xml",
+        "appxmetadata\\codeintegrity.cat",
+    };
+
+    // What Z_FINISH produces after a full flush: an empty, final, fixed huffman block. These are the 2 extra bytes
+    // AppxPackageObject::VerifyFile allows after the compressed blocks.
+    static const std::uint8_t deflateEndOfStream[] = { 0x03, 0x00 };
+
+    static std::string ToLower(std::string value)
+    {
+        std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return value;
+    }
+
+    static std::string EscapeXml(const std::string& value)
+    {
+        std::string result;
+        result.reserve(value.size());
+        for (auto c : value)
+        {
+            switch (c)
+            {
+                case '&':  result += "&amp;";  break;
+                case '<':  result += "&lt;";   break;
+                case '>':  result += "&gt;";   break;
+                case '"':  result += "&quot;"; break;
+                case '\'': result += "&apos;"; break;
+                default:   result.push_back(c); break;
+            }
+        }
+        return result;
+    }
+
+    AppxPackageWriter::AppxPackageWriter(IMsixFactory* factory, const ComPtr<IStream>& outputStream, bool forceZip32) :
+        m_factory(factory), m_zip(std::make_unique<ZipObjectWriter>(outputStream, forceZip32))
+    {
+    }
+
+    // IAppxPackageWriter
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::AddPayloadFile(LPCWSTR fileName, LPCWSTR contentType,
+        APPX_COMPRESSION_OPTION compressionOption, IStream* inputStream) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (fileName == nullptr || *fileName == L'\0' || contentType == nullptr ||
+            *contentType == L'\0' || inputStream == nullptr), "bad pointer");
+        ThrowErrorIf(Error::InvalidParameter, (compressionOption < APPX_COMPRESSION_OPTION_NONE ||
+            compressionOption > APPX_COMPRESSION_OPTION_SUPERFAST), "invalid compression option");
+        ThrowErrorIfNot(Error::InvalidState, (m_state == WriterState::Open), "package writer is closed or failed");
+
+        // Names in the blockmap use '\' as separator
+        auto name = wstring_to_utf8(fileName);
+        std::replace(name.begin(), name.end(), '/', '\\');
+        ThrowErrorIf(Error::InvalidParameter, (name.front() == '\\' || name.back() == '\\'), "invalid file name");
+        auto lowerName = ToLower(name);
+        ThrowErrorIf(Error::InvalidParameter,
+            std::find(reservedFileNames.begin(), reservedFileNames.end(), lowerName) != reservedFileNames.end(),
+            "file name is reserved for a footprint file");
+
+        // Anything that fails from here on leaves a partially written package behind
+        m_state = WriterState::Failed;
+        // All the compression levels deflate the same way, what matters is that every block is flushed.
+        auto zipName = Encoding::EncodeFileName(name);
+        m_blockMapFiles.push_back(AddFile(name, zipName, (compressionOption != APPX_COMPRESSION_OPTION_NONE), inputStream));
+        AddContentType(zipName, wstring_to_utf8(contentType));
+        m_state = WriterState::Open;
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::Close(IStream* manifest) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (manifest == nullptr), "bad pointer");
+        ThrowErrorIfNot(Error::InvalidState, (m_state == WriterState::Open), "package writer is closed or failed");
+
+        // Make sure the manifest is valid before writing it
+        ComPtr<IStream> manifestStream(manifest);
+        auto manifestObject = ComPtr<IAppxManifestReader>::Make<AppxManifestObject>(m_factory.Get(), manifestStream);
+        LARGE_INTEGER start = { 0 };
+        ThrowHrIfFailed(manifestStream->Seek(start, StreamBase::Reference::START, nullptr));
+
+        m_state = WriterState::Failed;
+        m_blockMapFiles.push_back(AddFile(APPXMANIFEST_XML, APPXMANIFEST_XML, true, manifestStream));
+        m_overrideContentTypes["/" APPXMANIFEST_XML] = "application/vnd.ms-appx.manifest+xml";
+
+        // The blockmap describes every file written so far, the content types also cover the blockmap itself.
+        auto blockMap = GetBlockMapXml();
+        std::vector<std::uint8_t> blockMapBytes(blockMap.begin(), blockMap.end());
+        AddFile(APPXBLOCKMAP_XML, APPXBLOCKMAP_XML, true, ComPtr<IStream>::Make<VectorStream>(&blockMapBytes));
+        m_overrideContentTypes["/" APPXBLOCKMAP_XML] = "application/vnd.ms-appx.blockmap+xml";
+
+        auto contentTypes = GetContentTypesXml();
+        std::vector<std::uint8_t> contentTypesBytes(contentTypes.begin(), contentTypes.end());
+        AddFile(CONTENT_TYPES_XML, CONTENT_TYPES_XML, true, ComPtr<IStream>::Make<VectorStream>(&contentTypesBytes));
+
+        m_zip->Close();
+        m_state = WriterState::Closed;
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    AppxPackageWriter::BlockMapFile AppxPackageWriter::AddFile(const std::string& name, const std::string& zipName, bool isCompressed, const ComPtr<IStream>& stream)
+    {
+        ThrowErrorIfNot(Error::InvalidParameter, m_fileNames.insert(ToLower(zipName)).second, "duplicate file name");
+
+        // The size is only used to choose the format of the local file header, what gets read is what's written.
+        LARGE_INTEGER zero = { 0 };
+        ULARGE_INTEGER size = { 0 };
+        ThrowHrIfFailed(stream->Seek(zero, StreamBase::Reference::END, &size));
+        ThrowHrIfFailed(stream->Seek(zero, StreamBase::Reference::START, nullptr));
+
+        BlockMapFile result;
+        result.name = name;
+        result.size = 0;
+        result.isCompressed = isCompressed;
+        result.localFileHeaderSize = m_zip->BeginFile(zipName, isCompressed, size.QuadPart);
+
+        // Blocks are read and written here in order, while the thread pool hashes and deflates the blocks ahead.
+        std::deque<std::future<ProcessedBlock>> pending;
+        const std::size_t maxPending = 2 * m_threadPool.GetThreadCount();
+        std::uint32_t crc = 0;
+        std::uint64_t sizeOnZip = 0;
+        bool endOfStream = false;
+        while (!endOfStream || !pending.empty())
+        {
+            while (!endOfStream && pending.size() < maxPending)
+            {
+                std::vector<std::uint8_t> data(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+                ULONG dataSize = 0;
+                ULONG bytesRead = 0;
+                do
+                {
+                    ThrowHrIfFailed(stream->Read(data.data() + dataSize, static_cast<ULONG>(data.size()) - dataSize, &bytesRead));
+                    dataSize += bytesRead;
+                } while (bytesRead != 0 && dataSize < data.size());
+
+                endOfStream = (dataSize < data.size());
+                if (dataSize == 0) { break; }
+                data.resize(dataSize);
+                pending.push_back(m_threadPool.Submit([this, isCompressed, data = std::move(data)]() mutable
+                {
+                    return ProcessBlock(std::move(data), isCompressed);
+                }));
+            }
+            if (pending.empty()) { break; }
+
+            auto block = pending.front().get();
+            pending.pop_front();
+            const auto& zipData = isCompressed ? block.compressedData : block.data;
+            crc = Crc32(crc, block.data.data(), block.data.size());
+            m_zip->WriteFileData(zipData.data(), zipData.size());
+
+            Block blockMapBlock;
+            blockMapBlock.compressedSize = zipData.size();
+            blockMapBlock.blockSize = isCompressed ? zipData.size() : BLOCKMAP_BLOCK_SIZE;
+            blockMapBlock.hash = std::move(block.hash);
+            result.blocks.push_back(std::move(blockMapBlock));
+            result.size += block.data.size();
+            sizeOnZip += zipData.size();
+        }
+
+        if (isCompressed)
+        {
+            m_zip->WriteFileData(deflateEndOfStream, sizeof(deflateEndOfStream));
+            sizeOnZip += sizeof(deflateEndOfStream);
+        }
+        m_zip->EndFile(crc, sizeOnZip, result.size);
+        return result;
+    }
+
+    AppxPackageWriter::ProcessedBlock AppxPackageWriter::ProcessBlock(std::vector<std::uint8_t>&& data, bool isCompressed)
+    {
+        ProcessedBlock result;
+        result.data = std::move(data);
+        ThrowErrorIfNot(Error::Unexpected,
+            SHA256::ComputeHash(result.data.data(), static_cast<std::uint32_t>(result.data.size()), result.hash),
+            "failed computing block hash");
+
+        if (isCompressed)
+        {   // Deflate can make a block a little bigger, the output buffer grows if needed.
+            auto deflater = GetDeflater();
+            result.compressedData.resize(result.data.size() + (result.data.size() / 8) + 64);
+            deflater->SetInput(result.data.data(), result.data.size());
+            std::size_t compressedSize = 0;
+            do
+            {
+                if (compressedSize == result.compressedData.size())
+                {
+                    result.compressedData.resize(result.compressedData.size() * 2);
+                }
+                deflater->SetOutput(result.compressedData.data() + compressedSize, result.compressedData.size() - compressedSize);
+                ThrowErrorIf(Error::DeflateWrite, (deflater->Deflate(false) == CompressionStatus::Error), "deflate failed");
+                compressedSize = result.compressedData.size() - deflater->GetAvailableDestinationSize();
+            } while (deflater->GetAvailableDestinationSize() == 0 || deflater->GetAvailableSourceSize() != 0);
+            result.compressedData.resize(compressedSize);
+            ReturnDeflater(std::move(deflater));
+        }
+        return result;
+    }
+
+    AppxPackageWriter::Deflater AppxPackageWriter::GetDeflater()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_deflatersLock);
+            if (!m_deflaters.empty())
+            {
+                auto result = std::move(m_deflaters.back());
+                m_deflaters.pop_back();
+                return result;
+            }
+        }
+        auto compressionObject = CreateCompressionObject();
+        ThrowErrorIfNot(Error::DeflateInitialize,
+            (compressionObject->Initialize(CompressionOperation::Deflate) == CompressionStatus::Ok),
+            "failed to initialize deflate");
+        return Deflater(compressionObject.release());
+    }
+
+    void AppxPackageWriter::ReturnDeflater(Deflater&& deflater)
+    {
+        std::lock_guard<std::mutex> lock(m_deflatersLock);
+        m_deflaters.push_back(std::move(deflater));
+    }
+
+    void AppxPackageWriter::AddContentType(const std::string& name, const std::string& contentType)
+    {
+        auto lastSlash = name.find_last_of('/');
+        auto lastDot = name.find_last_of('.');
+        if (lastDot == std::string::npos || (lastSlash != std::string::npos && lastDot < lastSlash) || lastDot == name.size() - 1)
+        {   // Files without an extension always need an override
+            m_overrideContentTypes["/" + name] = contentType;
+            return;
+        }
+
+        auto extension = ToLower(name.substr(lastDot + 1));
+        auto defaultContentType = m_defaultContentTypes.find(extension);
+        if (defaultContentType == m_defaultContentTypes.end())
+        {
+            m_defaultContentTypes.insert(std::make_pair(extension, contentType));
+        }
+        else if (defaultContentType->second != contentType)
+        {
+            m_overrideContentTypes["/" + name] = contentType;
+        }
+    }
+
+    std::string AppxPackageWriter::GetBlockMapXml()
+    {
+        std::ostringstream xml;
+        xml << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\r\n"
+            << "<BlockMap xmlns=\"http://schemas.microsoft.com/appx/2010/blockmap\" HashMethod=\"http://www.w3.org/2001/04/xmlenc#sha256\">";
+        for (const auto& file : m_blockMapFiles)
+        {
+            xml << "<File Name=\"" << EscapeXml(file.name) << "\" Size=\"" << file.size << "\" LfhSize=\"" << file.localFileHeaderSize << "\"";
+            if (file.blocks.empty())
+            {
+                xml << "/>";
+                continue;
+            }
+            xml << ">";
+            for (const auto& block : file.blocks)
+            {   // Uncompressed files don't have the Size attribute
+                xml << "<Block Hash=\"" << Encoding::Base64Encoding(block.hash) << "\"";
+                if (file.isCompressed) { xml << " Size=\"" << block.compressedSize << "\""; }
+                xml << "/>";
+            }
+            xml << "</File>";
+        }
+        xml << "</BlockMap>";
+        return xml.str();
+    }
+
+    std::string AppxPackageWriter::GetContentTypesXml()
+    {
+        std::ostringstream xml;
+        xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+            << "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">";
+        for (const auto& contentType : m_defaultContentTypes)
+        {
+            xml << "<Default Extension=\"" << EscapeXml(contentType.first) << "\" ContentType=\"" << EscapeXml(contentType.second) << "\"/>";
+        }
+        for (const auto& contentType : m_overrideContentTypes)
+        {
+            xml << "<Override PartName=\"" << EscapeXml(contentType.first) << "\" ContentType=\"" << EscapeXml(contentType.second) << "\"/>";
+        }
+        xml << "</Types>";
+        return xml.str();
+    }
+}
@@ -94,9 +94,22 @@ ComPtr<IStream>  AppxSignatureObject::GetValidationStream(const std::string& par
         {   // This stream implementation will throw if the underlying stream does not match the digest
             return ComPtr<IStream>::Make<HashStream>(stream, this->GetCodeIntegrityDigest());
         }
-        // TODO: unnamed stream for central directory?
+        // The zip file records and the central directory aren't files, see ValidateCentralDirectoryDigest and
+        // ValidateFileRecordsDigest.
     }
     return stream;
 }
 
+void AppxSignatureObject::ValidateCentralDirectoryDigest(const std::vector<std::uint8_t>& centralDirectory)
+{
+    if (!m_hasDigests) { return; }
+    ThrowErrorIfNot(Error::SignatureInvalid, (centralDirectory == m_CentralDirectory), "Central directory doesn't match digest hash");
+}
+
+void AppxSignatureObject::ValidateFileRecordsDigest(const std::vector<std::uint8_t>& fileRecords)
+{
+    if (!m_hasDigests) { return; }
+    ThrowErrorIfNot(Error::SignatureInvalid, (fileRecords == m_FileRecords), "Zip file records don't match digest hash");
+}
+
 } // namespace MSIX
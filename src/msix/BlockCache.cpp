@@ -0,0 +1,55 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "BlockCache.hpp"
+
+#include <cstring>
+
+namespace MSIX {
+
+    // IMsixBlockCache
+    HRESULT STDMETHODCALLTYPE BlockCache::FindBlock(const BYTE* hash, UINT32 hashSize, UINT32 blockSize, BYTE* block, BOOL* found) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (hash == nullptr || hashSize == 0 || (block == nullptr && blockSize != 0) || found == nullptr), "Invalid parameter");
+        *found = FALSE;
+        std::string key(reinterpret_cast<const char*>(hash), hashSize);
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto cached = m_blockIndex.find(key);
+        if ((cached != m_blockIndex.end()) && (cached->second->data.size() == blockSize))
+        {
+            m_blocks.splice(m_blocks.begin(), m_blocks, cached->second);
+            memcpy(block, cached->second->data.data(), blockSize);
+            *found = TRUE;
+        }
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE BlockCache::AddBlock(const BYTE* hash, UINT32 hashSize, UINT32 blockSize, const BYTE* block) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (hash == nullptr || hashSize == 0 || (block == nullptr && blockSize != 0)), "Invalid parameter");
+        if (blockSize > m_maxBytes) { return static_cast<HRESULT>(Error::OK); }
+        std::string key(reinterpret_cast<const char*>(hash), hashSize);
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto cached = m_blockIndex.find(key);
+        if (cached != m_blockIndex.end())
+        {   // Another reader got here first.
+            m_blocks.splice(m_blocks.begin(), m_blocks, cached->second);
+            return static_cast<HRESULT>(Error::OK);
+        }
+
+        CachedBlock cachedBlock = { key, std::vector<std::uint8_t>(block, block + blockSize) };
+        m_blocks.push_front(std::move(cachedBlock));
+        m_blockIndex[key] = m_blocks.begin();
+        m_bytes += blockSize;
+        while (m_bytes > m_maxBytes)
+        {
+            m_bytes -= m_blocks.back().data.size();
+            m_blockIndex.erase(m_blocks.back().hash);
+            m_blocks.pop_back();
+        }
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+}
@@ -0,0 +1,497 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "BlockMapStream.hpp"
+#include "ICompressionObject.hpp"
+#include "ThreadPool.hpp"
+
+#include <deque>
+#include <future>
+#include <limits>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+namespace MSIX {
+
+    // Smaller files aren't worth starting threads for.
+    static const std::size_t MinBlocksForParallelInflate = 16;
+    // Blocks that are read and being inflated ahead of the one being written, per thread.
+    static const std::size_t BlocksInFlightPerThread = 4;
+    // Stored blocks hashed together, as many as SHA256::ComputeHashes hashes side by side.
+    static const std::size_t StoredBlocksPerCheck = 16;
+
+    // Hashed into the stack, reading a block doesn't allocate.
+    static bool BlockHashMatches(const std::uint8_t* block, std::uint64_t size, const std::uint8_t* expectedHash)
+    {
+        std::uint8_t hash[BLOCKMAP_HASH_SIZE];
+        std::size_t blockSize = static_cast<std::size_t>(size);
+        SHA256::ComputeHashes(1, &block, &blockSize, hash);
+        return memcmp(hash, expectedHash, BLOCKMAP_HASH_SIZE) == 0;
+    }
+
+    static void CheckBlockHash(const std::uint8_t* block, std::uint64_t size, const std::uint8_t* expectedHash)
+    {
+        ThrowErrorIfNot(Error::SignatureInvalid, BlockHashMatches(block, size, expectedHash), "Signature hash doesn't match digest hash");
+    }
+
+    // Hashes the blocks in size bytes of data together and returns how many of them, from the first one on, match
+    // their hash in expectedHashes.
+    static std::size_t CountMatchingBlocks(const std::uint8_t* data, std::uint64_t size, const std::uint8_t* expectedHashes)
+    {
+        std::size_t count = static_cast<std::size_t>((size + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE);
+        std::vector<const std::uint8_t*> buffers(count);
+        std::vector<std::size_t> sizes(count);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            buffers[i] = data + i * BLOCKMAP_BLOCK_SIZE;
+            sizes[i] = static_cast<std::size_t>(std::min(BLOCKMAP_BLOCK_SIZE, size - i * BLOCKMAP_BLOCK_SIZE));
+        }
+        std::vector<std::uint8_t> hashes(count * BLOCKMAP_HASH_SIZE);
+        SHA256::ComputeHashes(count, buffers.data(), sizes.data(), hashes.data());
+        std::size_t matching = 0;
+        while ((matching < count) && (memcmp(hashes.data() + matching * BLOCKMAP_HASH_SIZE,
+            expectedHashes + matching * BLOCKMAP_HASH_SIZE, BLOCKMAP_HASH_SIZE) == 0))
+        {
+            matching++;
+        }
+        return matching;
+    }
+
+    // Inflates a block on its own and checks it against the blockmap while it is still in the cache. Returns false
+    // if the compressed data doesn't inflate to exactly the block without the data before it.
+    static bool InflateAndHashBlock(const std::vector<std::uint8_t>& compressed, std::vector<std::uint8_t>& inflated,
+        bool isLast, const std::uint8_t* expectedHash)
+    {
+        auto status = InflateBlock(compressed.data(), compressed.size(), inflated.data(), inflated.size());
+        if (status != (isLast ? CompressionStatus::End : CompressionStatus::Ok)) { return false; }
+        CheckBlockHash(inflated.data(), inflated.size(), expectedHash);
+        return true;
+    }
+
+    static void WriteAll(IStream* stream, const std::vector<std::uint8_t>& buffer)
+    {
+        std::size_t offset = 0;
+        while (offset < buffer.size())
+        {
+            ULONG written = 0;
+            ThrowHrIfFailed(stream->Write(buffer.data() + offset, static_cast<ULONG>(buffer.size() - offset), &written));
+            ThrowErrorIf(Error::FileWrite, (written == 0), "Write failed");
+            offset += written;
+        }
+    }
+
+    // Copies size bytes between two files without going through user space, with copy_file_range (which clones the
+    // blocks on file systems that can) or sendfile where that isn't supported. Returns the number of bytes copied,
+    // which is less than size if the kernel can't copy between these files.
+    static std::uint64_t CopyFileRange(int source, std::uint64_t sourceOffset, int target, std::uint64_t targetOffset, std::uint64_t size)
+    {
+        std::uint64_t copied = 0;
+        #ifdef __linux__
+        #ifdef SYS_copy_file_range
+        while (copied < size)
+        {
+            loff_t in = static_cast<loff_t>(sourceOffset + copied);
+            loff_t out = static_cast<loff_t>(targetOffset + copied);
+            auto bytes = syscall(SYS_copy_file_range, source, &in, target, &out, static_cast<std::size_t>(size - copied), 0);
+            if (bytes == -1 && errno == EINTR) { continue; }
+            if (bytes <= 0) { break; }
+            copied += static_cast<std::uint64_t>(bytes);
+        }
+        #endif
+        // sendfile writes at the target's position.
+        if ((copied < size) && (lseek(target, static_cast<off_t>(targetOffset + copied), SEEK_SET) != -1))
+        {
+            while (copied < size)
+            {
+                off_t in = static_cast<off_t>(sourceOffset + copied);
+                auto bytes = sendfile(target, source, &in, static_cast<std::size_t>(size - copied));
+                if (bytes == -1 && errno == EINTR) { continue; }
+                if (bytes <= 0) { break; }
+                copied += static_cast<std::uint64_t>(bytes);
+            }
+        }
+        #endif
+        return copied;
+    }
+
+    // Whether the file can be read back, which CopyStoredBlocksTo needs to check what the kernel wrote to it.
+    static bool IsReadable(int file)
+    {
+        #ifdef __linux__
+        int flags = fcntl(file, F_GETFL);
+        return (flags != -1) && ((flags & O_ACCMODE) == O_RDWR);
+        #else
+        return false;
+        #endif
+    }
+
+    // Reads up to buffer.size() bytes at offset, returns how many were read.
+    static std::size_t ReadFileRange(int file, std::uint64_t offset, std::vector<std::uint8_t>& buffer)
+    {
+        std::size_t read = 0;
+        #ifdef __linux__
+        while (read < buffer.size())
+        {
+            auto bytes = pread(file, buffer.data() + read, buffer.size() - read, static_cast<off_t>(offset + read));
+            if (bytes == -1 && errno == EINTR) { continue; }
+            if (bytes <= 0) { break; }
+            read += static_cast<std::size_t>(bytes);
+        }
+        #endif
+        return read;
+    }
+
+    static bool TruncateFile(int file, std::uint64_t size)
+    {
+        #ifdef __linux__
+        return ftruncate(file, static_cast<off_t>(size)) == 0;
+        #else
+        return false;
+        #endif
+    }
+
+    HRESULT STDMETHODCALLTYPE BlockMapStream::CopyTo(IStream* stream, ULARGE_INTEGER bytesCount, ULARGE_INTEGER* bytesRead, ULARGE_INTEGER* bytesWritten) noexcept try
+    {
+        if (bytesRead) { bytesRead->QuadPart = 0; }
+        if (bytesWritten) { bytesWritten->QuadPart = 0; }
+        ThrowErrorIf(Error::InvalidParameter, (nullptr == stream), "invalid parameter.");
+
+        FindCompressedBlocks();
+        std::uint64_t copied = 0;
+        if (bytesCount.QuadPart >= (m_streamSize - m_relativePosition))
+        {
+            copied = m_inflateStream ? CopyCompressedBlocksTo(stream) : CopyStoredBlocksTo(stream);
+        }
+
+        ULARGE_INTEGER remaining = { 0 };
+        remaining.QuadPart = bytesCount.QuadPart - copied;
+        ULARGE_INTEGER read = { 0 };
+        ULARGE_INTEGER written = { 0 };
+        ThrowHrIfFailed(StreamBase::CopyTo(stream, remaining, &read, &written));
+        if (bytesRead) { bytesRead->QuadPart = copied + read.QuadPart; }
+        if (bytesWritten) { bytesWritten->QuadPart = copied + written.QuadPart; }
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    void BlockMapStream::FindCompressedBlocks()
+    {
+        if (m_compressedBlocksFound) { return; }
+        m_compressedBlocksFound = true;
+        if (FAILED(m_stream->QueryInterface(UuidOfImpl<IInflateStreamInternal>::iid, reinterpret_cast<void**>(&m_inflateStream))) || !m_inflateStream)
+        {
+            return;
+        }
+
+        // The blocks have to add up to the compressed data, with or without the 2 bytes that end the deflate
+        // stream (see AppxPackageObject::VerifyFile).
+        std::vector<std::uint64_t> compressedOffsets;
+        compressedOffsets.reserve(m_blockCount);
+        std::uint64_t compressedOffset = 0;
+        for (std::size_t i = 0; i < m_blockCount; i++)
+        {
+            std::uint64_t compressedSize = m_blocks.GetCompressedSize(i);
+            if ((compressedSize == 0) || (compressedSize > std::numeric_limits<ULONG>::max())) { return; }
+            compressedOffsets.push_back(compressedOffset);
+            compressedOffset += compressedSize;
+        }
+        std::uint64_t sizeOnZip = GetSizeOnZip();
+        if ((compressedOffset != sizeOnZip) && (compressedOffset + 2 != sizeOnZip)) { return; }
+
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> seekPoints;
+        seekPoints.reserve(m_blockCount);
+        for (std::size_t i = 0; i < m_blockCount; i++)
+        {
+            seekPoints.emplace_back(GetBlockOffset(i), compressedOffsets[i]);
+        }
+        m_inflateStream->SetSeekPoints(std::move(seekPoints));
+        m_compressedOffsets = std::move(compressedOffsets);
+    }
+
+    void BlockMapStream::ForgetCompressedBlocks()
+    {
+        m_compressedOffsets.clear();
+        m_inflateStream->SetSeekPoints({});
+    }
+
+    bool BlockMapStream::LoadBlock(std::size_t index)
+    {
+        if (m_loadedBlock == index) { return true; }
+        FindCompressedBlocks();
+        if (m_compressedOffsets.empty() && !m_blockCache) { return false; }
+
+        std::uint64_t size = GetBlockSize(index);
+        m_loadedBlock = std::numeric_limits<std::size_t>::max();
+        m_blockBuffer.resize(static_cast<std::size_t>(size));
+        if (m_blockCache)
+        {
+            BOOL found = FALSE;
+            ThrowHrIfFailed(m_blockCache->FindBlock(m_blocks.GetHash(index), static_cast<UINT32>(BLOCKMAP_HASH_SIZE),
+                static_cast<UINT32>(size), m_blockBuffer.data(), &found));
+            if (found)
+            {
+                m_loadedBlock = index;
+                return true;
+            }
+        }
+
+        if (!InflateCompressedBlock(index))
+        {
+            if (!m_blockCache) { return false; }
+            // Stored files and blocks that don't inflate on their own are checked by the block's HashStream.
+            ULONG read = StreamBase::ReadAt(GetBlockStream(index), 0, m_blockBuffer.data(), static_cast<ULONG>(size));
+            ThrowErrorIf(Error::FileRead, (read != size), "Did not read as much as requested.");
+        }
+        if (m_blockCache)
+        {
+            ThrowHrIfFailed(m_blockCache->AddBlock(m_blocks.GetHash(index), static_cast<UINT32>(BLOCKMAP_HASH_SIZE),
+                static_cast<UINT32>(size), m_blockBuffer.data()));
+        }
+        m_loadedBlock = index;
+        return true;
+    }
+
+    bool BlockMapStream::InflateCompressedBlock(std::size_t index)
+    {
+        if (m_compressedOffsets.empty()) { return false; }
+
+        bool isLast = (index == m_blockCount - 1);
+        // The last block also gets what ends the deflate stream, so inflating it has to reach the end.
+        std::uint64_t compressedSize = isLast ? (GetSizeOnZip() - m_compressedOffsets[index]) : m_blocks.GetCompressedSize(index);
+        m_compressedBuffer.resize(static_cast<std::size_t>(compressedSize));
+        ULONG read = StreamBase::ReadAt(m_inflateStream->GetCompressedStream(), m_compressedOffsets[index], m_compressedBuffer.data(), static_cast<ULONG>(compressedSize));
+        ThrowErrorIf(Error::FileRead, (read != compressedSize), "Did not read as much as requested.");
+
+        if (!InflateAndHashBlock(m_compressedBuffer, m_blockBuffer, isLast, m_blocks.GetHash(index)))
+        {   // The blocks don't stand on their own, go through the inflate stream from now on.
+            ForgetCompressedBlocks();
+            return false;
+        }
+        return true;
+    }
+
+    std::uint64_t BlockMapStream::CopyCompressedBlocksTo(IStream* stream)
+    {
+        if (m_compressedOffsets.empty() || ((m_relativePosition % BLOCKMAP_BLOCK_SIZE) != 0)) { return 0; }
+        std::size_t first = static_cast<std::size_t>(m_relativePosition / BLOCKMAP_BLOCK_SIZE);
+        std::size_t threadCount = ThreadPool::GetDefaultThreadCount();
+        if ((threadCount >= 2) && (m_blockCount >= first + MinBlocksForParallelInflate))
+        {
+            return ParallelCopyTo(stream, first);
+        }
+
+        std::uint64_t copied = 0;
+        for (std::size_t index = first; (index < m_blockCount) && LoadBlock(index); index++)
+        {
+            WriteAll(stream, m_blockBuffer);
+            m_relativePosition += m_blockBuffer.size();
+            copied += m_blockBuffer.size();
+        }
+        return copied;
+    }
+
+    std::uint64_t BlockMapStream::CopyStoredBlocksTo(IStream* stream)
+    {
+        if ((m_relativePosition % BLOCKMAP_BLOCK_SIZE) != 0) { return 0; }
+        ComPtr<IFileBackedStream> source;
+        ComPtr<IFileBackedStream> target;
+        if (FAILED(m_stream->QueryInterface(UuidOfImpl<IFileBackedStream>::iid, reinterpret_cast<void**>(&source))) || !source ||
+            FAILED(stream->QueryInterface(UuidOfImpl<IFileBackedStream>::iid, reinterpret_cast<void**>(&target))) || !target ||
+            (m_blockCount == 0) || (GetBlockOffset(m_blockCount - 1) + GetBlockSize(m_blockCount - 1) != m_streamSize))
+        {
+            return 0;
+        }
+        int sourceFile = source->GetFileDescriptor();
+        int targetFile = target->GetFileDescriptor();
+        if ((sourceFile == -1) || (targetFile == -1) || !IsReadable(targetFile)) { return 0; }
+
+        LARGE_INTEGER move = { 0 };
+        ULARGE_INTEGER targetPosition = { 0 };
+        ThrowHrIfFailed(stream->Seek(move, StreamBase::Reference::CURRENT, &targetPosition));
+        std::uint64_t targetOffset = target->GetFileOffset() + targetPosition.QuadPart;
+        std::uint64_t copied = CopyFileRange(sourceFile, source->GetFileOffset() + m_relativePosition,
+            targetFile, targetOffset, m_streamSize - m_relativePosition);
+
+        // The package can change while it is copied, so the blocks are checked as they were written, not in the package.
+        // Nothing that doesn't match is left in the target. A block that was only partly written or can't be read back
+        // is written again through its HashStream.
+        // The blocks are read back and hashed StoredBlocksPerCheck at a time.
+        std::uint64_t checked = 0;
+        std::vector<std::uint8_t> buffer;
+        std::size_t index = static_cast<std::size_t>(m_relativePosition / BLOCKMAP_BLOCK_SIZE);
+        while (index < m_blockCount)
+        {
+            std::size_t count = 0;
+            std::uint64_t size = 0;
+            while ((count < StoredBlocksPerCheck) && (index + count < m_blockCount) &&
+                (checked + size + GetBlockSize(index + count) <= copied))
+            {
+                size += GetBlockSize(index + count);
+                count++;
+            }
+            buffer.resize(static_cast<std::size_t>(size));
+            if ((count == 0) || (ReadFileRange(targetFile, targetOffset + checked, buffer) != buffer.size()))
+            {
+                break;
+            }
+            if (CountMatchingBlocks(buffer.data(), size, m_blocks.GetHash(index)) != count)
+            {
+                ThrowErrorIfNot(Error::FileWrite, TruncateFile(targetFile, targetOffset), "Could not remove what didn't match");
+                ThrowErrorAndLog(Error::SignatureInvalid, "Signature hash doesn't match digest hash");
+            }
+            checked += size;
+            index += count;
+        }
+        // The kernel wrote past the target's position without moving it.
+        move.QuadPart = static_cast<LONGLONG>(targetPosition.QuadPart + checked);
+        ThrowHrIfFailed(stream->Seek(move, StreamBase::Reference::START, nullptr));
+        m_relativePosition += checked;
+        return checked;
+    }
+
+    std::function<std::size_t()> BlockMapStream::GetBlockCheck(std::size_t index, std::size_t& count)
+    {
+        FindCompressedBlocks();
+        std::uint64_t size = GetBlockSize(index);
+        const std::uint8_t* hash = m_blocks.GetHash(index);
+        if (!m_compressedOffsets.empty())
+        {
+            count = 1;
+            bool isLast = (index == m_blockCount - 1);
+            std::uint64_t compressedSize = isLast ? (GetSizeOnZip() - m_compressedOffsets[index]) : m_blocks.GetCompressedSize(index);
+            auto compressed = std::make_shared<std::vector<std::uint8_t>>(static_cast<std::size_t>(compressedSize));
+            ULONG read = StreamBase::ReadAt(m_inflateStream->GetCompressedStream(), m_compressedOffsets[index], compressed->data(), static_cast<ULONG>(compressedSize));
+            ThrowErrorIf(Error::FileRead, (read != compressedSize), "Did not read as much as requested.");
+            return [compressed, size, isLast, hash]() -> std::size_t
+            {
+                std::vector<std::uint8_t> inflated(static_cast<std::size_t>(size));
+                return InflateAndHashBlock(*compressed, inflated, isLast, hash) ? 1 : 0;
+            };
+        }
+        if (m_inflateStream)
+        {
+            count = 1;
+            return nullptr;
+        }
+
+        // Stored blocks are hashed together. Those of a mapped package are hashed where they are, the others are
+        // read here.
+        count = std::min({ count, StoredBlocksPerCheck, m_blockCount - index });
+        size = GetBlockOffset(index + count - 1) + GetBlockSize(index + count - 1) - GetBlockOffset(index);
+        ComPtr<IMappedStream> mapped;
+        if (SUCCEEDED(m_stream->QueryInterface(UuidOfImpl<IMappedStream>::iid, reinterpret_cast<void**>(&mapped))) && mapped &&
+            (mapped->GetMappedSize() == m_streamSize))
+        {
+            const std::uint8_t* data = mapped->GetMappedBuffer() + GetBlockOffset(index);
+            return [data, size, hash]()
+            {
+                return CountMatchingBlocks(data, size, hash);
+            };
+        }
+        auto data = std::make_shared<std::vector<std::uint8_t>>(static_cast<std::size_t>(size));
+        ULONG read = StreamBase::ReadAt(m_stream, GetBlockOffset(index), data->data(), static_cast<ULONG>(size));
+        ThrowErrorIf(Error::FileRead, (read != size), "Did not read as much as requested.");
+        return [data, hash]()
+        {
+            return CountMatchingBlocks(data->data(), data->size(), hash);
+        };
+    }
+
+    void BlockMapStream::CheckBlock(std::size_t index)
+    {
+        std::uint64_t size = GetBlockSize(index);
+        std::vector<std::uint8_t> buffer(static_cast<std::size_t>(size));
+        ULONG read = StreamBase::ReadAt(GetBlockStream(index), 0, buffer.data(), static_cast<ULONG>(size));
+        ThrowErrorIf(Error::FileRead, (read != size), "Did not read as much as requested.");
+    }
+
+    ComPtr<IStream> BlockMapStream::GetBlockStream(std::size_t index)
+    {
+        if (m_blockStreamIndex != index)
+        {
+            auto rangeStream = ComPtr<IStream>::Make<RangeStream>(GetBlockOffset(index), GetBlockSize(index), m_stream);
+            m_blockStream = ComPtr<IStream>::Make<HashStream>(rangeStream, m_blocks.GetHash(index), BLOCKMAP_HASH_SIZE);
+            m_blockStreamIndex = index;
+        }
+        return m_blockStream;
+    }
+
+    std::uint64_t BlockMapStream::ParallelCopyTo(IStream* stream, std::size_t first)
+    {
+        auto compressedStream = m_inflateStream->GetCompressedStream();
+        std::uint64_t sizeOnZip = GetSizeOnZip();
+        std::size_t threadCount = ThreadPool::GetDefaultThreadCount();
+        ThreadPool threadPool(std::min(threadCount, m_blockCount - first));
+        std::deque<std::future<std::unique_ptr<std::vector<std::uint8_t>>>> pending;
+        std::size_t next = first;
+        auto SubmitNext = [&]()
+        {   // The compressed data is read here, the source stream might not be safe to read from other threads.
+            if (m_blockCache)
+            {
+                auto cached = std::make_unique<std::vector<std::uint8_t>>(static_cast<std::size_t>(GetBlockSize(next)));
+                BOOL found = FALSE;
+                ThrowHrIfFailed(m_blockCache->FindBlock(m_blocks.GetHash(next), static_cast<UINT32>(BLOCKMAP_HASH_SIZE),
+                    static_cast<UINT32>(GetBlockSize(next)), cached->data(), &found));
+                if (found)
+                {
+                    std::promise<std::unique_ptr<std::vector<std::uint8_t>>> ready;
+                    ready.set_value(std::move(cached));
+                    pending.emplace_back(ready.get_future());
+                    next++;
+                    return;
+                }
+            }
+            bool isLast = (next == m_blockCount - 1);
+            std::uint64_t compressedSize = isLast ? (sizeOnZip - m_compressedOffsets[next]) : m_blocks.GetCompressedSize(next);
+            auto compressed = std::make_shared<std::vector<std::uint8_t>>(static_cast<std::size_t>(compressedSize));
+            ULONG read = StreamBase::ReadAt(compressedStream, m_compressedOffsets[next], compressed->data(), static_cast<ULONG>(compressedSize));
+            ThrowErrorIf(Error::FileRead, (read != compressedSize), "Did not read as much as requested.");
+            std::uint64_t size = GetBlockSize(next);
+            const std::uint8_t* hash = m_blocks.GetHash(next);
+            pending.emplace_back(threadPool.Submit([compressed, size, isLast, hash]()
+            {
+                auto inflated = std::make_unique<std::vector<std::uint8_t>>(static_cast<std::size_t>(size));
+                if (!InflateAndHashBlock(*compressed, *inflated, isLast, hash)) { inflated.reset(); }
+                return inflated;
+            }));
+            next++;
+        };
+
+        while ((next < m_blockCount) && (pending.size() < threadPool.GetThreadCount() * BlocksInFlightPerThread))
+        {
+            SubmitNext();
+        }
+
+        std::uint64_t copied = 0;
+        while (!pending.empty())
+        {
+            auto inflated = pending.front().get();
+            pending.pop_front();
+            if (!inflated)
+            {   // This block doesn't stand on its own, let the serial inflate take it from here.
+                ForgetCompressedBlocks();
+                break;
+            }
+            WriteAll(stream, *inflated);
+            if (m_blockCache)
+            {
+                ThrowHrIfFailed(m_blockCache->AddBlock(m_blocks.GetHash(static_cast<std::size_t>(m_relativePosition / BLOCKMAP_BLOCK_SIZE)), static_cast<UINT32>(BLOCKMAP_HASH_SIZE),
+                    static_cast<UINT32>(inflated->size()), inflated->data()));
+            }
+            m_relativePosition += inflated->size();
+            copied += inflated->size();
+            if (next < m_blockCount)
+            {
+                SubmitNext();
+            }
+        }
+        // Anything still in flight after a fallback finishes before the thread pool goes away.
+        return copied;
+    }
+}
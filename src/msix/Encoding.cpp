@@ -448,4 +448,24 @@ namespace MSIX { namespace Encoding {
         return result;
     }
 
+    const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string Base64Encoding(const std::vector<std::uint8_t>& bytes)
+    {
+        std::string result;
+        result.reserve(((bytes.size() + 2) / 3) * 4);
+        for (std::size_t index = 0; index < bytes.size(); index += 3)
+        {   // Every three bytes become four characters, the last group is padded with '='
+            std::size_t byteCount = std::min(bytes.size() - index, static_cast<std::size_t>(3));
+            std::uint32_t group = static_cast<std::uint32_t>(bytes[index]) << 16;
+            if (byteCount > 1) { group |= static_cast<std::uint32_t>(bytes[index+1]) << 8; }
+            if (byteCount > 2) { group |= static_cast<std::uint32_t>(bytes[index+2]); }
+            result.push_back(base64Alphabet[(group >> 18) & 0x3F]);
+            result.push_back(base64Alphabet[(group >> 12) & 0x3F]);
+            result.push_back(byteCount > 1 ? base64Alphabet[(group >> 6) & 0x3F] : '=');
+            result.push_back(byteCount > 2 ? base64Alphabet[group & 0x3F] : '=');
+        }
+        return result;
+    }
+
 } /*Encoding */ } /* MSIX */
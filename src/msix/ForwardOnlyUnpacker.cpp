@@ -0,0 +1,269 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "ForwardOnlyUnpacker.hpp"
+#include "AppxPackageObject.hpp"
+#include "AppxManifestObject.hpp"
+#include "VectorStream.hpp"
+#include "HashStream.hpp"
+#include "UnicodeConversion.hpp"
+#include "Encoding.hpp"
+#include "Exceptions.hpp"
+#include "SHA256.hpp"
+#include "IXml.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+namespace MSIX {
+
+    #define APPXBLOCKMAP_XML       "AppxBlockMap.xml"
+    #define APPXMANIFEST_XML       "AppxManifest.xml"
+    #define CODEINTEGRITY_CAT      "AppxMetadata/CodeIntegrity.cat"
+    #define APPXSIGNATURE_P7X      "AppxSignature.p7x"
+    #define CONTENT_TYPES_XML      "[Content_Types].xml"
+    #define APPXBUNDLEMANIFEST_XML "AppxMetadata/AppxBundleManifest.xml"
+
+    // Footprint files are kept in memory until the package is validated.
+    static const std::array<const char*, 5> footprintFileNames =
+    {   APPXBLOCKMAP_XML,
+        APPXMANIFEST_XML,
+        CODEINTEGRITY_CAT,
+        APPXSIGNATURE_P7X,
+        CONTENT_TYPES_XML,
+    };
+
+    static bool IsFootprintFile(const std::string& name)
+    {
+        return std::find(footprintFileNames.begin(), footprintFileNames.end(), name) != footprintFileNames.end();
+    }
+
+    // Names from the local file headers haven't been checked against the blockmap yet. They can't go above the
+    // destination or be absolute.
+    static bool IsInDestination(const std::string& name)
+    {
+        if (name.empty() || (name[0] == '/') || (name[0] == '\\') || ((name.size() > 1) && (name[1] == ':')))
+        {
+            return false;
+        }
+        std::size_t start = 0;
+        while (start <= name.size())
+        {
+            auto end = name.find_first_of("/\\", start);
+            if (end == std::string::npos) { end = name.size(); }
+            if (name.compare(start, end - start, "..") == 0) { return false; }
+            start = end + 1;
+        }
+        return true;
+    }
+
+    ForwardOnlyUnpacker::ForwardOnlyUnpacker(IMsixFactory* factory, MSIX_VALIDATION_OPTION validation,
+        const ComPtr<IStream>& stream, const ComPtr<DirectoryObject>& to) :
+        m_factory(factory), m_validation(validation), m_stream(stream), m_to(to)
+    {}
+
+    ForwardOnlyUnpacker::~ForwardOnlyUnpacker()
+    {   // Don't leave the payload of an invalid package behind. Only files this unpacker created are removed.
+        if (!m_isComplete)
+        {
+            for (const auto& name : m_createdFiles)
+            {
+                m_to->RemoveFile(name);
+            }
+        }
+    }
+
+    void ForwardOnlyUnpacker::Unpack()
+    {
+        ThrowErrorIf(Error::InvalidState, m_isComplete, "Package already unpacked");
+
+        // 1. Walk the local file headers. Payload files are extracted as they arrive and footprint files are kept
+        // for later. Reaching the end also checks the central directory against the files that were read.
+        ZipObjectForwardOnlyReader zip(m_stream);
+        std::string name;
+        bool isCompressed = false;
+        while (zip.NextFile(name, isCompressed))
+        {
+            ThrowErrorIf(Error::ZipLocalFileHeader, (m_files.find(name) != m_files.end()), "Duplicate file in the zip");
+            ThrowErrorIf(Error::NotSupported, (name == APPXBUNDLEMANIFEST_XML), "Bundles can't be unpacked from a forward only stream");
+            if (IsFootprintFile(name))
+            {
+                auto& data = m_footprintFiles[name];
+                m_files[name] = ReadFile(zip, isCompressed, [&data](const std::uint8_t* buffer, std::size_t size)
+                {
+                    data.insert(data.end(), buffer, buffer + size);
+                });
+            }
+            else
+            {
+                auto targetFile = CreateTargetFile(Encoding::DecodeFileName(name));
+                m_files[name] = ReadFile(zip, isCompressed, [&targetFile](const std::uint8_t* buffer, std::size_t size)
+                {
+                    ThrowHrIfFailed(targetFile->Write(buffer, static_cast<ULONG>(size), nullptr));
+                });
+            }
+        }
+
+        // 2. Validate the footprint files in the same order as AppxPackageObject.
+        ComPtr<IXmlFactory> xmlFactory;
+        ThrowHrIfFailed(m_factory->QueryInterface(UuidOfImpl<IXmlFactory>::iid, reinterpret_cast<void**>(&xmlFactory)));
+        auto GetFootprintFile = [this](const char* footprintName)
+        {
+            auto file = m_footprintFiles.find(footprintName);
+            return (file == m_footprintFiles.end()) ? ComPtr<IStream>() : ComPtr<IStream>::Make<VectorStream>(&file->second);
+        };
+
+        auto file = GetFootprintFile(APPXSIGNATURE_P7X);
+        if ((m_validation & MSIX_VALIDATION_OPTION_SKIPSIGNATURE) == 0)
+        {   ThrowErrorIfNot(Error::MissingAppxSignatureP7X, file, "AppxSignature.p7x not in archive!");
+        }
+        auto appxSignature = ComPtr<IVerifierObject>::Make<AppxSignatureObject>(m_factory.Get(), m_validation, file);
+
+        file = GetFootprintFile(CONTENT_TYPES_XML);
+        ThrowErrorIfNot(Error::MissingContentTypesXML, file, "[Content_Types].xml not in archive!");
+        auto stream = appxSignature->GetValidationStream(CONTENT_TYPES_XML, file);
+        xmlFactory->CreateDomFromStream(XmlContentType::ContentTypeXml, stream);
+
+        file = GetFootprintFile(APPXBLOCKMAP_XML);
+        ThrowErrorIfNot(Error::MissingAppxBlockMapXML, file, "AppxBlockMap.xml not in archive!");
+        stream = appxSignature->GetValidationStream(APPXBLOCKMAP_XML, file);
+        auto appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(m_factory.Get(), stream);
+
+        file = GetFootprintFile(APPXMANIFEST_XML);
+        ThrowErrorIfNot(Error::MissingAppxManifestXML, file, "AppxManifest.xml or AppxBundleManifest.xml not in archive!");
+        stream = appxBlockMap->GetValidationStream(APPXMANIFEST_XML, file);
+        auto appxManifest = ComPtr<IVerifierObject>::Make<AppxManifestObject>(m_factory.Get(), stream);
+
+        if ((m_validation & MSIX_VALIDATION_OPTION_SKIPSIGNATURE) == 0)
+        {
+            ComPtr<IAppxManifestPackageId> packageId;
+            ThrowHrIfFailed(appxManifest.As<IAppxManifestReader>()->GetPackageId(&packageId));
+            auto publisherFromSignature = appxSignature->GetPublisher();
+            BOOL isSame = FALSE;
+            ThrowHrIfFailed(packageId->ComparePublisher(
+                reinterpret_cast<LPCWSTR>(utf8_to_wstring(publisherFromSignature).c_str()), &isSame));
+            if(!isSame)
+            {
+                auto internal = packageId.As<IAppxManifestPackageIdInternal>();
+                std::string reason = "Publisher mismatch: '" + internal->GetPublisher() + "' != '" + publisherFromSignature + "'";
+                ThrowErrorAndLog(Error::PublisherMismatch, reason.c_str());
+            }
+        }
+
+        // 3. Check what was extracted against the blockmap.
+        VerifyFiles(appxBlockMap.As<IAppxBlockMapInternal>());
+
+        // 4. The package is valid, extract the footprint files like AppxPackageObject::Unpack does.
+        ExtractFootprintFile(APPXBLOCKMAP_XML, appxBlockMap->GetStream());
+        ExtractFootprintFile(APPXMANIFEST_XML, appxManifest->GetStream());
+        if (appxSignature->HasStream())
+        {
+            ExtractFootprintFile(APPXSIGNATURE_P7X, appxSignature->GetStream());
+        }
+        file = GetFootprintFile(CODEINTEGRITY_CAT);
+        if (file)
+        {
+            ExtractFootprintFile(CODEINTEGRITY_CAT, appxSignature->GetValidationStream(CODEINTEGRITY_CAT, file));
+        }
+        m_isComplete = true;
+    }
+
+    ForwardOnlyUnpacker::ZipFile ForwardOnlyUnpacker::ReadFile(ZipObjectForwardOnlyReader& zip, bool isCompressed,
+        const std::function<void(const std::uint8_t*, std::size_t)>& write)
+    {
+        ZipFile result;
+        result.isCompressed = isCompressed;
+        result.size = 0;
+
+        // Hash every block of the blockmap as it goes by, so the data doesn't have to be read again.
+        std::vector<std::uint8_t> block(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+        std::size_t blockSize = 0;
+        auto HashBlock = [&]()
+        {
+            std::vector<std::uint8_t> hash;
+            ThrowErrorIfNot(Error::Unexpected, SHA256::ComputeHash(block.data(), static_cast<std::uint32_t>(blockSize), hash),
+                "Failed computing hash");
+            result.hashes.push_back(std::move(hash));
+            blockSize = 0;
+        };
+
+        std::size_t bytesRead = 0;
+        while ((bytesRead = zip.ReadFileData(block.data() + blockSize, block.size() - blockSize)) != 0)
+        {
+            write(block.data() + blockSize, bytesRead);
+            blockSize += bytesRead;
+            result.size += bytesRead;
+            if (blockSize == block.size())
+            {
+                HashBlock();
+            }
+        }
+        if (blockSize != 0)
+        {
+            HashBlock();
+        }
+        result.sizeOnZip = zip.GetSizeOnZip();
+        return result;
+    }
+
+    void ForwardOnlyUnpacker::VerifyFiles(const ComPtr<IAppxBlockMapInternal>& blockMapInternal)
+    {
+        std::size_t filesInBlockMap = 0;
+        for (const auto& fileName : blockMapInternal->GetFileNames())
+        {
+            auto opcFileName = Encoding::EncodeFileName(fileName);
+            auto file = m_files.find(opcFileName);
+            if (file == m_files.end())
+            {   // Footprint files other than the code integrity catalog aren't in the blockmap
+                ThrowErrorIf(Error::FileNotFound, !IsFootprintFile(opcFileName), "File described in blockmap not contained in OPC container");
+                continue;
+            }
+            AppxPackageObject::VerifyFile(file->second.isCompressed, file->second.sizeOnZip, fileName, blockMapInternal);
+
+            // What BlockMapStream would check while reading the file
+            UINT64 size = 0;
+            ThrowHrIfFailed(blockMapInternal->GetFile(fileName)->GetUncompressedSize(&size));
+            ThrowErrorIf(Error::BlockMapSemanticError, (size != file->second.size),
+                "Size of the file in the block map and the OPC container don't match");
+            auto blocks = blockMapInternal->GetBlocks(fileName);
+            ThrowErrorIf(Error::SignatureInvalid, (blocks.GetCount() != file->second.hashes.size()), "Invalid signature");
+            for (std::size_t i = 0; i < blocks.GetCount(); i++)
+            {
+                const auto& hash = file->second.hashes[i];
+                ThrowErrorIf(Error::SignatureInvalid, (hash.size() != BLOCKMAP_HASH_SIZE) ||
+                    (memcmp(hash.data(), blocks.GetHash(i), BLOCKMAP_HASH_SIZE) != 0), "Invalid signature");
+            }
+            if (!IsFootprintFile(opcFileName))
+            {
+                filesInBlockMap++;
+            }
+        }
+
+        // Every file that was extracted has to be described by the blockmap
+        ThrowErrorIfNot(Error::BlockMapSemanticError, (filesInBlockMap == m_createdFiles.size()),
+            "Payload file not described in AppxBlockMap.xml");
+    }
+
+    ComPtr<IStream> ForwardOnlyUnpacker::CreateTargetFile(const std::string& name)
+    {
+        ThrowErrorIfNot(Error::ZipLocalFileHeader, IsInDestination(name), "File name in the zip is outside of the destination");
+        // Files that are already in the destination aren't written over, opening them fails.
+        auto file = m_to->OpenFile(name, MSIX::FileStream::Mode::CREATE_UPDATE);
+        m_createdFiles.push_back(name);
+        return file;
+    }
+
+    void ForwardOnlyUnpacker::ExtractFootprintFile(const std::string& name, const ComPtr<IStream>& stream)
+    {
+        ValidateStream(stream);
+        auto targetFile = CreateTargetFile(name);
+        LARGE_INTEGER li {0};
+        ThrowHrIfFailed(stream->Seek(li, StreamBase::Reference::START, nullptr));
+        ULARGE_INTEGER bytesCount = {0};
+        bytesCount.QuadPart = std::numeric_limits<std::uint64_t>::max();
+        ThrowHrIfFailed(stream->CopyTo(targetFile.Get(), bytesCount, nullptr, nullptr));
+    }
+}
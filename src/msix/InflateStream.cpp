@@ -12,6 +12,7 @@
 #include <cstring>
 #include <array>
 #include <utility>
+#include <limits>
 
 namespace MSIX {
 
@@ -31,9 +32,12 @@ namespace MSIX {
         // State::UNINITIALIZED
         InflateHandler([](InflateStream* self, void*, ULONG)
         {
-            ThrowHrIfFailed(self->m_stream->Seek({0}, StreamBase::START, nullptr));
-            self->m_fileCurrentPosition = 0;
-            self->m_fileCurrentWindowPositionEnd = 0;
+            LARGE_INTEGER start = { 0 };
+            start.QuadPart = static_cast<LONGLONG>(self->m_startPoint.second);
+            ThrowHrIfFailed(self->m_stream->Seek(start, StreamBase::START, nullptr));
+            self->m_mappedInputPosition = self->m_startPoint.second;
+            self->m_fileCurrentPosition = self->m_startPoint.first;
+            self->m_fileCurrentWindowPositionEnd = self->m_startPoint.first;
 
             self->m_compressionStatus = self->m_compressionObject->Initialize(CompressionOperation::Inflate);
             ThrowErrorIfNot(Error::InflateInitialize, (self->m_compressionStatus == CompressionStatus::Ok), "compression_stream_init failed");
@@ -44,8 +48,20 @@ namespace MSIX {
         InflateHandler([](InflateStream* self, void*, ULONG)
         {
             ThrowErrorIfNot(Error::InflateRead,(self->m_compressionObject->GetAvailableSourceSize() == 0), "uninflated bytes overwritten");
+            if (self->m_mappedInput)
+            {   // Inflate straight out of the mapping, no need to copy the compressed bytes first.
+                std::uint64_t available = std::min(self->m_mappedInputSize - self->m_mappedInputPosition,
+                    static_cast<std::uint64_t>(std::numeric_limits<std::uint32_t>::max()));
+                ThrowErrorIf(Error::FileRead, (available == 0), "Getting nothing back is unexpected here.");
+                self->m_compressionObject->SetInput(const_cast<std::uint8_t*>(self->m_mappedInput + self->m_mappedInputPosition), static_cast<size_t>(available));
+                self->m_mappedInputPosition += available;
+                return std::make_pair(true, InflateStream::State::READY_TO_INFLATE);
+            }
             ULONG available = 0;
-            self->m_compressedBuffer = std::make_unique<std::vector<std::uint8_t>>(BufferSize);
+            if (!self->m_compressedBuffer)
+            {   // Allocated once and reused for the life of the stream.
+                self->m_compressedBuffer = std::make_unique<std::vector<std::uint8_t>>(BufferSize);
+            }
             ThrowHrIfFailed(self->m_stream->Read(self->m_compressedBuffer->data(), static_cast<ULONG>(self->m_compressedBuffer->size()), &available));
             ThrowErrorIf(Error::FileRead, (available == 0), "Getting nothing back is unexpected here.");
             self->m_compressionObject->SetInput(self->m_compressedBuffer->data(), static_cast<size_t>(available));
@@ -53,23 +69,58 @@ namespace MSIX {
         }), // State::READY_TO_READ
 
         // State::READY_TO_INFLATE
-        InflateHandler([](InflateStream* self, void*, ULONG)
+        InflateHandler([](InflateStream* self, void* buffer, ULONG countBytes)
         {
-            self->m_inflateWindow = std::make_unique<std::vector<std::uint8_t>>(BufferSize);
+            // When there's nothing to skip and the caller wants at least a window's worth, inflate straight into
+            // the caller's buffer instead of going through the window. Never past the end of the file though.
+            bool inflateToCaller = (self->m_fileCurrentPosition == self->m_seekPosition) && (countBytes >= BufferSize);
+            ULONG outputSize = static_cast<ULONG>(BufferSize);
+            if (inflateToCaller)
+            {
+                outputSize = static_cast<ULONG>(std::min(static_cast<ULONGLONG>(countBytes), self->m_uncompressedSize - self->m_fileCurrentPosition));
+                self->m_compressionObject->SetOutput(reinterpret_cast<std::uint8_t*>(buffer), outputSize);
+            }
+            else
+            {
+                if (!self->m_inflateWindow)
+                {   // Allocated once and reused for the life of the stream.
+                    self->m_inflateWindow = std::make_unique<std::vector<std::uint8_t>>(BufferSize);
+                }
+                self->m_compressionObject->SetOutput(self->m_inflateWindow->data(), self->m_inflateWindow->size());
+            }
             self->m_inflateWindowPosition = 0;
-            self->m_compressionObject->SetOutput(self->m_inflateWindow->data(), self->m_inflateWindow->size());
             self->m_compressionStatus = self->m_compressionObject->Inflate();
             switch (self->m_compressionStatus)
             {
             case CompressionStatus::Error:
                 self->Cleanup();
+                if (self->m_startPoint.first != 0)
+                {   // The seek point doesn't stand on its own after all. Forget about them and start from the beginning.
+                    self->m_seekPoints.clear();
+                    self->m_startPoint = { 0, 0 };
+                    return std::make_pair(true, InflateStream::State::UNINITIALIZED);
+                }
                 ThrowErrorIfNot(Error::InflateCorruptData, false, "inflate failed unexpectedly.");
                 break;
             case CompressionStatus::Ok:
             case CompressionStatus::End:
             default:
-                self->m_fileCurrentWindowPositionEnd += (BufferSize - self->m_compressionObject->GetAvailableDestinationSize());
-                return std::make_pair(true, InflateStream::State::READY_TO_COPY);
+                ULONG inflated = static_cast<ULONG>(outputSize - self->m_compressionObject->GetAvailableDestinationSize());
+                self->m_fileCurrentWindowPositionEnd += inflated;
+                if (!inflateToCaller)
+                {
+                    return std::make_pair(true, InflateStream::State::READY_TO_COPY);
+                }
+                // Same as READY_TO_COPY does after copying out of the window, only without the copy.
+                self->m_bytesRead           += inflated;
+                self->m_seekPosition        += inflated;
+                self->m_fileCurrentPosition += inflated;
+                if (self->m_fileCurrentPosition == self->m_uncompressedSize)
+                {
+                    self->Cleanup();
+                    return std::make_pair(false, InflateStream::State::UNINITIALIZED);
+                }
+                return std::make_pair(true, (self->m_compressionObject->GetAvailableDestinationSize() == 0) ? InflateStream::State::READY_TO_INFLATE : InflateStream::State::READY_TO_READ);
             }
         }), // State::READY_TO_INFLATE
 
@@ -83,8 +134,9 @@ namespace MSIX {
                 return std::make_pair(true, InflateStream::State::CLEANUP);
             }
 
-            // If the end of the current window position is less than the seek position, keep inflating
-            if (self->m_fileCurrentWindowPositionEnd < self->m_seekPosition)
+            // If the current window ends before the seek position, keep inflating. A window that ends right at
+            // the seek position has nothing to copy either.
+            if (self->m_fileCurrentWindowPositionEnd <= self->m_seekPosition)
             {
                 self->m_fileCurrentPosition = self->m_fileCurrentWindowPositionEnd;
                 return std::make_pair(true, (self->m_compressionObject->GetAvailableDestinationSize() == 0) ? InflateStream::State::READY_TO_INFLATE : InflateStream::State::READY_TO_READ);
@@ -94,6 +146,7 @@ namespace MSIX {
             // calculate the number of bytes to skip ahead within this window
             ULONG bytesToSkipInWindow = (ULONG)(self->m_seekPosition - self->m_fileCurrentPosition);
             self->m_inflateWindowPosition += bytesToSkipInWindow;
+            self->m_fileCurrentPosition   += bytesToSkipInWindow;
 
             // Calculate the difference between the beginning of the window and the seek position.
             // if there's nothing left in the window to copy, then we need to fetch another window.
@@ -138,6 +191,12 @@ namespace MSIX {
         m_uncompressedSize(uncompressedSize)
     {
         m_compressionObject = CreateCompressionObject();
+        ComPtr<IMappedStream> mapped;
+        if (SUCCEEDED(m_stream->QueryInterface(UuidOfImpl<IMappedStream>::iid, reinterpret_cast<void**>(&mapped))) && mapped)
+        {
+            m_mappedInput = mapped->GetMappedBuffer();
+            m_mappedInputSize = mapped->GetMappedSize();
+        }
     }
 
     InflateStream::~InflateStream()
@@ -189,12 +248,18 @@ namespace MSIX {
             m_seekPosition = seekPosition.QuadPart;
             // If the caller is trying to seek back to an earlier
             // point in the inflated stream, we will need to reset
-            // zlib and start inflating from the beginning of the
-            // stream; otherwise, seeking forward is fine: We will
-            // catch up to the seek pointer during the ::Read operation.
-            if (m_seekPosition < m_fileCurrentPosition)
+            // zlib and start inflating from the nearest seek point
+            // before it, or the beginning of the stream. Seeking
+            // forward is fine: We will catch up to the seek pointer
+            // during the ::Read operation, unless there's a seek point
+            // on the way that lets us skip inflating what's in between.
+            auto seekPoint = std::upper_bound(m_seekPoints.begin(), m_seekPoints.end(), m_seekPosition,
+                [](std::uint64_t position, const std::pair<std::uint64_t, std::uint64_t>& point) { return position < point.first; });
+            auto startPoint = (seekPoint == m_seekPoints.begin()) ? std::make_pair<std::uint64_t, std::uint64_t>(0, 0) : *(seekPoint - 1);
+            if ((m_seekPosition < m_fileCurrentPosition) || (startPoint.first > m_fileCurrentPosition))
             {
-                m_fileCurrentPosition = 0;
+                m_startPoint = startPoint;
+                m_fileCurrentPosition = startPoint.first;
                 Cleanup();
             }
         }
@@ -202,6 +267,12 @@ namespace MSIX {
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
+    void InflateStream::SetSeekPoints(std::vector<std::pair<std::uint64_t, std::uint64_t>>&& seekPoints)
+    {
+        ThrowErrorIfNot(Error::InvalidParameter, std::is_sorted(seekPoints.begin(), seekPoints.end()), "seek points out of order");
+        m_seekPoints = std::move(seekPoints);
+    }
+
     void InflateStream::Cleanup()
     {
         if (m_state != State::UNINITIALIZED)
@@ -6,6 +6,8 @@
 #include "Compression.h"
 #include "Exceptions.hpp"
 
+#include <array>
+
 using namespace std;
 
 namespace MSIX {
@@ -26,7 +28,9 @@ namespace MSIX {
                     return GetStatus(compression_stream_init(&m_compressionStream, COMPRESSION_STREAM_DECODE, COMPRESSION_ZLIB));
                     break;
                 default:
-                    NOTIMPLEMENTED;
+                    // libcompression can't do a full flush, blocks compressed with it can't be inflated independently.
+                    // Nothing can be thrown from here, the package writer fails to get a deflater instead.
+                    return CompressionStatus::Error;
             }
         }
 
@@ -35,6 +39,11 @@ namespace MSIX {
             return GetStatus(compression_stream_process(&m_compressionStream, 0));
         }
 
+        CompressionStatus Deflate(bool finish) noexcept
+        {   // Never initialized for deflate, see Initialize.
+            return CompressionStatus::Error;
+        }
+
         CompressionStatus Cleanup() noexcept
         {
             return GetStatus(compression_stream_destroy(&m_compressionStream));
@@ -85,4 +94,47 @@ namespace MSIX {
     {
         return std::make_unique<CompressionObject>();
     }
+
+    CompressionStatus InflateBlock(const std::uint8_t* source, std::size_t sourceSize, std::uint8_t* destination, std::size_t destinationSize)
+    {
+        compression_stream stream = {0};
+        if (compression_stream_init(&stream, COMPRESSION_STREAM_DECODE, COMPRESSION_ZLIB) != COMPRESSION_STATUS_OK)
+        {
+            return CompressionStatus::Error;
+        }
+        stream.src_ptr = source;
+        stream.src_size = sourceSize;
+        stream.dst_ptr = destination;
+        stream.dst_size = destinationSize;
+        auto status = compression_stream_process(&stream, 0);
+        bool isBlock = (status != COMPRESSION_STATUS_ERROR) && (stream.src_size == 0) && (stream.dst_size == 0);
+        compression_stream_destroy(&stream);
+        if (!isBlock) { return CompressionStatus::Error; }
+        return (status == COMPRESSION_STATUS_END) ? CompressionStatus::End : CompressionStatus::Ok;
+    }
+
+    std::uint32_t Crc32(std::uint32_t crc, const std::uint8_t* buffer, std::size_t size)
+    {   // libcompression doesn't expose zlib's crc32
+        static const std::array<std::uint32_t, 256> table = []()
+        {
+            std::array<std::uint32_t, 256> result;
+            for (std::uint32_t i = 0; i < result.size(); i++)
+            {
+                std::uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+                }
+                result[i] = value;
+            }
+            return result;
+        }();
+
+        crc = ~crc;
+        for (std::size_t i = 0; i < size; i++)
+        {
+            crc = table[(crc ^ buffer[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
 }
\ No newline at end of file
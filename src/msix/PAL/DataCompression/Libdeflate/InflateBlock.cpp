@@ -0,0 +1,58 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "ICompressionObject.hpp"
+
+#include <vector>
+#include <libdeflate.h>
+
+namespace MSIX {
+
+    // libdeflate keeps no state between calls, so one decompressor per thread is enough.
+    class BlockDecompressor final
+    {
+    public:
+        BlockDecompressor() : m_decompressor(libdeflate_alloc_decompressor()) {}
+
+        ~BlockDecompressor()
+        {
+            if (m_decompressor) { libdeflate_free_decompressor(m_decompressor); }
+        }
+
+        libdeflate_decompressor* Get() { return m_decompressor; }
+        std::vector<std::uint8_t>& GetInput() { return m_input; }
+
+    private:
+        libdeflate_decompressor*  m_decompressor;
+        std::vector<std::uint8_t> m_input;
+    };
+
+    CompressionStatus InflateBlock(const std::uint8_t* source, std::size_t sourceSize, std::uint8_t* destination, std::size_t destinationSize)
+    {
+        thread_local BlockDecompressor decompressor;
+        if (decompressor.Get() == nullptr) { return CompressionStatus::Error; }
+
+        // libdeflate only inflates whole deflate streams, and a block that ends with a full flush isn't one. The
+        // flush leaves it byte aligned, so an empty final block (a fixed Huffman block with just the end of block
+        // code, 03 00) after it makes it one. If the block already ends the stream, the extra bytes aren't read.
+        auto& input = decompressor.GetInput();
+        input.assign(source, source + sourceSize);
+        input.push_back(0x03);
+        input.push_back(0x00);
+
+        std::size_t read = 0;
+        std::size_t written = 0;
+        auto result = libdeflate_deflate_decompress_ex(decompressor.Get(), input.data(), input.size(), destination,
+            destinationSize, &read, &written);
+        if ((result != LIBDEFLATE_SUCCESS) || (written != destinationSize))
+        {
+            return CompressionStatus::Error;
+        }
+        if (read == input.size())
+        {
+            return CompressionStatus::Ok;
+        }
+        return (read == sourceSize) ? CompressionStatus::End : CompressionStatus::Error;
+    }
+}
@@ -4,6 +4,9 @@
 //
 #include "ICompressionObject.hpp"
 #include "Exceptions.hpp"
+
+#include <algorithm>
+#include <limits>
 #ifdef WIN32
 #include "zlib.h"
 #else
@@ -23,12 +26,17 @@ namespace MSIX {
         CompressionStatus Initialize(CompressionOperation operation) noexcept
         {
             m_zstrm = { 0 };
+            m_operation = operation;
 
             switch (operation)
             {
                 case CompressionOperation::Inflate:
                     return GetStatus(inflateInit2(&m_zstrm, -MAX_WBITS));
                     break;
+                case CompressionOperation::Deflate:
+                    // raw deflate, same as the zip files we inflate
+                    return GetStatus(deflateInit2(&m_zstrm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY));
+                    break;
                 default:
                     NOTIMPLEMENTED;
             }
@@ -39,8 +47,18 @@ namespace MSIX {
             return GetStatus(inflate(&m_zstrm, Z_NO_FLUSH));
         }
 
+        CompressionStatus Deflate(bool finish) noexcept
+        {
+            return GetStatus(deflate(&m_zstrm, finish ? Z_FINISH : Z_FULL_FLUSH));
+        }
+
         CompressionStatus Cleanup() noexcept
         {
+            if (m_operation == CompressionOperation::Deflate)
+            {   // deflateEnd reports Z_DATA_ERROR for a stream that wasn't finished, which is how we use it.
+                deflateEnd(&m_zstrm);
+                return CompressionStatus::Ok;
+            }
             return GetStatus(inflateEnd(&m_zstrm));
         }
 
@@ -67,14 +85,15 @@ namespace MSIX {
         }
 
     private:
-        z_stream        m_zstrm;
+        z_stream             m_zstrm;
+        CompressionOperation m_operation = CompressionOperation::Inflate;
 
         CompressionStatus GetStatus(int status)
         {
             switch (status)
             {
                 case Z_BUF_ERROR:
-                    // Since we do not use Z_FINISH, Z_BUF_ERROR just means there is nothing to do.
+                    // Z_BUF_ERROR just means there is nothing to do, either there's no input or no room for output.
                     //__fallthrough;
                 case Z_OK:
                     return CompressionStatus::Ok;
@@ -97,4 +116,16 @@ namespace MSIX {
     {
         return std::make_unique<CompressionObject>();
     }
+
+    std::uint32_t Crc32(std::uint32_t crc, const std::uint8_t* buffer, std::size_t size)
+    {
+        while (size > 0)
+        {   // zlib takes the size as uInt
+            auto chunk = static_cast<uInt>(std::min(size, static_cast<std::size_t>(std::numeric_limits<uInt>::max())));
+            crc = static_cast<std::uint32_t>(crc32(crc, buffer, chunk));
+            buffer += chunk;
+            size -= chunk;
+        }
+        return crc;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "ICompressionObject.hpp"
+
+#include <limits>
+#ifdef WIN32
+#include "zlib.h"
+#else
+#include <zlib.h>
+#endif
+
+namespace MSIX {
+
+    // One inflater per thread that is reset between blocks, instead of allocating zlib's state and window for
+    // every block.
+    class BlockInflater final
+    {
+    public:
+        BlockInflater()
+        {
+            m_zstrm = { 0 };
+            m_isInitialized = (inflateInit2(&m_zstrm, -MAX_WBITS) == Z_OK);
+        }
+
+        ~BlockInflater()
+        {
+            if (m_isInitialized) { inflateEnd(&m_zstrm); }
+        }
+
+        z_stream* Get()
+        {
+            if (!m_isInitialized || (inflateReset(&m_zstrm) != Z_OK)) { return nullptr; }
+            return &m_zstrm;
+        }
+
+    private:
+        z_stream m_zstrm;
+        bool     m_isInitialized = false;
+    };
+
+    CompressionStatus InflateBlock(const std::uint8_t* source, std::size_t sourceSize, std::uint8_t* destination, std::size_t destinationSize)
+    {
+        if ((sourceSize > std::numeric_limits<uInt>::max()) || (destinationSize > std::numeric_limits<uInt>::max()))
+        {
+            return CompressionStatus::Error;
+        }
+        thread_local BlockInflater inflater;
+        z_stream* zstrm = inflater.Get();
+        if (zstrm == nullptr) { return CompressionStatus::Error; }
+
+        zstrm->next_in = const_cast<Bytef*>(source);
+        zstrm->avail_in = static_cast<uInt>(sourceSize);
+        zstrm->next_out = destination;
+        zstrm->avail_out = static_cast<uInt>(destinationSize);
+        // With no room left zlib still goes over what doesn't produce output, like the empty stored block of a full
+        // flush, so input left over means the block inflates to more than destinationSize.
+        int status = inflate(zstrm, Z_NO_FLUSH);
+        if (((status != Z_OK) && (status != Z_STREAM_END) && (status != Z_BUF_ERROR)) ||
+            (zstrm->avail_in != 0) || (zstrm->avail_out != 0))
+        {
+            return CompressionStatus::Error;
+        }
+        return (status == Z_STREAM_END) ? CompressionStatus::End : CompressionStatus::Ok;
+    }
+}
@@ -9,6 +9,8 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <fts.h>
+#include <unistd.h>
+#include <cstdio>
 
 namespace MSIX {
 
@@ -52,4 +54,40 @@ namespace MSIX {
         auto result = ComPtr<IStream>::Make<FileStream>(std::move(name), mode);
         return result;
     }
+
+    bool DirectoryObject::RemoveFile(const std::string& fileName)
+    {
+        std::string name = m_root + "/" + fileName;
+        return (std::remove(name.c_str()) == 0);
+    }
+
+    bool DirectoryObject::GetFileSize(const std::string& fileName, std::uint64_t& size)
+    {
+        std::string name = m_root + "/" + fileName;
+        struct stat fileStat;
+        if (stat(name.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) { return false; }
+        size = static_cast<std::uint64_t>(fileStat.st_size);
+        return true;
+    }
+
+    bool DirectoryObject::LinkFile(const std::string& fileName, const DirectoryObject& source, const std::string& sourceName)
+    {
+        std::string name = m_root + "/" + fileName;
+        std::string sourcePath = source.m_root + "/" + sourceName;
+        struct stat sourceStat;
+        struct stat targetStat;
+        if (stat(sourcePath.c_str(), &sourceStat) != 0) { return false; }
+        if (stat(name.c_str(), &targetStat) == 0)
+        {
+            if (targetStat.st_dev == sourceStat.st_dev && targetStat.st_ino == sourceStat.st_ino) { return true; }
+            std::remove(name.c_str());
+        }
+        else
+        {
+            auto lastSlash = name.find_last_of("/");
+            std::string path = name.substr(0, lastSlash);
+            mkdirp(path);
+        }
+        return (link(sourcePath.c_str(), name.c_str()) == 0);
+    }
 }
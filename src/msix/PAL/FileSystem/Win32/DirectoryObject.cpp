@@ -13,6 +13,7 @@
 #include <sstream>
 #include <locale>
 #include <codecvt>
+#include <algorithm>
 #include "MSIXWindows.hpp"
 #include "UnicodeConversion.hpp"
 
@@ -165,6 +166,62 @@ namespace MSIX {
         auto result = ComPtr<IStream>::Make<FileStream>(std::move(utf8_to_wstring(path)), mode);
         return result;
     }
+
+    bool DirectoryObject::RemoveFile(const std::string& fileName)
+    {
+        std::wstring utf16Name = utf8_to_wstring(m_root + "/" + fileName);
+        std::replace(utf16Name.begin(), utf16Name.end(), L'/', L'\\');
+        return (DeleteFile(utf16Name.c_str()) != FALSE);
+    }
+
+    bool DirectoryObject::GetFileSize(const std::string& fileName, std::uint64_t& size)
+    {
+        std::wstring utf16Name = utf8_to_wstring(m_root + "/" + fileName);
+        std::replace(utf16Name.begin(), utf16Name.end(), L'/', L'\\');
+        WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+        if (!GetFileAttributesEx(utf16Name.c_str(), GetFileExInfoStandard, &attributes) ||
+            (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            return false;
+        }
+        size = (static_cast<std::uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+        return true;
+    }
+
+    // Gets what identifies a file whatever the path to it, returns false if it can't be opened.
+    static bool GetFileIdentity(const std::wstring& utf16Name, BY_HANDLE_FILE_INFORMATION& information)
+    {
+        std::unique_ptr<std::remove_pointer<HANDLE>::type, decltype(&::CloseHandle)> file(
+            CreateFile(utf16Name.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr),
+            &CloseHandle);
+        if (INVALID_HANDLE_VALUE == file.get()) { file.release(); return false; }
+        return (GetFileInformationByHandle(file.get(), &information) != FALSE);
+    }
+
+    bool DirectoryObject::LinkFile(const std::string& fileName, const DirectoryObject& source, const std::string& sourceName)
+    {
+        std::wstring utf16Name = utf8_to_wstring(m_root + "/" + fileName);
+        std::replace(utf16Name.begin(), utf16Name.end(), L'/', L'\\');
+        std::wstring utf16SourceName = utf8_to_wstring(source.m_root + "/" + sourceName);
+        std::replace(utf16SourceName.begin(), utf16SourceName.end(), L'/', L'\\');
+
+        BY_HANDLE_FILE_INFORMATION sourceInformation = {};
+        BY_HANDLE_FILE_INFORMATION targetInformation = {};
+        if (!GetFileIdentity(utf16SourceName, sourceInformation)) { return false; }
+        if (GetFileIdentity(utf16Name, targetInformation) &&
+            targetInformation.dwVolumeSerialNumber == sourceInformation.dwVolumeSerialNumber &&
+            targetInformation.nFileIndexHigh == sourceInformation.nFileIndexHigh &&
+            targetInformation.nFileIndexLow == sourceInformation.nFileIndexLow)
+        {
+            return true;
+        }
+
+        // OpenFile makes sure the directories of the file exist.
+        OpenFile(fileName, FileStream::Mode::WRITE_UPDATE);
+        DeleteFile(utf16Name.c_str());
+        return (CreateHardLink(utf16Name.c_str(), utf16SourceName.c_str(), nullptr) != FALSE);
+    }
 }
 
 // Don't pollute other compilation units with any of our #defs...
@@ -11,6 +11,9 @@
 #include "Exceptions.hpp"
 #include "SHA256.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <memory>
 #include <vector>
 
@@ -105,4 +108,81 @@ namespace MSIX {
 
         return true;
     }
+
+    // CNG already uses the SHA-256 instructions where the CPU has them, so the buffers are hashed one at a time.
+    bool SHA256::IsSupported(Engine engine)
+    {
+        return (engine == Engine::Default) || (engine == Engine::Library);
+    }
+
+    void SHA256::ComputeHashes(std::size_t count, const std::uint8_t* const* buffers, const std::size_t* sizes, std::uint8_t* hashes)
+    {
+        ComputeHashes(Engine::Default, count, buffers, sizes, hashes);
+    }
+
+    void SHA256::ComputeHashes(Engine engine, std::size_t count, const std::uint8_t* const* buffers, const std::size_t* sizes, std::uint8_t* hashes)
+    {
+        ThrowErrorIfNot(Error::InvalidParameter, IsSupported(engine), "SHA256 engine not supported");
+        std::vector<std::uint8_t> hash;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            ThrowErrorIf(Error::InvalidParameter, (sizes[i] > (std::numeric_limits<std::uint32_t>::max)()), "buffer too large to hash");
+            ComputeHash(const_cast<std::uint8_t*>(buffers[i]), static_cast<std::uint32_t>(sizes[i]), hash);
+            memcpy(hashes + hash.size() * i, hash.data(), hash.size());
+        }
+    }
+
+    struct SHA256::Context
+    {
+        unique_alg_handle  algHandle;
+        unique_hash_handle hashHandle;
+        DWORD              hashLength = 0;
+    };
+
+    SHA256::SHA256() : m_context(std::make_unique<Context>())
+    {
+        BCRYPT_ALG_HANDLE algHandleT;
+        DWORD resultLength = 0;
+        ThrowStatusIfFailed(BCryptOpenAlgorithmProvider(&algHandleT, BCRYPT_SHA256_ALGORITHM, nullptr, 0),
+            "failed computing SHA256 hash");
+        m_context->algHandle.reset(algHandleT);
+        ThrowStatusIfFailed(BCryptGetProperty(m_context->algHandle.get(), BCRYPT_HASH_LENGTH, (PBYTE)&m_context->hashLength,
+            sizeof(m_context->hashLength), &resultLength, 0),
+            "failed computing SHA256 hash");
+        ThrowErrorIf(Error::Unexpected, (resultLength != sizeof(m_context->hashLength)), "failed computing SHA256 hash");
+        Init();
+    }
+
+    SHA256::~SHA256() {}
+
+    void SHA256::Init()
+    {
+        BCRYPT_HASH_HANDLE hashHandleT;
+        m_context->hashHandle.reset();
+        ThrowStatusIfFailed(BCryptCreateHash(m_context->algHandle.get(), &hashHandleT, nullptr, 0, nullptr, 0, 0),
+            "failed computing SHA256 hash");
+        m_context->hashHandle.reset(hashHandleT);
+    }
+
+    void SHA256::Update(const std::uint8_t* buffer, std::size_t cbBuffer)
+    {
+        ThrowErrorIf(Error::Unexpected, (m_context->hashHandle.get() == nullptr), "failed computing SHA256 hash");
+        while (cbBuffer > 0)
+        {   // BCryptHashData takes a ULONG size
+            ULONG size = static_cast<ULONG>((std::min)(cbBuffer, static_cast<std::size_t>((std::numeric_limits<ULONG>::max)())));
+            ThrowStatusIfFailed(BCryptHashData(m_context->hashHandle.get(), const_cast<PBYTE>(buffer), size, 0),
+                "failed computing SHA256 hash");
+            buffer += size;
+            cbBuffer -= size;
+        }
+    }
+
+    void SHA256::Final(std::vector<std::uint8_t>& hash)
+    {
+        ThrowErrorIf(Error::Unexpected, (m_context->hashHandle.get() == nullptr), "failed computing SHA256 hash");
+        hash.resize(m_context->hashLength);
+        ThrowStatusIfFailed(BCryptFinishHash(m_context->hashHandle.get(), hash.data(), m_context->hashLength, 0),
+            "failed computing SHA256 hash");
+        m_context->hashHandle.reset();
+    }
 }
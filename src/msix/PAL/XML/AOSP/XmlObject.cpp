@@ -252,6 +252,11 @@ public:
     {
         return ComPtr<IXmlDom>::Make<JavaXmlDom>(m_factory, stream);
     }
+
+    bool ParseFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, XmlStreamVisitor& visitor) override
+    {
+        return false;
+    }
 protected:
     IMsixFactory* m_factory;
 };
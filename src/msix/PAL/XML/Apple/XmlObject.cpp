@@ -174,6 +174,11 @@ public:
     {
         return ComPtr<IXmlDom>::Make<XmlDom>(m_factory, stream);
     }
+
+    bool ParseFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, XmlStreamVisitor& visitor) override
+    {
+        return false;
+    }
 protected:
     IMsixFactory* m_factory;
 };
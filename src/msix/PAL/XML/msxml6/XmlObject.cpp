@@ -578,6 +578,11 @@ public:
             HasIgnorableNamespaces);
     }
 
+    bool ParseFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, XmlStreamVisitor& visitor) override
+    {
+        return false;
+    }
+
 protected:
     bool            m_CoInitialized;
     IMsixFactory*   m_factory;
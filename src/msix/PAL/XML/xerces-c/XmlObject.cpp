@@ -7,6 +7,8 @@
 #include <vector>
 #include <map>
 #include <queue>
+#include <cwchar>
+#include <limits>
 
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
@@ -22,6 +24,10 @@
 #include "xercesc/framework/XMLGrammarPoolImpl.hpp"
 #include "xercesc/parsers/AbstractDOMParser.hpp"
 #include "xercesc/parsers/XercesDOMParser.hpp"
+#include "xercesc/parsers/SAX2XMLReaderImpl.hpp"
+#include "xercesc/sax2/Attributes.hpp"
+#include "xercesc/sax2/DefaultHandler.hpp"
+#include "xercesc/util/BinInputStream.hpp"
 #include "xercesc/sax/ErrorHandler.hpp"
 #include "xercesc/util/PlatformUtils.hpp"
 #include "xercesc/util/XMLString.hpp"
@@ -106,6 +112,28 @@ private:
     IMsixFactory* m_factory = nullptr;
 };
 
+// For Non validation parser GetResources will return an empty vector for the ContentType, BlockMap and AppxBundleManifest.
+static std::vector<std::pair<std::string, ComPtr<IStream>>> GetSchemas(IMsixFactory* factory, XmlContentType footPrintType)
+{
+    if (footPrintType == XmlContentType::AppxBlockMapXml)
+    {
+        return GetResources(factory, Resource::Type::BlockMap);
+    }
+    else if (footPrintType == XmlContentType::AppxManifestXml)
+    {
+        return GetResources(factory, Resource::Type::AppxManifest);
+    }
+    else if (footPrintType == XmlContentType::ContentTypeXml)
+    {
+        return GetResources(factory, Resource::Type::ContentType);
+    }
+    else if (footPrintType == XmlContentType::AppxBundleManifestXml)
+    {
+        return GetResources(factory, Resource::Type::AppxBundleManifest);
+    }
+    ThrowError(Error::InvalidParameter);
+}
+
 template<class T>
 class XercesPtr
 {
@@ -369,29 +397,8 @@ public:
         auto grammarPool = std::make_unique<XERCES_CPP_NAMESPACE::XMLGrammarPoolImpl>(XERCES_CPP_NAMESPACE::XMLPlatformUtils::fgMemoryManager);
         m_parser = std::make_unique<XERCES_CPP_NAMESPACE::XercesDOMParser>(nullptr, XERCES_CPP_NAMESPACE::XMLPlatformUtils::fgMemoryManager, grammarPool.get());
         
-        // For Non validation parser GetResources will return an empty vector for the ContentType, BlockMap and AppxBundleManifest.
         // XercesDom will only parse the schemas if the vector is not empty. If not, it will only see that it is valid xml.
-        std::vector<std::pair<std::string, ComPtr<IStream>>> schemas;
-        if (footPrintType == XmlContentType::AppxBlockMapXml)
-        {
-            schemas = GetResources(m_factory, Resource::Type::BlockMap);
-        }
-        else if (footPrintType == XmlContentType::AppxManifestXml)
-        {
-            schemas = GetResources(m_factory, Resource::Type::AppxManifest);
-        }
-        else if (footPrintType == XmlContentType::ContentTypeXml)
-        {
-            schemas = GetResources(m_factory, Resource::Type::ContentType);
-        }
-        else if (footPrintType == XmlContentType::AppxBundleManifestXml)
-        {
-            schemas = GetResources(m_factory, Resource::Type::AppxBundleManifest);
-        }
-        else
-        {
-            ThrowError(Error::InvalidParameter);
-        }
+        auto schemas = GetSchemas(m_factory, footPrintType);
 
         // Set the error handler and entity resolver for the parser
         auto errorHandler = std::make_unique<ParsingException>();
@@ -586,6 +593,114 @@ protected:
     ComPtr<IStream> m_stream;
 };
 
+// Lets Xerces read the document from the stream as it parses, instead of from a copy of all of it.
+class StreamBinInputStream final : public BinInputStream
+{
+public:
+    StreamBinInputStream(const ComPtr<IStream>& stream) : m_stream(stream) {}
+
+    XMLFilePos curPos() const override { return m_position; }
+
+    XMLSize_t readBytes(XMLByte* const toFill, const XMLSize_t maxToRead) override
+    {
+        ULONG actualRead = 0;
+        ThrowHrIfFailed(m_stream->Read(toFill, static_cast<ULONG>(std::min(maxToRead, static_cast<XMLSize_t>(std::numeric_limits<ULONG>::max()))), &actualRead));
+        m_position += actualRead;
+        return actualRead;
+    }
+
+    const XMLCh* getContentType() const override { return nullptr; }
+
+protected:
+    ComPtr<IStream> m_stream;
+    XMLFilePos m_position = 0;
+};
+
+class StreamInputSource final : public InputSource
+{
+public:
+    StreamInputSource(const ComPtr<IStream>& stream) : InputSource("XML File"), m_stream(stream) {}
+
+    BinInputStream* makeStream() const override { return new (getMemoryManager()) StreamBinInputStream(m_stream); }
+
+protected:
+    ComPtr<IStream> m_stream;
+};
+
+// The element the SAX parser is at. Its attributes are only there while the handler is called for it.
+class XercesStreamElement final : public ComClass<XercesStreamElement, IXmlElement>
+{
+public:
+    XercesStreamElement(const Attributes* const* attributes) : m_attributes(attributes)
+    {
+        for (const auto& name : attributeNames)
+        {
+            m_attributeNames.emplace_back(name, name + std::wcslen(name));
+        }
+    }
+
+    // IXmlElement
+    std::string GetAttributeValue(XmlAttributeName attribute) override
+    {
+        auto value = GetValue(attribute);
+        return (value == nullptr) ? std::string() : u16string_to_utf8(std::u16string(value));
+    }
+
+    std::vector<std::uint8_t> GetBase64DecodedAttributeValue(XmlAttributeName attribute) override
+    {
+        auto value = GetValue(attribute);
+        if (value == nullptr) { return {}; }
+        XMLSize_t len = 0;
+        XercesXMLBytePtr decodedData(XERCES_CPP_NAMESPACE::Base64::decodeToXMLByte(value, &len));
+        return std::vector<std::uint8_t>(decodedData.Get(), decodedData.Get() + len);
+    }
+
+    std::string GetText() override { NOTSUPPORTED; }
+
+protected:
+    const XMLCh* GetValue(XmlAttributeName attribute)
+    {
+        ThrowErrorIf(Error::XmlError, (*m_attributes == nullptr), "Element is no longer being read");
+        return (*m_attributes)->getValue(m_attributeNames[static_cast<std::uint8_t>(attribute)].c_str());
+    }
+
+    const Attributes* const* m_attributes;
+    std::vector<std::u16string> m_attributeNames;
+};
+
+// Hands the elements the SAX parser reads to the visitor.
+class XercesStreamHandler final : public DefaultHandler
+{
+public:
+    XercesStreamHandler(XmlStreamVisitor& visitor) : m_visitor(visitor)
+    {
+        m_element = ComPtr<IXmlElement>::Make<XercesStreamElement>(&m_attributes);
+    }
+
+    void startElement(const XMLCh* const uri, const XMLCh* const localname, const XMLCh* const qname, const Attributes& attrs) override
+    {
+        m_attributes = &attrs;
+        m_visitor.StartElement(m_visitor.context, GetName(localname, qname), m_element);
+        m_attributes = nullptr;
+    }
+
+    void endElement(const XMLCh* const uri, const XMLCh* const localname, const XMLCh* const qname) override
+    {
+        m_visitor.EndElement(m_visitor.context, GetName(localname, qname));
+    }
+
+protected:
+    // Without namespaces there's only the qualified name, like the DOM has.
+    std::string GetName(const XMLCh* const localname, const XMLCh* const qname)
+    {
+        return u16string_to_utf8(std::u16string((localname != nullptr && *localname != 0) ? localname : qname));
+    }
+
+    XmlStreamVisitor& m_visitor;
+    const Attributes* m_attributes = nullptr;
+    ComPtr<IXmlElement> m_element;
+};
+
 class XercesFactory final : public ComClass<XercesFactory, IXmlFactory>
 {
 public:
@@ -603,6 +718,56 @@ public:
     {
         return ComPtr<IXmlDom>::Make<XercesDom>(m_factory, stream, footPrintType);
     }
+
+    bool ParseFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, XmlStreamVisitor& visitor) override
+    {
+        // Stripping ignorable namespaces from a manifest needs a DOM.
+        if (footPrintType == XmlContentType::AppxManifestXml || footPrintType == XmlContentType::AppxBundleManifestXml)
+        {
+            return false;
+        }
+
+        auto grammarPool = std::make_unique<XERCES_CPP_NAMESPACE::XMLGrammarPoolImpl>(XERCES_CPP_NAMESPACE::XMLPlatformUtils::fgMemoryManager);
+        auto reader = std::make_unique<XERCES_CPP_NAMESPACE::SAX2XMLReaderImpl>(XERCES_CPP_NAMESPACE::XMLPlatformUtils::fgMemoryManager, grammarPool.get());
+
+        auto handler = std::make_unique<XercesStreamHandler>(visitor);
+        auto errorHandler = std::make_unique<ParsingException>();
+        auto entityResolver = std::make_unique<MsixEntityResolver>(m_factory, s_xmlNamespaces[static_cast<std::uint8_t>(footPrintType)]);
+        reader->setContentHandler(handler.get());
+        reader->setErrorHandler(errorHandler.get());
+        reader->setXMLEntityResolver(entityResolver.get());
+
+        // Validate the same way XercesDom does, and only check that it is valid xml when there are no schemas.
+        auto schemas = GetSchemas(m_factory, footPrintType);
+        bool validate = !schemas.empty();
+        reader->setFeature(XMLUni::fgSAX2CoreNameSpaces, validate);
+        reader->setFeature(XMLUni::fgSAX2CoreValidation, validate);
+        reader->setFeature(XMLUni::fgXercesSchema, validate);
+        if (validate)
+        {
+            reader->setFeature(XMLUni::fgXercesDynamic, false);
+            reader->setFeature(XMLUni::fgXercesCacheGrammarFromParse, true);
+            reader->setFeature(XMLUni::fgXercesSchemaFullChecking, true);
+            // Disable DTD and prevent XXE attacks, as XercesDom does.
+            reader->setFeature(XMLUni::fgXercesIgnoreCachedDTD, true);
+            reader->setFeature(XMLUni::fgXercesSkipDTDValidation, true);
+
+            for(const auto& schema : schemas)
+            {
+                auto schemaBuffer = Helper::CreateBufferFromStream(schema.second);
+                auto item = std::make_unique<XERCES_CPP_NAMESPACE::MemBufInputSource>(
+                    reinterpret_cast<const XMLByte*>(&schemaBuffer[0]), schemaBuffer.size(), schema.first.c_str());
+                reader->loadGrammar(*item, XERCES_CPP_NAMESPACE::Grammar::GrammarType::SchemaGrammarType, true);
+            }
+        }
+
+        LARGE_INTEGER li{0};
+        ThrowHrIfFailed(stream->Seek(li, StreamBase::Reference::START, nullptr));
+        StreamInputSource source(stream);
+        reader->parse(source);
+        ThrowHrIfFailed(stream->Seek(li, StreamBase::Reference::START, nullptr));
+        return true;
+    }
 protected:
     IMsixFactory* m_factory;
 };
@@ -0,0 +1,250 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PackageIndex.hpp"
+#include "Exceptions.hpp"
+#include "SHA256.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace MSIX {
+
+/* Index layout. All values are in the byte order of the machine that wrote the index.
+    magic                       8 bytes ("MSIXIDX\0")
+    version                     4 bytes
+    size of the index           8 bytes
+    key                         string
+    number of zip entries       4 bytes
+        name                    string
+        data offset             8 bytes
+        compressed size         8 bytes
+        uncompressed size       8 bytes
+        is compressed           1 byte
+    number of blockmap files    4 bytes
+        name                    string
+        size                    8 bytes
+        local file header size  4 bytes
+        number of blocks        4 bytes
+            block size          8 bytes
+            compressed size     8 bytes
+            hash                string
+   Strings are stored as a 4 bytes length followed by the bytes.
+*/
+static const char          IndexMagic[8] = { 'M', 'S', 'I', 'X', 'I', 'D', 'X', '\0' };
+static const std::uint32_t IndexVersion  = 1;
+static const char* const   IndexFileExtension = ".msixindex";
+
+class IndexWriter
+{
+public:
+    template <class T>
+    void Write(T value) { WriteBytes(&value, sizeof(T)); }
+
+    void WriteBytes(const void* value, std::size_t size)
+    {
+        auto bytes = reinterpret_cast<const std::uint8_t*>(value);
+        m_data.insert(m_data.end(), bytes, bytes + size);
+    }
+
+    template <class T>
+    void WriteString(const T& value)
+    {
+        Write(static_cast<std::uint32_t>(value.size()));
+        WriteBytes(value.data(), value.size());
+    }
+
+    std::vector<std::uint8_t>& GetData() { return m_data; }
+
+protected:
+    std::vector<std::uint8_t> m_data;
+};
+
+// Every read is bounds checked, an index that doesn't parse is treated as a cache miss.
+class IndexReader
+{
+public:
+    IndexReader(const std::uint8_t* data, std::size_t size) : m_data(data), m_size(size) {}
+
+    template <class T>
+    bool Read(T& value)
+    {
+        if (m_size - m_position < sizeof(T)) { return false; }
+        std::memcpy(&value, m_data + m_position, sizeof(T));
+        m_position += sizeof(T);
+        return true;
+    }
+
+    template <class T>
+    bool ReadString(T& value)
+    {
+        std::uint32_t size = 0;
+        if (!Read(size) || (m_size - m_position < size)) { return false; }
+        value.assign(m_data + m_position, m_data + m_position + size);
+        m_position += size;
+        return true;
+    }
+
+    bool IsAtEnd() { return m_position == m_size; }
+
+protected:
+    const std::uint8_t* m_data;
+    std::size_t         m_size;
+    std::size_t         m_position = 0;
+};
+
+static std::unique_ptr<PackageIndex> Parse(const std::uint8_t* data, std::size_t size, const std::string& key)
+{
+    IndexReader reader(data, size);
+    char magic[sizeof(IndexMagic)];
+    std::uint32_t version = 0;
+    std::uint64_t indexSize = 0;
+    std::string indexKey;
+    // A partially written index has the wrong size.
+    if (!reader.Read(magic) || std::memcmp(magic, IndexMagic, sizeof(IndexMagic)) != 0 ||
+        !reader.Read(version) || version != IndexVersion ||
+        !reader.Read(indexSize) || indexSize != size ||
+        !reader.ReadString(indexKey) || indexKey != key)
+    {   return nullptr;
+    }
+
+    auto result = std::make_unique<PackageIndex>(key);
+    std::uint32_t count = 0;
+    if (!reader.Read(count)) { return nullptr; }
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        std::string name;
+        PackageIndex::ZipEntry entry;
+        std::uint8_t isCompressed = 0;
+        if (!reader.ReadString(name) || !reader.Read(entry.dataOffset) || !reader.Read(entry.compressedSize) ||
+            !reader.Read(entry.uncompressedSize) || !reader.Read(isCompressed))
+        {   return nullptr;
+        }
+        entry.isCompressed = (isCompressed != 0);
+        result->GetZipEntries().insert(std::make_pair(std::move(name), entry));
+    }
+
+    if (!reader.Read(count)) { return nullptr; }
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        std::string name;
+        PackageIndex::BlockMapFile file;
+        std::uint32_t blockCount = 0;
+        if (!reader.ReadString(name) || !reader.Read(file.size) || !reader.Read(file.localFileHeaderSize) ||
+            !reader.Read(blockCount))
+        {   return nullptr;
+        }
+        for (std::uint32_t j = 0; j < blockCount; j++)
+        {
+            Block block;
+            if (!reader.Read(block.blockSize) || !reader.Read(block.compressedSize) || !reader.ReadString(block.hash))
+            {   return nullptr;
+            }
+            file.blocks.push_back(std::move(block));
+        }
+        result->GetBlockMapFiles().insert(std::make_pair(std::move(name), std::move(file)));
+    }
+    if (!reader.IsAtEnd()) { return nullptr; }
+    return result;
+}
+
+std::unique_ptr<PackageIndex> PackageIndex::Load(const ComPtr<IStream>& stream, const std::string& key)
+{
+    ComPtr<IMappedStream> mapped;
+    if (SUCCEEDED(stream->QueryInterface(UuidOfImpl<IMappedStream>::iid, reinterpret_cast<void**>(&mapped))) && mapped)
+    {   // Parse the index in place
+        return Parse(mapped->GetMappedBuffer(), static_cast<std::size_t>(mapped->GetMappedSize()), key);
+    }
+
+    LARGE_INTEGER start = { 0 };
+    ULARGE_INTEGER end = { 0 };
+    ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
+    if (end.QuadPart > std::numeric_limits<ULONG>::max()) { return nullptr; }
+    std::vector<std::uint8_t> data(static_cast<std::size_t>(end.QuadPart));
+    ULONG bytesRead = StreamBase::ReadAt(stream, 0, data.data(), static_cast<ULONG>(data.size()));
+    if (bytesRead != data.size()) { return nullptr; }
+    return Parse(data.data(), data.size(), key);
+}
+
+HRESULT PackageIndex::Save(const ComPtr<IStream>& stream)
+{
+    IndexWriter writer;
+    writer.WriteBytes(IndexMagic, sizeof(IndexMagic));
+    writer.Write(IndexVersion);
+    writer.Write(static_cast<std::uint64_t>(0)); // size of the index, filled in below
+    writer.WriteString(m_key);
+
+    writer.Write(static_cast<std::uint32_t>(m_zipEntries.size()));
+    for (const auto& entry : m_zipEntries)
+    {
+        writer.WriteString(entry.first);
+        writer.Write(entry.second.dataOffset);
+        writer.Write(entry.second.compressedSize);
+        writer.Write(entry.second.uncompressedSize);
+        writer.Write(static_cast<std::uint8_t>(entry.second.isCompressed ? 1 : 0));
+    }
+
+    writer.Write(static_cast<std::uint32_t>(m_blockMapFiles.size()));
+    for (const auto& file : m_blockMapFiles)
+    {
+        writer.WriteString(file.first);
+        writer.Write(file.second.size);
+        writer.Write(file.second.localFileHeaderSize);
+        writer.Write(static_cast<std::uint32_t>(file.second.blocks.size()));
+        for (const auto& block : file.second.blocks)
+        {
+            writer.Write(block.blockSize);
+            writer.Write(block.compressedSize);
+            writer.WriteString(block.hash);
+        }
+    }
+
+    auto& data = writer.GetData();
+    if (data.size() > std::numeric_limits<ULONG>::max()) { return static_cast<HRESULT>(Error::NotSupported); }
+    std::uint64_t size = static_cast<std::uint64_t>(data.size());
+    std::memcpy(data.data() + sizeof(IndexMagic) + sizeof(IndexVersion), &size, sizeof(size));
+
+    ULONG bytesWritten = 0;
+    HRESULT hr = stream->Write(data.data(), static_cast<ULONG>(data.size()), &bytesWritten);
+    if (SUCCEEDED(hr) && bytesWritten != data.size()) { hr = static_cast<HRESULT>(Error::FileWrite); }
+    return hr;
+}
+
+std::string GetPackageIndexKey(const std::uint8_t* centralDirectory, std::uint32_t size)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    std::vector<std::uint8_t> hash;
+    ThrowErrorIfNot(Error::Unexpected, SHA256::ComputeHash(const_cast<std::uint8_t*>(centralDirectory), size, hash),
+        "failed computing central directory hash");
+    std::string result;
+    result.reserve(hash.size() * 2);
+    for (auto byte : hash)
+    {
+        result.push_back(hexDigits[byte >> 4]);
+        result.push_back(hexDigits[byte & 0x0F]);
+    }
+    return result;
+}
+
+// DirectoryIndexCache
+HRESULT STDMETHODCALLTYPE DirectoryIndexCache::OpenIndex(LPCSTR key, IStream** index) noexcept try
+{
+    ThrowErrorIf(Error::InvalidParameter, (key == nullptr || index == nullptr || *index != nullptr), "bad pointer");
+    auto path = m_root + m_directory->GetPathSeparator() + key + IndexFileExtension;
+    // Not having an index is the common case, don't make it an error.
+    if (!std::ifstream(path, std::ios::binary).is_open())
+    {   return static_cast<HRESULT>(Error::OK);
+    }
+    return CreateStreamOnFile(const_cast<char*>(path.c_str()), true, index);
+} CATCH_RETURN();
+
+HRESULT STDMETHODCALLTYPE DirectoryIndexCache::CreateIndex(LPCSTR key, IStream** index) noexcept try
+{
+    ThrowErrorIf(Error::InvalidParameter, (key == nullptr || index == nullptr || *index != nullptr), "bad pointer");
+    *index = m_directory->OpenFile(std::string(key) + IndexFileExtension, FileStream::Mode::WRITE).Detach();
+    return static_cast<HRESULT>(Error::OK);
+} CATCH_RETURN();
+
+} // namespace MSIX
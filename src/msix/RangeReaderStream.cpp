@@ -0,0 +1,153 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "RangeReaderStream.hpp"
+#include "UnicodeConversion.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace MSIX {
+
+    // End of central directory record with the longest comment, plus the zip64 locator and record before it.
+    static const std::uint64_t ZipTailSize = 22 + 0xFFFF + 20 + 56;
+    // Read ahead is capped so sequential reads don't push everything else out of the cache.
+    static const std::uint64_t MaxReadAheadBlocks = 16;
+
+    RangeReaderStream::RangeReaderStream(const ComPtr<IMsixRangeReader>& reader, std::uint32_t blockSize, std::uint32_t maxCachedBlocks) :
+        m_reader(reader),
+        m_blockSize((blockSize == 0) ? DefaultBlockSize : blockSize),
+        m_maxCachedBlocks((maxCachedBlocks == 0) ? DefaultMaxCachedBlocks : maxCachedBlocks)
+    {
+        UINT64 size = 0;
+        ThrowHrIfFailed(m_reader->GetSize(&size));
+        m_size = size;
+        if (m_size > 0)
+        {   // Opening the package starts at the end, get all of that in one request.
+            std::uint64_t first = (m_size - std::min(m_size, ZipTailSize)) / m_blockSize;
+            std::uint64_t count = std::min(GetBlockCount() - first, m_maxCachedBlocks);
+            Fetch(GetBlockCount() - count, count);
+            m_nextFetch = GetBlockCount();
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE RangeReaderStream::Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept try
+    {
+        LARGE_INTEGER newPos = { 0 };
+        switch (origin)
+        {
+        case Reference::CURRENT:
+            newPos.QuadPart = m_position + move.QuadPart;
+            break;
+        case Reference::START:
+            newPos.QuadPart = move.QuadPart;
+            break;
+        case Reference::END:
+            newPos.QuadPart = m_size + move.QuadPart;
+            break;
+        }
+        ThrowErrorIf(Error::FileSeek, (newPos.QuadPart < 0), "seek failed");
+        m_position = static_cast<std::uint64_t>(newPos.QuadPart);
+        if (newPosition) { newPosition->QuadPart = m_position; }
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE RangeReaderStream::Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept try
+    {
+        if (bytesRead) { *bytesRead = 0; }
+        ULONG amountRead = ReadAt(m_position, buffer, countBytes);
+        m_position += amountRead;
+        if (bytesRead) { *bytesRead = amountRead; }
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    ULONG RangeReaderStream::ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes)
+    {
+        if (offset >= m_size || countBytes == 0) { return 0; }
+        ULONG amountToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - offset));
+        std::uint64_t lastWanted = (offset + amountToRead - 1) / m_blockSize;
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto output = reinterpret_cast<std::uint8_t*>(buffer);
+        ULONG amountRead = 0;
+        while (amountRead < amountToRead)
+        {
+            std::uint64_t position = offset + amountRead;
+            const auto& block = GetBlock(position / m_blockSize, lastWanted);
+            std::size_t blockOffset = static_cast<std::size_t>(position % m_blockSize);
+            ULONG count = static_cast<ULONG>(std::min(static_cast<std::size_t>(amountToRead - amountRead), block.size() - blockOffset));
+            std::memcpy(output + amountRead, block.data() + blockOffset, count);
+            amountRead += count;
+        }
+        return amountRead;
+    }
+
+    const std::vector<std::uint8_t>& RangeReaderStream::GetBlock(std::uint64_t index, std::uint64_t lastWanted)
+    {
+        auto cached = m_blockIndex.find(index);
+        if (cached == m_blockIndex.end())
+        {   // A miss where the last fetch ended is a sequential read, keep doubling how far ahead it reads.
+            m_readAhead = (index == m_nextFetch) ? std::min(std::max(m_readAhead * 2, static_cast<std::uint64_t>(1)), MaxReadAheadBlocks) : 0;
+            std::uint64_t last = std::min(std::max(lastWanted, index + m_readAhead), GetBlockCount() - 1);
+            // Stop at the first block that is already there and at what the cache and one request can hold.
+            std::uint64_t maxCount = std::min(m_maxCachedBlocks, static_cast<std::uint64_t>(std::numeric_limits<UINT32>::max()) / m_blockSize);
+            std::uint64_t count = 1;
+            while ((index + count <= last) && (count < maxCount) && !IsCached(index + count))
+            {
+                count++;
+            }
+            Fetch(index, count);
+            m_nextFetch = index + count;
+            cached = m_blockIndex.find(index);
+        }
+        else
+        {
+            m_blocks.splice(m_blocks.begin(), m_blocks, cached->second);
+        }
+        return cached->second->data;
+    }
+
+    void RangeReaderStream::Fetch(std::uint64_t first, std::uint64_t count)
+    {
+        std::uint64_t offset = first * m_blockSize;
+        UINT32 size = static_cast<UINT32>(std::min(count * m_blockSize, m_size - offset));
+        std::vector<std::uint8_t> data(size);
+        UINT32 bytesRead = 0;
+        ThrowHrIfFailed(m_reader->ReadRange(offset, size, data.data(), &bytesRead));
+        ThrowErrorIf(Error::FileRead, (bytesRead != size), "range reader returned less data than requested");
+
+        for (std::uint64_t i = 0; i < count; i++)
+        {
+            auto begin = data.begin() + static_cast<std::size_t>(i * m_blockSize);
+            auto end = data.begin() + static_cast<std::size_t>(std::min((i + 1) * m_blockSize, static_cast<std::uint64_t>(size)));
+            CachedBlock block = { first + i, std::vector<std::uint8_t>(begin, end) };
+            // Blocks of a fetch are inserted in order, so the first one ends up least recently used of them.
+            m_blocks.push_front(std::move(block));
+            m_blockIndex[first + i] = m_blocks.begin();
+            if (m_blocks.size() > m_maxCachedBlocks)
+            {
+                m_blockIndex.erase(m_blocks.back().index);
+                m_blocks.pop_back();
+            }
+        }
+    }
+
+    // IMsixStreamFactory
+    HRESULT STDMETHODCALLTYPE RangeReaderStreamFactory::CreateStreamOnRelativePath(LPCWSTR relativePath, IStream** stream) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (relativePath == nullptr), "Invalid parameter");
+        return CreateStreamOnRelativePathUtf8(wstring_to_utf8(relativePath).c_str(), stream);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE RangeReaderStreamFactory::CreateStreamOnRelativePathUtf8(LPCSTR relativePath, IStream** stream) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (relativePath == nullptr || stream == nullptr || *stream != nullptr), "Invalid parameter");
+        ComPtr<IMsixRangeReader> reader;
+        ThrowHrIfFailed(m_rangeReaderFactory->CreateRangeReaderOnRelativePathUtf8(relativePath, &reader));
+        ThrowErrorIfNot(Error::FileNotFound, reader, "range reader factory didn't return a reader");
+        *stream = ComPtr<IStream>::Make<RangeReaderStream>(reader, 0, 0).Detach();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+}
@@ -9,8 +9,12 @@
 #include "ZipObject.hpp"
 #include "ZipFileStream.hpp"
 #include "InflateStream.hpp"
-#include "VectorStream.hpp"
+#include "SHA256.hpp"
+#include "ThreadPool.hpp"
+#include "WorkCounter.hpp"
 
+#include <array>
+#include <future>
 #include <memory>
 #include <string>
 #include <limits>
@@ -135,6 +139,19 @@ constexpr static const GeneralPurposeBitFlags UnsupportedFlagsMask =
     GeneralPurposeBitFlags::UNSUPPORTED_14 |
     GeneralPurposeBitFlags::UNSUPPORTED_15;
 
+// Reads size bytes at offset with a single read. The result is shorter if the stream ends first, which the
+// Meta::SpanReader over it reports as a failed read once a field goes past the end.
+static std::vector<std::uint8_t> ReadBytesAt(const ComPtr<IStream>& stream, std::uint64_t offset, std::size_t size)
+{
+    ThrowErrorIf(Error::FileRead, (size > std::numeric_limits<ULONG>::max()), "read too big");
+    std::vector<std::uint8_t> result(size);
+    if (size != 0)
+    {
+        result.resize(StreamBase::ReadAt(stream, offset, result.data(), static_cast<ULONG>(size)));
+    }
+    return result;
+}
+
 /*  FROM APPNOTE.TXT section 4.5.3:
     If one of the size or offset fields in the Local or Central directory
     record is too small to hold the required data, a Zip64 extended information 
@@ -162,23 +179,19 @@ class Zip64ExtendedInformation final : public Meta::StructuredObject<
 >
 {
 public:
-    void Read(const ComPtr<IStream>& stream)
+    void Read(Meta::SpanReader& reader)
     {
-        StreamBase::Read(stream, &Field<0>().value);
+        Field<0>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<0>().value, static_cast<std::uint32_t>(HeaderIDs::Zip64ExtendedInfo));
 
-        StreamBase::Read(stream, &Field<1>().value);
+        Field<1>().Read(reader);
         Meta::OnlyEitherValueValidation<std::uint32_t>(Field<1>().value, 24, 28);
         
-        StreamBase::Read(stream, &Field<2>().value);
-
-        StreamBase::Read(stream, &Field<3>().value);
-
-        StreamBase::Read(stream, &Field<4>().value);
-        ThrowErrorIfNot(Error::ZipBadExtendedData, Field<4>().value < m_start.QuadPart, "invalid relative header offset");
+        ReadFields<2, 5>(reader);
+        ThrowErrorIfNot(Error::ZipBadExtendedData, Field<4>().value < m_start, "invalid relative header offset");
     }
 
-    Zip64ExtendedInformation(ULARGE_INTEGER start) : m_start(start) {}
+    Zip64ExtendedInformation(std::uint64_t start) : m_start(start) {}
  
     std::uint64_t GetUncompressedSize()         noexcept { return Field<2>().value; }
     void SetUncompressedSize(std::uint64_t v)   noexcept { Field<2>().value = v; }
@@ -188,7 +201,7 @@ public:
     void SetRelativeOffset(std::uint64_t v)     noexcept { Field<4>().value = v; }
 
 private:
-    ULARGE_INTEGER  m_start;
+    std::uint64_t   m_start;
 };
 
 /*  TODO: Implement large file support.
@@ -237,82 +250,54 @@ class CentralDirectoryFileHeader final : public Meta::StructuredObject<
     >
 {
 public:
-    void Read(const ComPtr<IStream>& stream)
+    void Read(Meta::SpanReader& reader)
     {
-        StreamBase::Read(stream, &Field<0>().value);
+        Field<0>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<0>().value, static_cast<std::uint32_t>(Signatures::CentralFileHeader));
 
-        StreamBase::Read(stream, &Field<1>().value);
-
-        StreamBase::Read(stream, &Field<2>().value);
-
-        StreamBase::Read(stream, &Field<3>().value);
+        ReadFields<1, 4>(reader);
         ThrowErrorIfNot(Error::ZipCentralDirectoryHeader,
             0 == (Field<3>().value & static_cast<std::uint16_t>(UnsupportedFlagsMask)),
             "unsupported flag(s) specified");
 
-        StreamBase::Read(stream, &Field<4>().value);
+        Field<4>().Read(reader);
         Meta::OnlyEitherValueValidation<std::uint16_t>(Field<4>().value,  static_cast<std::uint16_t>(CompressionType::Deflate),
             static_cast<std::uint16_t>(CompressionType::Store));
 
-        StreamBase::Read(stream, &Field<5>().value);
-        StreamBase::Read(stream, &Field<6>().value);
-        StreamBase::Read(stream, &Field<7>().value);
-        StreamBase::Read(stream, &Field<8>().value);
-        StreamBase::Read(stream, &Field<9>().value);
-
-        StreamBase::Read(stream, &Field<10>().value);
+        ReadFields<5, 11>(reader);
         ThrowErrorIfNot(Error::ZipCentralDirectoryHeader, (Field<10>().value != 0), "unsupported file name size");
         if (Field<10>().value !=0) {Field<17>().value.resize(Field<10>().value, 0); }
 
-        StreamBase::Read(stream, &Field<11>().value);
+        Field<11>().Read(reader);
         if (Field<11>().value != 0) { Field<18>().value.resize(Field<11>().value, 0); }
 
-        StreamBase::Read(stream, &Field<12>().value);
+        Field<12>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<12>().value, 0);
 
-        StreamBase::Read(stream, &Field<13>().value);
+        Field<13>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<13>().value, 0);
 
-        StreamBase::Read(stream, &Field<14>().value);
-
-        StreamBase::Read(stream, &Field<15>().value);
-        StreamBase::Read(stream, &Field<16>().value);
-        ULARGE_INTEGER pos = {0};
-        ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
+        ReadFields<14, 17>(reader);
         if (!GetIsZip64())
         {
-            ThrowErrorIf(Error::ZipCentralDirectoryHeader, (Field<16>().value >= pos.QuadPart), "invalid relative header offset");
+            ThrowErrorIf(Error::ZipCentralDirectoryHeader, (Field<16>().value >= reader.GetPosition()), "invalid relative header offset");
         }
         else
         {
             ThrowErrorIf(Error::ZipCentralDirectoryHeader, (Field<16>().value != 0xFFFFFFFF), "invalid zip64 local header offset");
         }
 
-        if (Field<17>().Size())
-        {
-            ThrowHrIfFailed(stream->Read(reinterpret_cast<void*>(Field<17>().value.data()), static_cast<ULONG>(Field<17>().Size()), nullptr));
-        }
-
-        if (Field<18>().Size())
-        {
-            ThrowHrIfFailed(stream->Read(reinterpret_cast<void*>(Field<18>().value.data()), static_cast<ULONG>(Field<18>().Size()), nullptr));
-        }
+        ReadFields<17, 19>(reader);
         // Only process for Zip64ExtendedInformation
         if (Field<18>().Size() > 2 && Field<18>().value[0] == 0x01 && Field<18>().value[1] == 0x00)
         {
-            LARGE_INTEGER zero = {0};
-            ThrowHrIfFailed(stream->Seek(zero, StreamBase::Reference::CURRENT, &pos));
-            auto vectorStream = ComPtr<IStream>::Make<VectorStream>(&Field<18>().value);
-            m_extendedInfo = std::make_unique<Zip64ExtendedInformation>(pos);
+            m_extendedInfo = std::make_unique<Zip64ExtendedInformation>(reader.GetPosition());
             ThrowErrorIfNot(Error::ZipCentralDirectoryHeader, (Field<18>().Size() >= m_extendedInfo->Size()), "Unexpected extended info size");
-            m_extendedInfo->Read(vectorStream.Get());
+            Meta::SpanReader extraReader(Field<18>().value.data(), Field<18>().Size());
+            m_extendedInfo->Read(extraReader);
         }
 
-        if (Field<19>().Size())
-        {
-            ThrowHrIfFailed(stream->Read(reinterpret_cast<void*>(Field<19>().value.data()), static_cast<ULONG>(Field<19>().Size()), nullptr));
-        }
+        Field<19>().Read(reader);
     }
 
     CentralDirectoryFileHeader(bool isZip64) : m_isZip64(isZip64)
@@ -428,56 +413,74 @@ class LocalFileHeader final : public Meta::StructuredObject<
 >
 {
 public:
-    void Read(const ComPtr<IStream> &stream)
+    // The fixed size part of the header is read first, then the file name and extra field together.
+    void Read(const ComPtr<IStream>& stream, std::uint64_t offset)
     {
-        StreamBase::Read(stream, &Field<0>().value);
+        auto header = ReadBytesAt(stream, offset, this->Size());
+        Meta::SpanReader reader(header.data(), header.size(), offset);
+        ReadFixedFields(reader);
+
+        auto names = ReadBytesAt(stream, reader.GetPosition(), Field<11>().Size() + Field<12>().Size());
+        Meta::SpanReader namesReader(names.data(), names.size(), reader.GetPosition());
+        ReadFields<11, 13>(namesReader);
+    }
+
+    // Reads up to the extra field length and sizes the file name and extra field.
+    void ReadFixedFields(Meta::SpanReader& reader)
+    {
+        Field<0>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>( Field<0>().value, static_cast<std::uint32_t>(Signatures::LocalFileHeader));
 
-        StreamBase::Read(stream, &Field<1>().value);
+        Field<1>().Read(reader);
         Meta::OnlyEitherValueValidation<std::uint16_t>(Field<1>().value, static_cast<std::uint16_t>(ZipVersions::Zip32DefaultVersion),
                                                   static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
 
-        StreamBase::Read(stream, &Field<2>().value);
+        Field<2>().Read(reader);
         ThrowErrorIfNot(Error::ZipLocalFileHeader, ((Field<2>().value & static_cast<std::uint16_t>(UnsupportedFlagsMask)) == 0), "unsupported flag(s) specified");
-        ThrowErrorIfNot(Error::ZipLocalFileHeader, (IsGeneralPurposeBitSet() == m_directoryEntry->IsGeneralPurposeBitSet()), "inconsistent general purpose bits specified");
+        ThrowErrorIfNot(Error::ZipLocalFileHeader, (!m_directoryEntry || (IsGeneralPurposeBitSet() == m_directoryEntry->IsGeneralPurposeBitSet())),
+            "inconsistent general purpose bits specified");
 
-        StreamBase::Read(stream, &Field<3>().value);
+        Field<3>().Read(reader);
         Meta::OnlyEitherValueValidation<std::uint16_t>(Field<3>().value, static_cast<std::uint16_t>(CompressionType::Deflate),
                                                   static_cast<std::uint16_t>(CompressionType::Store));
 
-        StreamBase::Read(stream, &Field<4>().value);
-        StreamBase::Read(stream, &Field<5>().value);
-        StreamBase::Read(stream, &Field<6>().value);
+        ReadFields<4, 7>(reader);
         ThrowErrorIfNot(Error::ZipLocalFileHeader, (!IsGeneralPurposeBitSet() || (Field<6>().value == 0)), "Invalid Zip CRC");
 
-        StreamBase::Read(stream, &Field<7>().value);
+        Field<7>().Read(reader);
         ThrowErrorIfNot(Error::ZipLocalFileHeader, (!IsGeneralPurposeBitSet() || (Field<7>().value == 0)), "Invalid Zip compressed size");
 
-        StreamBase::Read(stream, &Field<8>().value);
+        Field<8>().Read(reader);
 
-        StreamBase::Read(stream, &Field<9>().value);
+        Field<9>().Read(reader);
         ThrowErrorIfNot(Error::ZipLocalFileHeader, (Field<9>().value != 0), "unsupported file name size");
         Field<11>().value.resize(GetFileNameLength(), 0);
 
-        StreamBase::Read(stream, &Field<10>().value);
+        Field<10>().Read(reader);
         // Even if we don't validate them, we need to read the extra field
         if (Field<10>().value != 0) {Field<12>().value.resize(Field<10>().value, 0); }
+    }
 
-        if (Field<11>().Size())
-        {
-            ThrowHrIfFailed(stream->Read(reinterpret_cast<void*>(Field<11>().value.data()), static_cast<ULONG>(Field<11>().Size()), nullptr));
-        }
+    void ReadNames(Meta::SpanReader& reader) { ReadFields<11, 13>(reader); }
 
-        if (Field<12>().Size())
-        {
-            ThrowHrIfFailed(stream->Read(reinterpret_cast<void*>(Field<12>().value.data()), static_cast<ULONG>(Field<12>().Size()), nullptr));
-        }
+    LocalFileHeader(std::shared_ptr<CentralDirectoryFileHeader> directoryEntry) : m_isZip64(directoryEntry->GetIsZip64()), m_directoryEntry(directoryEntry)
+    {
     }
 
-    LocalFileHeader(std::shared_ptr<CentralDirectoryFileHeader> directoryEntry) : m_isZip64(directoryEntry->GetIsZip64()), m_directoryEntry(directoryEntry)
+    // Header read without its central directory entry, by ZipObjectForwardOnlyReader
+    LocalFileHeader() {}
+
+    // 4.5.3 The zip64 extended information of a local header has the uncompressed and compressed sizes.
+    bool HasZip64ExtendedInformation() noexcept
     {
+        return (Field<12>().Size() >= 20) && (Field<12>().value[0] == 0x01) && (Field<12>().value[1] == 0x00);
     }
 
+    std::uint64_t GetZip64UncompressedSize() noexcept { return GetExtraFieldValue(4); }
+    std::uint64_t GetZip64CompressedSize()   noexcept { return GetExtraFieldValue(12); }
+    std::uint32_t GetCrc32()                 noexcept { return Field<6>().value; }
+    std::uint16_t GetVersionNeededToExtract() noexcept { return Field<1>().value; }
+
     bool IsGeneralPurposeBitSet() noexcept
     {
         return ((GetGeneralPurposeBitFlags() & GeneralPurposeBitFlags::GeneralPurposeBit) == GeneralPurposeBitFlags::GeneralPurposeBit);
@@ -517,6 +520,13 @@ public:
         SetFileNameLength(static_cast<std::uint16_t>(name.size()));
     }
 protected:
+    std::uint64_t GetExtraFieldValue(std::size_t offset) noexcept
+    {
+        std::uint64_t value = 0;
+        std::memcpy(&value, Field<12>().value.data() + offset, sizeof(value));
+        return value;
+    }
+
     bool                                        m_isZip64        = false;
     std::shared_ptr<CentralDirectoryFileHeader> m_directoryEntry = nullptr;
 }; //class LocalFileHeader
@@ -540,49 +550,45 @@ class Zip64EndOfCentralDirectoryRecord final : public Meta::StructuredObject<
     >
 {
 public:
-    void Read(const ComPtr<IStream>& stream)
+    void Read(Meta::SpanReader& reader)
     {
-        StreamBase::Read(stream, &Field<0>().value);
+        Field<0>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<0>().value, static_cast<std::uint32_t>(Signatures::Zip64EndOfCD));
 
-        StreamBase::Read(stream, &Field<1>().value);
+        Field<1>().Read(reader);
         //4.3.14.1 The value stored into the "size of zip64 end of central
         //    directory record" should be the size of the remaining
         //    record and should not include the leading 12 bytes.
         ThrowErrorIfNot(Error::Zip64EOCDRecord, (Field<1>().value == (this->Size() - 12)), "invalid size of zip64 EOCD");
 
-        StreamBase::Read(stream, &Field<2>().value);
+        Field<2>().Read(reader);
         Meta::ExactValueValidation<std::uint16_t>(Field<2>().value, static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
 
-        StreamBase::Read(stream, &Field<3>().value);
+        Field<3>().Read(reader);
         Meta::ExactValueValidation<std::uint16_t>(Field<3>().value, static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
 
-        StreamBase::Read(stream, &Field<4>().value);
+        Field<4>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<4>().value, 0);
 
-        StreamBase::Read(stream, &Field<5>().value);
+        Field<5>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<5>().value, 0);
 
-        StreamBase::Read(stream, &Field<6>().value);
+        Field<6>().Read(reader);
         Meta::NotValueValidation<std::uint64_t>(Field<6>().value, 0);
 
-        StreamBase::Read(stream, &Field<7>().value);
+        Field<7>().Read(reader);
         Meta::NotValueValidation<std::uint64_t>(Field<7>().value, 0);
         ThrowErrorIfNot(Error::Zip64EOCDRecord, (Field<7>().value == this->GetTotalNumberOfEntries()), "invalid total number of entries");
 
-        ULARGE_INTEGER pos = {0};
-        ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
-        StreamBase::Read(stream, &Field<8>().value);
-        ThrowErrorIfNot(Error::Zip64EOCDRecord, ((Field<8>().value != 0) && (Field<8>().value < pos.QuadPart)), "invalid size of central directory");
+        auto pos = reader.GetPosition();
+        Field<8>().Read(reader);
+        ThrowErrorIfNot(Error::Zip64EOCDRecord, ((Field<8>().value != 0) && (Field<8>().value < pos)), "invalid size of central directory");
 
-        ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
-        StreamBase::Read(stream, &Field<9>().value);
-        ThrowErrorIfNot(Error::Zip64EOCDRecord, ((Field<9>().value != 0) && (Field<9>().value < pos.QuadPart)), "invalid size of central directory");
+        pos = reader.GetPosition();
+        Field<9>().Read(reader);
+        ThrowErrorIfNot(Error::Zip64EOCDRecord, ((Field<9>().value != 0) && (Field<9>().value < pos)), "invalid size of central directory");
 
-        if (Field<10>().Size())
-        {
-            ThrowHrIfFailed(stream->Read(reinterpret_cast<void*>(Field<10>().value.data()), static_cast<ULONG>(Field<10>().Size()), nullptr));
-        }
+        Field<10>().Read(reader);
     }
 
     Zip64EndOfCentralDirectoryRecord()
@@ -630,20 +636,18 @@ class Zip64EndOfCentralDirectoryLocator final : public Meta::StructuredObject<
     >
 {
 public:
-    void Read(const ComPtr<IStream>& stream)
+    void Read(Meta::SpanReader& reader)
     {
-        StreamBase::Read(stream, &Field<0>().value);
+        Field<0>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<0>().value, static_cast<std::uint32_t>(Signatures::Zip64EndOfCDLocator));
 
-        StreamBase::Read(stream, &Field<1>().value);
+        Field<1>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<1>().value, 0);
 
-        ULARGE_INTEGER pos = {0};
-        StreamBase::Read(stream, &Field<2>().value);
-        ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
-        ThrowErrorIfNot(Error::Zip64EOCDLocator, ((Field<2>().value != 0) && (Field<2>().value < pos.QuadPart)), "Invalid relative offset");
+        Field<2>().Read(reader);
+        ThrowErrorIfNot(Error::Zip64EOCDLocator, ((Field<2>().value != 0) && (Field<2>().value < reader.GetPosition())), "Invalid relative offset");
 
-        StreamBase::Read(stream, &Field<3>().value);
+        Field<3>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<3>().value, 1);
     }
 
@@ -684,29 +688,28 @@ class EndCentralDirectoryRecord final : public Meta::StructuredObject<
     >
 {
 public:
-    void Read(const ComPtr<IStream>& stream)
+    void Read(Meta::SpanReader& reader)
     {
-        StreamBase::Read(stream, &Field<0>().value);
+        Field<0>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<0>().value, static_cast<std::uint32_t>(Signatures::EndOfCentralDirectory));
 
-        StreamBase::Read(stream, &Field<1>().value);
+        Field<1>().Read(reader);
         Meta::OnlyEitherValueValidation<std::uint32_t>(Field<1>().value, 0, 0xFFFF);
 
-        StreamBase::Read(stream, &Field<2>().value);
+        Field<2>().Read(reader);
         Meta::OnlyEitherValueValidation<std::uint32_t>(Field<2>().value, 0, 0xFFFF);
         ThrowErrorIf(Error::ZipEOCDRecord, (Field<1>().value != Field<2>().value), "field missmatch");
         m_isZip64 = (0xFFFF == Field<2>().value);
 
-        StreamBase::Read(stream, &Field<3>().value);
+        Field<3>().Read(reader);
         if (Field<3>().value != 0 && Field<3>().value != 0xFFFF)
         {   m_archiveHasZip64Locator = false;
         }
 
-        StreamBase::Read(stream, &Field<4>().value);
+        Field<4>().Read(reader);
         ThrowErrorIf(Error::ZipEOCDRecord, (Field<3>().value != Field<4>().value), "field missmatch");
 
-        StreamBase::Read(stream, &Field<5>().value);
-        StreamBase::Read(stream, &Field<6>().value);
+        ReadFields<5, 7>(reader);
 
         if(m_archiveHasZip64Locator)
         {
@@ -716,13 +719,10 @@ public:
                 "unsupported offset of start of central directory");
         }
 
-        StreamBase::Read(stream, &Field<7>().value);
+        Field<7>().Read(reader);
         Meta::ExactValueValidation<std::uint32_t>(Field<7>().value, 0);
 
-        if (Field<8>().Size())
-        {
-           ThrowHrIfFailed(stream->Read(reinterpret_cast<void*>(Field<8>().value.data()), static_cast<ULONG>(Field<8>().Size()), nullptr));
-        }
+        Field<8>().Read(reader);
     }
 
     EndCentralDirectoryRecord()
@@ -762,10 +762,34 @@ private:
 //////////////////////////////////////////////////////////////////////////////////////////////
 //                              ZipObject member implementation                             //
 //////////////////////////////////////////////////////////////////////////////////////////////
+// Reads the local file header of a central directory entry to find where its data is.
+static PackageIndex::ZipEntry ReadZipEntry(const ComPtr<IStream>& stream, const std::shared_ptr<CentralDirectoryFileHeader>& centralFileHeader)
+{
+    auto localFileHeader = std::make_shared<LocalFileHeader>(centralFileHeader);
+    localFileHeader->Read(stream, centralFileHeader->GetRelativeOffsetOfLocalHeader());
+
+    PackageIndex::ZipEntry entry;
+    entry.dataOffset       = centralFileHeader->GetRelativeOffsetOfLocalHeader() + localFileHeader->Size();
+    entry.compressedSize   = localFileHeader->GetCompressedSize();
+    entry.uncompressedSize = localFileHeader->GetUncompressedSize();
+    entry.isCompressed     = localFileHeader->GetCompressionType() == CompressionType::Deflate;
+    return entry;
+}
+
 std::vector<std::string> ZipObject::GetFileNames(FileNameOptions)
 {
     std::vector<std::string> result;
-    std::for_each(m_streams.begin(), m_streams.end(), [&result](auto it)
+    if (m_index)
+    {
+        result.reserve(m_index->GetZipEntries().size());
+        for (const auto& entry : m_index->GetZipEntries())
+        {
+            result.push_back(entry.first);
+        }
+        return result;
+    }
+    result.reserve(m_centralDirectory.size());
+    std::for_each(m_centralDirectory.begin(), m_centralDirectory.end(), [&result](const auto& it)
     {
         result.push_back(it.first);
     });
@@ -773,13 +797,82 @@ std::vector<std::string> ZipObject::GetFileNames(FileNameOptions)
 }
 
 ComPtr<IStream> ZipObject::GetFile(const std::string& fileName)
-{   // TODO: Make this on-demand populate m_streams and then pull from there.
-    auto result = m_streams.find(fileName);
-    if (result == m_streams.end())
+{
+    std::lock_guard<std::mutex> lock(m_streamsLock);
+    auto cached = m_streams.find(fileName);
+    if (cached != m_streams.end())
+    {
+        return cached->second;
+    }
+
+    ComPtr<IStream> fileStream;
+    if (m_index)
+    {
+        auto entry = m_index->GetZipEntries().find(fileName);
+        if (entry == m_index->GetZipEntries().end())
+        {
+            return ComPtr<IStream>();
+        }
+        fileStream = CreateFileStream(fileName, entry->second);
+    }
+    else
+    {
+        auto centralFileHeader = m_centralDirectory.find(fileName);
+        if (centralFileHeader == m_centralDirectory.end())
+        {
+            return ComPtr<IStream>();
+        }
+        // Read the local file header only now that the file is actually requested
+        fileStream = CreateFileStream(fileName, ReadZipEntry(m_stream, centralFileHeader->second));
+    }
+
+    m_streams.insert(std::make_pair(fileName, fileStream));
+    return fileStream;
+}
+
+ComPtr<IStream> ZipObject::CreateFileStream(const std::string& fileName, const PackageIndex::ZipEntry& entry)
+{
+    auto fileStream = ComPtr<IStream>::Make<ZipFileStream>(
+        fileName,
+        "TODO: Implement", // TODO: put value from content type
+        m_factory,
+        entry.isCompressed,
+        entry.dataOffset,
+        entry.compressedSize,
+        m_stream,
+        m_fileRecordsDigest
+        );
+
+    if (entry.isCompressed)
+    {
+        fileStream = ComPtr<IStream>::Make<InflateStream>(std::move(fileStream), entry.uncompressedSize);
+    }
+    return fileStream;
+}
+
+void ZipObject::SaveIndex(std::map<std::string, PackageIndex::BlockMapFile>&& blockMapFiles)
+{
+    if (!m_indexCache || m_indexKey.empty() || m_index)
+    {
+        return;
+    }
+
+    PackageIndex index(m_indexKey);
     {
-        return ComPtr<IStream>();
-    }        
-    return result->second;
+        std::lock_guard<std::mutex> lock(m_streamsLock);
+        for (const auto& centralFileHeader : m_centralDirectory)
+        {
+            index.GetZipEntries().insert(std::make_pair(centralFileHeader.first, ReadZipEntry(m_stream, centralFileHeader.second)));
+        }
+    }
+    index.GetBlockMapFiles() = std::move(blockMapFiles);
+
+    // The index is only an optimization, failing to store it doesn't fail opening the package.
+    ComPtr<IStream> indexStream;
+    if (SUCCEEDED(m_indexCache->CreateIndex(m_indexKey.c_str(), &indexStream)) && indexStream)
+    {
+        index.Save(indexStream);
+    }
 }
 
 std::string ZipObject::GetFileName()
@@ -787,13 +880,17 @@ std::string ZipObject::GetFileName()
     return m_stream.As<IStreamInternal>()->GetName();
 }
 
-ZipObject::ZipObject(IMsixFactory* appxFactory, const ComPtr<IStream>& stream) : m_factory(appxFactory), m_stream(stream)
+ZipObject::ZipObject(IMsixFactory* appxFactory, const ComPtr<IStream>& stream) : m_factory(appxFactory), m_stream(stream),
+    m_fileRecordsDigest(std::make_shared<FileRecordsDigest>(stream))
 {   // Confirm that the file IS the correct format
     EndCentralDirectoryRecord endCentralDirectoryRecord;
     LARGE_INTEGER pos = {0};
+    ULARGE_INTEGER startOfEoCD = {0};
     pos.QuadPart = -1 * endCentralDirectoryRecord.Size();
-    ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::END, nullptr));
-    endCentralDirectoryRecord.Read(m_stream.Get());
+    ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::END, &startOfEoCD));
+    auto eocd = ReadBytesAt(m_stream, startOfEoCD.QuadPart, endCentralDirectoryRecord.Size());
+    Meta::SpanReader eocdReader(eocd.data(), eocd.size(), startOfEoCD.QuadPart);
+    endCentralDirectoryRecord.Read(eocdReader);
 
     // find where the zip central directory exists.
     std::uint64_t offsetStartOfCD = 0;
@@ -805,64 +902,716 @@ ZipObject::ZipObject(IMsixFactory* appxFactory, const ComPtr<IStream>& stream) :
         totalNumberOfEntries = endCentralDirectoryRecord.GetNumberOfCentralDirectoryEntries();
     }
     else
-    {   // Make sure that we have a zip64 end of central directory locator            
-        pos.QuadPart = -1*(endCentralDirectoryRecord.Size() + zip64Locator.Size());
-        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::END, nullptr));
-        zip64Locator.Read(m_stream.Get());
+    {   // Make sure that we have a zip64 end of central directory locator
+        ThrowErrorIf(Error::Zip64EOCDLocator, (startOfEoCD.QuadPart < zip64Locator.Size()), "missing zip64 end of central directory locator");
+        std::uint64_t startOfLocator = startOfEoCD.QuadPart - zip64Locator.Size();
+        auto locator = ReadBytesAt(m_stream, startOfLocator, zip64Locator.Size());
+        Meta::SpanReader locatorReader(locator.data(), locator.size(), startOfLocator);
+        zip64Locator.Read(locatorReader);
 
         // now read the end of zip central directory record
         Zip64EndOfCentralDirectoryRecord zip64EndOfCentralDirectory;
-        pos.QuadPart = zip64Locator.GetRelativeOffset();
-        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
-        zip64EndOfCentralDirectory.Read(m_stream.Get());            
+        auto record = ReadBytesAt(m_stream, zip64Locator.GetRelativeOffset(), zip64EndOfCentralDirectory.Size());
+        Meta::SpanReader recordReader(record.data(), record.size(), zip64Locator.GetRelativeOffset());
+        zip64EndOfCentralDirectory.Read(recordReader);
         offsetStartOfCD = zip64EndOfCentralDirectory.GetOffsetStartOfCD();
         totalNumberOfEntries = zip64EndOfCentralDirectory.GetTotalNumberOfEntries();
     }
 
-    // read the zip central directory
-    std::map<std::string, std::shared_ptr<CentralDirectoryFileHeader>> centralDirectory;
-    pos.QuadPart = offsetStartOfCD;
-    ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
+    // The whole central directory is read at once and parsed from memory. The read goes up to the end of the
+    // stream, as the entries of a malformed archive can run into the records that follow the central directory.
+    // The bytes are kept for the signature's digest of the central directory.
+    std::uint64_t endOfCD = endCentralDirectoryRecord.GetArchiveHasZip64Locator() ? zip64Locator.GetRelativeOffset() : startOfEoCD.QuadPart;
+    std::uint64_t endOfStream = startOfEoCD.QuadPart + endCentralDirectoryRecord.Size();
+    m_startOfCD = offsetStartOfCD;
+    m_endOfCD = endOfCD;
+    m_startOfEoCD = startOfEoCD.QuadPart;
+    m_endOfStream = endOfStream;
+    m_entryCount = totalNumberOfEntries;
+    m_isZip64 = endCentralDirectoryRecord.GetIsZip64();
+    m_hasZip64Locator = endCentralDirectoryRecord.GetArchiveHasZip64Locator();
+    auto& centralDirectory = m_centralDirectoryBytes;
+    if (offsetStartOfCD < endOfStream)
+    {
+        ThrowErrorIf(Error::ZipCentralDirectoryHeader, ((endOfStream - offsetStartOfCD) > std::numeric_limits<ULONG>::max()),
+            "central directory too big");
+        centralDirectory = ReadBytesAt(m_stream, offsetStartOfCD, static_cast<std::size_t>(endOfStream - offsetStartOfCD));
+    }
+
+    // With an index cache, a package that was opened before is found by the digest of its central directory
+    // and neither the central directory nor the local file headers need to be parsed again.
+    ComPtr<IMsixFactoryOverrides> factoryOverrides;
+    ThrowHrIfFailed(m_factory->QueryInterface(UuidOfImpl<IMsixFactoryOverrides>::iid, reinterpret_cast<void**>(&factoryOverrides)));
+    ComPtr<IUnknown> indexCacheUnk;
+    ThrowHrIfFailed(factoryOverrides->GetCurrentSpecifiedExtension(MSIX_FACTORY_EXTENSION_INDEX_CACHE, &indexCacheUnk));
+    if (indexCacheUnk.Get() != nullptr && endOfCD > offsetStartOfCD && (offsetStartOfCD + centralDirectory.size()) >= endOfCD)
+    {
+        m_indexCache = indexCacheUnk.As<IMsixIndexCache>();
+        m_indexKey = GetPackageIndexKey(centralDirectory.data(), static_cast<std::uint32_t>(endOfCD - offsetStartOfCD));
+        ComPtr<IStream> indexStream;
+        if (SUCCEEDED(m_indexCache->OpenIndex(m_indexKey.c_str(), &indexStream)) && indexStream)
+        {
+            m_index = PackageIndex::Load(indexStream, m_indexKey);
+            if (m_index) { return; }
+        }
+    }
+
+    // parse the zip central directory
+    Meta::SpanReader reader(centralDirectory.data(), centralDirectory.size(), offsetStartOfCD);
     for (std::uint32_t index = 0; index < totalNumberOfEntries; index++)
     {
         auto centralFileHeader = std::make_shared<CentralDirectoryFileHeader>(endCentralDirectoryRecord.GetIsZip64());
-        centralFileHeader->Read(m_stream.Get());
+        centralFileHeader->Read(reader);
         // TODO: ensure that there are no collisions on name!
-        centralDirectory.insert(std::make_pair(centralFileHeader->GetFileName(), centralFileHeader));
+        m_centralDirectory.insert(std::make_pair(centralFileHeader->GetFileName(), centralFileHeader));
     }
+    WorkCounter(m_factory).Add(MSIX_WORK_COUNTER_CENTRAL_DIRECTORY_ENTRIES, totalNumberOfEntries);
 
     if (endCentralDirectoryRecord.GetArchiveHasZip64Locator())
     {   // We should have no data between the end of the last central directory header and the start of the EoCD
-        ULARGE_INTEGER uPos = {0};
-        ThrowHrIfFailed(m_stream->Seek({0}, StreamBase::Reference::CURRENT, &uPos));
-        ThrowErrorIfNot(Error::ZipHiddenData, (uPos.QuadPart == zip64Locator.GetRelativeOffset()), "hidden data unsupported");
-    }
-
-    // TODO: change population of m_streams into cache semantics and move into ZipObject::GetFile
-    // Read the file repository
-    for (const auto& centralFileHeader : centralDirectory)
-    {
-        pos.QuadPart = centralFileHeader.second->GetRelativeOffsetOfLocalHeader();
-        ThrowHrIfFailed(m_stream->Seek(pos, MSIX::StreamBase::Reference::START, nullptr));
-        auto localFileHeader = std::make_shared<LocalFileHeader>(centralFileHeader.second);
-        localFileHeader->Read(m_stream.Get());
-
-        auto fileStream = ComPtr<IStream>::Make<ZipFileStream>(
-            centralFileHeader.second->GetFileName(),
-            "TODO: Implement", // TODO: put value from content type 
-            m_factory,
-            localFileHeader->GetCompressionType() == CompressionType::Deflate,
-            centralFileHeader.second->GetRelativeOffsetOfLocalHeader() + localFileHeader->Size(),
-            localFileHeader->GetCompressedSize(),
-            m_stream
-            );
-
-        if (localFileHeader->GetCompressionType() == CompressionType::Deflate)
+        ThrowErrorIfNot(Error::ZipHiddenData, (reader.GetPosition() == zip64Locator.GetRelativeOffset()), "hidden data unsupported");
+    }
+    // Local file headers are read on demand by GetFile, or all at once by SaveIndex
+} // ZipObject::ZipObject
+
+// Chunks in which the file records are read to compute their digest.
+static const std::size_t SignedDigestChunkSize = 1024 * 1024;
+
+// Overwrites a little endian field of a record that was read as bytes.
+static void SetRecordField(std::vector<std::uint8_t>& record, std::size_t offset, std::uint64_t value, std::size_t size)
+{
+    ThrowErrorIf(Error::ZipEOCDRecord, (offset + size > record.size()), "record too small");
+    for (std::size_t i = 0; i < size; i++)
+    {
+        record[offset + i] = static_cast<std::uint8_t>(value >> (i * 8));
+    }
+}
+
+std::uint64_t ZipObject::GetCentralDirectoryDigest(const std::string& signatureFile, std::vector<std::uint8_t>& digest)
+{
+    // The central directory says where the signature's record starts and so where the file records end.
+    ThrowErrorIf(Error::ZipCentralDirectoryHeader, ((m_startOfCD >= m_endOfStream) || (m_centralDirectoryBytes.size() != m_endOfStream - m_startOfCD)),
+        "invalid start of central directory");
+    const auto& end = m_centralDirectoryBytes;
+    Meta::SpanReader reader(end.data(), end.size(), m_startOfCD);
+    bool hasSignature = false;
+    std::uint64_t signatureOffset = 0;
+    std::uint64_t lastOffset = 0;
+    std::size_t signatureEntryStart = 0;
+    std::size_t signatureEntryEnd = 0;
+    for (std::uint64_t index = 0; index < m_entryCount; index++)
+    {
+        auto entryStart = static_cast<std::size_t>(reader.GetPosition() - m_startOfCD);
+        CentralDirectoryFileHeader centralFileHeader(m_isZip64);
+        centralFileHeader.Read(reader);
+        if (centralFileHeader.GetFileName() == signatureFile)
         {
-            fileStream = ComPtr<IStream>::Make<InflateStream>(std::move(fileStream), localFileHeader->GetUncompressedSize());
+            ThrowErrorIf(Error::SignatureInvalid, hasSignature, "signature is in the central directory twice");
+            hasSignature = true;
+            signatureOffset = centralFileHeader.GetRelativeOffsetOfLocalHeader();
+            signatureEntryStart = entryStart;
+            signatureEntryEnd = static_cast<std::size_t>(reader.GetPosition() - m_startOfCD);
         }
+        else
+        {
+            lastOffset = std::max(lastOffset, centralFileHeader.GetRelativeOffsetOfLocalHeader());
+        }
+    }
+    ThrowErrorIfNot(Error::SignatureInvalid, hasSignature, "signature not in the central directory");
+    ThrowErrorIf(Error::SignatureInvalid, ((lastOffset >= signatureOffset) && (m_entryCount > 1)), "signature isn't the last file record");
+    ThrowErrorIf(Error::SignatureInvalid, (signatureOffset > m_startOfCD), "invalid signature local header offset");
+
+    // Without the signature, everything after the file records moves back by the size of its record and of its
+    // central directory entry.
+    auto entriesEnd = static_cast<std::size_t>(reader.GetPosition() - m_startOfCD);
+    std::uint64_t entryCount = m_entryCount - 1;
+    std::uint64_t sizeOfCD = entriesEnd - (signatureEntryEnd - signatureEntryStart);
+    std::uint64_t moved = (m_startOfCD - signatureOffset) + (signatureEntryEnd - signatureEntryStart);
+    std::vector<std::uint8_t> endRecords(end.begin() + entriesEnd, end.end());
+    if (m_hasZip64Locator)
+    {   // The zip64 end of central directory record follows the central directory and the locator comes right
+        // before the end of central directory record, which keeps its 0xFFFF values.
+        ThrowErrorIfNot(Error::ZipHiddenData, (m_startOfCD + entriesEnd == m_endOfCD), "hidden data unsupported");
+        SetRecordField(endRecords, 24, entryCount, 8);          // total number of entries on this disk
+        SetRecordField(endRecords, 32, entryCount, 8);          // total number of entries
+        SetRecordField(endRecords, 40, sizeOfCD, 8);            // size of the central directory
+        SetRecordField(endRecords, 48, signatureOffset, 8);     // offset of start of central directory
+        auto locator = static_cast<std::size_t>(m_startOfEoCD - m_endOfCD) - Zip64EndOfCentralDirectoryLocator().Size();
+        SetRecordField(endRecords, locator + 8, m_endOfCD - moved, 8); // relative offset of the zip64 end of central directory record
+    }
+    else
+    {
+        auto eocd = static_cast<std::size_t>(m_startOfEoCD - m_startOfCD) - entriesEnd;
+        SetRecordField(endRecords, eocd + 8, entryCount, 2);     // total number of entries on this disk
+        SetRecordField(endRecords, eocd + 10, entryCount, 2);    // total number of entries
+        SetRecordField(endRecords, eocd + 12, sizeOfCD, 4);      // size of the central directory
+        SetRecordField(endRecords, eocd + 16, signatureOffset, 4); // offset of start of central directory
+    }
+    SHA256 centralDirectoryHash;
+    centralDirectoryHash.Update(end.data(), signatureEntryStart);
+    centralDirectoryHash.Update(end.data() + signatureEntryEnd, entriesEnd - signatureEntryEnd);
+    centralDirectoryHash.Update(endRecords.data(), endRecords.size());
+    centralDirectoryHash.Final(digest);
+    return signatureOffset;
+}
 
-        m_streams.insert(std::make_pair(centralFileHeader.second->GetFileName(), std::move(fileStream)));
+void ZipObject::GetFileRecordsDigest(std::uint64_t end, std::vector<std::uint8_t>& digest, const std::function<void()>& reader)
+{
+    ThrowErrorIf(Error::SignatureInvalid, (end > m_startOfCD), "file records run into the central directory");
+    // A mapped archive is hashed in place once reader is done, the reads through the mapping aren't worth a lock.
+    ComPtr<IMappedStream> mapped;
+    bool isMapped = SUCCEEDED(m_stream->QueryInterface(UuidOfImpl<IMappedStream>::iid, reinterpret_cast<void**>(&mapped))) && mapped &&
+        (mapped->GetMappedSize() >= end);
+    m_fileRecordsDigest->Begin(end, !isMapped && reader);
+    if (reader)
+    {
+        try
+        {
+            reader();
+        }
+        catch (...)
+        {
+            m_fileRecordsDigest->End();
+            throw;
+        }
     }
-} // ZipObject::ZipObject
+    std::uint64_t offset = m_fileRecordsDigest->End();
+
+    // Then what reader didn't read in order, up to the signature's local file header. Otherwise each chunk is
+    // hashed on another thread while the next one is read. SHA-256 has to see the bytes in order, so there is
+    // only ever one thread hashing.
+    if (isMapped)
+    {
+        m_fileRecordsDigest->Update(mapped->GetMappedBuffer() + offset, static_cast<std::size_t>(end - offset));
+    }
+    else
+    {   // The thread pool is declared after the buffers, so it is done with them before they go away.
+        std::array<std::vector<std::uint8_t>, 2> buffers;
+        std::array<std::future<void>, 2> hashed;
+        ThreadPool hasher(1);
+        for (std::size_t i = 0; offset < end; i = (i + 1) % buffers.size())
+        {
+            if (hashed[i].valid()) { hashed[i].get(); }
+            auto& buffer = buffers[i];
+            buffer.resize(static_cast<std::size_t>(std::min(static_cast<std::uint64_t>(SignedDigestChunkSize), end - offset)));
+            {
+                std::lock_guard<std::mutex> lock(m_streamsLock);
+                ULONG read = StreamBase::ReadAt(m_stream, offset, buffer.data(), static_cast<ULONG>(buffer.size()));
+                ThrowErrorIf(Error::FileRead, (read != buffer.size()), "Did not read as much as requested.");
+            }
+            auto fileRecordsDigest = m_fileRecordsDigest.get();
+            hashed[i] = hasher.Submit([fileRecordsDigest, &buffer]() { fileRecordsDigest->Update(buffer.data(), buffer.size()); });
+            offset += buffer.size();
+        }
+        for (auto& chunk : hashed)
+        {
+            if (chunk.valid()) { chunk.get(); }
+        }
+    }
+    m_fileRecordsDigest->Final(digest);
+}
+
+void ZipObject::SortByFileRecords(std::vector<std::string>& fileNames)
+{
+    // Names that aren't in the archive go last.
+    auto GetOffset = [this](const std::string& fileName)
+    {
+        if (m_index)
+        {
+            auto entry = m_index->GetZipEntries().find(fileName);
+            return (entry == m_index->GetZipEntries().end()) ? std::numeric_limits<std::uint64_t>::max() : entry->second.dataOffset;
+        }
+        auto centralFileHeader = m_centralDirectory.find(fileName);
+        return (centralFileHeader == m_centralDirectory.end()) ? std::numeric_limits<std::uint64_t>::max() :
+            centralFileHeader->second->GetRelativeOffsetOfLocalHeader();
+    };
+    std::vector<std::pair<std::uint64_t, std::string>> sorted;
+    sorted.reserve(fileNames.size());
+    for (auto& fileName : fileNames)
+    {
+        sorted.emplace_back(GetOffset(fileName), std::move(fileName));
+    }
+    std::sort(sorted.begin(), sorted.end());
+    for (std::size_t i = 0; i < sorted.size(); i++)
+    {
+        fileNames[i] = std::move(sorted[i].second);
+    }
+}
+
+// A gap between the hashed bytes and a read smaller than this is read to hash the read, it is most likely the local
+// file header in front of a file's data.
+static const std::uint64_t FileRecordsDigestMaxGap = SignedDigestChunkSize;
+
+void FileRecordsDigest::Begin(std::uint64_t end, bool isActive)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_hash.Init();
+    m_hashed = 0;
+    m_end = end;
+    m_isActive = isActive;
+}
+
+void FileRecordsDigest::Add(std::uint64_t offset, const void* buffer, std::size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_isActive || (offset >= m_end) || (offset + count <= m_hashed) || (offset > m_hashed + FileRecordsDigestMaxGap)) { return; }
+    if (offset > m_hashed)
+    {
+        std::vector<std::uint8_t> gap(static_cast<std::size_t>(offset - m_hashed));
+        if (StreamBase::ReadAt(m_stream, m_hashed, gap.data(), static_cast<ULONG>(gap.size())) != gap.size()) { return; }
+        m_hash.Update(gap.data(), gap.size());
+        m_hashed = offset;
+    }
+    auto size = static_cast<std::size_t>(std::min(offset + count, m_end) - m_hashed);
+    m_hash.Update(reinterpret_cast<const std::uint8_t*>(buffer) + (m_hashed - offset), size);
+    m_hashed += size;
+}
+
+std::uint64_t FileRecordsDigest::End()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_isActive = false;
+    return m_hashed;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                              ZipObjectWriter member implementation                       //
+//////////////////////////////////////////////////////////////////////////////////////////////
+static const std::uint64_t Zip32MaxValue = std::numeric_limits<std::uint32_t>::max();
+// A file this close to 4GB could end up bigger than 4GB once deflated, which deflate can do for incompressible
+// data. The margin is much bigger than that overhead.
+static const std::uint64_t Zip64LocalHeaderThreshold = Zip32MaxValue - 0x10000000;
+
+// Serializes the records written by ZipObjectWriter. All fields are little endian.
+class ZipRecordBuilder
+{
+public:
+    ZipRecordBuilder& Add16(std::uint16_t value) { return Add(value, sizeof(value)); }
+    ZipRecordBuilder& Add32(std::uint32_t value) { return Add(value, sizeof(value)); }
+    ZipRecordBuilder& Add64(std::uint64_t value) { return Add(value, sizeof(value)); }
+
+    ZipRecordBuilder& AddString(const std::string& value)
+    {
+        m_bytes.insert(m_bytes.end(), value.begin(), value.end());
+        return *this;
+    }
+
+    const std::vector<std::uint8_t>& GetBytes() { return m_bytes; }
+
+protected:
+    ZipRecordBuilder& Add(std::uint64_t value, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++)
+        {
+            m_bytes.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+        }
+        return *this;
+    }
+
+    std::vector<std::uint8_t> m_bytes;
+};
+
+std::uint32_t ZipObjectWriter::BeginFile(const std::string& name, bool isCompressed, std::uint64_t expectedSize)
+{
+    ThrowErrorIf(Error::InvalidState, m_isFileOpen, "previous file not finished");
+    ThrowErrorIf(Error::InvalidParameter, (name.empty() || name.size() > std::numeric_limits<std::uint16_t>::max()), "unsupported file name size");
+
+    Entry entry = {};
+    entry.name = name;
+    entry.isCompressed = isCompressed;
+    entry.hasZip64LocalHeader = (expectedSize >= Zip64LocalHeaderThreshold);
+    entry.offset = m_position;
+    ThrowErrorIf(Error::NotSupported, (m_forceZip32 && (entry.hasZip64LocalHeader || entry.offset >= Zip32MaxValue)),
+        "package requires zip64");
+
+    // The crc and sizes are unknown until the data is written, they go in the data descriptor.
+    ZipRecordBuilder header;
+    header.Add32(static_cast<std::uint32_t>(Signatures::LocalFileHeader))
+        .Add16(static_cast<std::uint16_t>(entry.hasZip64LocalHeader ? ZipVersions::Zip64FormatExtension : ZipVersions::Zip32DefaultVersion))
+        .Add16(static_cast<std::uint16_t>(GeneralPurposeBitFlags::GeneralPurposeBit))
+        .Add16(static_cast<std::uint16_t>(isCompressed ? CompressionType::Deflate : CompressionType::Store))
+        .Add16(static_cast<std::uint16_t>(MagicNumbers::FileTime))
+        .Add16(static_cast<std::uint16_t>(MagicNumbers::FileDate))
+        .Add32(0)  // crc
+        .Add32(0)  // compressed size
+        .Add32(0)  // uncompressed size
+        .Add16(static_cast<std::uint16_t>(name.size()))
+        .Add16(entry.hasZip64LocalHeader ? 20 : 0)
+        .AddString(name);
+    if (entry.hasZip64LocalHeader)
+    {
+        header.Add16(static_cast<std::uint16_t>(HeaderIDs::Zip64ExtendedInfo))
+            .Add16(16)
+            .Add64(0)  // uncompressed size
+            .Add64(0); // compressed size
+    }
+    Write(header.GetBytes());
+
+    m_entries.push_back(std::move(entry));
+    m_isFileOpen = true;
+    return static_cast<std::uint32_t>(header.GetBytes().size());
+}
+
+void ZipObjectWriter::WriteFileData(const std::uint8_t* data, std::size_t size)
+{
+    ThrowErrorIfNot(Error::InvalidState, m_isFileOpen, "no file to write to");
+    Write(data, size);
+}
+
+void ZipObjectWriter::EndFile(std::uint32_t crc, std::uint64_t compressedSize, std::uint64_t uncompressedSize)
+{
+    ThrowErrorIfNot(Error::InvalidState, m_isFileOpen, "no file to end");
+    auto& entry = m_entries.back();
+    ThrowErrorIf(Error::InvalidParameter, (entry.offset + compressedSize > m_position), "more data than was written");
+    ThrowErrorIf(Error::NotSupported,
+        (!entry.hasZip64LocalHeader && (compressedSize >= Zip32MaxValue || uncompressedSize >= Zip32MaxValue)),
+        "file grew past 4GB while it was written");
+    entry.crc = crc;
+    entry.compressedSize = compressedSize;
+    entry.uncompressedSize = uncompressedSize;
+
+    ZipRecordBuilder descriptor;
+    descriptor.Add32(static_cast<std::uint32_t>(Signatures::DataDescriptor)).Add32(crc);
+    if (entry.hasZip64LocalHeader)
+    {
+        descriptor.Add64(compressedSize).Add64(uncompressedSize);
+    }
+    else
+    {
+        descriptor.Add32(static_cast<std::uint32_t>(compressedSize)).Add32(static_cast<std::uint32_t>(uncompressedSize));
+    }
+    Write(descriptor.GetBytes());
+    m_isFileOpen = false;
+}
+
+void ZipObjectWriter::Close()
+{
+    ThrowErrorIf(Error::InvalidState, m_isFileOpen, "last file not finished");
+    std::uint64_t startOfCD = m_position;
+    bool isZip64 = false;
+    for (const auto& entry : m_entries)
+    {   // Only entries with values that don't fit get a zip64 extended information field, and then all of them
+        // are in it.
+        bool entryIsZip64 = (entry.compressedSize >= Zip32MaxValue || entry.uncompressedSize >= Zip32MaxValue ||
+            entry.offset >= Zip32MaxValue);
+        isZip64 = isZip64 || entryIsZip64;
+
+        ZipRecordBuilder header;
+        header.Add32(static_cast<std::uint32_t>(Signatures::CentralFileHeader))
+            .Add16(static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension))
+            .Add16(static_cast<std::uint16_t>((entryIsZip64 || entry.hasZip64LocalHeader) ? ZipVersions::Zip64FormatExtension : ZipVersions::Zip32DefaultVersion))
+            .Add16(static_cast<std::uint16_t>(GeneralPurposeBitFlags::GeneralPurposeBit))
+            .Add16(static_cast<std::uint16_t>(entry.isCompressed ? CompressionType::Deflate : CompressionType::Store))
+            .Add16(static_cast<std::uint16_t>(MagicNumbers::FileTime))
+            .Add16(static_cast<std::uint16_t>(MagicNumbers::FileDate))
+            .Add32(entry.crc)
+            .Add32(static_cast<std::uint32_t>(entryIsZip64 ? Zip32MaxValue : entry.compressedSize))
+            .Add32(static_cast<std::uint32_t>(entryIsZip64 ? Zip32MaxValue : entry.uncompressedSize))
+            .Add16(static_cast<std::uint16_t>(entry.name.size()))
+            .Add16(entryIsZip64 ? 28 : 0)
+            .Add16(0)  // file comment length
+            .Add16(0)  // disk number start
+            .Add16(0)  // internal file attributes
+            .Add32(0)  // external file attributes
+            .Add32(static_cast<std::uint32_t>(entryIsZip64 ? Zip32MaxValue : entry.offset))
+            .AddString(entry.name);
+        if (entryIsZip64)
+        {
+            header.Add16(static_cast<std::uint16_t>(HeaderIDs::Zip64ExtendedInfo))
+                .Add16(24)
+                .Add64(entry.uncompressedSize)
+                .Add64(entry.compressedSize)
+                .Add64(entry.offset);
+        }
+        Write(header.GetBytes());
+    }
+    std::uint64_t sizeOfCD = m_position - startOfCD;
+
+    isZip64 = isZip64 || m_entries.size() >= std::numeric_limits<std::uint16_t>::max() ||
+        startOfCD >= Zip32MaxValue || sizeOfCD >= Zip32MaxValue;
+    ThrowErrorIf(Error::NotSupported, (m_forceZip32 && isZip64), "package requires zip64");
+    ZipRecordBuilder end;
+    if (isZip64)
+    {
+        std::uint64_t startOfZip64EndOfCD = m_position;
+        end.Add32(static_cast<std::uint32_t>(Signatures::Zip64EndOfCD))
+            .Add64(44) // size of the record without the leading 12 bytes
+            .Add16(static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension))
+            .Add16(static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension))
+            .Add32(0)  // number of this disk
+            .Add32(0)  // disk with the start of the central directory
+            .Add64(m_entries.size())
+            .Add64(m_entries.size())
+            .Add64(sizeOfCD)
+            .Add64(startOfCD);
+        end.Add32(static_cast<std::uint32_t>(Signatures::Zip64EndOfCDLocator))
+            .Add32(0)  // disk with the start of the zip64 end of central directory
+            .Add64(startOfZip64EndOfCD)
+            .Add32(1); // total number of disks
+    }
+    end.Add32(static_cast<std::uint32_t>(Signatures::EndOfCentralDirectory))
+        .Add16(0)  // number of this disk
+        .Add16(0)  // disk with the start of the central directory
+        .Add16(static_cast<std::uint16_t>(isZip64 ? std::numeric_limits<std::uint16_t>::max() : m_entries.size()))
+        .Add16(static_cast<std::uint16_t>(isZip64 ? std::numeric_limits<std::uint16_t>::max() : m_entries.size()))
+        .Add32(static_cast<std::uint32_t>(isZip64 ? Zip32MaxValue : sizeOfCD))
+        .Add32(static_cast<std::uint32_t>(isZip64 ? Zip32MaxValue : startOfCD))
+        .Add16(0); // comment length
+    Write(end.GetBytes());
+}
+
+void ZipObjectWriter::Write(const std::uint8_t* data, std::size_t size)
+{
+    while (size > 0)
+    {
+        ULONG toWrite = static_cast<ULONG>(std::min(size, static_cast<std::size_t>(std::numeric_limits<ULONG>::max())));
+        ULONG bytesWritten = 0;
+        ThrowHrIfFailed(m_stream->Write(data, toWrite, &bytesWritten));
+        ThrowErrorIfNot(Error::FileWrite, (bytesWritten == toWrite), "write failed");
+        m_position += bytesWritten;
+        data += bytesWritten;
+        size -= bytesWritten;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                              ZipObjectForwardOnlyReader member implementation            //
+//////////////////////////////////////////////////////////////////////////////////////////////
+static const std::size_t ForwardOnlyReadSize = 64 * 1024;
+// Size of a central directory header up to the file name
+static const std::size_t CentralFileHeaderFixedSize = 46;
+
+ZipObjectForwardOnlyReader::ZipObjectForwardOnlyReader(const ComPtr<IStream>& stream) :
+    m_stream(stream), m_buffer(ForwardOnlyReadSize), m_inflater(CreateCompressionObject())
+{
+}
+
+ZipObjectForwardOnlyReader::~ZipObjectForwardOnlyReader()
+{
+    if (m_isInflating) { m_inflater->Cleanup(); }
+}
+
+// Makes sure that at least size bytes are buffered, returns false if the stream ends first.
+bool ZipObjectForwardOnlyReader::Fill(std::size_t size)
+{
+    if (GetAvailable() >= size) { return true; }
+    // Move what is left to the front, the buffer only grows for records bigger than it.
+    std::size_t available = GetAvailable();
+    std::memmove(m_buffer.data(), Peek(), available);
+    m_bufferPosition = 0;
+    m_bufferEnd = available;
+    if (m_buffer.size() < size) { m_buffer.resize(size); }
+    while (m_bufferEnd < size)
+    {
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(m_stream->Read(m_buffer.data() + m_bufferEnd, static_cast<ULONG>(m_buffer.size() - m_bufferEnd), &bytesRead));
+        if (bytesRead == 0) { return false; }
+        m_bufferEnd += bytesRead;
+    }
+    return true;
+}
+
+bool ZipObjectForwardOnlyReader::NextFile(std::string& name, bool& isCompressed)
+{
+    ThrowErrorIf(Error::InvalidState, m_isFileOpen, "the data of the current file wasn't read");
+    ThrowErrorIfNot(Error::FileRead, Fill(sizeof(std::uint32_t)), "unexpected end of the zip file");
+    if (PeekValue<std::uint32_t>(0) != static_cast<std::uint32_t>(Signatures::LocalFileHeader))
+    {
+        ReadCentralDirectory();
+        return false;
+    }
+
+    m_header = std::make_unique<LocalFileHeader>();
+    m_headerOffset = m_position;
+    std::size_t fixedSize = m_header->Size();
+    ThrowErrorIfNot(Error::FileRead, Fill(fixedSize), "unexpected end of the zip file");
+    Meta::SpanReader reader(Peek(), fixedSize, m_position);
+    m_header->ReadFixedFields(reader);
+    Consume(fixedSize);
+    std::size_t namesSize = static_cast<std::size_t>(m_header->GetFileNameLength()) + m_header->GetExtraFieldLength();
+    ThrowErrorIfNot(Error::FileRead, Fill(namesSize), "unexpected end of the zip file");
+    Meta::SpanReader namesReader(Peek(), namesSize, m_position);
+    m_header->ReadNames(namesReader);
+    Consume(namesSize);
+
+    m_hasDataDescriptor = m_header->IsGeneralPurposeBitSet();
+    // 4.3.9.2 The sizes in the data descriptor are 8 bytes if the local header has zip64 extended information.
+    // Packaging tools also write them for every file whose local header needs the zip64 version to extract, even
+    // without the extended information, so that is taken as the sign for them.
+    m_hasZip64Sizes = m_header->HasZip64ExtendedInformation() ||
+        (m_header->GetVersionNeededToExtract() == static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
+    if (!m_hasDataDescriptor)
+    {
+        m_expectedCompressedSize = m_header->GetCompressedSize();
+        m_expectedUncompressedSize = m_header->GetUncompressedSize();
+        if (m_header->HasZip64ExtendedInformation() && (m_expectedCompressedSize == Zip32MaxValue || m_expectedUncompressedSize == Zip32MaxValue))
+        {
+            m_expectedCompressedSize = m_header->GetZip64CompressedSize();
+            m_expectedUncompressedSize = m_header->GetZip64UncompressedSize();
+        }
+    }
+    m_compressedRead = 0;
+    m_uncompressedRead = 0;
+    m_crc = 0;
+    m_inflateEnded = false;
+    isCompressed = (m_header->GetCompressionType() == CompressionType::Deflate);
+    if (isCompressed)
+    {
+        ThrowErrorIfNot(Error::InflateInitialize, (m_inflater->Initialize(CompressionOperation::Inflate) == CompressionStatus::Ok),
+            "compression_stream_init failed");
+        m_isInflating = true;
+    }
+    name = m_header->GetFileName();
+    m_isFileOpen = true;
+    return true;
+}
+
+std::size_t ZipObjectForwardOnlyReader::ReadFileData(std::uint8_t* buffer, std::size_t size)
+{
+    if (!m_isFileOpen || size == 0) { return 0; }
+    std::size_t result = (m_header->GetCompressionType() == CompressionType::Deflate) ?
+        ReadCompressedData(buffer, size) : ReadStoredData(buffer, size);
+    m_uncompressedRead += result;
+    if (result == 0) { EndFile(); }
+    return result;
+}
+
+std::size_t ZipObjectForwardOnlyReader::ReadCompressedData(std::uint8_t* buffer, std::size_t size)
+{
+    std::size_t result = 0;
+    while (result == 0 && !m_inflateEnded)
+    {
+        std::size_t available = GetAvailable();
+        if (!m_hasDataDescriptor)
+        {
+            available = static_cast<std::size_t>(std::min(static_cast<std::uint64_t>(available), m_expectedCompressedSize - m_compressedRead));
+        }
+        m_inflater->SetInput(m_buffer.data() + m_bufferPosition, available);
+        m_inflater->SetOutput(buffer, size);
+        auto status = m_inflater->Inflate();
+        ThrowErrorIf(Error::InflateCorruptData, (status == CompressionStatus::Error || status == CompressionStatus::NeedDictionary),
+            "inflate failed unexpectedly.");
+        std::size_t consumed = available - m_inflater->GetAvailableSourceSize();
+        Consume(consumed);
+        m_compressedRead += consumed;
+        result = size - m_inflater->GetAvailableDestinationSize();
+        m_inflateEnded = (status == CompressionStatus::End);
+        if (result == 0 && consumed == 0 && !m_inflateEnded)
+        {   // Everything buffered went into inflate
+            ThrowErrorIf(Error::InflateCorruptData, (!m_hasDataDescriptor && (m_compressedRead == m_expectedCompressedSize)),
+                "compressed data ends before the deflate stream");
+            ThrowErrorIfNot(Error::FileRead, Fill(GetAvailable() + 1), "unexpected end of the zip file");
+        }
+    }
+    return result;
+}
+
+std::size_t ZipObjectForwardOnlyReader::ReadStoredData(std::uint8_t* buffer, std::size_t size)
+{
+    std::size_t count = 0;
+    if (!m_hasDataDescriptor)
+    {
+        if (m_compressedRead == m_expectedCompressedSize) { return 0; }
+        ThrowErrorIfNot(Error::FileRead, Fill(1), "unexpected end of the zip file");
+        count = static_cast<std::size_t>(std::min(static_cast<std::uint64_t>(std::min(size, GetAvailable())),
+            m_expectedCompressedSize - m_compressedRead));
+    }
+    else
+    {   // The data ends where there is a data descriptor for it. Only the bytes that can't be the start of one
+        // are returned, so a data descriptor is always completely buffered when it is checked.
+        std::size_t descriptorSize = m_hasZip64Sizes ? 24 : 16;
+        ThrowErrorIfNot(Error::FileRead, Fill(descriptorSize), "unexpected end of the zip file");
+        std::size_t limit = std::min(size, GetAvailable() - descriptorSize + 1);
+        while (count < limit && PeekValue<std::uint32_t>(count) != static_cast<std::uint32_t>(Signatures::DataDescriptor))
+        {
+            count++;
+        }
+        if (count == 0)
+        {
+            if (IsDataDescriptorNext()) { return 0; }
+            count = 1; // the signature is part of the data
+        }
+    }
+    std::memcpy(buffer, Peek(), count);
+    m_crc = Crc32(m_crc, Peek(), count);
+    Consume(count);
+    m_compressedRead += count;
+    return count;
+}
+
+// A data descriptor of a stored file is only recognized by its signature, which is optional in the spec but
+// written by the tools that create packages, and by its crc and sizes matching the data read so far.
+bool ZipObjectForwardOnlyReader::IsDataDescriptorNext()
+{
+    if (PeekValue<std::uint32_t>(0) != static_cast<std::uint32_t>(Signatures::DataDescriptor) || PeekValue<std::uint32_t>(4) != m_crc)
+    {   return false;
+    }
+    if (m_hasZip64Sizes)
+    {   return (PeekValue<std::uint64_t>(8) == m_compressedRead) && (PeekValue<std::uint64_t>(16) == m_compressedRead);
+    }
+    return (PeekValue<std::uint32_t>(8) == m_compressedRead) && (PeekValue<std::uint32_t>(12) == m_compressedRead);
+}
+
+void ZipObjectForwardOnlyReader::EndFile()
+{
+    if (m_isInflating)
+    {
+        m_inflater->Cleanup();
+        m_isInflating = false;
+    }
+    m_isFileOpen = false;
+
+    if (m_hasDataDescriptor)
+    {
+        ThrowErrorIfNot(Error::FileRead, Fill(sizeof(std::uint32_t)), "unexpected end of the zip file");
+        if (PeekValue<std::uint32_t>(0) == static_cast<std::uint32_t>(Signatures::DataDescriptor))
+        {   Consume(sizeof(std::uint32_t));
+        }
+        std::size_t descriptorSize = m_hasZip64Sizes ? 20 : 12;
+        ThrowErrorIfNot(Error::FileRead, Fill(descriptorSize), "unexpected end of the zip file");
+        std::uint64_t compressedSize = m_hasZip64Sizes ? PeekValue<std::uint64_t>(4) : PeekValue<std::uint32_t>(4);
+        std::uint64_t uncompressedSize = m_hasZip64Sizes ? PeekValue<std::uint64_t>(12) : PeekValue<std::uint32_t>(8);
+        Consume(descriptorSize);
+        ThrowErrorIfNot(Error::ZipLocalFileHeader, ((compressedSize == m_compressedRead) && (uncompressedSize == m_uncompressedRead)),
+            "data descriptor doesn't match the data of the file");
+    }
+    else
+    {
+        ThrowErrorIfNot(Error::ZipLocalFileHeader, ((m_expectedCompressedSize == m_compressedRead) && (m_expectedUncompressedSize == m_uncompressedRead)),
+            "local file header doesn't match the data of the file");
+    }
+    Entry entry = { m_header->GetFileName(), m_compressedRead, m_uncompressedRead };
+    m_entries.insert(std::make_pair(m_headerOffset, std::move(entry)));
+}
+
+// The central directory is only used to check that it describes the files that were read.
+void ZipObjectForwardOnlyReader::ReadCentralDirectory()
+{
+    std::size_t count = 0;
+    while (Fill(sizeof(std::uint32_t)) && PeekValue<std::uint32_t>(0) == static_cast<std::uint32_t>(Signatures::CentralFileHeader))
+    {
+        ThrowErrorIfNot(Error::FileRead, Fill(CentralFileHeaderFixedSize), "unexpected end of the zip file");
+        std::size_t size = CentralFileHeaderFixedSize + PeekValue<std::uint16_t>(28) + PeekValue<std::uint16_t>(30) + PeekValue<std::uint16_t>(32);
+        ThrowErrorIfNot(Error::FileRead, Fill(size), "unexpected end of the zip file");
+        // Whether the archive is zip64 is only known from the records after the central directory.
+        CentralDirectoryFileHeader centralFileHeader(PeekValue<std::uint32_t>(42) == Zip32MaxValue);
+        Meta::SpanReader reader(Peek(), size, m_position);
+        centralFileHeader.Read(reader);
+        Consume(size);
+
+        auto entry = m_entries.find(centralFileHeader.GetRelativeOffsetOfLocalHeader());
+        ThrowErrorIf(Error::ZipCentralDirectoryHeader, ((entry == m_entries.end()) ||
+            (entry->second.name != centralFileHeader.GetFileName()) ||
+            (entry->second.compressedSize != centralFileHeader.GetCompressedSize()) ||
+            (entry->second.uncompressedSize != centralFileHeader.GetUncompressedSize())),
+            "central directory doesn't match the local file headers");
+        count++;
+    }
+    ThrowErrorIfNot(Error::ZipCentralDirectoryHeader, (count == m_entries.size()), "central directory doesn't match the local file headers");
+    ThrowErrorIfNot(Error::ZipHiddenData, ((GetAvailable() >= sizeof(std::uint32_t)) &&
+        ((PeekValue<std::uint32_t>(0) == static_cast<std::uint32_t>(Signatures::Zip64EndOfCD)) ||
+         (PeekValue<std::uint32_t>(0) == static_cast<std::uint32_t>(Signatures::EndOfCentralDirectory)))),
+        "hidden data unsupported");
+}
+
 } // namespace MSIX
\ No newline at end of file
@@ -5,13 +5,20 @@
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
 #include "FileStream.hpp"
+#include "MappedFileStream.hpp"
 #include "RangeStream.hpp"
+#include "RangeReaderStream.hpp"
+#include "VectorStream.hpp"
+#include "StreamHelper.hpp"
 #include "ZipObject.hpp"
 #include "DirectoryObject.hpp"
+#include "PackageIndex.hpp"
+#include "BlockCache.hpp"
 #include "UnicodeConversion.hpp"
 #include "ComHelper.hpp"
 #include "AppxPackaging.hpp"
 #include "AppxPackageObject.hpp"
+#include "ForwardOnlyUnpacker.hpp"
 #include "AppxFactory.hpp"
 #include "Log.hpp"
 
@@ -19,6 +26,7 @@
 #include <memory>
 #include <cstdlib>
 #include <functional>
+#include <cstring>
 
 #ifndef WIN32
 // on non-win32 platforms, compile with -fvisibility=hidden
@@ -94,6 +102,101 @@ MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStream(
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromForwardOnlyStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (stream != nullptr && utf8Destination != nullptr),
+        "Invalid parameters"
+    );
+    // The package full name isn't known until the manifest is read, which is usually after the payload.
+    ThrowErrorIf(MSIX::Error::NotSupported, (packUnpackOptions & MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER),
+        "Package subfolder not supported for forward only streams");
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+
+    auto to = MSIX::ComPtr<MSIX::DirectoryObject>::Make<MSIX::DirectoryObject>(utf8Destination);
+    MSIX::ComPtr<IStream> source(stream);
+    MSIX::ForwardOnlyUnpacker unpacker(factory.As<IMsixFactory>().Get(), validationOption, source, to);
+    unpacker.Unpack();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageDifferential(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8PreviousDirectory,
+    char* utf8PreviousBlockMap,
+    char* utf8Destination,
+    UINT64* bytesSaved) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (utf8SourcePackage != nullptr && utf8PreviousDirectory != nullptr && utf8Destination != nullptr),
+        "Invalid parameters"
+    );
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
+
+    MSIX::ComPtr<IAppxPackageReader> reader;
+    ThrowHrIfFailed(factory->CreatePackageReader(stream.Get(), &reader));
+
+    // The previous blockmap is read into memory and its file closed, unpacking in place overwrites it.
+    std::string previousBlockMapName = (utf8PreviousBlockMap != nullptr) ? utf8PreviousBlockMap :
+        std::string(utf8PreviousDirectory) + "/AppxBlockMap.xml";
+    auto previousBlockMapBytes = MSIX::Helper::CreateBufferFromStream(
+        MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(previousBlockMapName, MSIX::FileStream::Mode::READ));
+    auto previousBlockMap = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&previousBlockMapBytes);
+
+    auto previous = MSIX::ComPtr<MSIX::DirectoryObject>::Make<MSIX::DirectoryObject>(utf8PreviousDirectory);
+    auto to = (std::strcmp(utf8PreviousDirectory, utf8Destination) == 0) ? previous :
+        MSIX::ComPtr<MSIX::DirectoryObject>::Make<MSIX::DirectoryObject>(utf8Destination);
+    auto saved = reader.As<IPackage>()->UnpackDifferential(packUnpackOptions, previousBlockMap, previous, to);
+    if (bytesSaved) { *bytesSaved = static_cast<UINT64>(saved); }
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE VerifyPackage(
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    MSIX_VERIFY_FILE_CALLBACK* callback,
+    void* context) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, (utf8SourcePackage != nullptr), "Invalid parameters");
+
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
+    return VerifyPackageFromStream(validationOption, stream.Get(), callback, context);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE VerifyPackageFromStream(
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    MSIX_VERIFY_FILE_CALLBACK* callback,
+    void* context) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, (stream != nullptr), "Invalid parameters");
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+
+    MSIX::ComPtr<IAppxPackageReader> reader;
+    ThrowHrIfFailed(factory->CreatePackageReader(stream, &reader));
+    reader.As<IPackage>()->Verify([&](const std::string& fileName, HRESULT result, std::uint64_t failedBlock)
+    {
+        if (callback) { callback(context, fileName.c_str(), result, failedBlock); }
+    });
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
 MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundle(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
@@ -174,6 +277,15 @@ MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFile(
     bool forRead,
     IStream** stream) noexcept try
 {
+    #ifndef WIN32
+    // Read only streams over regular files are memory mapped. Anything else (pipes, empty files, files
+    // that fail to map, etc) falls back to stdio.
+    if (forRead)
+    {
+        *stream = MSIX::MappedFileStream::OpenForRead(utf8File).Detach();
+        return static_cast<HRESULT>(MSIX::Error::OK);
+    }
+    #endif
     MSIX::FileStream::Mode mode = forRead ? MSIX::FileStream::Mode::READ : MSIX::FileStream::Mode::WRITE_UPDATE;
     *stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(utf8File, mode).Detach();
     return static_cast<HRESULT>(MSIX::Error::OK);
@@ -184,11 +296,58 @@ MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileUTF16(
     bool forRead,
     IStream** stream) noexcept try
 {
+    #ifndef WIN32
+    if (forRead)
+    {
+        *stream = MSIX::MappedFileStream::OpenForRead(MSIX::wstring_to_utf8(utf16File)).Detach();
+        return static_cast<HRESULT>(MSIX::Error::OK);
+    }
+    #endif
     MSIX::FileStream::Mode mode = forRead ? MSIX::FileStream::Mode::READ : MSIX::FileStream::Mode::WRITE_UPDATE;
     *stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(utf16File, mode).Detach();
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
+MSIX_API HRESULT STDMETHODCALLTYPE CreateIndexCacheOnDirectory(
+    char* utf8Directory,
+    IMsixIndexCache** indexCache) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (utf8Directory == nullptr || indexCache == nullptr || *indexCache != nullptr), "Invalid parameter");
+    *indexCache = MSIX::ComPtr<IMsixIndexCache>::Make<MSIX::DirectoryIndexCache>(utf8Directory).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreateBlockCache(
+    UINT64 maxBytes,
+    IMsixBlockCache** blockCache) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (blockCache == nullptr || *blockCache != nullptr), "Invalid parameter");
+    if (maxBytes == 0) { maxBytes = MSIX::BlockCache::DefaultMaxBytes; }
+    *blockCache = MSIX::ComPtr<IMsixBlockCache>::Make<MSIX::BlockCache>(maxBytes).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnRangeReader(
+    IMsixRangeReader* reader,
+    UINT32 blockSize,
+    UINT32 maxCachedBlocks,
+    IStream** stream) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (reader == nullptr || stream == nullptr || *stream != nullptr), "Invalid parameter");
+    *stream = MSIX::ComPtr<IStream>::Make<MSIX::RangeReaderStream>(reader, blockSize, maxCachedBlocks).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamFactoryOnRangeReaderFactory(
+    IMsixRangeReaderFactory* rangeReaderFactory,
+    IMsixStreamFactory** streamFactory) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (rangeReaderFactory == nullptr || streamFactory == nullptr || *streamFactory != nullptr),
+        "Invalid parameter");
+    *streamFactory = MSIX::ComPtr<IMsixStreamFactory>::Make<MSIX::RangeReaderStreamFactory>(rangeReaderFactory).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
 MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxFactoryWithHeap(
     COTASKMEMALLOC* memalloc,
     COTASKMEMFREE* memfree,
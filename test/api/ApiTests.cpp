@@ -6,6 +6,13 @@
 
 #include "ApiTests.hpp"
 #include "Verify.hpp"
+#ifdef INFLATE_BLOCK_TESTS
+#include "ICompressionObject.hpp"
+#endif
+#ifdef SHA256_TESTS
+#include "SHA256.hpp"
+#include "openssl/sha.h"
+#endif
 
 #include <iostream>
 #include <fstream>
@@ -15,10 +22,16 @@
 #include <string>
 #include <codecvt>
 #include <locale>
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 #ifndef WIN32
     #include <sys/types.h>
     #include <sys/stat.h>
+    #include <sys/resource.h>
     #include <unistd.h>
 #endif
 
@@ -344,6 +357,19 @@ void InitializeBundleHelper(IAppxBundleReader** bundleReader)
     return;
 }
 
+std::vector<std::uint8_t> ReadStream(IStream* stream)
+{
+    std::vector<std::uint8_t> content;
+    std::uint8_t buffer[4096];
+    ULONG bytesRead = 0;
+    do
+    {
+        VERIFY_SUCCEEDED(stream->Read(buffer, sizeof(buffer), &bytesRead));
+        content.insert(content.end(), buffer, buffer + bytesRead);
+    } while (bytesRead > 0);
+    return content;
+}
+
 void StartTestPackage(void*)
 {
     std::cout << "Starting test: TestPackage" << std::endl;
@@ -444,6 +470,66 @@ void StartTestPackage(void*)
                 VERIFY_IS_NULL(appxFile.Get());
             }
         )},
+        { "Package.PayloadFile.Seek", Test<IAppxPackageReader>("Validates reads after seeking around in a payload file",
+            [](IAppxPackageReader* packageReader)
+            {
+                auto file = utf8_to_utf16(GetInput<std::string>());
+                ComPtr<IAppxFile> appxFile;
+                VERIFY_SUCCEEDED(packageReader->GetPayloadFile(file.c_str(), &appxFile));
+                ComPtr<IStream> stream;
+                VERIFY_SUCCEEDED(appxFile->GetStream(&stream));
+
+                auto content = ReadStream(stream.Get());
+                VERIFY_IS_FALSE(content.empty());
+
+                std::uint8_t buffer[4096];
+                ULONG bytesRead = 0;
+                // Going backwards, so every seek starts inflating again and lands on a window boundary.
+                const std::uint64_t step = 32 * 1024;
+                for (std::uint64_t offset = ((content.size() - 1) / step) * step; ; offset -= step)
+                {
+                    LARGE_INTEGER li = {0};
+                    li.QuadPart = static_cast<LONGLONG>(offset);
+                    VERIFY_SUCCEEDED(stream->Seek(li, STREAM_SEEK_SET, nullptr));
+                    VERIFY_SUCCEEDED(stream->Read(buffer, sizeof(buffer), &bytesRead));
+                    auto expected = std::min(static_cast<std::uint64_t>(sizeof(buffer)), content.size() - offset);
+                    VERIFY_ARE_EQUAL(expected, static_cast<std::uint64_t>(bytesRead));
+                    VERIFY_IS_TRUE(std::equal(buffer, buffer + bytesRead, content.begin() + static_cast<std::size_t>(offset)));
+                    if (offset == 0) { break; }
+                }
+            }
+        )},
+        { "Package.PayloadFile.RandomReads", Test<IAppxPackageReader>("Validates reads of random ranges of a payload file",
+            [](IAppxPackageReader* packageReader)
+            {
+                auto file = utf8_to_utf16(GetInput<std::string>());
+                auto reads = GetInput<std::uint32_t>();
+                auto readSize = GetInput<std::uint32_t>();
+                ComPtr<IAppxFile> appxFile;
+                VERIFY_SUCCEEDED(packageReader->GetPayloadFile(file.c_str(), &appxFile));
+                ComPtr<IStream> stream;
+                VERIFY_SUCCEEDED(appxFile->GetStream(&stream));
+                auto content = ReadStream(stream.Get());
+                VERIFY_IS_FALSE(content.empty());
+
+                // Same ranges every run
+                std::uint32_t random = 12345;
+                std::vector<std::uint8_t> buffer(readSize);
+                for (std::uint32_t i = 0; i < reads; i++)
+                {
+                    random = random * 1103515245 + 12345;
+                    std::uint64_t offset = (random >> 8) % content.size();
+                    LARGE_INTEGER li = {0};
+                    li.QuadPart = static_cast<LONGLONG>(offset);
+                    VERIFY_SUCCEEDED(stream->Seek(li, STREAM_SEEK_SET, nullptr));
+                    ULONG bytesRead = 0;
+                    VERIFY_SUCCEEDED(stream->Read(buffer.data(), readSize, &bytesRead));
+                    auto expected = std::min(static_cast<std::uint64_t>(readSize), content.size() - offset);
+                    VERIFY_ARE_EQUAL(expected, static_cast<std::uint64_t>(bytesRead));
+                    VERIFY_IS_TRUE(std::equal(buffer.begin(), buffer.begin() + bytesRead, content.begin() + static_cast<std::size_t>(offset)));
+                }
+            }
+        )},
         { "Package.FootprintFile", Test<IAppxPackageReader>("Validates a footprint file information",
             [](IAppxPackageReader* packageReader)
             {
@@ -1025,6 +1111,1956 @@ void StartTestPackageBlockMap(void*)
     return;
 }
 
+// Returns the contents of the payload files of a package by name
+std::map<std::string, std::vector<std::uint8_t>> ReadPayloadFiles(IAppxPackageReader* packageReader)
+{
+    std::map<std::string, std::vector<std::uint8_t>> payload;
+    ComPtr<IAppxFilesEnumerator> files;
+    VERIFY_SUCCEEDED(packageReader->GetPayloadFiles(&files));
+    BOOL hasCurrent = FALSE;
+    VERIFY_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+    while (hasCurrent)
+    {
+        ComPtr<IAppxFile> file;
+        VERIFY_SUCCEEDED(files->GetCurrent(&file));
+        Text<wchar_t> fileName;
+        VERIFY_SUCCEEDED(file->GetName(&fileName));
+        ComPtr<IStream> stream;
+        VERIFY_SUCCEEDED(file->GetStream(&stream));
+
+        payload[fileName.ToString()] = ReadStream(stream.Get());
+
+        VERIFY_SUCCEEDED(files->MoveNext(&hasCurrent));
+    }
+    return payload;
+}
+
+// Opens a package with an index cache and reads its payload
+HRESULT ReadPayloadWithIndexCache(const std::string& packageName, IMsixIndexCache* indexCache, MSIX_VALIDATION_OPTION validation,
+    std::map<std::string, std::vector<std::uint8_t>>& payload)
+{
+    ComPtr<IAppxFactory> factory;
+    VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, validation, &factory));
+    ComPtr<IMsixFactoryOverrides> factoryOverrides;
+    VERIFY_SUCCEEDED(factory->QueryInterface(UuidOfImpl<IMsixFactoryOverrides>::iid, reinterpret_cast<void**>(&factoryOverrides)));
+    VERIFY_SUCCEEDED(factoryOverrides->SpecifyExtension(MSIX_FACTORY_EXTENSION_INDEX_CACHE, indexCache));
+
+    ComPtr<IStream> inputStream;
+    ComPtr<IAppxPackageReader> packageReader;
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName.c_str()), true, &inputStream));
+    HRESULT hr = factory->CreatePackageReader(inputStream.Get(), &packageReader);
+    if (SUCCEEDED(hr))
+    {
+        payload = ReadPayloadFiles(packageReader.Get());
+    }
+    return hr;
+}
+
+void StartTestIndexCache(void*)
+{
+    std::cout << "Starting test: TestIndexCache" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    std::map<std::string, Test<std::string>> indexCacheTests =
+    {
+        { "Package.IndexCache.Reopen", Test<std::string>("Validates a package reopened from the index cache has the same payload",
+            [](std::string* packageName)
+            {
+                auto cacheDirectory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    cacheDirectory = g_packageRootPath + cacheDirectory;
+                }
+                ComPtr<IMsixIndexCache> indexCache;
+                VERIFY_SUCCEEDED(CreateIndexCacheOnDirectory(const_cast<char*>(cacheDirectory.c_str()), &indexCache));
+
+                // The first reader creates the index if there isn't one yet, the second one uses it.
+                std::vector<std::map<std::string, std::vector<std::uint8_t>>> payloads(2);
+                for (auto& payload : payloads)
+                {
+                    VERIFY_SUCCEEDED(ReadPayloadWithIndexCache(*packageName, indexCache.Get(), MSIX_VALIDATION_OPTION_SKIPSIGNATURE, payload));
+                }
+                VERIFY_IS_FALSE(payloads[0].empty());
+                VERIFY_IS_TRUE(payloads[0] == payloads[1]);
+            }
+        )},
+        { "Package.IndexCache.SignedBlockMap", Test<std::string>("Validates the signature's digest of a blockmap bigger than a block is checked when the package is reopened from the index cache",
+            [](std::string*)
+            {
+                auto signedPackageName = GetInput<std::string>();
+                auto cacheDirectory = GetInput<std::string>();
+                auto outputName = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    signedPackageName = g_packageRootPath + signedPackageName;
+                    cacheDirectory = g_packageRootPath + cacheDirectory;
+                    outputName = g_packageRootPath + outputName;
+                }
+                ComPtr<IMsixIndexCache> indexCache;
+                VERIFY_SUCCEEDED(CreateIndexCacheOnDirectory(const_cast<char*>(cacheDirectory.c_str()), &indexCache));
+
+                std::ifstream input(signedPackageName, std::ios::binary);
+                std::vector<char> package((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+                VERIFY_IS_FALSE(package.empty());
+                {
+                    std::ofstream output(outputName, std::ios::binary | std::ios::trunc);
+                    output.write(package.data(), package.size());
+                }
+                std::vector<std::map<std::string, std::vector<std::uint8_t>>> payloads(2);
+                for (auto& payload : payloads)
+                {
+                    VERIFY_SUCCEEDED(ReadPayloadWithIndexCache(outputName, indexCache.Get(), MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN, payload));
+                }
+                VERIFY_IS_FALSE(payloads[0].empty());
+                VERIFY_IS_TRUE(payloads[0] == payloads[1]);
+
+                // Change a block hash in the stored AppxBlockMap.xml. The central directory doesn't change, so the
+                // package still has the same index and only the signature's digest of the blockmap can catch it.
+                const std::string blockMapStart = "<BlockMap ";
+                const std::string hashStart = "Hash=\"";
+                auto blockMap = std::search(package.begin(), package.end(), blockMapStart.begin(), blockMapStart.end());
+                VERIFY_IS_TRUE(blockMap != package.end());
+                auto hash = std::search(blockMap, package.end(), hashStart.begin(), hashStart.end());
+                VERIFY_IS_TRUE(hash != package.end());
+                auto& hashCharacter = *(hash + hashStart.size());
+                hashCharacter = (hashCharacter == 'A') ? 'B' : 'A';
+                {
+                    std::ofstream output(outputName, std::ios::binary | std::ios::trunc);
+                    output.write(package.data(), package.size());
+                }
+                std::map<std::string, std::vector<std::uint8_t>> payload;
+                auto hr = ReadPayloadWithIndexCache(outputName, indexCache.Get(), MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN, payload);
+                VERIFY_ARE_EQUAL(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), hr);
+                std::remove(outputName.c_str());
+            }
+        )},
+    };
+    ParseAndRun(indexCacheTests, "Finish.TestIndexCache", &packageName);
+    return;
+}
+
+void StartTestPackageWriter(void*)
+{
+    std::cout << "Starting test: TestPackageWriter" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    std::map<std::string, Test<std::string>> packageWriterTests =
+    {
+        { "PackageWriter.RoundTrip", Test<std::string>("Validates a package written from the payload and manifest of another one has the same payload",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                }
+
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                ComPtr<IStream> inputStream;
+                ComPtr<IAppxPackageReader> packageReader;
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName->c_str()), true, &inputStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+                auto expected = ReadPayloadFiles(packageReader.Get());
+
+                {
+                    ComPtr<IStream> outputStream;
+                    ComPtr<IAppxPackageWriter> packageWriter;
+                    APPX_PACKAGE_SETTINGS settings = { FALSE, nullptr };
+                    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), false, &outputStream));
+                    VERIFY_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), &settings, &packageWriter));
+
+                    ComPtr<IAppxFilesEnumerator> files;
+                    VERIFY_SUCCEEDED(packageReader->GetPayloadFiles(&files));
+                    BOOL hasCurrent = FALSE;
+                    VERIFY_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+                    while (hasCurrent)
+                    {
+                        ComPtr<IAppxFile> file;
+                        VERIFY_SUCCEEDED(files->GetCurrent(&file));
+                        Text<wchar_t> fileName;
+                        VERIFY_SUCCEEDED(file->GetName(&fileName));
+                        APPX_COMPRESSION_OPTION compression;
+                        VERIFY_SUCCEEDED(file->GetCompressionOption(&compression));
+                        ComPtr<IStream> stream;
+                        VERIFY_SUCCEEDED(file->GetStream(&stream));
+                        VERIFY_SUCCEEDED(packageWriter->AddPayloadFile(fileName.Get(), L"application/octet-stream", compression, stream.Get()));
+                        VERIFY_SUCCEEDED(files->MoveNext(&hasCurrent));
+                    }
+
+                    ComPtr<IAppxFile> manifestFile;
+                    ComPtr<IStream> manifestStream;
+                    VERIFY_SUCCEEDED(packageReader->GetFootprintFile(APPX_FOOTPRINT_FILE_TYPE_MANIFEST, &manifestFile));
+                    VERIFY_SUCCEEDED(manifestFile->GetStream(&manifestStream));
+                    VERIFY_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+                    // Nothing can be added once the package is closed
+                    VERIFY_ARE_EQUAL(static_cast<HRESULT>(MSIX::Error::InvalidState),
+                        packageWriter->Close(manifestStream.Get()));
+                }
+
+                ComPtr<IStream> writtenStream;
+                ComPtr<IAppxPackageReader> writtenReader;
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), true, &writtenStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(writtenStream.Get(), &writtenReader));
+                auto actual = ReadPayloadFiles(writtenReader.Get());
+                VERIFY_IS_FALSE(expected.empty());
+                VERIFY_IS_TRUE(expected == actual);
+            }
+        )},
+    };
+    ParseAndRun(packageWriterTests, "Finish.TestPackageWriter", &packageName);
+    return;
+}
+
+// Removes a file when it goes out of scope, so a test that fails doesn't leave what it wrote behind
+class FileRemover final
+{
+public:
+    FileRemover(const std::string& name) : m_name(name) {}
+    ~FileRemover() { std::remove(m_name.c_str()); }
+
+private:
+    std::string m_name;
+};
+
+// Adds up the work a factory reports, so tests can check how it grows with the size of a package without timing it
+class WorkCounter final : public IMsixWorkCounter
+{
+public:
+    static void Make(IMsixWorkCounter** result)
+    {
+        *result = new WorkCounter();
+    }
+
+    static WorkCounter* From(IMsixWorkCounter* counter)
+    {
+        return static_cast<WorkCounter*>(counter);
+    }
+
+    std::uint64_t Get(MSIX_WORK_COUNTER counter) { return m_counts[counter]; }
+    void Reset() { m_counts.clear(); }
+
+    // IUnknown
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr) { return E_INVALIDARG; }
+        if (riid == UuidOfImpl<IUnknown>::iid || riid == UuidOfImpl<IMsixWorkCounter>::iid)
+        {
+            *ppvObject = static_cast<IMsixWorkCounter*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppvObject = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return ++m_ref; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override
+    {
+        auto ref = --m_ref;
+        if (ref == 0) { delete this; }
+        return ref;
+    }
+
+    // IMsixWorkCounter
+    HRESULT STDMETHODCALLTYPE AddWork(MSIX_WORK_COUNTER counter, UINT64 count) noexcept override
+    {
+        m_counts[counter] += count;
+        return S_OK;
+    }
+
+private:
+    WorkCounter() = default;
+
+    ULONG m_ref = 1;
+    std::map<MSIX_WORK_COUNTER, std::uint64_t> m_counts;
+};
+
+// Stream of size bytes where every 8 bytes hold their offset divided by 8, so any range can be checked on its own
+class PatternStream final : public IStream
+{
+public:
+    static void Make(std::uint64_t size, IStream** result)
+    {
+        *result = new PatternStream(size);
+    }
+
+    static std::uint8_t GetByte(std::uint64_t offset)
+    {
+        return static_cast<std::uint8_t>((offset / 8) >> ((offset % 8) * 8));
+    }
+
+    // IUnknown
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr) { return E_INVALIDARG; }
+        if (riid == UuidOfImpl<IUnknown>::iid || riid == UuidOfImpl<ISequentialStream>::iid || riid == UuidOfImpl<IStream>::iid)
+        {
+            *ppvObject = static_cast<IStream*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppvObject = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return ++m_ref; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override
+    {
+        auto ref = --m_ref;
+        if (ref == 0) { delete this; }
+        return ref;
+    }
+
+    // ISequentialStream
+    HRESULT STDMETHODCALLTYPE Read(void* pv, ULONG cb, ULONG* pcbRead) noexcept override
+    {
+        ULONG read = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(cb), m_size - m_position));
+        for (ULONG i = 0; i < read; i++)
+        {
+            static_cast<std::uint8_t*>(pv)[i] = GetByte(m_position + i);
+        }
+        m_position += read;
+        if (pcbRead) { *pcbRead = read; }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override { return E_NOTIMPL; }
+
+    // IStream, only reading is allowed
+    HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override
+    {
+        std::int64_t base = (origin == STREAM_SEEK_END) ? static_cast<std::int64_t>(m_size) :
+            ((origin == STREAM_SEEK_CUR) ? static_cast<std::int64_t>(m_position) : 0);
+        if (base + move.QuadPart < 0 || static_cast<std::uint64_t>(base + move.QuadPart) > m_size) { return E_INVALIDARG; }
+        m_position = static_cast<std::uint64_t>(base + move.QuadPart);
+        if (newPosition) { newPosition->QuadPart = m_position; }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CopyTo(IStream*, ULARGE_INTEGER, ULARGE_INTEGER*, ULARGE_INTEGER*) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Commit(DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Revert() noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Stat(STATSTG*, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Clone(IStream**) noexcept override { return E_NOTIMPL; }
+
+protected:
+    PatternStream(std::uint64_t size) : m_size(size) {}
+
+    std::uint64_t   m_size;
+    std::uint64_t   m_position = 0;
+    ULONG           m_ref = 1;
+};
+
+// Returns true if the unpacked file has the pattern of fileSize bytes
+bool UnpackedFileMatchesPattern(const std::string& fileName, std::uint64_t fileSize)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    std::vector<char> buffer(64 * 1024);
+    std::uint64_t position = 0;
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0)
+    {
+        for (std::streamsize i = 0; i < file.gcount(); i++, position++)
+        {
+            if (static_cast<std::uint8_t>(buffer[i]) != PatternStream::GetByte(position)) { return false; }
+        }
+    }
+    return file.eof() && position == fileSize;
+}
+
+// Writes a package with the manifest of the input package and a single stored payload file of fileSize bytes
+void WriteLargePayloadPackage(IAppxFactory* factory, const std::string& packageName, const std::string& outputName, std::uint64_t fileSize,
+    LPCWSTR fileName = L"large.bin")
+{
+    ComPtr<IStream> inputStream;
+    ComPtr<IAppxPackageReader> packageReader;
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName.c_str()), true, &inputStream));
+    VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+
+    ComPtr<IStream> outputStream;
+    ComPtr<IAppxPackageWriter> packageWriter;
+    APPX_PACKAGE_SETTINGS settings = { FALSE, nullptr };
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), false, &outputStream));
+    VERIFY_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), &settings, &packageWriter));
+    ComPtr<IStream> patternStream;
+    PatternStream::Make(fileSize, &patternStream);
+    VERIFY_SUCCEEDED(packageWriter->AddPayloadFile(fileName, L"application/octet-stream", APPX_COMPRESSION_OPTION_NONE, patternStream.Get()));
+
+    ComPtr<IAppxFile> manifestFile;
+    ComPtr<IStream> manifestStream;
+    VERIFY_SUCCEEDED(packageReader->GetFootprintFile(APPX_FOOTPRINT_FILE_TYPE_MANIFEST, &manifestFile));
+    VERIFY_SUCCEEDED(manifestFile->GetStream(&manifestStream));
+    VERIFY_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+}
+
+// Stream that can only be read from start to end, like a pipe. It stops after limit bytes of the underlying stream.
+class ForwardOnlyStream final : public IStream
+{
+public:
+    static void Make(IStream* stream, std::uint64_t limit, IStream** result)
+    {
+        *result = new ForwardOnlyStream(stream, limit);
+    }
+
+    // IUnknown
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr) { return E_INVALIDARG; }
+        if (riid == UuidOfImpl<IUnknown>::iid || riid == UuidOfImpl<ISequentialStream>::iid || riid == UuidOfImpl<IStream>::iid)
+        {
+            *ppvObject = static_cast<IStream*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppvObject = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return ++m_ref; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override
+    {
+        auto ref = --m_ref;
+        if (ref == 0) { delete this; }
+        return ref;
+    }
+
+    // ISequentialStream
+    HRESULT STDMETHODCALLTYPE Read(void* pv, ULONG cb, ULONG* pcbRead) noexcept override
+    {
+        ULONG toRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(cb), m_limit - m_position));
+        ULONG read = 0;
+        HRESULT hr = (toRead == 0) ? S_OK : m_stream->Read(pv, toRead, &read);
+        m_position += read;
+        if (pcbRead) { *pcbRead = read; }
+        return hr;
+    }
+    HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override { return E_NOTIMPL; }
+
+    // IStream, nothing but reading is allowed
+    HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER, DWORD, ULARGE_INTEGER*) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CopyTo(IStream*, ULARGE_INTEGER, ULARGE_INTEGER*, ULARGE_INTEGER*) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Commit(DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Revert() noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Stat(STATSTG*, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Clone(IStream**) noexcept override { return E_NOTIMPL; }
+
+protected:
+    ForwardOnlyStream(IStream* stream, std::uint64_t limit) : m_stream(stream), m_limit(limit) {}
+
+    ComPtr<IStream> m_stream;
+    std::uint64_t   m_limit;
+    std::uint64_t   m_position = 0;
+    ULONG           m_ref = 1;
+};
+
+// Unpacks a package through a ForwardOnlyStream that stops after a fraction of the package
+HRESULT UnpackFromForwardOnlyStream(const std::string& packageName, const std::string& directory, std::uint64_t numerator, std::uint64_t denominator)
+{
+    ComPtr<IStream> inputStream;
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName.c_str()), true, &inputStream));
+    LARGE_INTEGER li = {0};
+    ULARGE_INTEGER size = {0};
+    VERIFY_SUCCEEDED(inputStream->Seek(li, STREAM_SEEK_END, &size));
+    VERIFY_SUCCEEDED(inputStream->Seek(li, STREAM_SEEK_SET, nullptr));
+
+    ComPtr<IStream> stream;
+    ForwardOnlyStream::Make(inputStream.Get(), size.QuadPart * numerator / denominator, &stream);
+    return UnpackPackageFromForwardOnlyStream(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        stream.Get(), const_cast<char*>(directory.c_str()));
+}
+
+// Returns the path of an unpacked payload file from its name in the package
+std::string GetUnpackedFileName(const std::string& directory, std::string fileName)
+{
+    std::replace(fileName.begin(), fileName.end(), '\\', '/');
+    return directory + "/" + fileName;
+}
+
+// Removes what an earlier run unpacked to directory, the forward only unpack doesn't write over files
+void RemoveUnpackedFiles(const std::string& packageName, const std::string& directory)
+{
+    ComPtr<IAppxFactory> factory;
+    ComPtr<IStream> inputStream;
+    ComPtr<IAppxPackageReader> packageReader;
+    VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName.c_str()), true, &inputStream));
+    VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+    for (const auto& file : ReadPayloadFiles(packageReader.Get()))
+    {
+        std::remove(GetUnpackedFileName(directory, file.first).c_str());
+    }
+    for (const auto& name : { "AppxManifest.xml", "AppxBlockMap.xml", "AppxSignature.p7x", "AppxMetadata/CodeIntegrity.cat" })
+    {
+        std::remove((directory + "/" + name).c_str());
+    }
+}
+
+// Replaces every occurrence of from in a file with to, which has the same size
+void ReplaceInFile(const std::string& fileName, const std::string& from, const std::string& to)
+{
+    std::string content;
+    {
+        std::ifstream input(fileName, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    std::size_t replaced = 0;
+    for (auto found = content.find(from); found != std::string::npos; found = content.find(from, found + to.size()))
+    {
+        content.replace(found, from.size(), to);
+        replaced++;
+    }
+    VERIFY_IS_TRUE(replaced != 0);
+    std::ofstream output(fileName, std::ios::binary | std::ios::trunc);
+    output.write(content.data(), content.size());
+}
+
+// Returns the content of a file, or an empty string if it can't be read
+std::string ReadFileContent(const std::string& fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void StartTestForwardOnlyUnpack(void*)
+{
+    std::cout << "Starting test: TestForwardOnlyUnpack" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    std::map<std::string, Test<std::string>> forwardOnlyUnpackTests =
+    {
+        { "ForwardOnlyUnpack.Payload", Test<std::string>("Validates a package unpacked from a forward only stream has the same payload as the package",
+            [](std::string* packageName)
+            {
+                auto directory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    directory = g_packageRootPath + directory;
+                }
+                RemoveUnpackedFiles(*packageName, directory);
+                VERIFY_SUCCEEDED(UnpackFromForwardOnlyStream(*packageName, directory, 1, 1));
+
+                ComPtr<IAppxFactory> factory;
+                ComPtr<IStream> inputStream;
+                ComPtr<IAppxPackageReader> packageReader;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName->c_str()), true, &inputStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+                auto expected = ReadPayloadFiles(packageReader.Get());
+                VERIFY_IS_FALSE(expected.empty());
+                for (const auto& file : expected)
+                {
+                    std::ifstream unpacked(GetUnpackedFileName(directory, file.first), std::ios::binary);
+                    VERIFY_IS_TRUE(unpacked.is_open());
+                    std::vector<std::uint8_t> content((std::istreambuf_iterator<char>(unpacked)), std::istreambuf_iterator<char>());
+                    VERIFY_IS_TRUE(content == file.second);
+                }
+            }
+        )},
+        { "ForwardOnlyUnpack.Truncated", Test<std::string>("Validates a truncated package fails to unpack and its payload is removed",
+            [](std::string* packageName)
+            {
+                auto directory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    directory = g_packageRootPath + directory;
+                }
+                // The blockmap is at the end, so some payload is extracted before the package is found to be invalid.
+                auto hr = UnpackFromForwardOnlyStream(*packageName, directory, 9, 10);
+                VERIFY_IS_TRUE(FAILED(hr));
+
+                ComPtr<IAppxFactory> factory;
+                ComPtr<IStream> inputStream;
+                ComPtr<IAppxPackageReader> packageReader;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName->c_str()), true, &inputStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+                for (const auto& file : ReadPayloadFiles(packageReader.Get()))
+                {
+                    std::ifstream unpacked(GetUnpackedFileName(directory, file.first), std::ios::binary);
+                    VERIFY_IS_FALSE(unpacked.is_open());
+                }
+            }
+        )},
+        { "ForwardOnlyUnpack.ExistingFile", Test<std::string>("Validates a forward only unpack doesn't write over or remove a file that is already in the destination",
+            [](std::string* packageName)
+            {
+                auto directory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    directory = g_packageRootPath + directory;
+                }
+                RemoveUnpackedFiles(*packageName, directory);
+                VERIFY_SUCCEEDED(UnpackFromForwardOnlyStream(*packageName, directory, 1, 1));
+                RemoveUnpackedFiles(*packageName, directory);
+
+                // The manifest is written after the payload, once the package is valid.
+                std::string existing = "not the manifest";
+                {
+                    std::ofstream manifest(directory + "/AppxManifest.xml", std::ios::binary | std::ios::trunc);
+                    manifest << existing;
+                }
+                VERIFY_IS_TRUE(FAILED(UnpackFromForwardOnlyStream(*packageName, directory, 1, 1)));
+                VERIFY_ARE_EQUAL(existing, ReadFileContent(directory + "/AppxManifest.xml"));
+
+                ComPtr<IAppxFactory> factory;
+                ComPtr<IStream> inputStream;
+                ComPtr<IAppxPackageReader> packageReader;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName->c_str()), true, &inputStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+                for (const auto& file : ReadPayloadFiles(packageReader.Get()))
+                {
+                    std::ifstream unpacked(GetUnpackedFileName(directory, file.first), std::ios::binary);
+                    VERIFY_IS_FALSE(unpacked.is_open());
+                }
+                std::remove((directory + "/AppxManifest.xml").c_str());
+            }
+        )},
+        { "ForwardOnlyUnpack.OutsideDestination", Test<std::string>("Validates a file name that goes above the destination fails before anything is written there",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                auto directory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                    directory = g_packageRootPath + directory;
+                }
+                FileRemover outputRemover(outputName);
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                WriteLargePayloadPackage(factory.Get(), *packageName, outputName, 1000, L"xx\\fo_escape.bin");
+                // Same size in the zip, so only the names change. The blockmap still has the old name.
+                ReplaceInFile(outputName, "xx/fo_escape.bin", "../fo_escape.bin");
+
+                // The file is created next to the destination, where the name would put it.
+                std::string escaped = g_packageRootPath + "fo_escape.bin";
+                FileRemover escapedRemover(escaped);
+                std::string existing = "next to the destination";
+                {
+                    std::ofstream file(escaped, std::ios::binary | std::ios::trunc);
+                    file << existing;
+                }
+                VERIFY_HR(static_cast<HRESULT>(MSIX::Error::ZipLocalFileHeader), UnpackFromForwardOnlyStream(outputName, directory, 1, 1));
+                VERIFY_ARE_EQUAL(existing, ReadFileContent(escaped));
+            }
+        )},
+    };
+    ParseAndRun(forwardOnlyUnpackTests, "Finish.TestForwardOnlyUnpack", &packageName);
+    return;
+}
+
+// Reads the payload of a package and unpacks it to directory, returns the size of what it has in the blockmap
+std::uint64_t UnpackForDifferentialUnpack(const std::string& packageName, const std::string& directory,
+    std::map<std::string, std::vector<std::uint8_t>>& payload)
+{
+    ComPtr<IAppxFactory> factory;
+    ComPtr<IStream> inputStream;
+    ComPtr<IAppxPackageReader> packageReader;
+    VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName.c_str()), true, &inputStream));
+    VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+    payload = ReadPayloadFiles(packageReader.Get());
+    VERIFY_IS_FALSE(payload.empty());
+    VERIFY_SUCCEEDED(UnpackPackage(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        const_cast<char*>(packageName.c_str()), const_cast<char*>(directory.c_str())));
+
+    // The manifest is in the blockmap too.
+    std::ifstream manifest(directory + "/AppxManifest.xml", std::ios::binary | std::ios::ate);
+    VERIFY_IS_TRUE(manifest.is_open());
+    std::uint64_t size = static_cast<std::uint64_t>(manifest.tellg());
+    for (const auto& file : payload)
+    {
+        size += file.second.size();
+    }
+    return size;
+}
+
+// Writes a package with the manifest of the input package and two stored payload files of the given sizes, which
+// differ between versions when their sizes do
+void WriteVersionedPackage(IAppxFactory* factory, const std::string& packageName, const std::string& outputName,
+    std::uint64_t linkedSize, std::uint64_t changedSize)
+{
+    ComPtr<IStream> inputStream;
+    ComPtr<IAppxPackageReader> packageReader;
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName.c_str()), true, &inputStream));
+    VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+
+    ComPtr<IStream> outputStream;
+    ComPtr<IAppxPackageWriter> packageWriter;
+    APPX_PACKAGE_SETTINGS settings = { FALSE, nullptr };
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), false, &outputStream));
+    VERIFY_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), &settings, &packageWriter));
+    ComPtr<IStream> linkedStream;
+    ComPtr<IStream> changedStream;
+    PatternStream::Make(linkedSize, &linkedStream);
+    PatternStream::Make(changedSize, &changedStream);
+    VERIFY_SUCCEEDED(packageWriter->AddPayloadFile(L"Versioned\\linked.bin", L"application/octet-stream", APPX_COMPRESSION_OPTION_NONE, linkedStream.Get()));
+    VERIFY_SUCCEEDED(packageWriter->AddPayloadFile(L"Versioned\\changed.bin", L"application/octet-stream", APPX_COMPRESSION_OPTION_NONE, changedStream.Get()));
+
+    ComPtr<IAppxFile> manifestFile;
+    ComPtr<IStream> manifestStream;
+    VERIFY_SUCCEEDED(packageReader->GetFootprintFile(APPX_FOOTPRINT_FILE_TYPE_MANIFEST, &manifestFile));
+    VERIFY_SUCCEEDED(manifestFile->GetStream(&manifestStream));
+    VERIFY_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+}
+
+// Reads the files of an unpacked package
+std::map<std::string, std::vector<std::uint8_t>> ReadUnpackedFiles(const std::string& directory, const std::vector<std::string>& names)
+{
+    std::map<std::string, std::vector<std::uint8_t>> files;
+    for (const auto& name : names)
+    {
+        std::ifstream file(directory + "/" + name, std::ios::binary);
+        VERIFY_IS_TRUE(file.is_open());
+        files[name].assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    return files;
+}
+
+void StartTestDifferentialUnpack(void*)
+{
+    std::cout << "Starting test: TestDifferentialUnpack" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    std::map<std::string, Test<std::string>> differentialUnpackTests =
+    {
+        { "DifferentialUnpack.Unchanged", Test<std::string>("Validates nothing is extracted when unpacking a package again over its previous unpack",
+            [](std::string* packageName)
+            {
+                auto previous = GetInput<std::string>();
+                auto directory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    previous = g_packageRootPath + previous;
+                    directory = g_packageRootPath + directory;
+                }
+                std::map<std::string, std::vector<std::uint8_t>> payload;
+                auto expectedSaved = UnpackForDifferentialUnpack(*packageName, previous, payload);
+
+                UINT64 bytesSaved = 0;
+                VERIFY_SUCCEEDED(UnpackPackageDifferential(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                    const_cast<char*>(packageName->c_str()), const_cast<char*>(previous.c_str()), nullptr,
+                    const_cast<char*>(directory.c_str()), &bytesSaved));
+                VERIFY_ARE_EQUAL(expectedSaved, static_cast<std::uint64_t>(bytesSaved));
+                for (const auto& file : payload)
+                {
+                    std::ifstream unpacked(GetUnpackedFileName(directory, file.first), std::ios::binary);
+                    VERIFY_IS_TRUE(unpacked.is_open());
+                    std::vector<std::uint8_t> content((std::istreambuf_iterator<char>(unpacked)), std::istreambuf_iterator<char>());
+                    VERIFY_IS_TRUE(content == file.second);
+                }
+            }
+        )},
+        { "DifferentialUnpack.InPlace", Test<std::string>("Validates unpacking in place extracts only the file that differs from the blockmap",
+            [](std::string* packageName)
+            {
+                auto directory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    directory = g_packageRootPath + directory;
+                }
+                std::map<std::string, std::vector<std::uint8_t>> payload;
+                auto expectedSaved = UnpackForDifferentialUnpack(*packageName, directory, payload);
+
+                // Cut the largest payload file short, it is the only one that has to be extracted again.
+                auto changed = std::max_element(payload.begin(), payload.end(),
+                    [](const auto& a, const auto& b) { return a.second.size() < b.second.size(); });
+                VERIFY_IS_FALSE(changed->second.empty());
+                {
+                    std::ofstream truncated(GetUnpackedFileName(directory, changed->first), std::ios::binary | std::ios::trunc);
+                    truncated.write(reinterpret_cast<const char*>(changed->second.data()), changed->second.size() / 2);
+                }
+                expectedSaved -= changed->second.size();
+
+                UINT64 bytesSaved = 0;
+                VERIFY_SUCCEEDED(UnpackPackageDifferential(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                    const_cast<char*>(packageName->c_str()), const_cast<char*>(directory.c_str()), nullptr,
+                    const_cast<char*>(directory.c_str()), &bytesSaved));
+                VERIFY_ARE_EQUAL(expectedSaved, static_cast<std::uint64_t>(bytesSaved));
+                for (const auto& file : payload)
+                {
+                    std::ifstream unpacked(GetUnpackedFileName(directory, file.first), std::ios::binary);
+                    VERIFY_IS_TRUE(unpacked.is_open());
+                    std::vector<std::uint8_t> content((std::istreambuf_iterator<char>(unpacked)), std::istreambuf_iterator<char>());
+                    VERIFY_IS_TRUE(content == file.second);
+                }
+            }
+        )},
+        { "DifferentialUnpack.InPlaceOverLinks", Test<std::string>("Validates unpacking in place over files linked from an older version leaves that version as it was",
+            [](std::string* packageName)
+            {
+                auto directory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    directory = g_packageRootPath + directory;
+                }
+                std::string packages[] = { directory + "_v1.appx", directory + "_v2.appx", directory + "_v3.appx" };
+                FileRemover removers[] = { packages[0], packages[1], packages[2] };
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                // linked.bin is the same in v1 and v2 and changes in v3, changed.bin changes in every version.
+                WriteVersionedPackage(factory.Get(), *packageName, packages[0], 100000, 1000);
+                WriteVersionedPackage(factory.Get(), *packageName, packages[1], 100000, 2000);
+                WriteVersionedPackage(factory.Get(), *packageName, packages[2], 100001, 3000);
+
+                std::string v1 = directory + "/v1";
+                std::string v2 = directory + "/v2";
+                VERIFY_SUCCEEDED(UnpackPackage(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                    const_cast<char*>(packages[0].c_str()), const_cast<char*>(v1.c_str())));
+                std::vector<std::string> names = { "AppxManifest.xml", "AppxBlockMap.xml", "Versioned/linked.bin", "Versioned/changed.bin" };
+                auto v1Files = ReadUnpackedFiles(v1, names);
+
+                UINT64 bytesSaved = 0;
+                VERIFY_SUCCEEDED(UnpackPackageDifferential(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                    const_cast<char*>(packages[1].c_str()), const_cast<char*>(v1.c_str()), nullptr,
+                    const_cast<char*>(v2.c_str()), &bytesSaved));
+                #ifndef WIN32
+                struct stat v1Stat;
+                struct stat v2Stat;
+                VERIFY_ARE_EQUAL(0, stat((v1 + "/Versioned/linked.bin").c_str(), &v1Stat));
+                VERIFY_ARE_EQUAL(0, stat((v2 + "/Versioned/linked.bin").c_str(), &v2Stat));
+                VERIFY_IS_TRUE(v1Stat.st_ino == v2Stat.st_ino);
+                #endif
+
+                VERIFY_SUCCEEDED(UnpackPackageDifferential(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                    const_cast<char*>(packages[2].c_str()), const_cast<char*>(v2.c_str()), nullptr,
+                    const_cast<char*>(v2.c_str()), &bytesSaved));
+                VERIFY_IS_TRUE(UnpackedFileMatchesPattern(v2 + "/Versioned/linked.bin", 100001));
+                VERIFY_IS_TRUE(UnpackedFileMatchesPattern(v2 + "/Versioned/changed.bin", 3000));
+                VERIFY_IS_TRUE(ReadUnpackedFiles(v1, names) == v1Files);
+            }
+        )},
+    };
+    ParseAndRun(differentialUnpackTests, "Finish.TestDifferentialUnpack", &packageName);
+    return;
+}
+
+// Range reader over a local file that counts the requests made to it
+class FileRangeReader final : public IMsixRangeReader
+{
+public:
+    static void Make(const std::string& fileName, FileRangeReader** result)
+    {
+        *result = new FileRangeReader(fileName);
+    }
+
+    // IUnknown
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr) { return E_INVALIDARG; }
+        if (riid == UuidOfImpl<IUnknown>::iid || riid == UuidOfImpl<IMsixRangeReader>::iid)
+        {
+            *ppvObject = static_cast<IMsixRangeReader*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppvObject = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return ++m_ref; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override
+    {
+        auto ref = --m_ref;
+        if (ref == 0) { delete this; }
+        return ref;
+    }
+
+    // IMsixRangeReader
+    HRESULT STDMETHODCALLTYPE GetSize(UINT64* size) noexcept override
+    {
+        m_file.clear();
+        m_file.seekg(0, std::ios::end);
+        *size = static_cast<UINT64>(m_file.tellg());
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE ReadRange(UINT64 offset, UINT32 size, BYTE* buffer, UINT32* bytesRead) noexcept override
+    {
+        m_requests++;
+        m_file.clear();
+        m_file.seekg(static_cast<std::streamoff>(offset));
+        m_file.read(reinterpret_cast<char*>(buffer), size);
+        *bytesRead = static_cast<UINT32>(m_file.gcount());
+        m_bytesRead += *bytesRead;
+        return S_OK;
+    }
+
+    std::size_t GetRequestCount() { return m_requests; }
+    std::uint64_t GetBytesRead() { return m_bytesRead; }
+
+protected:
+    FileRangeReader(const std::string& fileName) : m_file(fileName, std::ios::binary) {}
+
+    std::ifstream m_file;
+    std::size_t   m_requests = 0;
+    std::uint64_t m_bytesRead = 0;
+    ULONG         m_ref = 1;
+};
+
+void StartTestRangeReader(void*)
+{
+    std::cout << "Starting test: TestRangeReader" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    std::map<std::string, Test<std::string>> rangeReaderTests =
+    {
+        { "RangeReader.Package", Test<std::string>("Validates a package read through a range reader needs few requests to open and has the same payload",
+            [](std::string* packageName)
+            {
+                auto blockSize = GetInput<UINT32>();
+                auto maxCachedBlocks = GetInput<UINT32>();
+                auto maxOpenRequests = GetInput<std::size_t>();
+
+                ComPtr<IAppxFactory> factory;
+                ComPtr<IStream> inputStream;
+                ComPtr<IAppxPackageReader> packageReader;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName->c_str()), true, &inputStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+                auto expected = ReadPayloadFiles(packageReader.Get());
+
+                ComPtr<FileRangeReader> rangeReader;
+                FileRangeReader::Make(*packageName, &rangeReader);
+                ComPtr<IStream> rangeStream;
+                ComPtr<IAppxPackageReader> rangePackageReader;
+                VERIFY_SUCCEEDED(CreateStreamOnRangeReader(rangeReader.Get(), blockSize, maxCachedBlocks, &rangeStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(rangeStream.Get(), &rangePackageReader));
+                std::cout << "Requests to open the package: " << rangeReader->GetRequestCount() << std::endl;
+                VERIFY_IS_TRUE(rangeReader->GetRequestCount() <= maxOpenRequests);
+
+                auto actual = ReadPayloadFiles(rangePackageReader.Get());
+                VERIFY_IS_FALSE(expected.empty());
+                VERIFY_IS_TRUE(expected == actual);
+            }
+        )},
+    };
+    ParseAndRun(rangeReaderTests, "Finish.TestRangeReader", &packageName);
+    return;
+}
+
+void StartTestBlockCache(void*)
+{
+    std::cout << "Starting test: TestBlockCache" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    std::map<std::string, Test<std::string>> blockCacheTests =
+    {
+        { "Package.BlockCache.Reread", Test<std::string>("Validates payload files read again through the block cache of the factory are the same",
+            [](std::string* packageName)
+            {
+                auto maxBytes = GetInput<UINT64>();
+                ComPtr<IMsixBlockCache> blockCache;
+                VERIFY_SUCCEEDED(CreateBlockCache(maxBytes, &blockCache));
+
+                // The first reader is created before the factory has a block cache, the other two share it.
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                std::vector<std::map<std::string, std::vector<std::uint8_t>>> payloads(3);
+                for (std::size_t i = 0; i < payloads.size(); i++)
+                {
+                    if (i == 1)
+                    {
+                        ComPtr<IMsixFactoryOverrides> factoryOverrides;
+                        VERIFY_SUCCEEDED(factory->QueryInterface(UuidOfImpl<IMsixFactoryOverrides>::iid, reinterpret_cast<void**>(&factoryOverrides)));
+                        VERIFY_SUCCEEDED(factoryOverrides->SpecifyExtension(MSIX_FACTORY_EXTENSION_BLOCK_CACHE, blockCache.Get()));
+                    }
+                    ComPtr<IStream> inputStream;
+                    ComPtr<IAppxPackageReader> packageReader;
+                    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName->c_str()), true, &inputStream));
+                    VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+
+                    ComPtr<IAppxFilesEnumerator> files;
+                    VERIFY_SUCCEEDED(packageReader->GetPayloadFiles(&files));
+                    BOOL hasCurrent = FALSE;
+                    VERIFY_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+                    while (hasCurrent)
+                    {
+                        ComPtr<IAppxFile> file;
+                        VERIFY_SUCCEEDED(files->GetCurrent(&file));
+                        Text<wchar_t> fileName;
+                        VERIFY_SUCCEEDED(file->GetName(&fileName));
+                        ComPtr<IStream> stream;
+                        VERIFY_SUCCEEDED(file->GetStream(&stream));
+                        payloads[i][fileName.ToString()] = ReadStream(stream.Get());
+
+                        // Reading the file again from the start gets its blocks from the cache.
+                        LARGE_INTEGER start = { 0 };
+                        VERIFY_SUCCEEDED(stream->Seek(start, STREAM_SEEK_SET, nullptr));
+                        VERIFY_IS_TRUE(payloads[i][fileName.ToString()] == ReadStream(stream.Get()));
+
+                        VERIFY_SUCCEEDED(files->MoveNext(&hasCurrent));
+                    }
+                }
+                VERIFY_IS_FALSE(payloads[0].empty());
+                VERIFY_IS_TRUE(payloads[0] == payloads[1]);
+                VERIFY_IS_TRUE(payloads[0] == payloads[2]);
+            }
+        )},
+    };
+    ParseAndRun(blockCacheTests, "Finish.TestBlockCache", &packageName);
+    return;
+}
+
+// What VerifyPackage reported for a payload file
+struct VerifiedFile
+{
+    std::string name;
+    HRESULT result;
+    UINT64 failedBlock;
+};
+
+void STDMETHODCALLTYPE AddVerifiedFile(void* context, LPCSTR utf8FileName, HRESULT result, UINT64 failedBlock)
+{
+    static_cast<std::vector<VerifiedFile>*>(context)->push_back({ utf8FileName, result, failedBlock });
+}
+
+void StartTestVerifyPackage(void*)
+{
+    std::cout << "Starting test: TestVerifyPackage" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    std::map<std::string, Test<std::string>> verifyPackageTests =
+    {
+        { "Package.Verify.Payload", Test<std::string>("Validates every payload file of a package is reported as good",
+            [](std::string* packageName)
+            {
+                std::vector<VerifiedFile> verified;
+                VERIFY_SUCCEEDED(VerifyPackage(MSIX_VALIDATION_OPTION_SKIPSIGNATURE, const_cast<char*>(packageName->c_str()), AddVerifiedFile, &verified));
+
+                ComPtr<IAppxFactory> factory;
+                ComPtr<IStream> inputStream;
+                ComPtr<IAppxPackageReader> packageReader;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName->c_str()), true, &inputStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+                auto expected = ReadPayloadFiles(packageReader.Get());
+                VERIFY_IS_FALSE(expected.empty());
+                VERIFY_ARE_EQUAL(expected.size(), verified.size());
+                for (const auto& file : verified)
+                {
+                    VERIFY_SUCCEEDED(file.result);
+                    auto name = file.name;
+                    std::replace(name.begin(), name.end(), '/', '\\');
+                    VERIFY_IS_TRUE(expected.find(name) != expected.end());
+                }
+            }
+        )},
+        { "Package.Verify.BadBlock", Test<std::string>("Validates a corrupted block is reported with its file and stops the verification",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                }
+                auto fileName = GetInput<std::string>();
+                auto badBlock = GetInput<UINT64>();
+
+                // Find where the compressed data of the block starts from the blockmap
+                ComPtr<IAppxFactory> factory;
+                ComPtr<IStream> inputStream;
+                ComPtr<IAppxPackageReader> packageReader;
+                ComPtr<IAppxBlockMapReader> blockMapReader;
+                ComPtr<IAppxBlockMapReaderUtf8> blockMapReaderUtf8;
+                ComPtr<IAppxBlockMapFile> blockMapFile;
+                ComPtr<IAppxBlockMapBlocksEnumerator> blocks;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName->c_str()), true, &inputStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+                VERIFY_SUCCEEDED(packageReader->GetBlockMap(&blockMapReader));
+                VERIFY_SUCCEEDED(blockMapReader->QueryInterface(UuidOfImpl<IAppxBlockMapReaderUtf8>::iid, reinterpret_cast<void**>(&blockMapReaderUtf8)));
+                VERIFY_SUCCEEDED(blockMapReaderUtf8->GetFile(fileName.c_str(), &blockMapFile));
+                UINT32 localFileHeaderSize = 0;
+                VERIFY_SUCCEEDED(blockMapFile->GetLocalFileHeaderSize(&localFileHeaderSize));
+                VERIFY_SUCCEEDED(blockMapFile->GetBlocks(&blocks));
+                std::uint64_t blockOffset = 0;
+                UINT32 blockSize = 0;
+                for (UINT64 i = 0; i <= badBlock; i++)
+                {
+                    BOOL hasCurrent = FALSE;
+                    VERIFY_SUCCEEDED(blocks->GetHasCurrent(&hasCurrent));
+                    VERIFY_IS_TRUE(hasCurrent);
+                    ComPtr<IAppxBlockMapBlock> block;
+                    VERIFY_SUCCEEDED(blocks->GetCurrent(&block));
+                    blockOffset += blockSize;
+                    VERIFY_SUCCEEDED(block->GetCompressedSize(&blockSize));
+                    BOOL hasNext = FALSE;
+                    VERIFY_SUCCEEDED(blocks->MoveNext(&hasNext));
+                }
+
+                // Flip a byte in the middle of the block, its local file header starts 30 bytes before the file name
+                std::ifstream input(*packageName, std::ios::binary);
+                std::vector<char> package((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+                const char localFileHeaderSignature[] = { 'P', 'K', 3, 4 };
+                auto header = package.begin();
+                do
+                {
+                    header = std::search(header + 1, package.end(), fileName.begin(), fileName.end());
+                    VERIFY_IS_TRUE(header != package.end());
+                } while (!std::equal(header - 30, header - 26, localFileHeaderSignature));
+                auto position = static_cast<std::size_t>(header - 30 - package.begin()) + localFileHeaderSize + blockOffset + blockSize / 2;
+                package[position] = ~package[position];
+                {
+                    std::ofstream output(outputName, std::ios::binary | std::ios::trunc);
+                    output.write(package.data(), package.size());
+                }
+
+                std::vector<VerifiedFile> verified;
+                auto hr = VerifyPackage(MSIX_VALIDATION_OPTION_SKIPSIGNATURE, const_cast<char*>(outputName.c_str()), AddVerifiedFile, &verified);
+                VERIFY_IS_TRUE(FAILED(hr));
+                VERIFY_IS_FALSE(verified.empty());
+                for (std::size_t i = 0; i < verified.size() - 1; i++)
+                {
+                    VERIFY_SUCCEEDED(verified[i].result);
+                }
+                VERIFY_ARE_EQUAL(fileName, verified.back().name);
+                VERIFY_ARE_EQUAL(hr, verified.back().result);
+                VERIFY_ARE_EQUAL(badBlock, verified.back().failedBlock);
+            }
+        )},
+        { "Package.Verify.BadStoredBlock", Test<std::string>("Validates a corrupted block of a stored file, whose blocks are checked several at a time, is reported as the block that doesn't match",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                }
+                auto badBlock = GetInput<UINT64>();
+                const std::uint64_t blockSize = 65536;
+                const std::string fileName = "large.bin";
+
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                WriteLargePayloadPackage(factory.Get(), *packageName, outputName, 40 * blockSize + 100);
+
+                // Flip a byte in the middle of the block, the stored data starts after the local file header that
+                // starts 30 bytes before the file name.
+                std::vector<char> package;
+                {
+                    std::ifstream input(outputName, std::ios::binary);
+                    package.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+                }
+                const char localFileHeaderSignature[] = { 'P', 'K', 3, 4 };
+                auto header = package.begin();
+                do
+                {
+                    header = std::search(header + 1, package.end(), fileName.begin(), fileName.end());
+                    VERIFY_IS_TRUE(header != package.end());
+                } while (!std::equal(header - 30, header - 26, localFileHeaderSignature));
+                auto extraFieldSize = static_cast<std::uint8_t>(*(header - 2)) | (static_cast<std::uint8_t>(*(header - 1)) << 8);
+                auto position = static_cast<std::size_t>(header - package.begin()) + fileName.size() + extraFieldSize + badBlock * blockSize + blockSize / 2;
+                package[position] = ~package[position];
+                {
+                    std::ofstream output(outputName, std::ios::binary | std::ios::trunc);
+                    output.write(package.data(), package.size());
+                }
+
+                std::vector<VerifiedFile> verified;
+                auto hr = VerifyPackage(MSIX_VALIDATION_OPTION_SKIPSIGNATURE, const_cast<char*>(outputName.c_str()), AddVerifiedFile, &verified);
+                VERIFY_ARE_EQUAL(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), hr);
+                VERIFY_IS_FALSE(verified.empty());
+                VERIFY_ARE_EQUAL(fileName, verified.back().name);
+                VERIFY_ARE_EQUAL(hr, verified.back().result);
+                VERIFY_ARE_EQUAL(badBlock, verified.back().failedBlock);
+            }
+        )},
+        { "Package.Verify.Signature", Test<std::string>("Validates the zip file records and central directory of a signed package match its signature",
+            [](std::string* packageName)
+            {
+                std::vector<VerifiedFile> verified;
+                VERIFY_SUCCEEDED(VerifyPackage(MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN, const_cast<char*>(packageName->c_str()), AddVerifiedFile, &verified));
+                VERIFY_IS_FALSE(verified.empty());
+            }
+        )},
+        { "Package.Verify.TamperedArchive", Test<std::string>("Validates a change to a zip file record or to the central directory fails the signature",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                }
+
+                // Change the last mod file time of the first local file header, and of the central directory entry
+                // before the signature's, which is the last one. Only the signature covers them.
+                std::ifstream input(*packageName, std::ios::binary);
+                std::vector<char> package((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+                const char centralFileHeaderSignature[] = { 'P', 'K', 1, 2 };
+                auto signatureEntry = std::find_end(package.begin(), package.end(),
+                    std::begin(centralFileHeaderSignature), std::end(centralFileHeaderSignature));
+                auto entry = std::find_end(package.begin(), signatureEntry,
+                    std::begin(centralFileHeaderSignature), std::end(centralFileHeaderSignature));
+                VERIFY_IS_TRUE(entry != signatureEntry);
+                std::vector<std::size_t> positions = { 10, static_cast<std::size_t>(entry - package.begin()) + 12 };
+                for (auto position : positions)
+                {
+                    auto tampered = package;
+                    tampered[position] = ~tampered[position];
+                    {
+                        std::ofstream output(outputName, std::ios::binary | std::ios::trunc);
+                        output.write(tampered.data(), tampered.size());
+                    }
+
+                    std::vector<VerifiedFile> verified;
+                    auto hr = VerifyPackage(MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN, const_cast<char*>(outputName.c_str()), AddVerifiedFile, &verified);
+                    VERIFY_ARE_EQUAL(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), hr);
+                    VERIFY_IS_TRUE(verified.empty());
+                }
+            }
+        )},
+        { "Package.Verify.TamperedArchiveOpenAndUnpack", Test<std::string>("Validates a changed central directory fails opening the package and a changed zip file record fails unpacking it",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                auto directory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                    directory = g_packageRootPath + directory;
+                }
+                FileRemover outputRemover(outputName);
+                auto validation = MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN;
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, validation, &factory));
+
+                // Unpacking through a stream that isn't mapped computes the digest of the file records from the
+                // reads that unpack the files, so it reads little more than an unpack that skips the signature.
+                // The range reader keeps a few small blocks, reading the package again would show.
+                std::ifstream input(*packageName, std::ios::binary);
+                std::vector<char> package((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+                auto UnpackFromRangeReader = [&](const std::string& fileName, MSIX_VALIDATION_OPTION option, std::uint64_t* bytesRead)
+                {
+                    ComPtr<FileRangeReader> rangeReader;
+                    FileRangeReader::Make(fileName, &rangeReader);
+                    ComPtr<IStream> rangeStream;
+                    VERIFY_SUCCEEDED(CreateStreamOnRangeReader(rangeReader.Get(), 4096, 4, &rangeStream));
+                    auto hr = UnpackPackageFromStream(MSIX_PACKUNPACK_OPTION_NONE, option, rangeStream.Get(),
+                        const_cast<char*>(directory.c_str()));
+                    if (bytesRead) { *bytesRead = rangeReader->GetBytesRead(); }
+                    return hr;
+                };
+                std::uint64_t unsignedBytesRead = 0;
+                std::uint64_t bytesRead = 0;
+                VERIFY_SUCCEEDED(UnpackFromRangeReader(*packageName, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &unsignedBytesRead));
+                VERIFY_SUCCEEDED(UnpackFromRangeReader(*packageName, validation, &bytesRead));
+                std::cout << "Bytes read to unpack a package of " << package.size() << " bytes: " << unsignedBytesRead
+                          << " skipping the signature, " << bytesRead << " checking it" << std::endl;
+                VERIFY_IS_TRUE(bytesRead < unsignedBytesRead + package.size() / 2);
+
+                // The first local file header's last mod file time is only covered by the signature.
+                auto tampered = package;
+                tampered[10] = ~tampered[10];
+                {
+                    std::ofstream output(outputName, std::ios::binary | std::ios::trunc);
+                    output.write(tampered.data(), tampered.size());
+                }
+                ComPtr<IStream> inputStream;
+                ComPtr<IAppxPackageReader> packageReader;
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), true, &inputStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+                VERIFY_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), UnpackFromRangeReader(outputName, validation, nullptr));
+                VERIFY_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), UnpackPackage(MSIX_PACKUNPACK_OPTION_NONE, validation,
+                    const_cast<char*>(outputName.c_str()), const_cast<char*>(directory.c_str())));
+
+                // The central directory entry in front of the signature's, which is the last one.
+                const char centralFileHeaderSignature[] = { 'P', 'K', 1, 2 };
+                auto signatureEntry = std::find_end(package.begin(), package.end(),
+                    std::begin(centralFileHeaderSignature), std::end(centralFileHeaderSignature));
+                auto entry = std::find_end(package.begin(), signatureEntry,
+                    std::begin(centralFileHeaderSignature), std::end(centralFileHeaderSignature));
+                VERIFY_IS_TRUE(entry != signatureEntry);
+                packageReader = nullptr;
+                inputStream = nullptr;
+                tampered = package;
+                auto position = static_cast<std::size_t>(entry - package.begin()) + 12;
+                tampered[position] = ~tampered[position];
+                {
+                    std::ofstream output(outputName, std::ios::binary | std::ios::trunc);
+                    output.write(tampered.data(), tampered.size());
+                }
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), true, &inputStream));
+                VERIFY_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), factory->CreatePackageReader(inputStream.Get(), &packageReader));
+            }
+        )},
+        { "Package.Verify.TamperedFootprintFile", Test<std::string>("Validates a footprint file bigger than a block that doesn't match its digest isn't unpacked",
+            [](std::string* packageName)
+            {   // The code integrity catalog of the package has a byte changed past its first 64KB, everything else
+                // matches the signature.
+                auto tamperedName = GetInput<std::string>();
+                auto directory = GetInput<std::string>();
+                auto forwardOnlyDirectory = GetInput<std::string>();
+                auto footprintFile = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    tamperedName = g_packageRootPath + tamperedName;
+                    directory = g_packageRootPath + directory;
+                    forwardOnlyDirectory = g_packageRootPath + forwardOnlyDirectory;
+                }
+                std::remove((directory + "/" + footprintFile).c_str());
+                auto validation = MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN;
+                auto VerifyNotUnpacked = [&](const std::string& unpackDirectory)
+                {
+                    std::ifstream unpacked(unpackDirectory + "/" + footprintFile, std::ios::binary);
+                    VERIFY_IS_FALSE(unpacked.is_open());
+                };
+
+                // The range reader isn't mapped, so the catalog is read in pieces.
+                ComPtr<FileRangeReader> rangeReader;
+                FileRangeReader::Make(tamperedName, &rangeReader);
+                ComPtr<IStream> rangeStream;
+                VERIFY_SUCCEEDED(CreateStreamOnRangeReader(rangeReader.Get(), 4096, 4, &rangeStream));
+                VERIFY_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), UnpackPackageFromStream(MSIX_PACKUNPACK_OPTION_NONE,
+                    validation, rangeStream.Get(), const_cast<char*>(directory.c_str())));
+                VerifyNotUnpacked(directory);
+
+                VERIFY_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), UnpackPackage(MSIX_PACKUNPACK_OPTION_NONE, validation,
+                    const_cast<char*>(tamperedName.c_str()), const_cast<char*>(directory.c_str())));
+                VerifyNotUnpacked(directory);
+
+                // The forward only unpack doesn't replace files, it gets a directory of its own.
+                ComPtr<IStream> inputStream;
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(tamperedName.c_str()), true, &inputStream));
+                LARGE_INTEGER li = {0};
+                ULARGE_INTEGER size = {0};
+                VERIFY_SUCCEEDED(inputStream->Seek(li, STREAM_SEEK_END, &size));
+                VERIFY_SUCCEEDED(inputStream->Seek(li, STREAM_SEEK_SET, nullptr));
+                ComPtr<IStream> stream;
+                ForwardOnlyStream::Make(inputStream.Get(), size.QuadPart, &stream);
+                VERIFY_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), UnpackPackageFromForwardOnlyStream(MSIX_PACKUNPACK_OPTION_NONE,
+                    validation, stream.Get(), const_cast<char*>(forwardOnlyDirectory.c_str())));
+                VerifyNotUnpacked(forwardOnlyDirectory);
+            }
+        )},
+    };
+    ParseAndRun(verifyPackageTests, "Finish.TestVerifyPackage", &packageName);
+    return;
+}
+
+void StartTestUnflushedBlocks(void*)
+{
+    std::cout << "Starting test: TestUnflushedBlocks" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    // The payload file of the package is one deflate stream with a sync flush at the end of each block instead of a
+    // full flush, so the blocks line up with the blockmap but all but the first need the ones before them to inflate.
+    std::map<std::string, Test<std::string>> unflushedBlocksTests =
+    {
+        { "Package.UnflushedBlocks.Unpack", Test<std::string>("Validates a package whose blocks don't inflate on their own unpacks",
+            [](std::string* packageName)
+            {
+                auto directory = GetInput<std::string>();
+                auto fileName = GetInput<std::string>();
+                auto fileSize = GetInput<std::uint64_t>();
+                if (!g_packageRootPath.empty())
+                {
+                    directory = g_packageRootPath + directory;
+                }
+                VERIFY_SUCCEEDED(UnpackPackage(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                    const_cast<char*>(packageName->c_str()), const_cast<char*>(directory.c_str())));
+                std::ifstream unpacked(directory + "/" + fileName, std::ios::binary | std::ios::ate);
+                VERIFY_IS_TRUE(unpacked.is_open());
+                VERIFY_ARE_EQUAL(fileSize, static_cast<std::uint64_t>(unpacked.tellg()));
+            }
+        )},
+        { "Package.UnflushedBlocks.Seek", Test<std::string>("Validates seeking back to each block of a file whose blocks don't inflate on their own",
+            [](std::string* packageName)
+            {
+                auto fileName = utf8_to_utf16(GetInput<std::string>());
+                ComPtr<IAppxFactory> factory;
+                ComPtr<IStream> inputStream;
+                ComPtr<IAppxPackageReader> packageReader;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName->c_str()), true, &inputStream));
+                VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+                ComPtr<IAppxFile> file;
+                VERIFY_SUCCEEDED(packageReader->GetPayloadFile(fileName.c_str(), &file));
+                ComPtr<IStream> stream;
+                VERIFY_SUCCEEDED(file->GetStream(&stream));
+                auto content = ReadStream(stream.Get());
+                VERIFY_IS_TRUE(content.size() > 16 * 65536);
+
+                // From the last block to the first, each read starting a little into the block.
+                std::vector<std::uint8_t> buffer(4096);
+                for (std::uint64_t block = content.size() / 65536 + 1; block-- > 0;)
+                {
+                    std::uint64_t offset = std::min(block * 65536 + 100, static_cast<std::uint64_t>(content.size()));
+                    LARGE_INTEGER li = {0};
+                    li.QuadPart = static_cast<LONGLONG>(offset);
+                    VERIFY_SUCCEEDED(stream->Seek(li, STREAM_SEEK_SET, nullptr));
+                    ULONG bytesRead = 0;
+                    VERIFY_SUCCEEDED(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+                    VERIFY_ARE_EQUAL(std::min(static_cast<std::uint64_t>(buffer.size()), content.size() - offset), static_cast<std::uint64_t>(bytesRead));
+                    VERIFY_IS_TRUE(std::equal(buffer.begin(), buffer.begin() + bytesRead, content.begin() + static_cast<std::size_t>(offset)));
+                }
+            }
+        )},
+        { "Package.UnflushedBlocks.Verify", Test<std::string>("Validates every block of a file whose blocks don't inflate on their own is verified",
+            [](std::string* packageName)
+            {
+                std::vector<VerifiedFile> verified;
+                VERIFY_SUCCEEDED(VerifyPackage(MSIX_VALIDATION_OPTION_SKIPSIGNATURE, const_cast<char*>(packageName->c_str()), AddVerifiedFile, &verified));
+                VERIFY_ARE_EQUAL(static_cast<std::size_t>(1), verified.size());
+                VERIFY_SUCCEEDED(verified.front().result);
+            }
+        )},
+    };
+    ParseAndRun(unflushedBlocksTests, "Finish.TestUnflushedBlocks", &packageName);
+    return;
+}
+
+#ifdef __linux__
+// Returns the size of the address space of the process in bytes
+std::uint64_t GetAddressSpaceSize()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 7, "VmSize:") == 0)
+        {
+            return std::stoull(line.substr(7)) * 1024;
+        }
+    }
+    return 0;
+}
+#endif
+
+void StartTestLargePayload(void*)
+{
+    std::cout << "Starting test: TestLargePayload" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    std::map<std::string, Test<std::string>> largePayloadTests =
+    {
+        { "Package.LargePayload.ReadBackwards", Test<std::string>("Validates a large stored payload file read backwards in small steps, going through each block a fixed number of times",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                }
+                auto fileSize = GetInput<std::uint64_t>() * 1024 * 1024;
+                auto readSize = GetInput<ULONG>();
+                // The input size is small so the test runs anywhere. Set APITEST_LARGE_PAYLOAD_MB to run it with a file
+                // of several GB, which needs that much free disk space.
+                const char* largeSize = std::getenv("APITEST_LARGE_PAYLOAD_MB");
+                if (largeSize != nullptr)
+                {
+                    fileSize = std::stoull(largeSize) * 1024 * 1024;
+                }
+                FileRemover outputRemover(outputName);
+
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                WriteLargePayloadPackage(factory.Get(), *packageName, outputName, fileSize);
+                ComPtr<IMsixWorkCounter> workCounter;
+                WorkCounter::Make(&workCounter);
+                ComPtr<IMsixFactoryOverrides> factoryOverrides;
+                VERIFY_SUCCEEDED(factory->QueryInterface(UuidOfImpl<IMsixFactoryOverrides>::iid, reinterpret_cast<void**>(&factoryOverrides)));
+                VERIFY_SUCCEEDED(factoryOverrides->SpecifyExtension(MSIX_FACTORY_EXTENSION_WORK_COUNTER, workCounter.Get()));
+
+                {
+                    ComPtr<IStream> writtenStream;
+                    ComPtr<IAppxPackageReader> writtenReader;
+                    ComPtr<IAppxPackageReaderUtf8> writtenReaderUtf8;
+                    ComPtr<IAppxFile> file;
+                    ComPtr<IStream> stream;
+                    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), true, &writtenStream));
+                    VERIFY_SUCCEEDED(factory->CreatePackageReader(writtenStream.Get(), &writtenReader));
+                    VERIFY_SUCCEEDED(writtenReader->QueryInterface(UuidOfImpl<IAppxPackageReaderUtf8>::iid, reinterpret_cast<void**>(&writtenReaderUtf8)));
+                    VERIFY_SUCCEEDED(writtenReaderUtf8->GetPayloadFile("large.bin", &file));
+                    VERIFY_SUCCEEDED(file->GetStream(&stream));
+
+                    // Checked once at the end, there are too many reads to log each of them.
+                    std::vector<std::uint8_t> buffer(readSize);
+                    std::uint64_t position = fileSize;
+                    std::uint64_t reads = 0;
+                    HRESULT hr = S_OK;
+                    bool same = true;
+                    while (position > 0 && SUCCEEDED(hr) && same)
+                    {
+                        ULONG toRead = static_cast<ULONG>(std::min(position, static_cast<std::uint64_t>(readSize)));
+                        position -= toRead;
+                        reads++;
+                        LARGE_INTEGER li = { 0 };
+                        li.QuadPart = static_cast<LONGLONG>(position);
+                        ULONG read = 0;
+                        hr = stream->Seek(li, STREAM_SEEK_SET, nullptr);
+                        if (SUCCEEDED(hr)) { hr = stream->Read(buffer.data(), toRead, &read); }
+                        same = (read == toRead);
+                        for (ULONG i = 0; i < read && same; i++)
+                        {
+                            same = (buffer[i] == PatternStream::GetByte(position + i));
+                        }
+                    }
+                    VERIFY_SUCCEEDED(hr);
+                    VERIFY_IS_TRUE(same);
+
+                    // Each read goes through the blocks it covers and no others: the block it starts in, and the next
+                    // one when it crosses a block boundary, which no more reads than there are blocks do. Finding the
+                    // block of a read by walking the blocks before it would make this grow with the square of the size.
+                    const std::uint64_t blockSize = 64 * 1024;
+                    auto blocks = (fileSize + blockSize - 1) / blockSize;
+                    auto blocksVisited = WorkCounter::From(workCounter.Get())->Get(MSIX_WORK_COUNTER_PAYLOAD_BLOCKS);
+                    VERIFY_IS_TRUE(blocksVisited >= reads);
+                    VERIFY_IS_TRUE(blocksVisited <= reads + blocks);
+                }
+            }
+        )},
+        { "Package.LargePayload.UnpackTampered", Test<std::string>("Validates that unpacking a stored file checks what was copied",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                auto directory = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                    directory = g_packageRootPath + directory;
+                }
+                auto fileSize = GetInput<std::uint64_t>() * 1024 * 1024;
+                FileRemover outputRemover(outputName);
+
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                WriteLargePayloadPackage(factory.Get(), *packageName, outputName, fileSize);
+
+                std::string unpacked = directory + "/unpacked";
+                VERIFY_SUCCEEDED(UnpackPackage(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                    const_cast<char*>(outputName.c_str()), const_cast<char*>(unpacked.c_str())));
+                VERIFY_IS_TRUE(UnpackedFileMatchesPattern(unpacked + "/large.bin", fileSize));
+
+                // Change one byte in the middle of the stored data. The pattern holds the offset of every 8 bytes, so
+                // the bytes around that offset are only found once in the package.
+                std::uint64_t offset = fileSize / 2;
+                std::string content;
+                {
+                    std::ifstream input(outputName, std::ios::binary);
+                    content.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+                }
+                std::string expected;
+                for (std::uint64_t i = 0; i < 16; i++)
+                {
+                    expected.push_back(static_cast<char>(PatternStream::GetByte(offset + i)));
+                }
+                auto found = content.find(expected);
+                VERIFY_IS_TRUE(found != std::string::npos);
+                content[found] = static_cast<char>(~content[found]);
+                {
+                    std::ofstream output(outputName, std::ios::binary | std::ios::trunc);
+                    output.write(content.data(), content.size());
+                }
+
+                // The unpack fails and nothing that didn't match the blockmap is left behind.
+                std::string tampered = directory + "/tampered";
+                VERIFY_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid), UnpackPackage(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                    const_cast<char*>(outputName.c_str()), const_cast<char*>(tampered.c_str())));
+                std::ifstream largeFile(tampered + "/large.bin", std::ios::binary | std::ios::ate);
+                VERIFY_IS_TRUE(!largeFile.is_open() || largeFile.tellg() == 0);
+            }
+        )},
+        #ifdef __linux__
+        { "Package.LargePayload.OpenWithoutMapping", Test<std::string>("Validates a package that can't be memory mapped is read with stdio",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                }
+                auto fileSize = GetInput<std::uint64_t>() * 1024 * 1024;
+                FileRemover outputRemover(outputName);
+
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                WriteLargePayloadPackage(factory.Get(), *packageName, outputName, fileSize);
+
+                // Limit the address space so the package doesn't fit in it and mmap fails. The limit is restored before
+                // anything is verified.
+                struct rlimit limit;
+                VERIFY_ARE_EQUAL(0, getrlimit(RLIMIT_AS, &limit));
+                struct rlimit reduced = limit;
+                reduced.rlim_cur = static_cast<rlim_t>(GetAddressSpaceSize() + fileSize / 2);
+                VERIFY_ARE_EQUAL(0, setrlimit(RLIMIT_AS, &reduced));
+                HRESULT hr = S_OK;
+                bool same = true;
+                {
+                    ComPtr<IStream> packageStream;
+                    ComPtr<IAppxPackageReader> packageReader;
+                    ComPtr<IAppxPackageReaderUtf8> packageReaderUtf8;
+                    ComPtr<IAppxFile> file;
+                    ComPtr<IStream> stream;
+                    hr = CreateStreamOnFile(const_cast<char*>(outputName.c_str()), true, &packageStream);
+                    if (SUCCEEDED(hr)) { hr = factory->CreatePackageReader(packageStream.Get(), &packageReader); }
+                    if (SUCCEEDED(hr)) { hr = packageReader->QueryInterface(UuidOfImpl<IAppxPackageReaderUtf8>::iid, reinterpret_cast<void**>(&packageReaderUtf8)); }
+                    if (SUCCEEDED(hr)) { hr = packageReaderUtf8->GetPayloadFile("large.bin", &file); }
+                    if (SUCCEEDED(hr)) { hr = file->GetStream(&stream); }
+
+                    std::vector<std::uint8_t> buffer(64 * 1024);
+                    std::uint64_t position = 0;
+                    while (SUCCEEDED(hr) && same && position < fileSize)
+                    {
+                        ULONG read = 0;
+                        hr = stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read);
+                        same = (read > 0);
+                        for (ULONG i = 0; i < read && same; i++, position++)
+                        {
+                            same = (buffer[i] == PatternStream::GetByte(position));
+                        }
+                    }
+                    same = same && (position == fileSize);
+                }
+                setrlimit(RLIMIT_AS, &limit);
+                VERIFY_SUCCEEDED(hr);
+                VERIFY_IS_TRUE(same);
+            }
+        )},
+        #endif
+    };
+    ParseAndRun(largePayloadTests, "Finish.TestLargePayload", &packageName);
+    return;
+}
+
+// Writes a package with the manifest of the input package and count small stored payload files
+void WritePackageWithEntries(IAppxFactory* factory, const std::string& packageName, const std::string& outputName, std::uint32_t count)
+{
+    ComPtr<IStream> inputStream;
+    ComPtr<IAppxPackageReader> packageReader;
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packageName.c_str()), true, &inputStream));
+    VERIFY_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+
+    ComPtr<IStream> outputStream;
+    ComPtr<IAppxPackageWriter> packageWriter;
+    APPX_PACKAGE_SETTINGS settings = { FALSE, nullptr };
+    VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), false, &outputStream));
+    VERIFY_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), &settings, &packageWriter));
+
+    // Checked once at the end, there are too many files to log each of them.
+    HRESULT hr = S_OK;
+    for (std::uint32_t i = 0; i < count && SUCCEEDED(hr); i++)
+    {
+        ComPtr<IStream> patternStream;
+        PatternStream::Make(64, &patternStream);
+        auto fileName = L"Generated\\file" + std::to_wstring(i) + L".bin";
+        hr = packageWriter->AddPayloadFile(fileName.c_str(), L"application/octet-stream", APPX_COMPRESSION_OPTION_NONE, patternStream.Get());
+    }
+    VERIFY_SUCCEEDED(hr);
+
+    ComPtr<IAppxFile> manifestFile;
+    ComPtr<IStream> manifestStream;
+    VERIFY_SUCCEEDED(packageReader->GetFootprintFile(APPX_FOOTPRINT_FILE_TYPE_MANIFEST, &manifestFile));
+    VERIFY_SUCCEEDED(manifestFile->GetStream(&manifestStream));
+    VERIFY_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+}
+
+void StartTestManyEntries(void*)
+{
+    std::cout << "Starting test: TestManyEntries" << std::endl;
+    auto packageName = GetInput<std::string>();
+    if (!g_packageRootPath.empty())
+    {
+        packageName = g_packageRootPath + packageName;
+    }
+
+    std::map<std::string, Test<std::string>> manyEntriesTests =
+    {
+        { "Package.ManyEntries.Open", Test<std::string>("Validates packages with many payload files open, doing work that grows linearly with the number of files",
+            [](std::string* packageName)
+            {
+                auto outputName = GetInput<std::string>();
+                if (!g_packageRootPath.empty())
+                {
+                    outputName = g_packageRootPath + outputName;
+                }
+                auto smallCount = GetInput<std::uint32_t>();
+                auto largeCount = GetInput<std::uint32_t>();
+                FileRemover outputRemover(outputName);
+
+                ComPtr<IAppxFactory> factory;
+                VERIFY_SUCCEEDED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                ComPtr<IMsixWorkCounter> workCounter;
+                WorkCounter::Make(&workCounter);
+                ComPtr<IMsixFactoryOverrides> factoryOverrides;
+                VERIFY_SUCCEEDED(factory->QueryInterface(UuidOfImpl<IMsixFactoryOverrides>::iid, reinterpret_cast<void**>(&factoryOverrides)));
+                VERIFY_SUCCEEDED(factoryOverrides->SpecifyExtension(MSIX_FACTORY_EXTENSION_WORK_COUNTER, workCounter.Get()));
+
+                std::vector<std::uint64_t> entriesVisited;
+                std::vector<std::uint64_t> filesVisited;
+                for (auto count : { smallCount, largeCount })
+                {
+                    WritePackageWithEntries(factory.Get(), *packageName, outputName, count);
+
+                    {
+                        WorkCounter::From(workCounter.Get())->Reset();
+                        ComPtr<IStream> writtenStream;
+                        ComPtr<IAppxPackageReader> writtenReader;
+                        ComPtr<IAppxFilesEnumerator> files;
+                        VERIFY_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), true, &writtenStream));
+                        VERIFY_SUCCEEDED(factory->CreatePackageReader(writtenStream.Get(), &writtenReader));
+                        VERIFY_SUCCEEDED(writtenReader->GetPayloadFiles(&files));
+                        std::uint32_t found = 0;
+                        BOOL hasCurrent = FALSE;
+                        HRESULT hr = files->GetHasCurrent(&hasCurrent);
+                        while (SUCCEEDED(hr) && hasCurrent)
+                        {
+                            found++;
+                            hr = files->MoveNext(&hasCurrent);
+                        }
+                        VERIFY_SUCCEEDED(hr);
+                        VERIFY_ARE_EQUAL(count, found);
+                    }
+                    entriesVisited.push_back(WorkCounter::From(workCounter.Get())->Get(MSIX_WORK_COUNTER_CENTRAL_DIRECTORY_ENTRIES));
+                    filesVisited.push_back(WorkCounter::From(workCounter.Get())->Get(MSIX_WORK_COUNTER_PACKAGE_FILES));
+                    VERIFY_IS_TRUE(entriesVisited.back() >= count);
+                    VERIFY_IS_TRUE(filesVisited.back() >= count);
+                }
+                // The footprint files are a fixed amount of work on top of the payload files, so opening the large package
+                // does no more work per file than opening the small one unless a step of the open is worse than linear.
+                VERIFY_IS_TRUE(entriesVisited[1] * smallCount <= entriesVisited[0] * largeCount);
+                VERIFY_IS_TRUE(filesVisited[1] * smallCount <= filesVisited[0] * largeCount);
+            }
+        )},
+    };
+    ParseAndRun(manyEntriesTests, "Finish.TestManyEntries", &packageName);
+    return;
+}
+
+#ifdef INFLATE_BLOCK_TESTS
+// Raw deflate data of "MSIX block " 20 times, ended by a full flush like a block in the middle of a file and by the
+// end of the deflate stream like the last block of a file.
+const std::vector<std::uint8_t> g_fullFlushBlock = { 0xf2, 0x0d, 0xf6, 0x8c, 0x50, 0x48, 0xca, 0xc9, 0x4f, 0xce, 0x56,
+    0xf0, 0x1d, 0x6e, 0x4c, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff };
+const std::vector<std::uint8_t> g_finalBlock = { 0xf3, 0x0d, 0xf6, 0x8c, 0x50, 0x48, 0xca, 0xc9, 0x4f, 0xce, 0x56,
+    0xf0, 0x1d, 0x6e, 0x4c, 0x00 };
+
+std::vector<std::uint8_t> GetInflatedBlock()
+{
+    std::string text;
+    for (int i = 0; i < 20; i++) { text += "MSIX block "; }
+    return std::vector<std::uint8_t>(text.begin(), text.end());
+}
+
+int InflateBlock(const std::vector<std::uint8_t>& source, std::vector<std::uint8_t>& destination)
+{
+    return static_cast<int>(MSIX::InflateBlock(source.data(), source.size(), destination.data(), destination.size()));
+}
+
+void StartTestInflateBlock(void*)
+{
+    std::cout << "Starting test: TestInflateBlock" << std::endl;
+
+    std::map<std::string, Test<void>> inflateBlockTests =
+    {
+        { "InflateBlock.FullFlush", Test<void>("Validates a block that ends with a full flush inflates and doesn't end the stream",
+            [](void*)
+            {
+                auto expected = GetInflatedBlock();
+                std::vector<std::uint8_t> inflated(expected.size());
+                VERIFY_ARE_EQUAL(static_cast<int>(MSIX::CompressionStatus::Ok), InflateBlock(g_fullFlushBlock, inflated));
+                VERIFY_IS_TRUE(inflated == expected);
+            }
+        )},
+        { "InflateBlock.Final", Test<void>("Validates a block that ends the deflate stream inflates and ends it",
+            [](void*)
+            {
+                auto expected = GetInflatedBlock();
+                std::vector<std::uint8_t> inflated(expected.size());
+                VERIFY_ARE_EQUAL(static_cast<int>(MSIX::CompressionStatus::End), InflateBlock(g_finalBlock, inflated));
+                VERIFY_IS_TRUE(inflated == expected);
+            }
+        )},
+        { "InflateBlock.TooLong", Test<void>("Validates a block that inflates to more than its size, or goes on after the end of the stream, fails",
+            [](void*)
+            {
+                std::vector<std::uint8_t> inflated(GetInflatedBlock().size() - 1);
+                VERIFY_ARE_EQUAL(static_cast<int>(MSIX::CompressionStatus::Error), InflateBlock(g_fullFlushBlock, inflated));
+                VERIFY_ARE_EQUAL(static_cast<int>(MSIX::CompressionStatus::Error), InflateBlock(g_finalBlock, inflated));
+
+                auto trailing = g_finalBlock;
+                trailing.push_back(0x00);
+                inflated.resize(GetInflatedBlock().size());
+                VERIFY_ARE_EQUAL(static_cast<int>(MSIX::CompressionStatus::Error), InflateBlock(trailing, inflated));
+            }
+        )},
+        { "InflateBlock.Truncated", Test<void>("Validates a block cut short, which inflates to less than its size, fails",
+            [](void*)
+            {
+                std::vector<std::uint8_t> inflated(GetInflatedBlock().size());
+                std::vector<std::uint8_t> truncated(g_fullFlushBlock.begin(), g_fullFlushBlock.begin() + 10);
+                VERIFY_ARE_EQUAL(static_cast<int>(MSIX::CompressionStatus::Error), InflateBlock(truncated, inflated));
+                truncated.assign(g_finalBlock.begin(), g_finalBlock.begin() + 10);
+                VERIFY_ARE_EQUAL(static_cast<int>(MSIX::CompressionStatus::Error), InflateBlock(truncated, inflated));
+            }
+        )},
+    };
+    ParseAndRun(inflateBlockTests, "Finish.TestInflateBlock");
+    return;
+}
+#endif
+
+#ifdef SHA256_TESTS
+std::string ToHex(const std::vector<std::uint8_t>& bytes)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+    for (auto byte : bytes)
+    {
+        result += digits[byte >> 4];
+        result += digits[byte & 0xf];
+    }
+    return result;
+}
+
+// Hashes buffer with MSIX::SHA256, in one call if pieceSizes is empty or else incrementally in pieces of those sizes
+std::vector<std::uint8_t> HashWithMsix(std::vector<std::uint8_t>& buffer, const std::vector<std::size_t>& pieceSizes = {})
+{
+    std::vector<std::uint8_t> hash;
+    if (pieceSizes.empty())
+    {
+        MSIX::SHA256::ComputeHash(buffer.data(), static_cast<std::uint32_t>(buffer.size()), hash);
+        return hash;
+    }
+    MSIX::SHA256 sha256;
+    std::size_t offset = 0;
+    for (std::size_t i = 0; offset < buffer.size(); i++)
+    {
+        auto size = std::min(pieceSizes[i % pieceSizes.size()], buffer.size() - offset);
+        sha256.Update(buffer.data() + offset, size);
+        offset += size;
+    }
+    sha256.Final(hash);
+    return hash;
+}
+
+void StartTestSHA256(void*)
+{
+    std::cout << "Starting test: TestSHA256" << std::endl;
+
+    std::map<std::string, Test<void>> sha256Tests =
+    {
+        { "SHA256.KnownAnswers", Test<void>("Validates SHA256 gives the FIPS 180-2 example hashes, in one call and incrementally",
+            [](void*)
+            {
+                std::vector<std::pair<std::string, std::string>> knownAnswers =
+                {
+                    { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+                    { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+                    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+                    { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+                        "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+                    { std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+                };
+                for (const auto& knownAnswer : knownAnswers)
+                {
+                    std::vector<std::uint8_t> message(knownAnswer.first.begin(), knownAnswer.first.end());
+                    VERIFY_ARE_EQUAL(knownAnswer.second, ToHex(HashWithMsix(message)));
+                    VERIFY_ARE_EQUAL(knownAnswer.second, ToHex(HashWithMsix(message, { 1, 63, 64, 65, 1000 })));
+                }
+            }
+        )},
+        { "SHA256.MatchesOpenSSL", Test<void>("Validates SHA256, which uses the SHA-256 instructions where the CPU has them, hashes like OpenSSL's portable code for every length up to a few blocks",
+            [](void*)
+            {
+                // Checked once at the end, there are too many lengths to log each of them.
+                bool same = true;
+                for (std::size_t length = 0; (length <= 1100) && same; length++)
+                {
+                    std::vector<std::uint8_t> message(length);
+                    for (std::size_t i = 0; i < length; i++)
+                    {
+                        message[i] = static_cast<std::uint8_t>((i * 31 + length) & 0xff);
+                    }
+                    std::vector<std::uint8_t> expected(SHA256_DIGEST_LENGTH);
+                    ::SHA256(message.data(), message.size(), expected.data());
+
+                    same = (HashWithMsix(message) == expected) &&
+                        (HashWithMsix(message, { 1, 7, 64, 100 }) == expected) &&
+                        (HashWithMsix(message, { 63, 65 }) == expected);
+                }
+                VERIFY_IS_TRUE(same);
+            }
+        )},
+        { "SHA256.EnginesMatchOpenSSL", Test<void>("Validates every way SHA256::ComputeHashes can hash that the CPU has, one buffer at a time or several side by side, hashes like OpenSSL for batches of mixed lengths",
+            [](void*)
+            {
+                using Engine = MSIX::SHA256::Engine;
+                // Lengths around the padding boundaries and a whole block, with buffers that don't start aligned.
+                const std::vector<std::size_t> lengths = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 1000, 65536 };
+                std::vector<std::uint8_t> data(65536 + 64);
+                for (std::size_t i = 0; i < data.size(); i++)
+                {
+                    data[i] = static_cast<std::uint8_t>((i * 131 + (i >> 8)) & 0xff);
+                }
+                for (auto engine : { Engine::Default, Engine::Library, Engine::Instructions, Engine::Avx2, Engine::Avx512 })
+                {
+                    if (!MSIX::SHA256::IsSupported(engine)) { continue; }
+                    bool same = true;
+                    for (std::size_t count = 1; (count <= 33) && same; count++)
+                    {
+                        std::vector<const std::uint8_t*> buffers(count);
+                        std::vector<std::size_t> sizes(count);
+                        for (std::size_t i = 0; i < count; i++)
+                        {
+                            buffers[i] = data.data() + (i * 7 + count) % 64;
+                            sizes[i] = lengths[(i * 5 + count) % lengths.size()];
+                        }
+                        std::vector<std::uint8_t> hashes(count * SHA256_DIGEST_LENGTH);
+                        MSIX::SHA256::ComputeHashes(engine, count, buffers.data(), sizes.data(), hashes.data());
+                        for (std::size_t i = 0; (i < count) && same; i++)
+                        {
+                            std::uint8_t expected[SHA256_DIGEST_LENGTH];
+                            ::SHA256(buffers[i], sizes[i], expected);
+                            same = (memcmp(hashes.data() + i * SHA256_DIGEST_LENGTH, expected, SHA256_DIGEST_LENGTH) == 0);
+                        }
+                    }
+                    VERIFY_IS_TRUE(same);
+                }
+            }
+        )},
+    };
+    ParseAndRun(sha256Tests, "Finish.TestSHA256");
+    return;
+}
+#endif
+
 void StartTestBundle(void*)
 {
     std::cout << "Starting test: TestBundle" << std::endl;
@@ -1241,6 +3277,22 @@ int RunApiTestInternal(char* input, char* target, char* packageRootPath)
         { "Start.TestPackage", Test<void>("Test IAppxPackageReader", StartTestPackage) },
         { "Start.TestPackageManifest", Test<void>("Test IAppxManifestReader", StartTestPackageManifest) },
         { "Start.TestPackageBlockMap", Test<void>("Test IAppxBlockMapReader", StartTestPackageBlockMap) },
+        { "Start.TestIndexCache", Test<void>("Test MSIX_FACTORY_EXTENSION_INDEX_CACHE", StartTestIndexCache) },
+        { "Start.TestBlockCache", Test<void>("Test MSIX_FACTORY_EXTENSION_BLOCK_CACHE", StartTestBlockCache) },
+        { "Start.TestVerifyPackage", Test<void>("Test VerifyPackage", StartTestVerifyPackage) },
+        { "Start.TestUnflushedBlocks", Test<void>("Test a package whose blocks don't inflate on their own", StartTestUnflushedBlocks) },
+        { "Start.TestLargePayload", Test<void>("Test reading large payload files", StartTestLargePayload) },
+        { "Start.TestManyEntries", Test<void>("Test packages with many payload files", StartTestManyEntries) },
+        #ifdef INFLATE_BLOCK_TESTS
+        { "Start.TestInflateBlock", Test<void>("Test InflateBlock", StartTestInflateBlock) },
+        #endif
+        #ifdef SHA256_TESTS
+        { "Start.TestSHA256", Test<void>("Test SHA256", StartTestSHA256) },
+        #endif
+        { "Start.TestPackageWriter", Test<void>("Test IAppxPackageWriter", StartTestPackageWriter) },
+        { "Start.TestForwardOnlyUnpack", Test<void>("Test UnpackPackageFromForwardOnlyStream", StartTestForwardOnlyUnpack) },
+        { "Start.TestDifferentialUnpack", Test<void>("Test UnpackPackageDifferential", StartTestDifferentialUnpack) },
+        { "Start.TestRangeReader", Test<void>("Test CreateStreamOnRangeReader", StartTestRangeReader) },
         { "Start.TestBundle", Test<void>("Test IAppxBundleReader", StartTestBundle) },
         { "Start.TestBundleManifest", Test<void>("Test IAppxBundleManifestReader", StartTestBundleManifest) },
     };
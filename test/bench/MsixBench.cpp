@@ -0,0 +1,542 @@
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// Times the SDK on generated packages, to compare a change against the code before it. Only the public API is used,
+// so the same source builds against older versions of the SDK. Define MSIXBENCH_NO_VERIFY_PACKAGE for versions that
+// don't have VerifyPackage yet.
+#include "AppxPackaging.hpp"
+#include "MSIXWindows.hpp"
+#ifdef INFLATE_BLOCK_BENCH
+#include "ICompressionObject.hpp"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+LPVOID STDMETHODCALLTYPE MyAllocate(SIZE_T cb)  { return std::malloc(cb); }
+void STDMETHODCALLTYPE MyFree(LPVOID pv)        { std::free(pv); }
+
+// Allocations with new, in the SDK as well where it shares the C++ runtime of msixbench
+std::atomic<std::uint64_t> g_allocations(0);
+
+void* operator new(std::size_t size)
+{
+    g_allocations++;
+    void* result = std::malloc(size ? size : 1);
+    if (result == nullptr) { throw std::bad_alloc(); }
+    return result;
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+// Stripped down ComPtr provided for those platforms that do not already have a ComPtr class.
+template <class T>
+class ComPtr
+{
+public:
+    // default ctor
+    ComPtr() = default;
+    ComPtr(T* ptr) : m_ptr(ptr) { InternalAddRef(); }
+
+    ~ComPtr() { InternalRelease(); }
+    inline T* operator->() const { return m_ptr; }
+    inline T* Get() const { return m_ptr; }
+
+    inline T** operator&()
+    {   InternalRelease();
+        return &m_ptr;
+    }
+
+protected:
+    T* m_ptr = nullptr;
+
+    inline void InternalAddRef() { if (m_ptr) { m_ptr->AddRef(); } }
+    inline void InternalRelease()
+    {
+        T* temp = m_ptr;
+        if (temp)
+        {   m_ptr = nullptr;
+            temp->Release();
+        }
+    }
+};
+
+// Failures end the benchmark, main reports them.
+void Check(HRESULT hr, const char* what)
+{
+    if (FAILED(hr))
+    {
+        std::ostringstream message;
+        message << what << " failed with 0x" << std::hex << static_cast<std::uint32_t>(hr);
+        throw std::runtime_error(message.str());
+    }
+}
+
+// Runs function a few times and returns the shortest time it took in milliseconds, which is the least affected by
+// the rest of the machine.
+double BestOf(int runs, const std::function<void()>& function)
+{
+    auto best = std::chrono::steady_clock::duration::max();
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::steady_clock::now() - start);
+    }
+    return std::chrono::duration<double, std::milli>(best).count();
+}
+
+ComPtr<IAppxFactory> CreateFactory()
+{
+    ComPtr<IAppxFactory> factory;
+    Check(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory), "CoCreateAppxFactoryWithHeap");
+    return factory;
+}
+
+ComPtr<IAppxPackageReader> OpenPackage(IAppxFactory* factory, const std::string& packageName)
+{
+    ComPtr<IStream> inputStream;
+    ComPtr<IAppxPackageReader> packageReader;
+    Check(CreateStreamOnFile(const_cast<char*>(packageName.c_str()), true, &inputStream), "CreateStreamOnFile");
+    Check(factory->CreatePackageReader(inputStream.Get(), &packageReader), "CreatePackageReader");
+    return packageReader;
+}
+
+// Stream of size bytes where every 8 bytes hold their offset divided by 8, which deflate compresses a few times.
+class PatternStream final : public IStream
+{
+public:
+    static void Make(std::uint64_t size, IStream** result)
+    {
+        *result = new PatternStream(size);
+    }
+
+    // IUnknown
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr) { return E_INVALIDARG; }
+        if (riid == UuidOfImpl<IUnknown>::iid || riid == UuidOfImpl<ISequentialStream>::iid || riid == UuidOfImpl<IStream>::iid)
+        {
+            *ppvObject = static_cast<IStream*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppvObject = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return ++m_ref; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override
+    {
+        auto ref = --m_ref;
+        if (ref == 0) { delete this; }
+        return ref;
+    }
+
+    // ISequentialStream
+    HRESULT STDMETHODCALLTYPE Read(void* pv, ULONG cb, ULONG* pcbRead) noexcept override
+    {
+        ULONG read = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(cb), m_size - m_position));
+        for (ULONG i = 0; i < read; i++)
+        {
+            std::uint64_t offset = m_position + i;
+            static_cast<std::uint8_t*>(pv)[i] = static_cast<std::uint8_t>((offset / 8) >> ((offset % 8) * 8));
+        }
+        m_position += read;
+        if (pcbRead) { *pcbRead = read; }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override { return E_NOTIMPL; }
+
+    // IStream, only reading is allowed
+    HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override
+    {
+        std::int64_t base = (origin == STREAM_SEEK_END) ? static_cast<std::int64_t>(m_size) :
+            ((origin == STREAM_SEEK_CUR) ? static_cast<std::int64_t>(m_position) : 0);
+        if (base + move.QuadPart < 0 || static_cast<std::uint64_t>(base + move.QuadPart) > m_size) { return E_INVALIDARG; }
+        m_position = static_cast<std::uint64_t>(base + move.QuadPart);
+        if (newPosition) { newPosition->QuadPart = m_position; }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CopyTo(IStream*, ULARGE_INTEGER, ULARGE_INTEGER*, ULARGE_INTEGER*) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Commit(DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Revert() noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Stat(STATSTG*, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Clone(IStream**) noexcept override { return E_NOTIMPL; }
+
+protected:
+    PatternStream(std::uint64_t size) : m_size(size) {}
+
+    std::uint64_t   m_size;
+    std::uint64_t   m_position = 0;
+    ULONG           m_ref = 1;
+};
+
+// Stream that keeps nothing of what is written to it
+class NullStream final : public IStream
+{
+public:
+    static void Make(IStream** result)
+    {
+        *result = new NullStream();
+    }
+
+    // IUnknown
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr) { return E_INVALIDARG; }
+        if (riid == UuidOfImpl<IUnknown>::iid || riid == UuidOfImpl<ISequentialStream>::iid || riid == UuidOfImpl<IStream>::iid)
+        {
+            *ppvObject = static_cast<IStream*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppvObject = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return ++m_ref; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override
+    {
+        auto ref = --m_ref;
+        if (ref == 0) { delete this; }
+        return ref;
+    }
+
+    // ISequentialStream
+    HRESULT STDMETHODCALLTYPE Read(void*, ULONG, ULONG* pcbRead) noexcept override
+    {
+        if (pcbRead) { *pcbRead = 0; }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE Write(const void*, ULONG cb, ULONG* pcbWritten) noexcept override
+    {
+        m_position += cb;
+        if (pcbWritten) { *pcbWritten = cb; }
+        return S_OK;
+    }
+
+    // IStream, only writing and finding out how much was written are allowed
+    HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override
+    {
+        if (origin == STREAM_SEEK_SET) { m_position = static_cast<std::uint64_t>(move.QuadPart); }
+        else { m_position += move.QuadPart; }
+        if (newPosition) { newPosition->QuadPart = m_position; }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CopyTo(IStream*, ULARGE_INTEGER, ULARGE_INTEGER*, ULARGE_INTEGER*) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Commit(DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Revert() noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Stat(STATSTG*, DWORD) noexcept override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE Clone(IStream**) noexcept override { return E_NOTIMPL; }
+
+protected:
+    NullStream() {}
+
+    std::uint64_t   m_position = 0;
+    ULONG           m_ref = 1;
+};
+
+// Writes a package with the manifest of the input package and the payload files addFiles adds
+void WritePackage(const std::string& packageName, const std::string& outputName, const std::function<void(IAppxPackageWriter*)>& addFiles)
+{
+    auto factory = CreateFactory();
+    auto packageReader = OpenPackage(factory.Get(), packageName);
+
+    ComPtr<IStream> outputStream;
+    ComPtr<IAppxPackageWriter> packageWriter;
+    APPX_PACKAGE_SETTINGS settings = { FALSE, nullptr };
+    Check(CreateStreamOnFile(const_cast<char*>(outputName.c_str()), false, &outputStream), "CreateStreamOnFile");
+    Check(factory->CreatePackageWriter(outputStream.Get(), &settings, &packageWriter), "CreatePackageWriter");
+    addFiles(packageWriter.Get());
+
+    ComPtr<IAppxFile> manifestFile;
+    ComPtr<IStream> manifestStream;
+    Check(packageReader->GetFootprintFile(APPX_FOOTPRINT_FILE_TYPE_MANIFEST, &manifestFile), "GetFootprintFile");
+    Check(manifestFile->GetStream(&manifestStream), "GetStream");
+    Check(packageWriter->Close(manifestStream.Get()), "Close");
+}
+
+// A command gets the arguments after its name
+struct Command
+{
+    const char* usage;
+    std::size_t argumentCount;
+    std::function<void(char** arguments)> run;
+};
+
+// count small stored payload files
+void PackEntries(char** arguments)
+{
+    auto count = std::strtoul(arguments[2], nullptr, 10);
+    WritePackage(arguments[0], arguments[1], [count](IAppxPackageWriter* packageWriter)
+    {
+        for (unsigned long i = 0; i < count; i++)
+        {
+            ComPtr<IStream> patternStream;
+            PatternStream::Make(64, &patternStream);
+            auto fileName = L"Generated\\file" + std::to_wstring(i) + L".bin";
+            Check(packageWriter->AddPayloadFile(fileName.c_str(), L"application/octet-stream", APPX_COMPRESSION_OPTION_NONE, patternStream.Get()), "AddPayloadFile");
+        }
+    });
+}
+
+// One payload file, large.bin, stored or compressed. It has generated data of the given size in MB, or what is in
+// the given file.
+void PackFile(char** arguments)
+{
+    char* end = nullptr;
+    auto size = static_cast<std::uint64_t>(std::strtoull(arguments[2], &end, 10)) * 1024 * 1024;
+    ComPtr<IStream> contentStream;
+    if (*end == '\0')
+    {
+        PatternStream::Make(size, &contentStream);
+    }
+    else
+    {
+        Check(CreateStreamOnFile(arguments[2], true, &contentStream), "CreateStreamOnFile");
+    }
+    auto compression = (std::string(arguments[3]) == "stored") ? APPX_COMPRESSION_OPTION_NONE : APPX_COMPRESSION_OPTION_NORMAL;
+    WritePackage(arguments[0], arguments[1], [&contentStream, compression](IAppxPackageWriter* packageWriter)
+    {
+        Check(packageWriter->AddPayloadFile(L"large.bin", L"application/octet-stream", compression, contentStream.Get()), "AddPayloadFile");
+    });
+}
+
+ComPtr<IStream> GetLargeFile(IAppxPackageReader* packageReader)
+{
+    ComPtr<IAppxFile> file;
+    ComPtr<IStream> stream;
+    Check(packageReader->GetPayloadFile(L"large.bin", &file), "GetPayloadFile");
+    Check(file->GetStream(&stream), "GetStream");
+    return stream;
+}
+
+// 4KB reads at random offsets of large.bin, the same offsets every time
+void RandomRead(char** arguments)
+{
+    auto factory = CreateFactory();
+    auto packageReader = OpenPackage(factory.Get(), arguments[0]);
+    auto stream = GetLargeFile(packageReader.Get());
+    auto reads = std::strtoul(arguments[1], nullptr, 10);
+    ULARGE_INTEGER size = { 0 };
+    LARGE_INTEGER start = { 0 };
+    Check(stream->Seek(start, STREAM_SEEK_END, &size), "Seek");
+
+    std::mt19937_64 random(42);
+    std::vector<std::uint8_t> buffer(4096);
+    auto elapsed = BestOf(1, [&]()
+    {
+        for (unsigned long i = 0; i < reads; i++)
+        {
+            LARGE_INTEGER position = { 0 };
+            position.QuadPart = static_cast<LONGLONG>(random() % (size.QuadPart - buffer.size()));
+            ULONG read = 0;
+            Check(stream->Seek(position, STREAM_SEEK_SET, nullptr), "Seek");
+            Check(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read), "Read");
+            if (read != buffer.size()) { throw std::runtime_error("short read"); }
+        }
+    });
+    std::cout << "random-read: " << reads << " reads in " << std::fixed << std::setprecision(1) << elapsed << " ms, "
+        << std::setprecision(3) << elapsed / reads << " ms per read" << std::endl;
+}
+
+// large.bin read from start to end, in reads of the given size in KB
+void Read(char** arguments)
+{
+    auto factory = CreateFactory();
+    auto packageReader = OpenPackage(factory.Get(), arguments[0]);
+    std::vector<std::uint8_t> buffer(std::strtoul(arguments[1], nullptr, 10) * 1024);
+    std::uint64_t total = 0;
+    std::uint64_t allocations = 0;
+    auto elapsed = BestOf(3, [&]()
+    {
+        auto stream = GetLargeFile(packageReader.Get());
+        auto allocationsBefore = g_allocations.load();
+        total = 0;
+        ULONG read = 0;
+        do
+        {
+            Check(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read), "Read");
+            total += read;
+        } while (read > 0);
+        allocations = g_allocations.load() - allocationsBefore;
+    });
+    double megabytes = static_cast<double>(total) / (1024 * 1024);
+    std::cout << "read: " << std::fixed << std::setprecision(1) << megabytes / (elapsed / 1000) << " MB/s, "
+        << static_cast<double>(allocations) / megabytes << " allocations per MB" << std::endl;
+}
+
+// large.bin copied with IStream::CopyTo, which is how files are unpacked
+void Copy(char** arguments)
+{
+    auto factory = CreateFactory();
+    auto packageReader = OpenPackage(factory.Get(), arguments[0]);
+    std::uint64_t total = 0;
+    auto elapsed = BestOf(3, [&]()
+    {
+        auto stream = GetLargeFile(packageReader.Get());
+        ComPtr<IStream> nullStream;
+        NullStream::Make(&nullStream);
+        ULARGE_INTEGER count = { 0 };
+        ULARGE_INTEGER written = { 0 };
+        count.QuadPart = std::numeric_limits<std::uint64_t>::max();
+        Check(stream->CopyTo(nullStream.Get(), count, nullptr, &written), "CopyTo");
+        total = written.QuadPart;
+    });
+    std::cout << "copy: " << std::fixed << std::setprecision(1) << (static_cast<double>(total) / (1024 * 1024)) / (elapsed / 1000)
+        << " MB/s" << std::endl;
+}
+
+#ifdef INFLATE_BLOCK_BENCH
+// InflateBlock over the full blocks of large.bin, already in memory, so nothing but inflating is timed. The blocks
+// are found with the compressed sizes in the blockmap, after the local file header that starts 30 bytes before the
+// file name. Only built with the SDK, which links the objects InflateBlock is in.
+void InflateBlocks(char** arguments)
+{
+    auto factory = CreateFactory();
+    auto packageReader = OpenPackage(factory.Get(), arguments[0]);
+    ComPtr<IAppxBlockMapReader> blockMapReader;
+    ComPtr<IAppxBlockMapFile> blockMapFile;
+    ComPtr<IAppxBlockMapBlocksEnumerator> blocks;
+    Check(packageReader->GetBlockMap(&blockMapReader), "GetBlockMap");
+    Check(blockMapReader->GetFile(L"large.bin", &blockMapFile), "GetFile");
+    Check(blockMapFile->GetBlocks(&blocks), "GetBlocks");
+    std::vector<std::size_t> compressedSizes;
+    BOOL hasCurrent = FALSE;
+    Check(blocks->GetHasCurrent(&hasCurrent), "GetHasCurrent");
+    while (hasCurrent)
+    {
+        ComPtr<IAppxBlockMapBlock> block;
+        UINT32 compressedSize = 0;
+        Check(blocks->GetCurrent(&block), "GetCurrent");
+        Check(block->GetCompressedSize(&compressedSize), "GetCompressedSize");
+        compressedSizes.push_back(compressedSize);
+        Check(blocks->MoveNext(&hasCurrent), "MoveNext");
+    }
+    // The last block also ends the deflate stream, which its compressed size doesn't cover.
+    if (!compressedSizes.empty()) { compressedSizes.pop_back(); }
+
+    std::ifstream input(arguments[0], std::ios::binary);
+    std::vector<std::uint8_t> package((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    const std::string fileName = "large.bin";
+    const std::uint8_t localFileHeaderSignature[] = { 'P', 'K', 3, 4 };
+    auto header = package.begin();
+    do
+    {
+        header = std::search(header + 1, package.end(), fileName.begin(), fileName.end());
+        if (header == package.end()) { throw std::runtime_error("large.bin not found"); }
+    } while ((header - package.begin() < 30) || !std::equal(header - 30, header - 26, localFileHeaderSignature));
+    std::size_t extraFieldSize = *(header - 2) | (*(header - 1) << 8);
+    const std::uint8_t* data = &*header + fileName.size() + extraFieldSize;
+
+    const std::size_t blockSize = 65536;
+    std::vector<std::uint8_t> inflated(blockSize);
+    auto elapsed = BestOf(3, [&]()
+    {
+        const std::uint8_t* source = data;
+        for (auto compressedSize : compressedSizes)
+        {
+            if (MSIX::InflateBlock(source, compressedSize, inflated.data(), inflated.size()) != MSIX::CompressionStatus::Ok)
+            {
+                throw std::runtime_error("block doesn't inflate on its own");
+            }
+            source += compressedSize;
+        }
+    });
+    double megabytes = static_cast<double>(compressedSizes.size() * blockSize) / (1024 * 1024);
+    std::cout << "inflate-block: " << std::fixed << std::setprecision(1) << megabytes / (elapsed / 1000) << " MB/s" << std::endl;
+}
+#endif
+
+#ifndef MSIXBENCH_NO_VERIFY_PACKAGE
+// VerifyPackage, which checks every block of every payload file against the blockmap without extracting them
+void Verify(char** arguments)
+{
+    std::ifstream input(arguments[0], std::ios::binary | std::ios::ate);
+    auto packageSize = static_cast<std::uint64_t>(input.tellg());
+    auto elapsed = BestOf(3, [&]()
+    {
+        Check(VerifyPackage(MSIX_VALIDATION_OPTION_SKIPSIGNATURE, arguments[0], nullptr, nullptr), "VerifyPackage");
+    });
+    std::cout << "verify: " << std::fixed << std::setprecision(1) << elapsed << " ms, "
+        << (static_cast<double>(packageSize) / (1024 * 1024)) / (elapsed / 1000) << " MB/s of package" << std::endl;
+}
+#endif
+
+// Opening the package and getting its manifest, which is all some callers want from a package
+void Manifest(char** arguments)
+{
+    auto factory = CreateFactory();
+    std::string packageName = arguments[0];
+    auto elapsed = BestOf(5, [&]()
+    {
+        auto packageReader = OpenPackage(factory.Get(), packageName);
+        ComPtr<IAppxManifestReader> manifestReader;
+        Check(packageReader->GetManifest(&manifestReader), "GetManifest");
+    });
+    std::cout << "manifest: " << std::fixed << std::setprecision(1) << elapsed << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::map<std::string, Command> commands =
+    {
+        { "pack-entries", { "pack-entries <package> <output> <count>: writes the manifest of package and count small files to output", 3, PackEntries } },
+        { "pack-file", { "pack-file <package> <output> <MB|file> <stored|compressed>: writes the manifest of package and a file of MB, or file, to output", 4, PackFile } },
+        { "random-read", { "random-read <package> <reads>: time of random 4KB reads from the file written by pack-file", 2, RandomRead } },
+        { "read", { "read <package> <KB>: throughput and allocations reading the file written by pack-file in reads of KB", 2, Read } },
+        { "copy", { "copy <package>: throughput of copying the file written by pack-file to a stream that drops it", 1, Copy } },
+#ifdef INFLATE_BLOCK_BENCH
+        { "inflate-block", { "inflate-block <package>: throughput of InflateBlock over the blocks of the file written by pack-file", 1, InflateBlocks } },
+#endif
+#ifndef MSIXBENCH_NO_VERIFY_PACKAGE
+        { "verify", { "verify <package>: time of VerifyPackage", 1, Verify } },
+#endif
+        { "manifest", { "manifest <package>: time to open package and get its manifest", 1, Manifest } },
+    };
+
+    auto command = (argc > 1) ? commands.find(argv[1]) : commands.end();
+    if ((command == commands.end()) || (static_cast<std::size_t>(argc - 2) < command->second.argumentCount))
+    {
+        std::cout << "Usage:" << std::endl;
+        for (const auto& usage : commands)
+        {
+            std::cout << "\tmsixbench " << usage.second.usage << std::endl;
+        }
+        return 1;
+    }
+    try
+    {
+        command->second.run(argv + 2);
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}